@@ -30,8 +30,21 @@
 #define MICROPY_PERSISTENT_CODE_LOAD (0)
 #define MICROPY_PERSISTENT_CODE_SAVE (1)
 
+// the native emitter can only make code for the arch of the host
+#if defined(__x86_64__)
+#define MICROPY_EMIT_X64            (1)
+#else
 #define MICROPY_EMIT_X64            (0)
+#endif
+#if defined(__i386__)
+#define MICROPY_EMIT_X86            (1)
+#else
 #define MICROPY_EMIT_X86            (0)
+#endif
+#define MICROPY_EMIT_NATIVE_FLOAT   (MICROPY_EMIT_X64)
+// native code for the host arch is run by the unix port, so the frames of
+// native functions must have the same layout as there
+#define MICROPY_TRACK_CODE_STATE    (MICROPY_EMIT_X64 || MICROPY_EMIT_X86)
 #define MICROPY_EMIT_THUMB          (0)
 #define MICROPY_EMIT_INLINE_THUMB   (0)
 #define MICROPY_EMIT_INLINE_THUMB_ARMV7M (0)
@@ -47,6 +60,7 @@
 #define MICROPY_COMP_RETURN_IF_EXPR (1)
 
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (0)
+#define MICROPY_OPT_SUPERINSTRUCTIONS (1)
 
 #define MICROPY_READER_POSIX        (1)
 #define MICROPY_ENABLE_RUNTIME      (0)
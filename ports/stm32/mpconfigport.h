@@ -41,6 +41,9 @@
 #ifndef MICROPY_EMIT_INLINE_THUMB
 #define MICROPY_EMIT_INLINE_THUMB   (1)
 #endif
+#ifndef MICROPY_EMIT_NATIVE_FLOAT
+#define MICROPY_EMIT_NATIVE_FLOAT   (1)
+#endif
 
 // compiler configuration
 #define MICROPY_COMP_MODULE_CONST   (1)
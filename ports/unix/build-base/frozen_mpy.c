@@ -0,0 +1,2472 @@
+#include "py/mpconfig.h"
+#include "py/objint.h"
+#include "py/objstr.h"
+#include "py/emitglue.h"
+
+#if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE != 1
+#error "incompatible MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE"
+#endif
+
+#if MICROPY_LONGINT_IMPL != 2
+#error "incompatible MICROPY_LONGINT_IMPL"
+#endif
+
+#if MPZ_DIG_SIZE != 16
+#error "incompatible MPZ_DIG_SIZE"
+#endif
+
+#if MICROPY_PY_BUILTINS_FLOAT
+typedef struct _mp_obj_float_t {
+    mp_obj_base_t base;
+    mp_float_t value;
+} mp_obj_float_t;
+#endif
+
+#if MICROPY_PY_BUILTINS_COMPLEX
+typedef struct _mp_obj_complex_t {
+    mp_obj_base_t base;
+    mp_float_t real;
+    mp_float_t imag;
+} mp_obj_complex_t;
+#endif
+
+enum {
+    MP_QSTR_upip_dot_py = MP_QSTRnumber_of,
+    MP_QSTR_os,
+    MP_QSTR_json,
+    MP_QSTR_upip_utarfile,
+    MP_QSTR_tarfile,
+    MP_QSTR_debug,
+    MP_QSTR_install_path,
+    MP_QSTR_cleanup_files,
+    MP_QSTR_gzdict_sz,
+    MP_QSTR_file_buf,
+    MP_QSTR_NotFoundError,
+    MP_QSTR_op_split,
+    MP_QSTR_op_basename,
+    MP_QSTR__makedirs,
+    MP_QSTR_save_file,
+    MP_QSTR_install_tar,
+    MP_QSTR_expandhome,
+    MP_QSTR_ussl,
+    MP_QSTR_warn_ussl,
+    MP_QSTR_url_open,
+    MP_QSTR_get_pkg_metadata,
+    MP_QSTR_fatal,
+    MP_QSTR_install_pkg,
+    MP_QSTR_install,
+    MP_QSTR_get_install_path,
+    MP_QSTR_cleanup,
+    MP_QSTR_help,
+    MP_QSTR_main,
+    MP_QSTR_wb,
+    MP_QSTR_fname,
+    MP_QSTR_subf,
+    MP_QSTR_setup_dot_,
+    MP_QSTR_PKG_hyphen_INFO,
+    MP_QSTR_README,
+    MP_QSTR__dot_egg_hyphen_info,
+    MP_QSTR_extractfile,
+    MP_QSTR_deps,
+    MP_QSTR_Skipping,
+    MP_QSTR_DIRTYPE,
+    MP_QSTR_f,
+    MP_QSTR_prefix,
+    MP_QSTR__tilde__slash_,
+    MP_QSTR_HOME,
+    MP_QSTR_s,
+    MP_QSTR_https_colon_,
+    MP_QSTR_wrap_socket,
+    MP_QSTR_server_hostname,
+    MP_QSTR_url,
+    MP_QSTR_Error_colon_,
+    MP_QSTR_msg,
+    MP_QSTR_exc,
+    MP_QSTR_info,
+    MP_QSTR_releases,
+    MP_QSTR_TarFile,
+    MP_QSTR_fileobj,
+    MP_QSTR_pkg_spec,
+    MP_QSTR_Queue_colon_,
+    MP_QSTR_to_install,
+    MP_QSTR__hyphen_h,
+    MP_QSTR__hyphen__hyphen_help,
+    MP_QSTR__hyphen_p,
+    MP_QSTR__hyphen_r,
+    MP_QSTR__hash_,
+    MP_QSTR__hyphen__hyphen_debug,
+    MP_QSTR__hyphen_,
+    MP_QSTR_upip_utarfile_dot_py,
+    MP_QSTR_size,
+    MP_QSTR_TAR_HEADER,
+    MP_QSTR_REGTYPE,
+    MP_QSTR_roundup,
+    MP_QSTR_FileSection,
+    MP_QSTR_TarInfo,
+    MP_QSTR_val,
+    MP_QSTR_align,
+    MP_QSTR_skip,
+    MP_QSTR_content_len,
+    MP_QSTR_self,
+    MP_QSTR_aligned_len,
+    MP_QSTR_sz,
+    MP_QSTR_buf,
+    MP_QSTR_rb,
+    MP_QSTR__0x00_,
+    MP_QSTR_tarinfo,
+};
+
+extern const qstr_pool_t mp_qstr_const_pool;
+const qstr_pool_t mp_qstr_frozen_const_pool = {
+    (qstr_pool_t*)&mp_qstr_const_pool, // previous pool
+    MP_QSTRnumber_of, // previous pool size
+    83, // allocated entries
+    83, // used entries
+    {
+        (const byte*)"\x9e\xa2\x07" "upip.py",
+        (const byte*)"\x79\x6f\x02" "os",
+        (const byte*)"\xfd\xd1\x04" "json",
+        (const byte*)"\x32\x80\x0d" "upip_utarfile",
+        (const byte*)"\x24\xc0\x07" "tarfile",
+        (const byte*)"\xd4\x55\x05" "debug",
+        (const byte*)"\x56\x0a\x0c" "install_path",
+        (const byte*)"\x8f\x1f\x0d" "cleanup_files",
+        (const byte*)"\x34\x14\x09" "gzdict_sz",
+        (const byte*)"\xed\x15\x08" "file_buf",
+        (const byte*)"\x9e\x1a\x0d" "NotFoundError",
+        (const byte*)"\xd7\xb9\x08" "op_split",
+        (const byte*)"\xb7\x56\x0b" "op_basename",
+        (const byte*)"\xb4\xa9\x09" "_makedirs",
+        (const byte*)"\xbd\xa0\x09" "save_file",
+        (const byte*)"\x7c\xcb\x0b" "install_tar",
+        (const byte*)"\x4c\x47\x0a" "expandhome",
+        (const byte*)"\x1c\xf2\x04" "ussl",
+        (const byte*)"\x49\xae\x09" "warn_ussl",
+        (const byte*)"\xc5\xfa\x08" "url_open",
+        (const byte*)"\xa2\x78\x10" "get_pkg_metadata",
+        (const byte*)"\xdb\xd0\x05" "fatal",
+        (const byte*)"\xa7\xb8\x0b" "install_pkg",
+        (const byte*)"\x04\xdb\x07" "install",
+        (const byte*)"\xdf\xf8\x10" "get_install_path",
+        (const byte*)"\xc5\x2e\x07" "cleanup",
+        (const byte*)"\x94\x5c\x04" "help",
+        (const byte*)"\xce\xb7\x04" "main",
+        (const byte*)"\x70\x70\x02" "wb",
+        (const byte*)"\xe4\x55\x05" "fname",
+        (const byte*)"\x27\x31\x04" "subf",
+        (const byte*)"\x2c\x5b\x06" "setup.",
+        (const byte*)"\xfa\xaa\x08" "PKG-INFO",
+        (const byte*)"\x5f\xeb\x06" "README",
+        (const byte*)"\x2d\x61\x09" ".egg-info",
+        (const byte*)"\xae\x9d\x0b" "extractfile",
+        (const byte*)"\x87\xec\x04" "deps",
+        (const byte*)"\x34\xd0\x08" "Skipping",
+        (const byte*)"\x42\x17\x07" "DIRTYPE",
+        (const byte*)"\xc3\xb5\x01" "f",
+        (const byte*)"\x95\x3e\x06" "prefix",
+        (const byte*)"\x14\x71\x02" "~/",
+        (const byte*)"\x6a\x76\x04" "HOME",
+        (const byte*)"\xd6\xb5\x01" "s",
+        (const byte*)"\x34\xf9\x06" "https:",
+        (const byte*)"\xcb\xf3\x0b" "wrap_socket",
+        (const byte*)"\x58\xef\x0f" "server_hostname",
+        (const byte*)"\x8e\x63\x03" "url",
+        (const byte*)"\x47\x4d\x06" "Error:",
+        (const byte*)"\x7c\x46\x03" "msg",
+        (const byte*)"\xdb\x24\x03" "exc",
+        (const byte*)"\xeb\xb3\x04" "info",
+        (const byte*)"\x1f\x8d\x08" "releases",
+        (const byte*)"\x64\xfd\x07" "TarFile",
+        (const byte*)"\x04\x4c\x07" "fileobj",
+        (const byte*)"\x43\x9a\x08" "pkg_spec",
+        (const byte*)"\x0e\x69\x06" "Queue:",
+        (const byte*)"\x80\xf8\x0a" "to_install",
+        (const byte*)"\xe0\x66\x02" "-h",
+        (const byte*)"\x34\x6e\x06" "--help",
+        (const byte*)"\xf8\x66\x02" "-p",
+        (const byte*)"\xfa\x66\x02" "-r",
+        (const byte*)"\x86\xb5\x01" "#",
+        (const byte*)"\x34\x9b\x07" "--debug",
+        (const byte*)"\x88\xb5\x01" "-",
+        (const byte*)"\x55\x87\x10" "upip_utarfile.py",
+        (const byte*)"\x20\xa5\x04" "size",
+        (const byte*)"\x82\x45\x0a" "TAR_HEADER",
+        (const byte*)"\xcd\xd1\x07" "REGTYPE",
+        (const byte*)"\x82\x38\x07" "roundup",
+        (const byte*)"\x0a\x55\x0b" "FileSection",
+        (const byte*)"\x4c\x5c\x07" "TarInfo",
+        (const byte*)"\xfe\x7a\x03" "val",
+        (const byte*)"\xa8\xfb\x05" "align",
+        (const byte*)"\x04\xaf\x04" "skip",
+        (const byte*)"\x54\x75\x0b" "content_len",
+        (const byte*)"\x79\x77\x04" "self",
+        (const byte*)"\xb1\x45\x0b" "aligned_len",
+        (const byte*)"\xec\x70\x02" "sz",
+        (const byte*)"\x74\x49\x03" "buf",
+        (const byte*)"\xd5\x70\x02" "rb",
+        (const byte*)"\xa5\xb5\x01" "\x00",
+        (const byte*)"\x0c\x60\x07" "tarinfo",
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__NotFoundError
+STATIC byte bytecode_data_upip__lt_module_gt__NotFoundError[31] = {
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x09,
+    MP_QSTR_NotFoundError & 0xff, MP_QSTR_NotFoundError >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x8e, 0x12, 0x00, 0x00, 0xff,
+    0x1b, MP_QSTR___name__ & 0xff, MP_QSTR___name__ >> 8,
+    0x24, MP_QSTR___module__ & 0xff, MP_QSTR___module__ >> 8,
+    0x16, MP_QSTR_NotFoundError & 0xff, MP_QSTR_NotFoundError >> 8,
+    0x24, MP_QSTR___qualname__ & 0xff, MP_QSTR___qualname__ >> 8,
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__NotFoundError = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 0,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__NotFoundError,
+        .const_table = NULL,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 31,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__op_split
+STATIC byte bytecode_data_upip__lt_module_gt__op_split[92] = {
+    0x07, 0x00, 0x00, 0x01, 0x00, 0x00, 0x11,
+    MP_QSTR_op_split & 0xff, MP_QSTR_op_split >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0x15, 0x28, 0x29, 0x2c, 0x2d, 0x27, 0x24, 0x24, 0x24, 0x00, 0x00, 0xff,
+    0xb0, 
+    0x16, MP_QSTR_ & 0xff, MP_QSTR_ >> 8,
+    0x4b, 0x02, 0x09, 0x80, 
+    0x16, MP_QSTR_ & 0xff, MP_QSTR_ >> 8,
+    0x16, MP_QSTR_ & 0xff, MP_QSTR_ >> 8,
+    0x50, 0x02, 
+    0x5b, 
+    0xb0, 
+    0x1e, MP_QSTR_rsplit & 0xff, MP_QSTR_rsplit >> 8,
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0x81, 
+    0x66, 0x02, 
+    0xc1, 
+    0x1c, MP_QSTR_len & 0xff, MP_QSTR_len >> 8,
+    0xb1, 
+    0x64, 0x01, 
+    0x49, 0x02, 0x01, 
+    0x37, 0x07, 0x80, 
+    0x16, MP_QSTR_ & 0xff, MP_QSTR_ >> 8,
+    0xb0, 
+    0x50, 0x02, 
+    0x5b, 
+    0xb1, 
+    0x80, 
+    0x21, 
+    0xc2, 
+    0xb2, 
+    0x36, 0x04, 0x80, 
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0xc2, 
+    0x48, 0x21, 
+    0x81, 
+    0x21, 
+    0x50, 0x02, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__op_split[1] = {
+    MP_ROM_QSTR(MP_QSTR_path),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__op_split = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 1,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__op_split,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__op_split,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 92,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__op_basename
+STATIC byte bytecode_data_upip__lt_module_gt__op_basename[26] = {
+    0x03, 0x00, 0x00, 0x01, 0x00, 0x00, 0x09,
+    MP_QSTR_op_basename & 0xff, MP_QSTR_op_basename >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0x20, 0x00, 0x00, 0xff,
+    0x1c, MP_QSTR_op_split & 0xff, MP_QSTR_op_split >> 8,
+    0xb0, 
+    0x64, 0x01, 
+    0x81, 
+    0x21, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__op_basename[1] = {
+    MP_ROM_QSTR(MP_QSTR_path),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__op_basename = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 1,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__op_basename,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__op_basename,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 26,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt___makedirs
+STATIC byte bytecode_data_upip__lt_module_gt___makedirs[200] = {
+    0x11, 0x02, 0x00, 0x02, 0x00, 0x01, 0x19,
+    MP_QSTR__makedirs & 0xff, MP_QSTR__makedirs >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0x24, 0x22, 0x24, 0x39, 0x2a, 0x24, 0x26, 0x2e, 0x26, 0x24, 0x23, 0x2c, 0x53, 0x1f, 0x27, 0x22, 0x31, 0x00, 0x00, 0xff,
+    0x10, 
+    0xc2, 
+    0x16, MP_QSTR_ & 0xff, MP_QSTR_ >> 8,
+    0xc3, 
+    0xb0, 
+    0x1e, MP_QSTR_rstrip & 0xff, MP_QSTR_rstrip >> 8,
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0x66, 0x01, 
+    0x1e, MP_QSTR_split & 0xff, MP_QSTR_split >> 8,
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0x66, 0x01, 
+    0x11, 
+    0x7f, 
+    0x58, 0x02, 
+    0x21, 
+    0xc4, 
+    0xb4, 
+    0x80, 
+    0x21, 
+    0x16, MP_QSTR_ & 0xff, MP_QSTR_ >> 8,
+    0x4b, 0x02, 0x04, 0x80, 
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0xc3, 
+    0xb4, 
+    0x47, 
+    0x43, 0x74, 0x00, 
+    0xc5, 
+    0xb3, 
+    0x37, 0x10, 0x80, 
+    0xb3, 
+    0x7f, 
+    0x21, 
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0x4b, 0x05, 0x06, 0x80, 
+    0xb3, 
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0xe5, 
+    0xc3, 
+    0x48, 0x35, 
+    0xe5, 
+    0xc3, 
+    0x3f, 0x12, 0x00, 
+    0x1c, MP_QSTR_os & 0xff, MP_QSTR_os >> 8,
+    0x1e, MP_QSTR_mkdir & 0xff, MP_QSTR_mkdir >> 8,
+    0xb3, 
+    0x66, 0x01, 
+    0x32, 
+    0x12, 
+    0xc2, 
+    0x44, 
+    0x35, 0x43, 0x80, 
+    0x30, 
+    0x1c, MP_QSTR_OSError & 0xff, MP_QSTR_OSError >> 8,
+    0x4b, 0x08, 0x39, 0x80, 
+    0xc6, 
+    0x40, 0x2d, 0x00, 
+    0xb6, 
+    0x1d, MP_QSTR_args & 0xff, MP_QSTR_args >> 8,
+    0x80, 
+    0x21, 
+    0x1c, MP_QSTR_errno & 0xff, MP_QSTR_errno >> 8,
+    0x1d, MP_QSTR_EEXIST & 0xff, MP_QSTR_EEXIST >> 8,
+    0x4b, 0x05, 0x15, 0x80, 
+    0xb6, 
+    0x1d, MP_QSTR_args & 0xff, MP_QSTR_args >> 8,
+    0x80, 
+    0x21, 
+    0x1c, MP_QSTR_errno & 0xff, MP_QSTR_errno >> 8,
+    0x1d, MP_QSTR_EISDIR & 0xff, MP_QSTR_EISDIR >> 8,
+    0x4b, 0x05, 0x02, 0x80, 
+    0x5c, 0x00, 
+    0x10, 
+    0xc2, 
+    0x44, 
+    0x45, 
+    0x11, 
+    0x11, 
+    0xc6, 
+    0x28, 0x06, 
+    0x41, 
+    0x35, 0x01, 0x80, 
+    0x41, 
+    0x35, 0x89, 0x7f, 
+    0xb2, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt___makedirs[2] = {
+    MP_ROM_QSTR(MP_QSTR_name),
+    MP_ROM_QSTR(MP_QSTR_mode),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt___makedirs = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 2,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt___makedirs,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt___makedirs,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 200,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__save_file
+STATIC byte bytecode_data_upip__lt_module_gt__save_file[77] = {
+    0x0a, 0x01, 0x00, 0x02, 0x00, 0x00, 0x0f,
+    MP_QSTR_save_file & 0xff, MP_QSTR_save_file >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0x38, 0x20, 0x2e, 0x20, 0x2c, 0x24, 0x23, 0x00, 0x00, 0xff,
+    0x1c, MP_QSTR_open & 0xff, MP_QSTR_open >> 8,
+    0xb0, 
+    0x16, MP_QSTR_wb & 0xff, MP_QSTR_wb >> 8,
+    0x64, 0x02, 
+    0x3d, 0x26, 0x00, 
+    0xc2, 
+    0xb1, 
+    0x1e, MP_QSTR_readinto & 0xff, MP_QSTR_readinto >> 8,
+    0x1c, MP_QSTR_file_buf & 0xff, MP_QSTR_file_buf >> 8,
+    0x66, 0x01, 
+    0xc3, 
+    0xb3, 
+    0x36, 0x03, 0x80, 
+    0x35, 0x10, 0x80, 
+    0xb2, 
+    0x1e, MP_QSTR_write & 0xff, MP_QSTR_write >> 8,
+    0x1c, MP_QSTR_file_buf & 0xff, MP_QSTR_file_buf >> 8,
+    0xb3, 
+    0x66, 0x02, 
+    0x32, 
+    0x35, 0xdd, 0x7f, 
+    0x44, 
+    0x11, 
+    0x3e, 
+    0x41, 
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__save_file[2] = {
+    MP_ROM_QSTR(MP_QSTR_fname),
+    MP_ROM_QSTR(MP_QSTR_subf),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__save_file = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 2,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__save_file,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__save_file,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 77,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__install_tar
+STATIC byte bytecode_data_upip__lt_module_gt__install_tar[272] = {
+    0x14, 0x01, 0x00, 0x02, 0x00, 0x00, 0x21,
+    MP_QSTR_install_tar & 0xff, MP_QSTR_install_tar >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0x41, 0x23, 0x46, 0x26, 0x23, 0x1f, 0x42, 0x49, 0x22, 0x50, 0x33, 0x2c, 0x33, 0x22, 0x27, 0x2b, 0x4a, 0x24, 0x24, 0x31, 0x27, 0x2b, 0x28, 0x29, 0x2c, 0x00, 0x00, 0xff,
+    0x53, 0x00, 
+    0xc2, 
+    0xb0, 
+    0x47, 
+    0x43, 0xde, 0x00, 
+    0xc3, 
+    0xb3, 
+    0x1d, MP_QSTR_name & 0xff, MP_QSTR_name >> 8,
+    0xc4, 
+    0x3f, 0x17, 0x00, 
+    0x48, 0x44, 
+    0x1e, MP_QSTR_index & 0xff, MP_QSTR_index >> 8,
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0x66, 0x01, 
+    0x49, 0x1a, 0x01, 
+    0x11, 
+    0x58, 0x02, 
+    0x21, 
+    0xc4, 
+    0x44, 
+    0x35, 0x13, 0x80, 
+    0x30, 
+    0x1c, MP_QSTR_ValueError & 0xff, MP_QSTR_ValueError >> 8,
+    0x4b, 0x08, 0x09, 0x80, 
+    0x32, 
+    0x16, MP_QSTR_ & 0xff, MP_QSTR_ >> 8,
+    0xc4, 
+    0x45, 
+    0x35, 0x01, 0x80, 
+    0x41, 
+    0x12, 
+    0xc5, 
+    0x16, MP_QSTR_setup_dot_ & 0xff, MP_QSTR_setup_dot_ >> 8,
+    0x16, MP_QSTR_PKG_hyphen_INFO & 0xff, MP_QSTR_PKG_hyphen_INFO >> 8,
+    0x16, MP_QSTR_README & 0xff, MP_QSTR_README >> 8,
+    0x50, 0x03, 
+    0x47, 
+    0x43, 0x51, 0x00, 
+    0xc6, 
+    0xb4, 
+    0x1e, MP_QSTR_startswith & 0xff, MP_QSTR_startswith >> 8,
+    0xb6, 
+    0x66, 0x01, 
+    0x36, 0x08, 0x80, 
+    0x16, MP_QSTR__dot_egg_hyphen_info & 0xff, MP_QSTR__dot_egg_hyphen_info >> 8,
+    0xb4, 
+    0x4b, 0x06, 0x3a, 0x80, 
+    0xb4, 
+    0x1e, MP_QSTR_endswith & 0xff, MP_QSTR_endswith >> 8,
+    0x17, 0x02, 
+    0x66, 0x01, 
+    0x37, 0x13, 0x80, 
+    0xb0, 
+    0x1e, MP_QSTR_extractfile & 0xff, MP_QSTR_extractfile >> 8,
+    0xb3, 
+    0x66, 0x01, 
+    0x1e, MP_QSTR_read & 0xff, MP_QSTR_read >> 8,
+    0x66, 0x00, 
+    0xb2, 
+    0x16, MP_QSTR_deps & 0xff, MP_QSTR_deps >> 8,
+    0x27, 
+    0x10, 
+    0xc5, 
+    0x1c, MP_QSTR_debug & 0xff, MP_QSTR_debug >> 8,
+    0x37, 0x0b, 0x80, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x16, MP_QSTR_Skipping & 0xff, MP_QSTR_Skipping >> 8,
+    0xb4, 
+    0x64, 0x02, 
+    0x32, 
+    0x32, 
+    0x32, 
+    0x32, 
+    0x32, 
+    0x35, 0x03, 0x80, 
+    0x35, 0xac, 0x7f, 
+    0xb5, 
+    0x37, 0x41, 0x80, 
+    0x48, 0x14, 
+    0xf1, 
+    0xc7, 
+    0xb3, 
+    0x1d, MP_QSTR_type & 0xff, MP_QSTR_type >> 8,
+    0x1c, MP_QSTR_tarfile & 0xff, MP_QSTR_tarfile >> 8,
+    0x1d, MP_QSTR_DIRTYPE & 0xff, MP_QSTR_DIRTYPE >> 8,
+    0x4b, 0x05, 0x2c, 0x80, 
+    0x1c, MP_QSTR_debug & 0xff, MP_QSTR_debug >> 8,
+    0x37, 0x0b, 0x80, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x17, 0x03, 
+    0xb7, 
+    0xf1, 
+    0x64, 0x01, 
+    0x32, 
+    0x1c, MP_QSTR__makedirs & 0xff, MP_QSTR__makedirs >> 8,
+    0xb7, 
+    0x64, 0x01, 
+    0x32, 
+    0xb0, 
+    0x1e, MP_QSTR_extractfile & 0xff, MP_QSTR_extractfile >> 8,
+    0xb3, 
+    0x66, 0x01, 
+    0xc8, 
+    0x1c, MP_QSTR_save_file & 0xff, MP_QSTR_save_file >> 8,
+    0x48, 0x78, 
+    0x64, 0x02, 
+    0x32, 
+    0x35, 0x1f, 0x7f, 
+    0xb2, 
+    0x5b, 
+};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__install_tar_0 = {{&mp_type_str}, 36962, 13, (const byte*)"\x2f\x72\x65\x71\x75\x69\x72\x65\x73\x2e\x74\x78\x74"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__install_tar_1 = {{&mp_type_str}, 56712, 11, (const byte*)"\x45\x78\x74\x72\x61\x63\x74\x69\x6e\x67\x20"};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__install_tar[4] = {
+    MP_ROM_QSTR(MP_QSTR_f),
+    MP_ROM_QSTR(MP_QSTR_prefix),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__install_tar_0),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__install_tar_1),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__install_tar = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 2,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__install_tar,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__install_tar,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 272,
+        .n_obj = 2,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__expandhome
+STATIC byte bytecode_data_upip__lt_module_gt__expandhome[59] = {
+    0x07, 0x00, 0x00, 0x01, 0x00, 0x00, 0x0c,
+    MP_QSTR_expandhome & 0xff, MP_QSTR_expandhome >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0x60, 0x28, 0x2e, 0x30, 0x00, 0x00, 0xff,
+    0x16, MP_QSTR__tilde__slash_ & 0xff, MP_QSTR__tilde__slash_ >> 8,
+    0xb0, 
+    0x4b, 0x06, 0x1e, 0x80, 
+    0x1c, MP_QSTR_os & 0xff, MP_QSTR_os >> 8,
+    0x1e, MP_QSTR_getenv & 0xff, MP_QSTR_getenv >> 8,
+    0x16, MP_QSTR_HOME & 0xff, MP_QSTR_HOME >> 8,
+    0x66, 0x01, 
+    0xc1, 
+    0xb0, 
+    0x1e, MP_QSTR_replace & 0xff, MP_QSTR_replace >> 8,
+    0x16, MP_QSTR__tilde__slash_ & 0xff, MP_QSTR__tilde__slash_ >> 8,
+    0xb1, 
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0xf1, 
+    0x66, 0x02, 
+    0xc0, 
+    0xb0, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__expandhome[1] = {
+    MP_ROM_QSTR(MP_QSTR_s),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__expandhome = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 1,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__expandhome,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__expandhome,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 59,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__url_open
+STATIC byte bytecode_data_upip__lt_module_gt__url_open[374] = {
+    0x13, 0x02, 0x00, 0x01, 0x00, 0x00, 0x29,
+    MP_QSTR_url_open & 0xff, MP_QSTR_url_open >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0x69, 0x40, 0x27, 0x48, 0x31, 0x23, 0x1f, 0x41, 0x58, 0x46, 0x30, 0x43, 0x49, 0x28, 0x31, 0x27, 0x2b, 0x64, 0x2f, 0x28, 0x2e, 0x27, 0x2e, 0x2a, 0x29, 0x20, 0x28, 0x24, 0x2a, 0x27, 0x57, 0x28, 0x4f, 0x00, 0x00, 0xff,
+    0x1c, MP_QSTR_debug & 0xff, MP_QSTR_debug >> 8,
+    0x37, 0x08, 0x80, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0xb0, 
+    0x64, 0x01, 
+    0x32, 
+    0xb0, 
+    0x1e, MP_QSTR_split & 0xff, MP_QSTR_split >> 8,
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0x83, 
+    0x66, 0x02, 
+    0x59, 0x04, 
+    0xc1, 
+    0xc2, 
+    0xc3, 
+    0xc4, 
+    0x3f, 0x13, 0x00, 
+    0x1c, MP_QSTR_usocket & 0xff, MP_QSTR_usocket >> 8,
+    0x1e, MP_QSTR_getaddrinfo & 0xff, MP_QSTR_getaddrinfo >> 8,
+    0xb3, 
+    0x14, 0x83, 0x3b, 
+    0x66, 0x02, 
+    0xc5, 
+    0x44, 
+    0x35, 0x25, 0x80, 
+    0x30, 
+    0x1c, MP_QSTR_OSError & 0xff, MP_QSTR_OSError >> 8,
+    0x4b, 0x08, 0x1b, 0x80, 
+    0xc6, 
+    0x40, 0x0f, 0x00, 
+    0x1c, MP_QSTR_fatal & 0xff, MP_QSTR_fatal >> 8,
+    0x17, 0x01, 
+    0xb3, 
+    0xf6, 
+    0xb6, 
+    0x64, 0x02, 
+    0x32, 
+    0x44, 
+    0x45, 
+    0x11, 
+    0x11, 
+    0xc6, 
+    0x28, 0x06, 
+    0x41, 
+    0x35, 0x01, 0x80, 
+    0x41, 
+    0xb5, 
+    0x80, 
+    0x21, 
+    0x84, 
+    0x21, 
+    0xc7, 
+    0x1c, MP_QSTR_usocket & 0xff, MP_QSTR_usocket >> 8,
+    0x1e, MP_QSTR_socket & 0xff, MP_QSTR_socket >> 8,
+    0xb5, 
+    0x80, 
+    0x21, 
+    0x80, 
+    0x21, 
+    0x66, 0x01, 
+    0xc8, 
+    0x3f, 0xac, 0x00, 
+    0xb8, 
+    0x1e, MP_QSTR_connect & 0xff, MP_QSTR_connect >> 8,
+    0xb7, 
+    0x66, 0x01, 
+    0x32, 
+    0xb1, 
+    0x16, MP_QSTR_https_colon_ & 0xff, MP_QSTR_https_colon_ >> 8,
+    0x4b, 0x02, 0x27, 0x80, 
+    0x1c, MP_QSTR_ussl & 0xff, MP_QSTR_ussl >> 8,
+    0x1e, MP_QSTR_wrap_socket & 0xff, MP_QSTR_wrap_socket >> 8,
+    0xb8, 
+    0x16, MP_QSTR_server_hostname & 0xff, MP_QSTR_server_hostname >> 8,
+    0xb3, 
+    0x66, 0x82, 0x01, 
+    0xc8, 
+    0x1c, MP_QSTR_warn_ussl & 0xff, MP_QSTR_warn_ussl >> 8,
+    0x37, 0x0f, 0x80, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x17, 0x02, 
+    0xb3, 
+    0xf6, 
+    0x64, 0x01, 
+    0x32, 
+    0x10, 
+    0x25, MP_QSTR_warn_ussl & 0xff, MP_QSTR_warn_ussl >> 8,
+    0xb8, 
+    0x1e, MP_QSTR_write & 0xff, MP_QSTR_write >> 8,
+    0x17, 0x03, 
+    0x48, 0x43, 
+    0x50, 0x02, 
+    0xf6, 
+    0x66, 0x01, 
+    0x32, 
+    0xb8, 
+    0x1e, MP_QSTR_readline & 0xff, MP_QSTR_readline >> 8,
+    0x66, 0x00, 
+    0xc9, 
+    0xb9, 
+    0x1e, MP_QSTR_split & 0xff, MP_QSTR_split >> 8,
+    0x11, 
+    0x82, 
+    0x66, 0x02, 
+    0x59, 0x03, 
+    0xca, 
+    0xcb, 
+    0xcc, 
+    0xbb, 
+    0x17, 0x04, 
+    0x4b, 0x05, 0x21, 0x80, 
+    0xbb, 
+    0x17, 0x05, 
+    0x4a, 0x02, 0x07, 0x80, 
+    0xbb, 
+    0x17, 0x06, 
+    0x4b, 0x02, 0x0a, 0x80, 
+    0x1c, MP_QSTR_NotFoundError & 0xff, MP_QSTR_NotFoundError >> 8,
+    0x17, 0x07, 
+    0x64, 0x01, 
+    0x5c, 0x01, 
+    0x1c, MP_QSTR_ValueError & 0xff, MP_QSTR_ValueError >> 8,
+    0xbb, 
+    0x64, 0x01, 
+    0x5c, 0x01, 
+    0xb8, 
+    0x1e, MP_QSTR_readline & 0xff, MP_QSTR_readline >> 8,
+    0x66, 0x00, 
+    0xc9, 
+    0xb9, 
+    0x36, 0x0a, 0x80, 
+    0x1c, MP_QSTR_ValueError & 0xff, MP_QSTR_ValueError >> 8,
+    0x17, 0x08, 
+    0x64, 0x01, 
+    0x5c, 0x01, 
+    0xb9, 
+    0x17, 0x09, 
+    0x4b, 0x02, 0x03, 0x80, 
+    0x35, 0x03, 0x80, 
+    0x35, 0xdd, 0x7f, 
+    0x44, 
+    0x35, 0x24, 0x80, 
+    0x30, 
+    0x1c, MP_QSTR_Exception & 0xff, MP_QSTR_Exception >> 8,
+    0x4b, 0x08, 0x1a, 0x80, 
+    0xc6, 
+    0x40, 0x0e, 0x00, 
+    0xb8, 
+    0x1e, MP_QSTR_close & 0xff, MP_QSTR_close >> 8,
+    0x66, 0x00, 
+    0x32, 
+    0xb6, 
+    0x5c, 0x01, 
+    0x44, 
+    0x45, 
+    0x11, 
+    0x11, 
+    0xc6, 
+    0x28, 0x06, 
+    0x41, 
+    0x35, 0x01, 0x80, 
+    0x41, 
+    0xb8, 
+    0x5b, 
+};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__url_open_0 = {{&mp_type_str}, 10889, 35, (const byte*)"\x55\x6e\x61\x62\x6c\x65\x20\x74\x6f\x20\x72\x65\x73\x6f\x6c\x76\x65\x20\x25\x73\x20\x28\x6e\x6f\x20\x49\x6e\x74\x65\x72\x6e\x65\x74\x3f\x29"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__url_open_1 = {{&mp_type_str}, 51159, 44, (const byte*)"\x57\x61\x72\x6e\x69\x6e\x67\x3a\x20\x25\x73\x20\x53\x53\x4c\x20\x63\x65\x72\x74\x69\x66\x69\x63\x61\x74\x65\x20\x69\x73\x20\x6e\x6f\x74\x20\x76\x61\x6c\x69\x64\x61\x74\x65\x64"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__url_open_2 = {{&mp_type_str}, 26169, 30, (const byte*)"\x47\x45\x54\x20\x2f\x25\x73\x20\x48\x54\x54\x50\x2f\x31\x2e\x30\x0d\x0a\x48\x6f\x73\x74\x3a\x20\x25\x73\x0d\x0a\x0d\x0a"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__url_open_3 = {{&mp_type_bytes}, 28951, 3, (const byte*)"\x32\x30\x30"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__url_open_4 = {{&mp_type_bytes}, 22421, 3, (const byte*)"\x34\x30\x34"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__url_open_5 = {{&mp_type_bytes}, 29975, 3, (const byte*)"\x33\x30\x31"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__url_open_6 = {{&mp_type_str}, 48284, 17, (const byte*)"\x50\x61\x63\x6b\x61\x67\x65\x20\x6e\x6f\x74\x20\x66\x6f\x75\x6e\x64"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__url_open_7 = {{&mp_type_str}, 39199, 30, (const byte*)"\x55\x6e\x65\x78\x70\x65\x63\x74\x65\x64\x20\x45\x4f\x46\x20\x69\x6e\x20\x48\x54\x54\x50\x20\x68\x65\x61\x64\x65\x72\x73"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__url_open_8 = {{&mp_type_bytes}, 27298, 2, (const byte*)"\x0d\x0a"};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__url_open[10] = {
+    MP_ROM_QSTR(MP_QSTR_url),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__url_open_0),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__url_open_1),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__url_open_2),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__url_open_3),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__url_open_4),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__url_open_5),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__url_open_6),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__url_open_7),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__url_open_8),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__url_open = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 1,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__url_open,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__url_open,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 374,
+        .n_obj = 9,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__get_pkg_metadata
+STATIC byte bytecode_data_upip__lt_module_gt__get_pkg_metadata[58] = {
+    0x08, 0x01, 0x00, 0x01, 0x00, 0x00, 0x0c,
+    MP_QSTR_get_pkg_metadata & 0xff, MP_QSTR_get_pkg_metadata >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0x97, 0x2b, 0x23, 0x4e, 0x00, 0x00, 0xff,
+    0x1c, MP_QSTR_url_open & 0xff, MP_QSTR_url_open >> 8,
+    0x17, 0x01, 
+    0xb0, 
+    0xf6, 
+    0x64, 0x01, 
+    0xc1, 
+    0x40, 0x0e, 0x00, 
+    0x1c, MP_QSTR_json & 0xff, MP_QSTR_json >> 8,
+    0x1e, MP_QSTR_load & 0xff, MP_QSTR_load >> 8,
+    0xb1, 
+    0x66, 0x01, 
+    0x5b, 
+    0x44, 
+    0x11, 
+    0xb1, 
+    0x1e, MP_QSTR_close & 0xff, MP_QSTR_close >> 8,
+    0x66, 0x00, 
+    0x32, 
+    0x41, 
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__get_pkg_metadata_0 = {{&mp_type_str}, 42459, 36, (const byte*)"\x68\x74\x74\x70\x73\x3a\x2f\x2f\x70\x79\x70\x69\x2e\x70\x79\x74\x68\x6f\x6e\x2e\x6f\x72\x67\x2f\x70\x79\x70\x69\x2f\x25\x73\x2f\x6a\x73\x6f\x6e"};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__get_pkg_metadata[2] = {
+    MP_ROM_QSTR(MP_QSTR_name),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__get_pkg_metadata_0),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__get_pkg_metadata = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 1,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__get_pkg_metadata,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__get_pkg_metadata,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 58,
+        .n_obj = 1,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__fatal
+STATIC byte bytecode_data_upip__lt_module_gt__fatal[58] = {
+    0x05, 0x00, 0x00, 0x02, 0x00, 0x01, 0x0c,
+    MP_QSTR_fatal & 0xff, MP_QSTR_fatal >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0x9f, 0x2b, 0x2b, 0x23, 0x00, 0x00, 0xff,
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x16, MP_QSTR_Error_colon_ & 0xff, MP_QSTR_Error_colon_ >> 8,
+    0xb0, 
+    0x64, 0x02, 
+    0x32, 
+    0xb1, 
+    0x37, 0x0a, 0x80, 
+    0x1c, MP_QSTR_debug & 0xff, MP_QSTR_debug >> 8,
+    0x37, 0x03, 0x80, 
+    0xb1, 
+    0x5c, 0x01, 
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1e, MP_QSTR_exit & 0xff, MP_QSTR_exit >> 8,
+    0x81, 
+    0x66, 0x01, 
+    0x32, 
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__fatal[2] = {
+    MP_ROM_QSTR(MP_QSTR_msg),
+    MP_ROM_QSTR(MP_QSTR_exc),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__fatal = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 2,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__fatal,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__fatal,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 58,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__install_pkg
+STATIC byte bytecode_data_upip__lt_module_gt__install_pkg[203] = {
+    0x12, 0x01, 0x00, 0x02, 0x00, 0x00, 0x1b,
+    MP_QSTR_install_pkg & 0xff, MP_QSTR_install_pkg >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0xa5, 0x48, 0x2a, 0x28, 0x22, 0x2b, 0x33, 0x28, 0x2f, 0x28, 0x28, 0x23, 0x30, 0x30, 0x4b, 0x29, 0x22, 0x22, 0x2b, 0x00, 0x00, 0xff,
+    0x1c, MP_QSTR_get_pkg_metadata & 0xff, MP_QSTR_get_pkg_metadata >> 8,
+    0xb0, 
+    0x64, 0x01, 
+    0xc2, 
+    0xb2, 
+    0x16, MP_QSTR_info & 0xff, MP_QSTR_info >> 8,
+    0x21, 
+    0x16, MP_QSTR_version & 0xff, MP_QSTR_version >> 8,
+    0x21, 
+    0xc3, 
+    0xb2, 
+    0x16, MP_QSTR_releases & 0xff, MP_QSTR_releases >> 8,
+    0x21, 
+    0xb3, 
+    0x21, 
+    0xc4, 
+    0x28, 0x02, 
+    0x1c, MP_QSTR_gc & 0xff, MP_QSTR_gc >> 8,
+    0x1e, MP_QSTR_collect & 0xff, MP_QSTR_collect >> 8,
+    0x66, 0x00, 
+    0x32, 
+    0x1c, MP_QSTR_len & 0xff, MP_QSTR_len >> 8,
+    0xb4, 
+    0x64, 0x01, 
+    0x49, 0x02, 0x01, 
+    0x36, 0x06, 0x80, 
+    0x1c, MP_QSTR_AssertionError & 0xff, MP_QSTR_AssertionError >> 8,
+    0x5c, 0x01, 
+    0xb4, 
+    0x80, 
+    0x21, 
+    0x16, MP_QSTR_url & 0xff, MP_QSTR_url >> 8,
+    0x21, 
+    0xc5, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x17, 0x02, 
+    0x48, 0x03, 
+    0xb5, 
+    0x50, 0x03, 
+    0xf6, 
+    0x64, 0x01, 
+    0x32, 
+    0x1c, MP_QSTR_op_basename & 0xff, MP_QSTR_op_basename >> 8,
+    0xb5, 
+    0x64, 0x01, 
+    0xc6, 
+    0x1c, MP_QSTR_url_open & 0xff, MP_QSTR_url_open >> 8,
+    0xb5, 
+    0x64, 0x01, 
+    0xc7, 
+    0x40, 0x2b, 0x00, 
+    0x1c, MP_QSTR_uzlib & 0xff, MP_QSTR_uzlib >> 8,
+    0x1e, MP_QSTR_DecompIO & 0xff, MP_QSTR_DecompIO >> 8,
+    0xb7, 
+    0x1c, MP_QSTR_gzdict_sz & 0xff, MP_QSTR_gzdict_sz >> 8,
+    0x66, 0x02, 
+    0xc8, 
+    0x1c, MP_QSTR_tarfile & 0xff, MP_QSTR_tarfile >> 8,
+    0x1e, MP_QSTR_TarFile & 0xff, MP_QSTR_TarFile >> 8,
+    0x16, MP_QSTR_fileobj & 0xff, MP_QSTR_fileobj >> 8,
+    0xb8, 
+    0x66, 0x82, 0x00, 
+    0xc9, 
+    0x1c, MP_QSTR_install_tar & 0xff, MP_QSTR_install_tar >> 8,
+    0x48, 0x91, 
+    0x64, 0x02, 
+    0xca, 
+    0x44, 
+    0x11, 
+    0xb7, 
+    0x1e, MP_QSTR_close & 0xff, MP_QSTR_close >> 8,
+    0x66, 0x00, 
+    0x32, 
+    0x41, 
+    0x28, 0x09, 
+    0x28, 0x08, 
+    0x1c, MP_QSTR_gc & 0xff, MP_QSTR_gc >> 8,
+    0x1e, MP_QSTR_collect & 0xff, MP_QSTR_collect >> 8,
+    0x66, 0x00, 
+    0x32, 
+    0xba, 
+    0x5b, 
+};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__install_pkg_0 = {{&mp_type_str}, 7236, 24, (const byte*)"\x49\x6e\x73\x74\x61\x6c\x6c\x69\x6e\x67\x20\x25\x73\x20\x25\x73\x20\x66\x72\x6f\x6d\x20\x25\x73"};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__install_pkg[3] = {
+    MP_ROM_QSTR(MP_QSTR_pkg_spec),
+    MP_ROM_QSTR(MP_QSTR_install_path),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__install_pkg_0),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__install_pkg = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 2,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__install_pkg,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__install_pkg,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 203,
+        .n_obj = 1,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__install
+STATIC byte bytecode_data_upip__lt_module_gt__install[332] = {
+    0x10, 0x02, 0x00, 0x02, 0x00, 0x01, 0x25,
+    MP_QSTR_install & 0xff, MP_QSTR_install >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0xbd, 0x20, 0x36, 0x29, 0x44, 0x26, 0x27, 0x2a, 0x26, 0x2e, 0x24, 0x4b, 0x23, 0x23, 0x23, 0x27, 0x2b, 0x29, 0x26, 0x23, 0x29, 0x29, 0x27, 0x28, 0x34, 0x24, 0x34, 0x5e, 0x51, 0x00, 0x00, 0xff,
+    0x1c, MP_QSTR_gc & 0xff, MP_QSTR_gc >> 8,
+    0x1e, MP_QSTR_mem_free & 0xff, MP_QSTR_mem_free >> 8,
+    0x66, 0x00, 
+    0x1c, MP_QSTR_gc & 0xff, MP_QSTR_gc >> 8,
+    0x1e, MP_QSTR_mem_alloc & 0xff, MP_QSTR_mem_alloc >> 8,
+    0x66, 0x00, 
+    0xf1, 
+    0xc2, 
+    0xb2, 
+    0x14, 0x84, 0x80, 0x00, 
+    0x4b, 0x03, 0x04, 0x80, 
+    0x9c, 
+    0x25, MP_QSTR_gzdict_sz & 0xff, MP_QSTR_gzdict_sz >> 8,
+    0xb1, 
+    0x11, 
+    0x4b, 0x07, 0x07, 0x80, 
+    0x1c, MP_QSTR_get_install_path & 0xff, MP_QSTR_get_install_path >> 8,
+    0x64, 0x00, 
+    0xc1, 
+    0xb1, 
+    0x7f, 
+    0x21, 
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0x4b, 0x05, 0x06, 0x80, 
+    0xb1, 
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0xe5, 
+    0xc1, 
+    0x1c, MP_QSTR_isinstance & 0xff, MP_QSTR_isinstance >> 8,
+    0xb0, 
+    0x1c, MP_QSTR_list & 0xff, MP_QSTR_list >> 8,
+    0x64, 0x02, 
+    0x36, 0x04, 0x80, 
+    0xb0, 
+    0x51, 0x01, 
+    0xc0, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x17, 0x02, 
+    0xb1, 
+    0xf1, 
+    0x64, 0x01, 
+    0x32, 
+    0x51, 0x00, 
+    0xc3, 
+    0x3f, 0x85, 0x00, 
+    0x35, 0x7a, 0x80, 
+    0x1c, MP_QSTR_debug & 0xff, MP_QSTR_debug >> 8,
+    0x37, 0x0b, 0x80, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x16, MP_QSTR_Queue_colon_ & 0xff, MP_QSTR_Queue_colon_ >> 8,
+    0xb0, 
+    0x64, 0x02, 
+    0x32, 
+    0xb0, 
+    0x1e, MP_QSTR_pop & 0xff, MP_QSTR_pop >> 8,
+    0x80, 
+    0x66, 0x01, 
+    0xc4, 
+    0x48, 0x43, 
+    0x4b, 0x06, 0x03, 0x80, 
+    0x35, 0x56, 0x80, 
+    0x1c, MP_QSTR_install_pkg & 0xff, MP_QSTR_install_pkg >> 8,
+    0x48, 0x41, 
+    0x64, 0x02, 
+    0xc5, 
+    0xb3, 
+    0x1e, MP_QSTR_append & 0xff, MP_QSTR_append >> 8,
+    0xb4, 
+    0x66, 0x01, 
+    0x32, 
+    0x1c, MP_QSTR_debug & 0xff, MP_QSTR_debug >> 8,
+    0x37, 0x08, 0x80, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0xb5, 
+    0x64, 0x01, 
+    0x32, 
+    0xb5, 
+    0x1e, MP_QSTR_get & 0xff, MP_QSTR_get >> 8,
+    0x16, MP_QSTR_deps & 0xff, MP_QSTR_deps >> 8,
+    0x16, MP_QSTR_ & 0xff, MP_QSTR_ >> 8,
+    0x66, 0x02, 
+    0x1e, MP_QSTR_rstrip & 0xff, MP_QSTR_rstrip >> 8,
+    0x66, 0x00, 
+    0xc6, 
+    0xb6, 
+    0x37, 0x1d, 0x80, 
+    0xb6, 
+    0x1e, MP_QSTR_decode & 0xff, MP_QSTR_decode >> 8,
+    0x16, MP_QSTR_utf_hyphen_8 & 0xff, MP_QSTR_utf_hyphen_8 >> 8,
+    0x66, 0x01, 
+    0x1e, MP_QSTR_split & 0xff, MP_QSTR_split >> 8,
+    0x16, MP_QSTR__0x0a_ & 0xff, MP_QSTR__0x0a_ >> 8,
+    0x66, 0x01, 
+    0xc6, 
+    0xb0, 
+    0x1e, MP_QSTR_extend & 0xff, MP_QSTR_extend >> 8,
+    0xb6, 
+    0x66, 0x01, 
+    0x32, 
+    0xb0, 
+    0x36, 0x82, 0x7f, 
+    0x44, 
+    0x35, 0x36, 0x80, 
+    0x30, 
+    0x1c, MP_QSTR_Exception & 0xff, MP_QSTR_Exception >> 8,
+    0x4b, 0x08, 0x2c, 0x80, 
+    0xc7, 
+    0x40, 0x20, 0x00, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x17, 0x03, 
+    0x1e, MP_QSTR_format & 0xff, MP_QSTR_format >> 8,
+    0x48, 0x47, 
+    0x66, 0x02, 
+    0x16, MP_QSTR_file & 0xff, MP_QSTR_file >> 8,
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_stderr & 0xff, MP_QSTR_stderr >> 8,
+    0x64, 0x82, 0x01, 
+    0x32, 
+    0x44, 
+    0x45, 
+    0x11, 
+    0x11, 
+    0xc7, 
+    0x28, 0x07, 
+    0x41, 
+    0x35, 0x01, 0x80, 
+    0x41, 
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__install_0 = {{&mp_type_str}, 1253, 15, (const byte*)"\x49\x6e\x73\x74\x61\x6c\x6c\x69\x6e\x67\x20\x74\x6f\x3a\x20"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__install_1 = {{&mp_type_str}, 31671, 62, (const byte*)"\x45\x72\x72\x6f\x72\x20\x69\x6e\x73\x74\x61\x6c\x6c\x69\x6e\x67\x20\x27\x7b\x7d\x27\x3a\x20\x7b\x7d\x2c\x20\x70\x61\x63\x6b\x61\x67\x65\x73\x20\x6d\x61\x79\x20\x62\x65\x20\x70\x61\x72\x74\x69\x61\x6c\x6c\x79\x20\x69\x6e\x73\x74\x61\x6c\x6c\x65\x64"};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__install[4] = {
+    MP_ROM_QSTR(MP_QSTR_to_install),
+    MP_ROM_QSTR(MP_QSTR_install_path),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__install_0),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__install_1),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__install = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 2,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__install,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__install,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 332,
+        .n_obj = 2,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__get_install_path
+STATIC byte bytecode_data_upip__lt_module_gt__get_install_path[60] = {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0d,
+    MP_QSTR_get_install_path & 0xff, MP_QSTR_get_install_path >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0xe0, 0x20, 0x49, 0x2d, 0x2d, 0x00, 0x00, 0xff,
+    0x1c, MP_QSTR_install_path & 0xff, MP_QSTR_install_path >> 8,
+    0x11, 
+    0x4b, 0x07, 0x0d, 0x80, 
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_path & 0xff, MP_QSTR_path >> 8,
+    0x81, 
+    0x21, 
+    0x25, MP_QSTR_install_path & 0xff, MP_QSTR_install_path >> 8,
+    0x1c, MP_QSTR_expandhome & 0xff, MP_QSTR_expandhome >> 8,
+    0x1c, MP_QSTR_install_path & 0xff, MP_QSTR_install_path >> 8,
+    0x64, 0x01, 
+    0x25, MP_QSTR_install_path & 0xff, MP_QSTR_install_path >> 8,
+    0x1c, MP_QSTR_install_path & 0xff, MP_QSTR_install_path >> 8,
+    0x5b, 
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__get_install_path = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 0,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__get_install_path,
+        .const_table = NULL,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 60,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__cleanup
+STATIC byte bytecode_data_upip__lt_module_gt__cleanup[78] = {
+    0x0b, 0x01, 0x00, 0x00, 0x00, 0x00, 0x0c,
+    MP_QSTR_cleanup & 0xff, MP_QSTR_cleanup >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0xe8, 0x29, 0x23, 0x5a, 0x00, 0x00, 0xff,
+    0x1c, MP_QSTR_cleanup_files & 0xff, MP_QSTR_cleanup_files >> 8,
+    0x47, 
+    0x43, 0x31, 0x00, 
+    0xc0, 
+    0x3f, 0x10, 0x00, 
+    0x1c, MP_QSTR_os & 0xff, MP_QSTR_os >> 8,
+    0x1e, MP_QSTR_unlink & 0xff, MP_QSTR_unlink >> 8,
+    0xb0, 
+    0x66, 0x01, 
+    0x32, 
+    0x44, 
+    0x35, 0x1a, 0x80, 
+    0x30, 
+    0x1c, MP_QSTR_OSError & 0xff, MP_QSTR_OSError >> 8,
+    0x4b, 0x08, 0x10, 0x80, 
+    0x32, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x17, 0x00, 
+    0xb0, 
+    0xf1, 
+    0x64, 0x01, 
+    0x32, 
+    0x45, 
+    0x35, 0x01, 0x80, 
+    0x41, 
+    0x35, 0xcc, 0x7f, 
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__cleanup_0 = {{&mp_type_str}, 17877, 23, (const byte*)"\x57\x61\x72\x6e\x69\x6e\x67\x3a\x20\x43\x61\x6e\x6e\x6f\x74\x20\x64\x65\x6c\x65\x74\x65\x20"};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__cleanup[1] = {
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__cleanup_0),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__cleanup = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 0,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__cleanup,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__cleanup,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 78,
+        .n_obj = 1,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__help
+STATIC byte bytecode_data_upip__lt_module_gt__help[58] = {
+    0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c,
+    MP_QSTR_help & 0xff, MP_QSTR_help >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0xef, 0x89, 0x08, 0x33, 0x00, 0x00, 0xff,
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x17, 0x00, 
+    0x64, 0x01, 
+    0x32, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x17, 0x01, 
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_path & 0xff, MP_QSTR_path >> 8,
+    0x81, 
+    0x21, 
+    0x64, 0x02, 
+    0x32, 
+    0x1c, MP_QSTR_print & 0xff, MP_QSTR_print >> 8,
+    0x17, 0x02, 
+    0x64, 0x01, 
+    0x32, 
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__help_0 = {{&mp_type_str}, 14525, 341, (const byte*)"\x75\x70\x69\x70\x20\x2d\x20\x53\x69\x6d\x70\x6c\x65\x20\x50\x79\x50\x49\x20\x70\x61\x63\x6b\x61\x67\x65\x20\x6d\x61\x6e\x61\x67\x65\x72\x20\x66\x6f\x72\x20\x4d\x69\x63\x72\x6f\x50\x79\x74\x68\x6f\x6e\x0a\x55\x73\x61\x67\x65\x3a\x20\x6d\x69\x63\x72\x6f\x70\x79\x74\x68\x6f\x6e\x20\x2d\x6d\x20\x75\x70\x69\x70\x20\x69\x6e\x73\x74\x61\x6c\x6c\x20\x5b\x2d\x70\x20\x3c\x70\x61\x74\x68\x3e\x5d\x20\x3c\x70\x61\x63\x6b\x61\x67\x65\x3e\x2e\x2e\x2e\x20\x7c\x20\x2d\x72\x20\x3c\x72\x65\x71\x75\x69\x72\x65\x6d\x65\x6e\x74\x73\x2e\x74\x78\x74\x3e\x0a\x69\x6d\x70\x6f\x72\x74\x20\x75\x70\x69\x70\x3b\x20\x75\x70\x69\x70\x2e\x69\x6e\x73\x74\x61\x6c\x6c\x28\x70\x61\x63\x6b\x61\x67\x65\x5f\x6f\x72\x5f\x6c\x69\x73\x74\x2c\x20\x5b\x3c\x70\x61\x74\x68\x3e\x5d\x29\x0a\x0a\x49\x66\x20\x3c\x70\x61\x74\x68\x3e\x20\x69\x73\x20\x6e\x6f\x74\x20\x67\x69\x76\x65\x6e\x2c\x20\x70\x61\x63\x6b\x61\x67\x65\x73\x20\x77\x69\x6c\x6c\x20\x62\x65\x20\x69\x6e\x73\x74\x61\x6c\x6c\x65\x64\x20\x69\x6e\x74\x6f\x20\x73\x79\x73\x2e\x70\x61\x74\x68\x5b\x31\x5d\x0a\x28\x63\x61\x6e\x20\x62\x65\x20\x73\x65\x74\x20\x66\x72\x6f\x6d\x20\x4d\x49\x43\x52\x4f\x50\x59\x50\x41\x54\x48\x20\x65\x6e\x76\x69\x72\x6f\x6e\x6d\x65\x6e\x74\x20\x76\x61\x72\x69\x61\x62\x6c\x65\x2c\x20\x69\x66\x20\x63\x75\x72\x72\x65\x6e\x74\x20\x73\x79\x73\x74\x65\x6d\x0a\x73\x75\x70\x70\x6f\x72\x74\x73\x20\x74\x68\x61\x74\x29\x2e"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__help_1 = {{&mp_type_str}, 17177, 29, (const byte*)"\x43\x75\x72\x72\x65\x6e\x74\x20\x76\x61\x6c\x75\x65\x20\x6f\x66\x20\x73\x79\x73\x2e\x70\x61\x74\x68\x5b\x31\x5d\x3a"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__help_2 = {{&mp_type_str}, 34882, 146, (const byte*)"\x0a\x4e\x6f\x74\x65\x3a\x20\x6f\x6e\x6c\x79\x20\x4d\x69\x63\x72\x6f\x50\x79\x74\x68\x6f\x6e\x20\x70\x61\x63\x6b\x61\x67\x65\x73\x20\x28\x75\x73\x75\x61\x6c\x6c\x79\x2c\x20\x6e\x61\x6d\x65\x64\x20\x6d\x69\x63\x72\x6f\x70\x79\x74\x68\x6f\x6e\x2d\x2a\x29\x20\x61\x72\x65\x20\x73\x75\x70\x70\x6f\x72\x74\x65\x64\x0a\x66\x6f\x72\x20\x69\x6e\x73\x74\x61\x6c\x6c\x61\x74\x69\x6f\x6e\x2c\x20\x75\x70\x69\x70\x20\x64\x6f\x65\x73\x20\x6e\x6f\x74\x20\x73\x75\x70\x70\x6f\x72\x74\x20\x61\x72\x62\x69\x74\x72\x61\x72\x79\x20\x63\x6f\x64\x65\x20\x69\x6e\x20\x73\x65\x74\x75\x70\x2e\x70\x79\x2e\x0a"};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__help[3] = {
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__help_0),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__help_1),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__help_2),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__help = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 0,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__help,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__help,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 58,
+        .n_obj = 3,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip__lt_module_gt__main
+STATIC byte bytecode_data_upip__lt_module_gt__main[438] = {
+    0x0c, 0x01, 0x00, 0x00, 0x00, 0x00, 0x32,
+    MP_QSTR_main & 0xff, MP_QSTR_main >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x81, 0xff, 0x20, 0x20, 0x44, 0x1f, 0x37, 0x27, 0x42, 0x31, 0x49, 0x43, 0x22, 0x23, 0x2b, 0x25, 0x30, 0x27, 0x22, 0x28, 0x2d, 0x28, 0x28, 0x2b, 0x25, 0x2b, 0x20, 0x28, 0x24, 0x23, 0x2a, 0x23, 0x39, 0x28, 0x47, 0x1f, 0x52, 0x35, 0x24, 0x27, 0x42, 0x48, 0x27, 0x00, 0x00, 0xff,
+    0x11, 
+    0x25, MP_QSTR_install_path & 0xff, MP_QSTR_install_path >> 8,
+    0x1c, MP_QSTR_len & 0xff, MP_QSTR_len >> 8,
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_argv & 0xff, MP_QSTR_argv >> 8,
+    0x64, 0x01, 
+    0x49, 0x00, 0x02, 
+    0x36, 0x22, 0x80, 
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_argv & 0xff, MP_QSTR_argv >> 8,
+    0x81, 
+    0x21, 
+    0x16, MP_QSTR__hyphen_h & 0xff, MP_QSTR__hyphen_h >> 8,
+    0x4a, 0x02, 0x11, 0x80, 
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_argv & 0xff, MP_QSTR_argv >> 8,
+    0x81, 
+    0x21, 
+    0x16, MP_QSTR__hyphen__hyphen_help & 0xff, MP_QSTR__hyphen__hyphen_help >> 8,
+    0x4b, 0x02, 0x09, 0x80, 
+    0x1c, MP_QSTR_help & 0xff, MP_QSTR_help >> 8,
+    0x64, 0x00, 
+    0x32, 
+    0x11, 
+    0x5b, 
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_argv & 0xff, MP_QSTR_argv >> 8,
+    0x81, 
+    0x21, 
+    0x16, MP_QSTR_install & 0xff, MP_QSTR_install >> 8,
+    0x4b, 0x05, 0x09, 0x80, 
+    0x1c, MP_QSTR_fatal & 0xff, MP_QSTR_fatal >> 8,
+    0x17, 0x00, 
+    0x64, 0x01, 
+    0x32, 
+    0x51, 0x00, 
+    0xc0, 
+    0x82, 
+    0xc1, 
+    0x35, 0xb8, 0x80, 
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_argv & 0xff, MP_QSTR_argv >> 8,
+    0xb1, 
+    0x21, 
+    0xc2, 
+    0xb1, 
+    0x49, 0x0e, 0x01, 
+    0xc1, 
+    0xb2, 
+    0x16, MP_QSTR__hyphen_h & 0xff, MP_QSTR__hyphen_h >> 8,
+    0x4a, 0x02, 0x08, 0x80, 
+    0xb2, 
+    0x16, MP_QSTR__hyphen__hyphen_help & 0xff, MP_QSTR__hyphen__hyphen_help >> 8,
+    0x4b, 0x02, 0x09, 0x80, 
+    0x1c, MP_QSTR_help & 0xff, MP_QSTR_help >> 8,
+    0x64, 0x00, 
+    0x32, 
+    0x11, 
+    0x5b, 
+    0xb2, 
+    0x16, MP_QSTR__hyphen_p & 0xff, MP_QSTR__hyphen_p >> 8,
+    0x4b, 0x02, 0x15, 0x80, 
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_argv & 0xff, MP_QSTR_argv >> 8,
+    0xb1, 
+    0x21, 
+    0x25, MP_QSTR_install_path & 0xff, MP_QSTR_install_path >> 8,
+    0xb1, 
+    0x49, 0x0e, 0x01, 
+    0xc1, 
+    0x35, 0x72, 0x80, 
+    0xb2, 
+    0x16, MP_QSTR__hyphen_r & 0xff, MP_QSTR__hyphen_r >> 8,
+    0x4b, 0x02, 0x50, 0x80, 
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_argv & 0xff, MP_QSTR_argv >> 8,
+    0xb1, 
+    0x21, 
+    0xc3, 
+    0xb1, 
+    0x49, 0x0e, 0x01, 
+    0xc1, 
+    0x1c, MP_QSTR_open & 0xff, MP_QSTR_open >> 8,
+    0xb3, 
+    0x64, 0x01, 
+    0x3d, 0x31, 0x00, 
+    0xc4, 
+    0xb4, 
+    0x1e, MP_QSTR_readline & 0xff, MP_QSTR_readline >> 8,
+    0x66, 0x00, 
+    0xc5, 
+    0xb5, 
+    0x36, 0x03, 0x80, 
+    0x35, 0x1f, 0x80, 
+    0xb5, 
+    0x80, 
+    0x21, 
+    0x16, MP_QSTR__hash_ & 0xff, MP_QSTR__hash_ >> 8,
+    0x4b, 0x02, 0x03, 0x80, 
+    0x35, 0x0f, 0x80, 
+    0xb0, 
+    0x1e, MP_QSTR_append & 0xff, MP_QSTR_append >> 8,
+    0xb5, 
+    0x1e, MP_QSTR_rstrip & 0xff, MP_QSTR_rstrip >> 8,
+    0x66, 0x00, 
+    0x66, 0x01, 
+    0x32, 
+    0x35, 0xd2, 0x7f, 
+    0x44, 
+    0x11, 
+    0x3e, 
+    0x41, 
+    0x35, 0x1a, 0x80, 
+    0xb2, 
+    0x16, MP_QSTR__hyphen__hyphen_debug & 0xff, MP_QSTR__hyphen__hyphen_debug >> 8,
+    0x4b, 0x02, 0x07, 0x80, 
+    0x12, 
+    0x25, MP_QSTR_debug & 0xff, MP_QSTR_debug >> 8,
+    0x35, 0x0b, 0x80, 
+    0x1c, MP_QSTR_fatal & 0xff, MP_QSTR_fatal >> 8,
+    0x17, 0x01, 
+    0xb2, 
+    0xf1, 
+    0x64, 0x01, 
+    0x32, 
+    0xb1, 
+    0x1c, MP_QSTR_len & 0xff, MP_QSTR_len >> 8,
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_argv & 0xff, MP_QSTR_argv >> 8,
+    0x64, 0x01, 
+    0x4b, 0x00, 0x13, 0x80, 
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_argv & 0xff, MP_QSTR_argv >> 8,
+    0xb1, 
+    0x21, 
+    0x80, 
+    0x21, 
+    0x16, MP_QSTR__hyphen_ & 0xff, MP_QSTR__hyphen_ >> 8,
+    0x4a, 0x02, 0x22, 0x7f, 
+    0xb0, 
+    0x1e, MP_QSTR_extend & 0xff, MP_QSTR_extend >> 8,
+    0x1c, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x1d, MP_QSTR_argv & 0xff, MP_QSTR_argv >> 8,
+    0xb1, 
+    0x11, 
+    0x58, 0x02, 
+    0x21, 
+    0x66, 0x01, 
+    0x32, 
+    0xb0, 
+    0x36, 0x09, 0x80, 
+    0x1c, MP_QSTR_help & 0xff, MP_QSTR_help >> 8,
+    0x64, 0x00, 
+    0x32, 
+    0x11, 
+    0x5b, 
+    0x1c, MP_QSTR_install & 0xff, MP_QSTR_install >> 8,
+    0xb0, 
+    0x64, 0x01, 
+    0x32, 
+    0x1c, MP_QSTR_debug & 0xff, MP_QSTR_debug >> 8,
+    0x36, 0x07, 0x80, 
+    0x1c, MP_QSTR_cleanup & 0xff, MP_QSTR_cleanup >> 8,
+    0x64, 0x00, 
+    0x32, 
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__main_0 = {{&mp_type_str}, 50937, 32, (const byte*)"\x4f\x6e\x6c\x79\x20\x27\x69\x6e\x73\x74\x61\x6c\x6c\x27\x20\x63\x6f\x6d\x6d\x61\x6e\x64\x20\x73\x75\x70\x70\x6f\x72\x74\x65\x64"};
+STATIC const mp_obj_str_t const_obj_upip__lt_module_gt__main_1 = {{&mp_type_str}, 40302, 28, (const byte*)"\x55\x6e\x6b\x6e\x6f\x77\x6e\x2f\x75\x6e\x73\x75\x70\x70\x6f\x72\x74\x65\x64\x20\x6f\x70\x74\x69\x6f\x6e\x3a\x20"};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt__main[2] = {
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__main_0),
+    MP_ROM_PTR(&const_obj_upip__lt_module_gt__main_1),
+};
+STATIC const mp_raw_code_t raw_code_upip__lt_module_gt__main = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 0,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt__main,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt__main,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 438,
+        .n_obj = 2,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip.py, scope upip_<module>
+STATIC byte bytecode_data_upip__lt_module_gt_[302] = {
+    0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x37,
+    MP_QSTR__lt_module_gt_ & 0xff, MP_QSTR__lt_module_gt_ >> 8,
+    MP_QSTR_upip_dot_py & 0xff, MP_QSTR_upip_dot_py >> 8,
+    0x29, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x6b, 0x24, 0x24, 0x25, 0x44, 0x4c, 0x6f, 0x85, 0x0b, 0x65, 0x20, 0x8b, 0x14, 0x85, 0x09, 0x85, 0x1f, 0x65, 0x60, 0x28, 0x28, 0x24, 0x85, 0x2e, 0x85, 0x08, 0x69, 0x60, 0x85, 0x17, 0x89, 0x24, 0x85, 0x08, 0x85, 0x07, 0x85, 0x10, 0x85, 0x33, 0x2b, 0x00, 0x00, 0xff,
+    0x80, 
+    0x11, 
+    0x68, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x24, MP_QSTR_sys & 0xff, MP_QSTR_sys >> 8,
+    0x80, 
+    0x11, 
+    0x68, MP_QSTR_gc & 0xff, MP_QSTR_gc >> 8,
+    0x24, MP_QSTR_gc & 0xff, MP_QSTR_gc >> 8,
+    0x80, 
+    0x11, 
+    0x68, MP_QSTR_uos & 0xff, MP_QSTR_uos >> 8,
+    0x24, MP_QSTR_os & 0xff, MP_QSTR_os >> 8,
+    0x80, 
+    0x11, 
+    0x68, MP_QSTR_uerrno & 0xff, MP_QSTR_uerrno >> 8,
+    0x24, MP_QSTR_errno & 0xff, MP_QSTR_errno >> 8,
+    0x80, 
+    0x11, 
+    0x68, MP_QSTR_ujson & 0xff, MP_QSTR_ujson >> 8,
+    0x24, MP_QSTR_json & 0xff, MP_QSTR_json >> 8,
+    0x80, 
+    0x11, 
+    0x68, MP_QSTR_uzlib & 0xff, MP_QSTR_uzlib >> 8,
+    0x24, MP_QSTR_uzlib & 0xff, MP_QSTR_uzlib >> 8,
+    0x80, 
+    0x11, 
+    0x68, MP_QSTR_upip_utarfile & 0xff, MP_QSTR_upip_utarfile >> 8,
+    0x24, MP_QSTR_tarfile & 0xff, MP_QSTR_tarfile >> 8,
+    0x1b, MP_QSTR_gc & 0xff, MP_QSTR_gc >> 8,
+    0x1e, MP_QSTR_collect & 0xff, MP_QSTR_collect >> 8,
+    0x66, 0x00, 
+    0x32, 
+    0x10, 
+    0x25, MP_QSTR_debug & 0xff, MP_QSTR_debug >> 8,
+    0x11, 
+    0x25, MP_QSTR_install_path & 0xff, MP_QSTR_install_path >> 8,
+    0x51, 0x00, 
+    0x24, MP_QSTR_cleanup_files & 0xff, MP_QSTR_cleanup_files >> 8,
+    0x9f, 
+    0x25, MP_QSTR_gzdict_sz & 0xff, MP_QSTR_gzdict_sz >> 8,
+    0x1b, MP_QSTR_bytearray & 0xff, MP_QSTR_bytearray >> 8,
+    0x14, 0x84, 0x00, 
+    0x64, 0x01, 
+    0x25, MP_QSTR_file_buf & 0xff, MP_QSTR_file_buf >> 8,
+    0x20, 
+    0x60, 0x00, 
+    0x16, MP_QSTR_NotFoundError & 0xff, MP_QSTR_NotFoundError >> 8,
+    0x1b, MP_QSTR_Exception & 0xff, MP_QSTR_Exception >> 8,
+    0x64, 0x03, 
+    0x24, MP_QSTR_NotFoundError & 0xff, MP_QSTR_NotFoundError >> 8,
+    0x60, 0x01, 
+    0x24, MP_QSTR_op_split & 0xff, MP_QSTR_op_split >> 8,
+    0x60, 0x02, 
+    0x24, MP_QSTR_op_basename & 0xff, MP_QSTR_op_basename >> 8,
+    0x14, 0x83, 0x7f, 
+    0x50, 0x01, 
+    0x18, 
+    0x61, 0x03, 
+    0x24, MP_QSTR__makedirs & 0xff, MP_QSTR__makedirs >> 8,
+    0x60, 0x04, 
+    0x24, MP_QSTR_save_file & 0xff, MP_QSTR_save_file >> 8,
+    0x60, 0x05, 
+    0x24, MP_QSTR_install_tar & 0xff, MP_QSTR_install_tar >> 8,
+    0x60, 0x06, 
+    0x24, MP_QSTR_expandhome & 0xff, MP_QSTR_expandhome >> 8,
+    0x80, 
+    0x11, 
+    0x68, MP_QSTR_ussl & 0xff, MP_QSTR_ussl >> 8,
+    0x24, MP_QSTR_ussl & 0xff, MP_QSTR_ussl >> 8,
+    0x80, 
+    0x11, 
+    0x68, MP_QSTR_usocket & 0xff, MP_QSTR_usocket >> 8,
+    0x24, MP_QSTR_usocket & 0xff, MP_QSTR_usocket >> 8,
+    0x12, 
+    0x25, MP_QSTR_warn_ussl & 0xff, MP_QSTR_warn_ussl >> 8,
+    0x60, 0x07, 
+    0x24, MP_QSTR_url_open & 0xff, MP_QSTR_url_open >> 8,
+    0x60, 0x08, 
+    0x24, MP_QSTR_get_pkg_metadata & 0xff, MP_QSTR_get_pkg_metadata >> 8,
+    0x11, 
+    0x50, 0x01, 
+    0x18, 
+    0x61, 0x09, 
+    0x24, MP_QSTR_fatal & 0xff, MP_QSTR_fatal >> 8,
+    0x60, 0x0a, 
+    0x24, MP_QSTR_install_pkg & 0xff, MP_QSTR_install_pkg >> 8,
+    0x11, 
+    0x50, 0x01, 
+    0x18, 
+    0x61, 0x0b, 
+    0x24, MP_QSTR_install & 0xff, MP_QSTR_install >> 8,
+    0x60, 0x0c, 
+    0x24, MP_QSTR_get_install_path & 0xff, MP_QSTR_get_install_path >> 8,
+    0x60, 0x0d, 
+    0x24, MP_QSTR_cleanup & 0xff, MP_QSTR_cleanup >> 8,
+    0x60, 0x0e, 
+    0x24, MP_QSTR_help & 0xff, MP_QSTR_help >> 8,
+    0x60, 0x0f, 
+    0x24, MP_QSTR_main & 0xff, MP_QSTR_main >> 8,
+    0x1b, MP_QSTR___name__ & 0xff, MP_QSTR___name__ >> 8,
+    0x16, MP_QSTR___main__ & 0xff, MP_QSTR___main__ >> 8,
+    0x4b, 0x02, 0x07, 0x80, 
+    0x1b, MP_QSTR_main & 0xff, MP_QSTR_main >> 8,
+    0x64, 0x00, 
+    0x32, 
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip__lt_module_gt_[16] = {
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__NotFoundError),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__op_split),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__op_basename),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt___makedirs),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__save_file),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__install_tar),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__expandhome),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__url_open),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__get_pkg_metadata),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__fatal),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__install_pkg),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__install),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__get_install_path),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__cleanup),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__help),
+    MP_ROM_PTR(&raw_code_upip__lt_module_gt__main),
+};
+const mp_raw_code_t raw_code_upip__lt_module_gt_ = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 0,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip__lt_module_gt_,
+        .const_table = (mp_uint_t*)const_table_data_upip__lt_module_gt_,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 302,
+        .n_obj = 0,
+        .n_raw_code = 16,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__roundup
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__roundup[29] = {
+    0x05, 0x00, 0x00, 0x02, 0x00, 0x00, 0x09,
+    MP_QSTR_roundup & 0xff, MP_QSTR_roundup >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x81, 0x0c, 0x00, 0x00, 0xff,
+    0x48, 0x01, 
+    0xf1, 
+    0x49, 0x1b, 0x01, 
+    0xb1, 
+    0x49, 0x1b, 0x01, 
+    0xd2, 
+    0xee, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__roundup[2] = {
+    MP_ROM_QSTR(MP_QSTR_val),
+    MP_ROM_QSTR(MP_QSTR_align),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__roundup = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 2,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__roundup,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__roundup,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 29,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__FileSection___init__
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__FileSection___init__[40] = {
+    0x06, 0x00, 0x00, 0x04, 0x00, 0x00, 0x0b,
+    MP_QSTR___init__ & 0xff, MP_QSTR___init__ >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x81, 0x11, 0x26, 0x26, 0x00, 0x00, 0xff,
+    0x48, 0x10, 
+    0x26, MP_QSTR_f & 0xff, MP_QSTR_f >> 8,
+    0x48, 0x20, 
+    0x26, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0x48, 0x32, 
+    0xf2, 
+    0xb0, 
+    0x26, MP_QSTR_align & 0xff, MP_QSTR_align >> 8,
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__FileSection___init__[4] = {
+    MP_ROM_QSTR(MP_QSTR_self),
+    MP_ROM_QSTR(MP_QSTR_f),
+    MP_ROM_QSTR(MP_QSTR_content_len),
+    MP_ROM_QSTR(MP_QSTR_aligned_len),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__FileSection___init__ = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 4,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__FileSection___init__,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__FileSection___init__,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 40,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__FileSection_read
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__FileSection_read[89] = {
+    0x06, 0x00, 0x00, 0x02, 0x00, 0x01, 0x10,
+    MP_QSTR_read & 0xff, MP_QSTR_read >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x81, 0x16, 0x2b, 0x23, 0x2a, 0x26, 0x2d, 0x28, 0x2d, 0x00, 0x00, 0xff,
+    0xb0, 
+    0x1d, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0x49, 0x02, 0x00, 
+    0x37, 0x03, 0x80, 
+    0x17, 0x02, 
+    0x5b, 
+    0x48, 0x10, 
+    0x1d, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0x4b, 0x01, 0x06, 0x80, 
+    0xb0, 
+    0x1d, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0xc1, 
+    0xb0, 
+    0x1d, MP_QSTR_f & 0xff, MP_QSTR_f >> 8,
+    0x1e, MP_QSTR_read & 0xff, MP_QSTR_read >> 8,
+    0xb1, 
+    0x66, 0x01, 
+    0xc2, 
+    0x1c, MP_QSTR_len & 0xff, MP_QSTR_len >> 8,
+    0xb2, 
+    0x64, 0x01, 
+    0xc1, 
+    0xb0, 
+    0x30, 
+    0x1d, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0xb1, 
+    0xe6, 
+    0x33, 
+    0x26, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0xb2, 
+    0x5b, 
+};
+STATIC const mp_obj_str_t const_obj_upip_utarfile__lt_module_gt__FileSection_read_0 = {{&mp_type_bytes}, 5381, 0, (const byte*)""};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__FileSection_read[3] = {
+    MP_ROM_QSTR(MP_QSTR_self),
+    MP_ROM_QSTR(MP_QSTR_sz),
+    MP_ROM_PTR(&const_obj_upip_utarfile__lt_module_gt__FileSection_read_0),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__FileSection_read = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 2,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__FileSection_read,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__FileSection_read,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 89,
+        .n_obj = 1,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__FileSection_readinto
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__FileSection_readinto[96] = {
+    0x06, 0x00, 0x00, 0x02, 0x00, 0x00, 0x0f,
+    MP_QSTR_readinto & 0xff, MP_QSTR_readinto >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x81, 0x20, 0x2b, 0x22, 0x30, 0x31, 0x2d, 0x2d, 0x00, 0x00, 0xff,
+    0xb0, 
+    0x1d, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0x49, 0x02, 0x00, 
+    0x37, 0x02, 0x80, 
+    0x80, 
+    0x5b, 
+    0x1c, MP_QSTR_len & 0xff, MP_QSTR_len >> 8,
+    0xb1, 
+    0x64, 0x01, 
+    0xb0, 
+    0x1d, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0x4b, 0x01, 0x11, 0x80, 
+    0x1c, MP_QSTR_memoryview & 0xff, MP_QSTR_memoryview >> 8,
+    0xb1, 
+    0x64, 0x01, 
+    0x11, 
+    0xb0, 
+    0x1d, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0x58, 0x02, 
+    0x21, 
+    0xc1, 
+    0xb0, 
+    0x1d, MP_QSTR_f & 0xff, MP_QSTR_f >> 8,
+    0x1e, MP_QSTR_readinto & 0xff, MP_QSTR_readinto >> 8,
+    0xb1, 
+    0x66, 0x01, 
+    0xc2, 
+    0xb0, 
+    0x30, 
+    0x1d, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0xb2, 
+    0xe6, 
+    0x33, 
+    0x26, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0xb2, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__FileSection_readinto[2] = {
+    MP_ROM_QSTR(MP_QSTR_self),
+    MP_ROM_QSTR(MP_QSTR_buf),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__FileSection_readinto = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 2,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__FileSection_readinto,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__FileSection_readinto,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 96,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__FileSection_skip
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__FileSection_skip[82] = {
+    0x08, 0x00, 0x00, 0x01, 0x00, 0x00, 0x0f,
+    MP_QSTR_skip & 0xff, MP_QSTR_skip >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x81, 0x29, 0x2c, 0x24, 0x28, 0x23, 0x29, 0x2e, 0x00, 0x00, 0xff,
+    0xb0, 
+    0x1d, MP_QSTR_content_len & 0xff, MP_QSTR_content_len >> 8,
+    0xb0, 
+    0x1d, MP_QSTR_align & 0xff, MP_QSTR_align >> 8,
+    0xf1, 
+    0xc1, 
+    0xb1, 
+    0x37, 0x2a, 0x80, 
+    0x1c, MP_QSTR_bytearray & 0xff, MP_QSTR_bytearray >> 8,
+    0x90, 
+    0x64, 0x01, 
+    0xc2, 
+    0x35, 0x1b, 0x80, 
+    0x1c, MP_QSTR_min & 0xff, MP_QSTR_min >> 8,
+    0xb1, 
+    0x90, 
+    0x64, 0x02, 
+    0xc3, 
+    0xb0, 
+    0x1d, MP_QSTR_f & 0xff, MP_QSTR_f >> 8,
+    0x1e, MP_QSTR_readinto & 0xff, MP_QSTR_readinto >> 8,
+    0x48, 0x23, 
+    0x66, 0x02, 
+    0x32, 
+    0x48, 0x13, 
+    0xe6, 
+    0xc1, 
+    0xb1, 
+    0x36, 0xe1, 0x7f, 
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__FileSection_skip[1] = {
+    MP_ROM_QSTR(MP_QSTR_self),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__FileSection_skip = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 1,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__FileSection_skip,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__FileSection_skip,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 82,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__FileSection
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__FileSection[64] = {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f,
+    MP_QSTR_FileSection & 0xff, MP_QSTR_FileSection >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x8e, 0x10, 0x65, 0x40, 0x8c, 0x0a, 0x85, 0x09, 0x00, 0x00, 0xff,
+    0x1b, MP_QSTR___name__ & 0xff, MP_QSTR___name__ >> 8,
+    0x24, MP_QSTR___module__ & 0xff, MP_QSTR___module__ >> 8,
+    0x16, MP_QSTR_FileSection & 0xff, MP_QSTR_FileSection >> 8,
+    0x24, MP_QSTR___qualname__ & 0xff, MP_QSTR___qualname__ >> 8,
+    0x60, 0x00, 
+    0x24, MP_QSTR___init__ & 0xff, MP_QSTR___init__ >> 8,
+    0x14, 0x84, 0x80, 0x00, 
+    0x50, 0x01, 
+    0x18, 
+    0x61, 0x01, 
+    0x24, MP_QSTR_read & 0xff, MP_QSTR_read >> 8,
+    0x60, 0x02, 
+    0x24, MP_QSTR_readinto & 0xff, MP_QSTR_readinto >> 8,
+    0x60, 0x03, 
+    0x24, MP_QSTR_skip & 0xff, MP_QSTR_skip >> 8,
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__FileSection[4] = {
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__FileSection___init__),
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__FileSection_read),
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__FileSection_readinto),
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__FileSection_skip),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__FileSection = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 0,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__FileSection,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__FileSection,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 64,
+        .n_obj = 0,
+        .n_raw_code = 4,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__TarInfo___str__
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__TarInfo___str__[37] = {
+    0x05, 0x00, 0x00, 0x01, 0x00, 0x00, 0x09,
+    MP_QSTR___str__ & 0xff, MP_QSTR___str__ >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x81, 0x34, 0x00, 0x00, 0xff,
+    0x17, 0x01, 
+    0xb0, 
+    0x1d, MP_QSTR_name & 0xff, MP_QSTR_name >> 8,
+    0xb0, 
+    0x1d, MP_QSTR_type & 0xff, MP_QSTR_type >> 8,
+    0xb0, 
+    0x1d, MP_QSTR_size & 0xff, MP_QSTR_size >> 8,
+    0x50, 0x03, 
+    0xf6, 
+    0x5b, 
+};
+STATIC const mp_obj_str_t const_obj_upip_utarfile__lt_module_gt__TarInfo___str___0 = {{&mp_type_str}, 62189, 19, (const byte*)"\x54\x61\x72\x49\x6e\x66\x6f\x28\x25\x72\x2c\x20\x25\x73\x2c\x20\x25\x64\x29"};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__TarInfo___str__[2] = {
+    MP_ROM_QSTR(MP_QSTR_self),
+    MP_ROM_PTR(&const_obj_upip_utarfile__lt_module_gt__TarInfo___str___0),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__TarInfo___str__ = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 1,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__TarInfo___str__,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__TarInfo___str__,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 37,
+        .n_obj = 1,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__TarInfo
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__TarInfo[36] = {
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x09,
+    MP_QSTR_TarInfo & 0xff, MP_QSTR_TarInfo >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x8e, 0x33, 0x00, 0x00, 0xff,
+    0x1b, MP_QSTR___name__ & 0xff, MP_QSTR___name__ >> 8,
+    0x24, MP_QSTR___module__ & 0xff, MP_QSTR___module__ >> 8,
+    0x16, MP_QSTR_TarInfo & 0xff, MP_QSTR_TarInfo >> 8,
+    0x24, MP_QSTR___qualname__ & 0xff, MP_QSTR___qualname__ >> 8,
+    0x60, 0x00, 
+    0x24, MP_QSTR___str__ & 0xff, MP_QSTR___str__ >> 8,
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__TarInfo[1] = {
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__TarInfo___str__),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__TarInfo = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 0,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__TarInfo,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__TarInfo,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 36,
+        .n_obj = 0,
+        .n_raw_code = 1,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__TarFile___init__
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__TarFile___init__[55] = {
+    0x06, 0x00, 0x00, 0x03, 0x00, 0x02, 0x0c,
+    MP_QSTR___init__ & 0xff, MP_QSTR___init__ >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x81, 0x39, 0x24, 0x49, 0x2f, 0x00, 0x00, 0xff,
+    0xb2, 
+    0x37, 0x09, 0x80, 
+    0x48, 0x20, 
+    0x26, MP_QSTR_f & 0xff, MP_QSTR_f >> 8,
+    0x35, 0x0f, 0x80, 
+    0x1c, MP_QSTR_open & 0xff, MP_QSTR_open >> 8,
+    0xb1, 
+    0x16, MP_QSTR_rb & 0xff, MP_QSTR_rb >> 8,
+    0x64, 0x02, 
+    0xb0, 
+    0x26, MP_QSTR_f & 0xff, MP_QSTR_f >> 8,
+    0x11, 
+    0xb0, 
+    0x26, MP_QSTR_subf & 0xff, MP_QSTR_subf >> 8,
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__TarFile___init__[3] = {
+    MP_ROM_QSTR(MP_QSTR_self),
+    MP_ROM_QSTR(MP_QSTR_name),
+    MP_ROM_QSTR(MP_QSTR_fileobj),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__TarFile___init__ = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 3,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__TarFile___init__,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__TarFile___init__,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 55,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__TarFile_next
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__TarFile_next[249] = {
+    0x0a, 0x00, 0x00, 0x01, 0x00, 0x00, 0x18,
+    MP_QSTR_next & 0xff, MP_QSTR_next >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x81, 0x40, 0x28, 0x2c, 0x2f, 0x24, 0x42, 0x1f, 0x63, 0x2d, 0x42, 0x27, 0x3c, 0x37, 0x3b, 0x1f, 0x2a, 0x00, 0x00, 0xff,
+    0xb0, 
+    0x1d, MP_QSTR_subf & 0xff, MP_QSTR_subf >> 8,
+    0x37, 0x0c, 0x80, 
+    0xb0, 
+    0x1d, MP_QSTR_subf & 0xff, MP_QSTR_subf >> 8,
+    0x1e, MP_QSTR_skip & 0xff, MP_QSTR_skip >> 8,
+    0x66, 0x00, 
+    0x32, 
+    0xb0, 
+    0x1d, MP_QSTR_f & 0xff, MP_QSTR_f >> 8,
+    0x1e, MP_QSTR_read & 0xff, MP_QSTR_read >> 8,
+    0x14, 0x84, 0x00, 
+    0x66, 0x01, 
+    0xc1, 
+    0xb1, 
+    0x36, 0x02, 0x80, 
+    0x11, 
+    0x5b, 
+    0x1c, MP_QSTR_uctypes & 0xff, MP_QSTR_uctypes >> 8,
+    0x1e, MP_QSTR_struct & 0xff, MP_QSTR_struct >> 8,
+    0x1c, MP_QSTR_uctypes & 0xff, MP_QSTR_uctypes >> 8,
+    0x1e, MP_QSTR_addressof & 0xff, MP_QSTR_addressof >> 8,
+    0xb1, 
+    0x66, 0x01, 
+    0x1c, MP_QSTR_TAR_HEADER & 0xff, MP_QSTR_TAR_HEADER >> 8,
+    0x1c, MP_QSTR_uctypes & 0xff, MP_QSTR_uctypes >> 8,
+    0x1d, MP_QSTR_LITTLE_ENDIAN & 0xff, MP_QSTR_LITTLE_ENDIAN >> 8,
+    0x66, 0x03, 
+    0xc2, 
+    0xb2, 
+    0x1d, MP_QSTR_name & 0xff, MP_QSTR_name >> 8,
+    0x80, 
+    0x21, 
+    0x49, 0x02, 0x00, 
+    0x37, 0x02, 0x80, 
+    0x11, 
+    0x5b, 
+    0x1c, MP_QSTR_TarInfo & 0xff, MP_QSTR_TarInfo >> 8,
+    0x64, 0x00, 
+    0xc3, 
+    0x1c, MP_QSTR_str & 0xff, MP_QSTR_str >> 8,
+    0xb2, 
+    0x1d, MP_QSTR_name & 0xff, MP_QSTR_name >> 8,
+    0x16, MP_QSTR_utf_hyphen_8 & 0xff, MP_QSTR_utf_hyphen_8 >> 8,
+    0x64, 0x02, 
+    0x1e, MP_QSTR_rstrip & 0xff, MP_QSTR_rstrip >> 8,
+    0x16, MP_QSTR__0x00_ & 0xff, MP_QSTR__0x00_ >> 8,
+    0x66, 0x01, 
+    0xb3, 
+    0x26, MP_QSTR_name & 0xff, MP_QSTR_name >> 8,
+    0x1c, MP_QSTR_int & 0xff, MP_QSTR_int >> 8,
+    0x1c, MP_QSTR_bytes & 0xff, MP_QSTR_bytes >> 8,
+    0xb2, 
+    0x1d, MP_QSTR_size & 0xff, MP_QSTR_size >> 8,
+    0x64, 0x01, 
+    0x88, 
+    0x64, 0x02, 
+    0xb3, 
+    0x26, MP_QSTR_size & 0xff, MP_QSTR_size >> 8,
+    0x1c, MP_QSTR_REGTYPE & 0xff, MP_QSTR_REGTYPE >> 8,
+    0x1c, MP_QSTR_DIRTYPE & 0xff, MP_QSTR_DIRTYPE >> 8,
+    0x51, 0x02, 
+    0xb3, 
+    0x1d, MP_QSTR_name & 0xff, MP_QSTR_name >> 8,
+    0x7f, 
+    0x21, 
+    0x16, MP_QSTR__slash_ & 0xff, MP_QSTR__slash_ >> 8,
+    0xd9, 
+    0x21, 
+    0xb3, 
+    0x26, MP_QSTR_type & 0xff, MP_QSTR_type >> 8,
+    0x1c, MP_QSTR_FileSection & 0xff, MP_QSTR_FileSection >> 8,
+    0xb0, 
+    0x1d, MP_QSTR_f & 0xff, MP_QSTR_f >> 8,
+    0xb3, 
+    0x1d, MP_QSTR_size & 0xff, MP_QSTR_size >> 8,
+    0x1c, MP_QSTR_roundup & 0xff, MP_QSTR_roundup >> 8,
+    0xb3, 
+    0x1d, MP_QSTR_size & 0xff, MP_QSTR_size >> 8,
+    0x14, 0x84, 0x00, 
+    0x64, 0x02, 
+    0x64, 0x03, 
+    0x30, 
+    0xb0, 
+    0x26, MP_QSTR_subf & 0xff, MP_QSTR_subf >> 8,
+    0xb3, 
+    0x26, MP_QSTR_subf & 0xff, MP_QSTR_subf >> 8,
+    0xb3, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__TarFile_next[1] = {
+    MP_ROM_QSTR(MP_QSTR_self),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__TarFile_next = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 1,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__TarFile_next,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__TarFile_next,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 249,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__TarFile___iter__
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__TarFile___iter__[18] = {
+    0x02, 0x00, 0x00, 0x01, 0x00, 0x00, 0x09,
+    MP_QSTR___iter__ & 0xff, MP_QSTR___iter__ >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x81, 0x54, 0x00, 0x00, 0xff,
+    0xb0, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__TarFile___iter__[1] = {
+    MP_ROM_QSTR(MP_QSTR_self),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__TarFile___iter__ = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 1,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__TarFile___iter__,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__TarFile___iter__,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 18,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__TarFile___next__
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__TarFile___next__[41] = {
+    0x04, 0x00, 0x00, 0x01, 0x00, 0x00, 0x0c,
+    MP_QSTR___next__ & 0xff, MP_QSTR___next__ >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x81, 0x57, 0x28, 0x26, 0x26, 0x00, 0x00, 0xff,
+    0xb0, 
+    0x1e, MP_QSTR_next & 0xff, MP_QSTR_next >> 8,
+    0x66, 0x00, 
+    0xc1, 
+    0xb1, 
+    0x11, 
+    0x4b, 0x07, 0x06, 0x80, 
+    0x1c, MP_QSTR_StopIteration & 0xff, MP_QSTR_StopIteration >> 8,
+    0x5c, 0x01, 
+    0xb1, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__TarFile___next__[1] = {
+    MP_ROM_QSTR(MP_QSTR_self),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__TarFile___next__ = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 1,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__TarFile___next__,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__TarFile___next__,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 41,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__TarFile_extractfile
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__TarFile_extractfile[22] = {
+    0x03, 0x00, 0x00, 0x02, 0x00, 0x00, 0x09,
+    MP_QSTR_extractfile & 0xff, MP_QSTR_extractfile >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x81, 0x5d, 0x00, 0x00, 0xff,
+    0xb1, 
+    0x1d, MP_QSTR_subf & 0xff, MP_QSTR_subf >> 8,
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__TarFile_extractfile[2] = {
+    MP_ROM_QSTR(MP_QSTR_self),
+    MP_ROM_QSTR(MP_QSTR_tarinfo),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__TarFile_extractfile = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 2,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__TarFile_extractfile,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__TarFile_extractfile,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 22,
+        .n_obj = 0,
+        .n_raw_code = 0,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile__lt_module_gt__TarFile
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt__TarFile[68] = {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+    MP_QSTR_TarFile & 0xff, MP_QSTR_TarFile >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x8e, 0x38, 0x8a, 0x07, 0x85, 0x14, 0x65, 0x65, 0x60, 0x00, 0x00, 0xff,
+    0x1b, MP_QSTR___name__ & 0xff, MP_QSTR___name__ >> 8,
+    0x24, MP_QSTR___module__ & 0xff, MP_QSTR___module__ >> 8,
+    0x16, MP_QSTR_TarFile & 0xff, MP_QSTR_TarFile >> 8,
+    0x24, MP_QSTR___qualname__ & 0xff, MP_QSTR___qualname__ >> 8,
+    0x11, 
+    0x11, 
+    0x50, 0x02, 
+    0x18, 
+    0x61, 0x00, 
+    0x24, MP_QSTR___init__ & 0xff, MP_QSTR___init__ >> 8,
+    0x60, 0x01, 
+    0x24, MP_QSTR_next & 0xff, MP_QSTR_next >> 8,
+    0x60, 0x02, 
+    0x24, MP_QSTR___iter__ & 0xff, MP_QSTR___iter__ >> 8,
+    0x60, 0x03, 
+    0x24, MP_QSTR___next__ & 0xff, MP_QSTR___next__ >> 8,
+    0x60, 0x04, 
+    0x24, MP_QSTR_extractfile & 0xff, MP_QSTR_extractfile >> 8,
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt__TarFile[5] = {
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__TarFile___init__),
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__TarFile_next),
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__TarFile___iter__),
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__TarFile___next__),
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__TarFile_extractfile),
+};
+STATIC const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt__TarFile = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 0,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt__TarFile,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt__TarFile,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 68,
+        .n_obj = 0,
+        .n_raw_code = 5,
+        #endif
+    },
+};
+
+// frozen bytecode for file upip_utarfile.py, scope upip_utarfile_<module>
+STATIC byte bytecode_data_upip_utarfile__lt_module_gt_[149] = {
+    0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x13,
+    MP_QSTR__lt_module_gt_ & 0xff, MP_QSTR__lt_module_gt_ >> 8,
+    MP_QSTR_upip_utarfile_dot_py & 0xff, MP_QSTR_upip_utarfile_dot_py >> 8,
+    0x69, 0x22, 0x3d, 0x1f, 0x61, 0x26, 0x46, 0x65, 0x8b, 0x23, 0x6b, 0x40, 0x00, 0x00, 0xff,
+    0x80, 
+    0x11, 
+    0x68, MP_QSTR_uctypes & 0xff, MP_QSTR_uctypes >> 8,
+    0x24, MP_QSTR_uctypes & 0xff, MP_QSTR_uctypes >> 8,
+    0x53, 0x02, 
+    0x1b, MP_QSTR_uctypes & 0xff, MP_QSTR_uctypes >> 8,
+    0x1d, MP_QSTR_ARRAY & 0xff, MP_QSTR_ARRAY >> 8,
+    0x49, 0x15, 0x00, 
+    0x1b, MP_QSTR_uctypes & 0xff, MP_QSTR_uctypes >> 8,
+    0x1d, MP_QSTR_UINT8 & 0xff, MP_QSTR_UINT8 >> 8,
+    0x14, 0x80, 0x64, 
+    0xec, 
+    0x50, 0x02, 
+    0x16, MP_QSTR_name & 0xff, MP_QSTR_name >> 8,
+    0x54, 
+    0x1b, MP_QSTR_uctypes & 0xff, MP_QSTR_uctypes >> 8,
+    0x1d, MP_QSTR_ARRAY & 0xff, MP_QSTR_ARRAY >> 8,
+    0x14, 0x80, 0x7c, 
+    0xec, 
+    0x1b, MP_QSTR_uctypes & 0xff, MP_QSTR_uctypes >> 8,
+    0x1d, MP_QSTR_UINT8 & 0xff, MP_QSTR_UINT8 >> 8,
+    0x49, 0x15, 0x0b, 
+    0x50, 0x02, 
+    0x16, MP_QSTR_size & 0xff, MP_QSTR_size >> 8,
+    0x54, 
+    0x24, MP_QSTR_TAR_HEADER & 0xff, MP_QSTR_TAR_HEADER >> 8,
+    0x16, MP_QSTR_dir & 0xff, MP_QSTR_dir >> 8,
+    0x24, MP_QSTR_DIRTYPE & 0xff, MP_QSTR_DIRTYPE >> 8,
+    0x16, MP_QSTR_file & 0xff, MP_QSTR_file >> 8,
+    0x24, MP_QSTR_REGTYPE & 0xff, MP_QSTR_REGTYPE >> 8,
+    0x60, 0x00, 
+    0x24, MP_QSTR_roundup & 0xff, MP_QSTR_roundup >> 8,
+    0x20, 
+    0x60, 0x01, 
+    0x16, MP_QSTR_FileSection & 0xff, MP_QSTR_FileSection >> 8,
+    0x64, 0x02, 
+    0x24, MP_QSTR_FileSection & 0xff, MP_QSTR_FileSection >> 8,
+    0x20, 
+    0x60, 0x02, 
+    0x16, MP_QSTR_TarInfo & 0xff, MP_QSTR_TarInfo >> 8,
+    0x64, 0x02, 
+    0x24, MP_QSTR_TarInfo & 0xff, MP_QSTR_TarInfo >> 8,
+    0x20, 
+    0x60, 0x03, 
+    0x16, MP_QSTR_TarFile & 0xff, MP_QSTR_TarFile >> 8,
+    0x64, 0x02, 
+    0x24, MP_QSTR_TarFile & 0xff, MP_QSTR_TarFile >> 8,
+    0x11, 
+    0x5b, 
+};
+STATIC const mp_rom_obj_t const_table_data_upip_utarfile__lt_module_gt_[4] = {
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__roundup),
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__FileSection),
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__TarInfo),
+    MP_ROM_PTR(&raw_code_upip_utarfile__lt_module_gt__TarFile),
+};
+const mp_raw_code_t raw_code_upip_utarfile__lt_module_gt_ = {
+    .kind = MP_CODE_BYTECODE,
+    .scope_flags = 0x00,
+    .n_pos_args = 0,
+    .data.u_byte = {
+        .bytecode = bytecode_data_upip_utarfile__lt_module_gt_,
+        .const_table = (mp_uint_t*)const_table_data_upip_utarfile__lt_module_gt_,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        .bc_len = 149,
+        .n_obj = 0,
+        .n_raw_code = 4,
+        #endif
+    },
+};
+
+const char mp_frozen_mpy_names[] = {
+"upip.py\0"
+"upip_utarfile.py\0"
+"\0"};
+const mp_raw_code_t *const mp_frozen_mpy_content[] = {
+    &raw_code_upip__lt_module_gt_,
+    &raw_code_upip_utarfile__lt_module_gt_,
+};
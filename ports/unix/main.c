@@ -45,6 +45,7 @@
 #include "py/stackctrl.h"
 #include "py/mphal.h"
 #include "py/mpthread.h"
+#include "py/bc.h"
 #include "extmod/misc.h"
 #include "genhdr/mpversion.h"
 #include "input.h"
@@ -52,11 +53,23 @@
 // Command line options, with their defaults
 STATIC bool compile_only = false;
 STATIC uint emit_opt = MP_EMIT_OPT_NONE;
+#if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+STATIC bool alloc_trace = false;
+#endif
+#if MICROPY_VM_STATS
+STATIC bool vm_stats = false;
+#endif
+#if MICROPY_EMIT_NATIVE_TIERING
+STATIC mp_uint_t native_tier_threshold = MICROPY_EMIT_NATIVE_TIERING_THRESHOLD;
+#endif
 
 #if MICROPY_ENABLE_GC
 // Heap size of GC heap (if enabled)
 // Make it larger on a 64 bit machine, because pointers are larger.
 long heap_size = 1024*1024 * (sizeof(mp_uint_t) / 4);
+#if MICROPY_GC_SPLIT_HEAP
+STATIC long heap_chunks = 1;
+#endif
 #endif
 
 STATIC void stderr_print_strn(void *env, const char *str, size_t len) {
@@ -319,6 +332,30 @@ STATIC int usage(char **argv) {
 , heap_size);
     impl_opts_cnt++;
 #endif
+#if MICROPY_GC_SPLIT_HEAP
+    printf(
+"  heapchunks=<n> -- split the heap into n separately allocated chunks\n"
+);
+    impl_opts_cnt++;
+#endif
+#if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+    printf(
+"  alloctrace -- print the heap allocations made by each source line on exit\n"
+);
+    impl_opts_cnt++;
+#endif
+#if MICROPY_VM_STATS
+    printf(
+"  vmstats -- print the counts of executed opcodes on exit\n"
+);
+    impl_opts_cnt++;
+#endif
+#if MICROPY_EMIT_NATIVE_TIERING
+    printf(
+"  tier=<n> -- run bytecode functions as native code after n calls or loops (0 = never)\n"
+);
+    impl_opts_cnt++;
+#endif
 
     if (impl_opts_cnt == 0) {
         printf("  (none)\n");
@@ -377,6 +414,30 @@ STATIC void pre_process_options(int argc, char **argv) {
                     if (heap_size < 700) {
                         goto invalid_arg;
                     }
+#endif
+#if MICROPY_GC_SPLIT_HEAP
+                } else if (strncmp(argv[a + 1], "heapchunks=", sizeof("heapchunks=") - 1) == 0) {
+                    char *end;
+                    heap_chunks = strtol(argv[a + 1] + sizeof("heapchunks=") - 1, &end, 0);
+                    if (*end != 0 || heap_chunks < 1) {
+                        goto invalid_arg;
+                    }
+#endif
+#if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+                } else if (strcmp(argv[a + 1], "alloctrace") == 0) {
+                    alloc_trace = true;
+#endif
+#if MICROPY_VM_STATS
+                } else if (strcmp(argv[a + 1], "vmstats") == 0) {
+                    vm_stats = true;
+#endif
+#if MICROPY_EMIT_NATIVE_TIERING
+                } else if (strncmp(argv[a + 1], "tier=", sizeof("tier=") - 1) == 0) {
+                    char *end;
+                    native_tier_threshold = strtol(argv[a + 1] + sizeof("tier=") - 1, &end, 0);
+                    if (*end != 0) {
+                        goto invalid_arg;
+                    }
 #endif
                 } else {
 invalid_arg:
@@ -436,12 +497,35 @@ MP_NOINLINE int main_(int argc, char **argv) {
     pre_process_options(argc, argv);
 
 #if MICROPY_ENABLE_GC
+    #if MICROPY_GC_SPLIT_HEAP
+    // Each chunk is a separate allocation, so in general they are not
+    // contiguous and the GC has to manage them as distinct areas.
+    long chunk_size = heap_size / heap_chunks;
+    char **heap_chunk = malloc(heap_chunks * sizeof(char*));
+    char *heap = heap_chunk[0] = malloc(chunk_size);
+    gc_init(heap, heap + chunk_size);
+    for (long i = 1; i < heap_chunks; i++) {
+        heap_chunk[i] = malloc(chunk_size);
+        gc_add(heap_chunk[i], heap_chunk[i] + chunk_size);
+    }
+    #else
     char *heap = malloc(heap_size);
     gc_init(heap, heap + heap_size);
+    #endif
 #endif
 
     mp_init();
 
+    #if MICROPY_EMIT_NATIVE_TIERING
+    MP_STATE_VM(native_tier_threshold) = native_tier_threshold;
+    #endif
+
+    #if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+    if (alloc_trace) {
+        m_alloc_trace_start();
+    }
+    #endif
+
     char *home = getenv("HOME");
     char *path = getenv("MICROPYPATH");
     if (path == NULL) {
@@ -628,12 +712,31 @@ MP_NOINLINE int main_(int argc, char **argv) {
     }
     #endif
 
+    #if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+    if (alloc_trace) {
+        m_alloc_trace_dump(&mp_stderr_print);
+    }
+    #endif
+
+    #if MICROPY_VM_STATS
+    if (vm_stats) {
+        mp_vm_stats_dump(&mp_stderr_print);
+    }
+    #endif
+
     mp_deinit();
 
 #if MICROPY_ENABLE_GC && !defined(NDEBUG)
     // We don't really need to free memory since we are about to exit the
     // process, but doing so helps to find memory leaks.
+    #if MICROPY_GC_SPLIT_HEAP
+    for (long i = 0; i < heap_chunks; i++) {
+        free(heap_chunk[i]);
+    }
+    free(heap_chunk);
+    #else
     free(heap);
+    #endif
 #endif
 
     //printf("total bytes = %d\n", m_get_total_bytes_allocated());
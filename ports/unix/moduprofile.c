@@ -0,0 +1,227 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "py/runtime.h"
+#include "py/bc.h"
+#include "py/stream.h"
+
+#if MICROPY_PY_UPROFILE
+
+#if !MICROPY_TRACK_CODE_STATE
+#error uprofile requires MICROPY_TRACK_CODE_STATE
+#endif
+
+// A statistical profiler: SIGPROF interrupts the program at a regular interval
+// of CPU time and the handler records the bytecode call stack of the thread it
+// interrupted.  The handler can't allocate, so the samples go into a fixed ring
+// buffer and are only turned into Python objects by uprofile.collect().
+
+#define UPROFILE_MAX_DEPTH (16)
+
+typedef struct _uprofile_frame_t {
+    qstr block_name;
+    qstr source_file;
+    size_t line;
+} uprofile_frame_t;
+
+typedef struct _uprofile_sample_t {
+    volatile bool ready;
+    bool truncated;
+    uint8_t depth;
+    // innermost frame first
+    uprofile_frame_t frames[UPROFILE_MAX_DEPTH];
+} uprofile_sample_t;
+
+// The handler may run in any thread, so slots are claimed atomically.  Only
+// qstrs are stored, so a sample stays valid after its functions are freed.
+STATIC uprofile_sample_t uprofile_ring[MICROPY_PY_UPROFILE];
+STATIC size_t uprofile_head;
+STATIC size_t uprofile_tail;
+STATIC size_t uprofile_dropped;
+
+STATIC void uprofile_sighandler(int signum) {
+    (void)signum;
+    #if MICROPY_PY_THREAD
+    // the signal may be delivered to a thread that isn't running Python
+    mp_state_thread_t *ts = mp_thread_get_state();
+    if (ts == NULL) {
+        return;
+    }
+    const mp_code_state_t *code_state = ts->current_code_state;
+    #else
+    const mp_code_state_t *code_state = MP_STATE_THREAD(current_code_state);
+    #endif
+    if (code_state == NULL) {
+        return;
+    }
+
+    size_t head = __atomic_load_n(&uprofile_head, __ATOMIC_RELAXED);
+    if (head - __atomic_load_n(&uprofile_tail, __ATOMIC_ACQUIRE) >= MICROPY_PY_UPROFILE
+        || !__atomic_compare_exchange_n(&uprofile_head, &head, head + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&uprofile_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uprofile_sample_t *s = &uprofile_ring[head % MICROPY_PY_UPROFILE];
+    size_t depth = 0;
+    for (; code_state != NULL && depth < UPROFILE_MAX_DEPTH; code_state = code_state->prev, ++depth) {
+        uprofile_frame_t *f = &s->frames[depth];
+        f->line = mp_bytecode_get_source_line(code_state->fun_bc->bytecode, code_state->ip,
+            &f->block_name, &f->source_file);
+    }
+    s->depth = depth;
+    s->truncated = code_state != NULL;
+    __atomic_store_n(&s->ready, true, __ATOMIC_RELEASE);
+}
+
+STATIC mp_obj_t uprofile_counts(void) {
+    if (MP_STATE_PORT(uprofile_counts) == MP_OBJ_NULL) {
+        MP_STATE_PORT(uprofile_counts) = mp_obj_new_dict(0);
+    }
+    return MP_STATE_PORT(uprofile_counts);
+}
+
+STATIC void uprofile_count(mp_obj_t counts, mp_obj_t key, size_t n) {
+    mp_map_elem_t *elem = mp_map_lookup(mp_obj_dict_get_map(counts), key, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+    if (elem->value == MP_OBJ_NULL) {
+        elem->value = MP_OBJ_NEW_SMALL_INT(0);
+    }
+    elem->value = MP_OBJ_NEW_SMALL_INT(MP_OBJ_SMALL_INT_VALUE(elem->value) + n);
+}
+
+STATIC mp_obj_t mod_uprofile_start(size_t n_args, const mp_obj_t *args) {
+    mp_int_t period_us = 1000;
+    if (n_args > 0) {
+        period_us = mp_obj_get_int(args[0]);
+    }
+    if (period_us <= 0) {
+        mp_raise_ValueError(NULL);
+    }
+
+    struct sigaction sa;
+    sa.sa_handler = uprofile_sighandler;
+    sigemptyset(&sa.sa_mask);
+    // restart interrupted system calls so the program doesn't see the signal
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &sa, NULL);
+
+    struct itimerval it;
+    it.it_interval.tv_sec = period_us / 1000000;
+    it.it_interval.tv_usec = period_us % 1000000;
+    it.it_value = it.it_interval;
+    setitimer(ITIMER_PROF, &it, NULL);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_uprofile_start_obj, 0, 1, mod_uprofile_start);
+
+STATIC mp_obj_t mod_uprofile_stop(void) {
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, NULL);
+    // a signal may still be pending, and its default action is to terminate
+    signal(SIGPROF, SIG_IGN);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_uprofile_stop_obj, mod_uprofile_stop);
+
+// Move the samples from the ring buffer into a dict which maps each distinct
+// stack, in collapsed format (outermost frame first, separated by ';'), to the
+// number of times it was seen.
+STATIC mp_obj_t mod_uprofile_collect(void) {
+    mp_obj_t counts = uprofile_counts();
+    vstr_t vstr;
+    mp_print_t print;
+    vstr_init_print(&vstr, 128, &print);
+    for (;;) {
+        size_t tail = uprofile_tail;
+        uprofile_sample_t *s = &uprofile_ring[tail % MICROPY_PY_UPROFILE];
+        if (tail == __atomic_load_n(&uprofile_head, __ATOMIC_RELAXED)
+            || !__atomic_load_n(&s->ready, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        vstr_reset(&vstr);
+        if (s->truncated) {
+            vstr_add_str(&vstr, "...;");
+        }
+        for (size_t i = s->depth; i > 0; --i) {
+            const uprofile_frame_t *f = &s->frames[i - 1];
+            mp_printf(&print, "%q (%q:%u)%s", f->block_name, f->source_file, (uint)f->line, i > 1 ? ";" : "");
+        }
+        s->ready = false;
+        __atomic_store_n(&uprofile_tail, tail + 1, __ATOMIC_RELEASE);
+        uprofile_count(counts, mp_obj_new_str(vstr.buf, vstr.len, false), 1);
+    }
+    vstr_clear(&vstr);
+
+    size_t dropped = __atomic_exchange_n(&uprofile_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped != 0) {
+        uprofile_count(counts, mp_obj_new_str("<dropped>", 9, false), dropped);
+    }
+    return counts;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_uprofile_collect_obj, mod_uprofile_collect);
+
+// Write the collected stacks in the "collapsed" format understood by
+// flamegraph.pl, one "stack count" line each, and start counting afresh.
+STATIC mp_obj_t mod_uprofile_dump(size_t n_args, const mp_obj_t *args) {
+    mp_print_t print = mp_plat_print;
+    if (n_args > 0) {
+        mp_get_stream_raise(args[0], MP_STREAM_OP_WRITE);
+        print.data = MP_OBJ_TO_PTR(args[0]);
+        print.print_strn = mp_stream_write_adaptor;
+    }
+    mp_map_t *map = mp_obj_dict_get_map(mod_uprofile_collect());
+    for (size_t i = 0; i < map->alloc; i++) {
+        if (MP_MAP_SLOT_IS_FILLED(map, i)) {
+            mp_printf(&print, "%s %d\n", mp_obj_str_get_str(map->table[i].key),
+                (int)MP_OBJ_SMALL_INT_VALUE(map->table[i].value));
+        }
+    }
+    MP_STATE_PORT(uprofile_counts) = MP_OBJ_NULL;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_uprofile_dump_obj, 0, 1, mod_uprofile_dump);
+
+STATIC const mp_rom_map_elem_t mp_module_uprofile_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_uprofile) },
+    { MP_ROM_QSTR(MP_QSTR_start), MP_ROM_PTR(&mod_uprofile_start_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stop), MP_ROM_PTR(&mod_uprofile_stop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_collect), MP_ROM_PTR(&mod_uprofile_collect_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dump), MP_ROM_PTR(&mod_uprofile_dump_obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(mp_module_uprofile_globals, mp_module_uprofile_globals_table);
+
+const mp_obj_module_t mp_module_uprofile = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&mp_module_uprofile_globals,
+};
+
+#endif // MICROPY_PY_UPROFILE
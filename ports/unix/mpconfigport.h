@@ -43,6 +43,12 @@
 #if !defined(MICROPY_EMIT_ARM) && defined(__arm__) && !defined(__thumb2__)
     #define MICROPY_EMIT_ARM        (1)
 #endif
+#ifndef MICROPY_EMIT_NATIVE_TIERING
+#define MICROPY_EMIT_NATIVE_TIERING (MICROPY_EMIT_X64 || MICROPY_EMIT_X86)
+#endif
+#ifndef MICROPY_EMIT_NATIVE_FLOAT
+#define MICROPY_EMIT_NATIVE_FLOAT   (1)
+#endif
 #define MICROPY_COMP_MODULE_CONST   (1)
 #define MICROPY_COMP_TRIPLE_TUPLE_ASSIGN (1)
 #define MICROPY_COMP_RETURN_IF_EXPR (1)
@@ -70,9 +76,31 @@
 #ifndef MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (1)
 #endif
+#if !defined(MICROPY_OPT_CLASS_LOOKUP_CACHE) && !(MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL)
+#define MICROPY_OPT_CLASS_LOOKUP_CACHE (256)
+#endif
+#ifndef MICROPY_OPT_MAP_LOOKUP_CACHE
+#define MICROPY_OPT_MAP_LOOKUP_CACHE (128)
+#endif
+#ifndef MICROPY_MAP_COMPACT
+#define MICROPY_MAP_COMPACT         (1)
+#endif
+#if !defined(MICROPY_OPT_INLINE_CACHE) && !(MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL)
+#define MICROPY_OPT_INLINE_CACHE    (128)
+#endif
+#ifndef MICROPY_OPT_SUPERINSTRUCTIONS
+#define MICROPY_OPT_SUPERINSTRUCTIONS (1)
+#endif
+#ifndef MICROPY_OPT_SMALL_INT_FAST_PATH
+#define MICROPY_OPT_SMALL_INT_FAST_PATH (1)
+#endif
+#ifndef MICROPY_QSTR_HASH_INDEX
+#define MICROPY_QSTR_HASH_INDEX     (1)
+#endif
 #define MICROPY_CAN_OVERRIDE_BUILTINS (1)
 #define MICROPY_PY_FUNCTION_ATTRS   (1)
 #define MICROPY_PY_DESCRIPTORS      (1)
+#define MICROPY_PY_SLOTS            (1)
 #define MICROPY_PY_BUILTINS_STR_UNICODE (1)
 #define MICROPY_PY_BUILTINS_STR_CENTER (1)
 #define MICROPY_PY_BUILTINS_STR_PARTITION (1)
@@ -84,6 +112,8 @@
 #define MICROPY_PY_BUILTINS_INPUT   (1)
 #define MICROPY_PY_BUILTINS_POW3    (1)
 #define MICROPY_PY_MICROPYTHON_MEM_INFO (1)
+#define MICROPY_PY_MICROPYTHON_ALLOC_TRACE (128)
+#define MICROPY_TRACK_CODE_STATE    (1)
 #define MICROPY_PY_ALL_SPECIAL_METHODS (1)
 #define MICROPY_PY_REVERSE_SPECIAL_METHODS (1)
 #define MICROPY_PY_ARRAY_SLICE_ASSIGN (1)
@@ -105,14 +135,28 @@
 #define MICROPY_PY_IO_FILEIO        (1)
 #define MICROPY_PY_IO_RESOURCE_STREAM (1)
 #define MICROPY_PY_GC_COLLECT_RETVAL (1)
+#define MICROPY_GC_PAUSE_STATS      (1)
+#ifndef MICROPY_GC_STACK_SPILL
+#define MICROPY_GC_STACK_SPILL      (1)
+#endif
+#ifndef MICROPY_GC_SPLIT_HEAP
+#define MICROPY_GC_SPLIT_HEAP       (1)
+#endif
+#if !defined(MICROPY_GC_THREAD_ALLOC_BUF) && MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
+#define MICROPY_GC_THREAD_ALLOC_BUF (128)
+#endif
 #define MICROPY_MODULE_FROZEN_STR   (1)
 
+#ifndef MICROPY_STACKLESS
 #define MICROPY_STACKLESS           (0)
 #define MICROPY_STACKLESS_STRICT    (0)
+#endif
 
 #define MICROPY_PY_OS_STATVFS       (1)
 #define MICROPY_PY_UTIME            (1)
 #define MICROPY_PY_UTIME_MP_HAL     (1)
+// Number of samples buffered by the uprofile sampling profiler (0 to disable)
+#define MICROPY_PY_UPROFILE         (256)
 #define MICROPY_PY_UERRNO           (1)
 #define MICROPY_PY_UCTYPES          (1)
 #define MICROPY_PY_UZLIB            (1)
@@ -175,6 +219,7 @@ extern const struct _mp_obj_module_t mp_module_termios;
 extern const struct _mp_obj_module_t mp_module_socket;
 extern const struct _mp_obj_module_t mp_module_ffi;
 extern const struct _mp_obj_module_t mp_module_jni;
+extern const struct _mp_obj_module_t mp_module_uprofile;
 
 #if MICROPY_PY_UOS_VFS
 #define MICROPY_PY_UOS_VFS_DEF { MP_ROM_QSTR(MP_QSTR_uos_vfs), MP_ROM_PTR(&mp_module_uos_vfs) },
@@ -206,6 +251,11 @@ extern const struct _mp_obj_module_t mp_module_jni;
 #else
 #define MICROPY_PY_SOCKET_DEF
 #endif
+#if MICROPY_PY_UPROFILE
+#define MICROPY_PY_UPROFILE_DEF { MP_ROM_QSTR(MP_QSTR_uprofile), MP_ROM_PTR(&mp_module_uprofile) },
+#else
+#define MICROPY_PY_UPROFILE_DEF
+#endif
 #if MICROPY_PY_USELECT_POSIX
 #define MICROPY_PY_USELECT_DEF { MP_ROM_QSTR(MP_QSTR_uselect), MP_ROM_PTR(&mp_module_uselect) },
 #else
@@ -222,6 +272,7 @@ extern const struct _mp_obj_module_t mp_module_jni;
     MICROPY_PY_UOS_VFS_DEF \
     MICROPY_PY_USELECT_DEF \
     MICROPY_PY_TERMIOS_DEF \
+    MICROPY_PY_UPROFILE_DEF \
 
 // type definitions for the specific machine
 
@@ -291,6 +342,7 @@ void mp_unix_mark_exec(void);
 #define MICROPY_PORT_ROOT_POINTERS \
     const char *readline_hist[50]; \
     void *mmap_region_head; \
+    mp_obj_t uprofile_counts; \
 
 // We need to provide a declaration/definition of alloca()
 // unless support for it is disabled.
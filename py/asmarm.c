@@ -215,6 +215,15 @@ void asm_arm_mov_reg_i32(asm_arm_t *as, uint rd, int imm) {
     }
 }
 
+// the imm is always stored as a full word in the code, and its offset is returned
+size_t asm_arm_mov_reg_i32_fix_word(asm_arm_t *as, uint rd, int imm) {
+    emit_al(as, 0x59f0000 | (rd << 12)); // ldr rd, [pc]
+    emit_al(as, 0xa000000); // b pc
+    size_t offset = as->base.code_offset;
+    emit(as, imm);
+    return offset;
+}
+
 void asm_arm_mov_local_reg(asm_arm_t *as, int local_num, uint rd) {
     // str rd, [sp, #local_num*4]
     emit_al(as, 0x58d0000 | (rd << 12) | (local_num << 2));
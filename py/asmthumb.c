@@ -285,6 +285,23 @@ void asm_thumb_mov_reg_i32_aligned(asm_thumb_t *as, uint reg_dest, int i32) {
     asm_thumb_mov_reg_i32_optimised(as, reg_dest, i32);
 }
 
+#define OP_LDR_FROM_PC_OFFSET(rlo_dest, word_offset) (0x4800 | ((rlo_dest) << 8) | ((word_offset) & 0x00ff))
+
+// the i32 is stored as a full word in the code, and its offset is returned
+size_t asm_thumb_mov_reg_i32_fix_word(asm_thumb_t *as, uint rlo_dest, int i32) {
+    assert(rlo_dest < ASM_THUMB_REG_R8);
+    // align on machine-word, so the i32 follows the ldr and b
+    if ((as->base.code_offset & 3) != 0) {
+        asm_thumb_op16(as, ASM_THUMB_OP_NOP);
+    }
+    asm_thumb_op16(as, OP_LDR_FROM_PC_OFFSET(rlo_dest, 0));
+    // jump over the i32 value (instruction prefetch adds 2 to PC)
+    asm_thumb_op16(as, OP_B_N(2));
+    size_t offset = as->base.code_offset;
+    mp_asm_base_data(&as->base, 4, i32);
+    return offset;
+}
+
 #define OP_STR_TO_SP_OFFSET(rlo_dest, word_offset) (0x9000 | ((rlo_dest) << 8) | ((word_offset) & 0x00ff))
 #define OP_LDR_FROM_SP_OFFSET(rlo_dest, word_offset) (0x9800 | ((rlo_dest) << 8) | ((word_offset) & 0x00ff))
 
@@ -311,6 +328,28 @@ void asm_thumb_mov_reg_local_addr(asm_thumb_t *as, uint rlo_dest, int local_num)
     asm_thumb_op16(as, OP_ADD_REG_SP_OFFSET(rlo_dest, word_offset));
 }
 
+#define OP_LDR_W_HI(reg_base) (0xf8d0 | (reg_base))
+#define OP_LDR_W_LO(reg_dest, imm12) ((reg_dest) << 12 | (imm12))
+
+void asm_thumb_ldr_reg_reg_i12_optimised(asm_thumb_t *as, uint reg_dest, uint reg_base, uint word_offset) {
+    if (reg_dest < ASM_THUMB_REG_R8 && reg_base < ASM_THUMB_REG_R8 && word_offset < 32) {
+        asm_thumb_ldr_rlo_rlo_i5(as, reg_dest, reg_base, word_offset);
+    } else {
+        asm_thumb_op32(as, OP_LDR_W_HI(reg_base), OP_LDR_W_LO(reg_dest, word_offset * 4));
+    }
+}
+
+#define OP_STR_W_HI(reg_base) (0xf8c0 | (reg_base))
+#define OP_STR_W_LO(reg_src, imm12) ((reg_src) << 12 | (imm12))
+
+void asm_thumb_str_reg_reg_i12_optimised(asm_thumb_t *as, uint reg_src, uint reg_base, uint word_offset) {
+    if (reg_src < ASM_THUMB_REG_R8 && reg_base < ASM_THUMB_REG_R8 && word_offset < 32) {
+        asm_thumb_str_rlo_rlo_i5(as, reg_src, reg_base, word_offset);
+    } else {
+        asm_thumb_op32(as, OP_STR_W_HI(reg_base), OP_STR_W_LO(reg_src, word_offset * 4));
+    }
+}
+
 // this could be wrong, because it should have a range of +/- 16MiB...
 #define OP_BW_HI(byte_offset) (0xf000 | (((byte_offset) >> 12) & 0x07ff))
 #define OP_BW_LO(byte_offset) (0xb800 | (((byte_offset) >> 1) & 0x07ff))
@@ -371,10 +410,42 @@ void asm_thumb_bl_ind(asm_thumb_t *as, void *fun_ptr, uint fun_id, uint reg_temp
         asm_thumb_op16(as, ASM_THUMB_FORMAT_9_10_ENCODE(ASM_THUMB_FORMAT_9_LDR | ASM_THUMB_FORMAT_9_WORD_TRANSFER, reg_temp, ASM_THUMB_REG_R7, fun_id));
         asm_thumb_op16(as, OP_BLX(reg_temp));
     } else {
-        // load ptr to function into register using immediate; 6 bytes
-        asm_thumb_mov_reg_i32(as, reg_temp, (mp_uint_t)fun_ptr);
+        // load ptr to function from table with a wide ldr; 6 bytes
+        (void)fun_ptr;
+        asm_thumb_ldr_reg_reg_i12_optimised(as, reg_temp, ASM_THUMB_REG_R7, fun_id);
         asm_thumb_op16(as, OP_BLX(reg_temp));
     }
 }
 
+#define OP_VMOV_S_REG_HI (0xee00)
+#define OP_VMOV_S_REG_LO(s, reg) (0x0a10 | ((reg) << 12) | ((s) << 7)) // s must be 0 or 1
+#define OP_VMOV_REG_S0_HI (0xee10)
+#define OP_VMOV_REG_S0_LO(reg) (0x0a10 | ((reg) << 12))
+
+void asm_thumb_vfp_op_reg_reg(asm_thumb_t *as, uint op, uint reg_dest, uint reg_src) {
+    asm_thumb_op32(as, OP_VMOV_S_REG_HI, OP_VMOV_S_REG_LO(0, reg_dest));
+    asm_thumb_op32(as, OP_VMOV_S_REG_HI, OP_VMOV_S_REG_LO(1, reg_src));
+    asm_thumb_op32(as, 0xee00 | (op & 0xf0), 0x0a20 | ((op & 0x0f) << 4)); // vop.f32 s0, s0, s1
+    asm_thumb_op32(as, OP_VMOV_REG_S0_HI, OP_VMOV_REG_S0_LO(reg_dest));
+}
+
+void asm_thumb_vfp_cmp_reg_reg(asm_thumb_t *as, uint reg_a, uint reg_b) {
+    asm_thumb_op32(as, OP_VMOV_S_REG_HI, OP_VMOV_S_REG_LO(0, reg_a));
+    asm_thumb_op32(as, OP_VMOV_S_REG_HI, OP_VMOV_S_REG_LO(1, reg_b));
+    asm_thumb_op32(as, 0xeeb4, 0x0a60); // vcmp.f32 s0, s1
+    asm_thumb_op32(as, 0xeef1, 0xfa10); // vmrs APSR_nzcv, FPSCR
+}
+
+void asm_thumb_vfp_cvt_f32_s32_reg(asm_thumb_t *as, uint reg) {
+    asm_thumb_op32(as, OP_VMOV_S_REG_HI, OP_VMOV_S_REG_LO(0, reg));
+    asm_thumb_op32(as, 0xeeb8, 0x0ac0); // vcvt.f32.s32 s0, s0
+    asm_thumb_op32(as, OP_VMOV_REG_S0_HI, OP_VMOV_REG_S0_LO(reg));
+}
+
+void asm_thumb_vfp_cvt_s32_f32_reg(asm_thumb_t *as, uint reg) {
+    asm_thumb_op32(as, OP_VMOV_S_REG_HI, OP_VMOV_S_REG_LO(0, reg));
+    asm_thumb_op32(as, 0xeebd, 0x0ac0); // vcvt.s32.f32 s0, s0
+    asm_thumb_op32(as, OP_VMOV_REG_S0_HI, OP_VMOV_REG_S0_LO(reg));
+}
+
 #endif // MICROPY_EMIT_THUMB || MICROPY_EMIT_INLINE_THUMB
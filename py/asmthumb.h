@@ -229,14 +229,27 @@ bool asm_thumb_bl_label(asm_thumb_t *as, uint label);
 void asm_thumb_mov_reg_i32(asm_thumb_t *as, uint reg_dest, mp_uint_t i32_src); // convenience
 void asm_thumb_mov_reg_i32_optimised(asm_thumb_t *as, uint reg_dest, int i32_src); // convenience
 void asm_thumb_mov_reg_i32_aligned(asm_thumb_t *as, uint reg_dest, int i32); // convenience
+size_t asm_thumb_mov_reg_i32_fix_word(asm_thumb_t *as, uint rlo_dest, int i32); // convenience
 void asm_thumb_mov_local_reg(asm_thumb_t *as, int local_num_dest, uint rlo_src); // convenience
 void asm_thumb_mov_reg_local(asm_thumb_t *as, uint rlo_dest, int local_num); // convenience
 void asm_thumb_mov_reg_local_addr(asm_thumb_t *as, uint rlo_dest, int local_num); // convenience
+void asm_thumb_ldr_reg_reg_i12_optimised(asm_thumb_t *as, uint reg_dest, uint reg_base, uint word_offset); // convenience
+void asm_thumb_str_reg_reg_i12_optimised(asm_thumb_t *as, uint reg_src, uint reg_base, uint word_offset); // convenience
 
 void asm_thumb_b_label(asm_thumb_t *as, uint label); // convenience: picks narrow or wide branch
 void asm_thumb_bcc_label(asm_thumb_t *as, int cc, uint label); // convenience: picks narrow or wide branch
 void asm_thumb_bl_ind(asm_thumb_t *as, void *fun_ptr, uint fun_id, uint reg_temp); // convenience
 
+// VFP single precision ops on values held in core registers, using s0 and s1
+#define ASM_THUMB_VFP_OP_ADD (0x30)
+#define ASM_THUMB_VFP_OP_SUB (0x34)
+#define ASM_THUMB_VFP_OP_MUL (0x20)
+#define ASM_THUMB_VFP_OP_DIV (0x80)
+void asm_thumb_vfp_op_reg_reg(asm_thumb_t *as, uint op, uint reg_dest, uint reg_src);
+void asm_thumb_vfp_cmp_reg_reg(asm_thumb_t *as, uint reg_a, uint reg_b); // sets APSR flags
+void asm_thumb_vfp_cvt_f32_s32_reg(asm_thumb_t *as, uint reg);
+void asm_thumb_vfp_cvt_s32_f32_reg(asm_thumb_t *as, uint reg);
+
 #if GENERIC_ASM_API
 
 // The following macros provide a (mostly) arch-independent API to
@@ -286,6 +299,7 @@ void asm_thumb_bl_ind(asm_thumb_t *as, void *fun_ptr, uint fun_id, uint reg_temp
 #define ASM_MOV_REG_TO_LOCAL(as, reg, local_num) asm_thumb_mov_local_reg(as, (local_num), (reg))
 #define ASM_MOV_IMM_TO_REG(as, imm, reg) asm_thumb_mov_reg_i32_optimised(as, (reg), (imm))
 #define ASM_MOV_ALIGNED_IMM_TO_REG(as, imm, reg) asm_thumb_mov_reg_i32_aligned(as, (reg), (imm))
+#define ASM_MOV_IMM_TO_REG_FIX_WORD(as, imm, reg) asm_thumb_mov_reg_i32_fix_word(as, (reg), (imm))
 #define ASM_MOV_IMM_TO_LOCAL_USING(as, imm, local_num, reg_temp) \
     do { \
         asm_thumb_mov_reg_i32_optimised(as, (reg_temp), (imm)); \
@@ -304,14 +318,24 @@ void asm_thumb_bl_ind(asm_thumb_t *as, void *fun_ptr, uint fun_id, uint reg_temp
 #define ASM_SUB_REG_REG(as, reg_dest, reg_src) asm_thumb_sub_rlo_rlo_rlo((as), (reg_dest), (reg_dest), (reg_src))
 #define ASM_MUL_REG_REG(as, reg_dest, reg_src) asm_thumb_format_4((as), ASM_THUMB_FORMAT_4_MUL, (reg_dest), (reg_src))
 
+#if MICROPY_EMIT_INLINE_THUMB_FLOAT && MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_FLOAT
+// the target has a VFP, and unboxed floats are held in the core registers
+#define ASM_FLOAT_ADD_REG_REG(as, reg_dest, reg_src) asm_thumb_vfp_op_reg_reg((as), ASM_THUMB_VFP_OP_ADD, (reg_dest), (reg_src))
+#define ASM_FLOAT_SUB_REG_REG(as, reg_dest, reg_src) asm_thumb_vfp_op_reg_reg((as), ASM_THUMB_VFP_OP_SUB, (reg_dest), (reg_src))
+#define ASM_FLOAT_MUL_REG_REG(as, reg_dest, reg_src) asm_thumb_vfp_op_reg_reg((as), ASM_THUMB_VFP_OP_MUL, (reg_dest), (reg_src))
+#define ASM_FLOAT_DIV_REG_REG(as, reg_dest, reg_src) asm_thumb_vfp_op_reg_reg((as), ASM_THUMB_VFP_OP_DIV, (reg_dest), (reg_src))
+#define ASM_FLOAT_FROM_INT_REG(as, reg) asm_thumb_vfp_cvt_f32_s32_reg((as), (reg))
+#define ASM_INT_FROM_FLOAT_REG(as, reg) asm_thumb_vfp_cvt_s32_f32_reg((as), (reg))
+#endif
+
 #define ASM_LOAD_REG_REG(as, reg_dest, reg_base) asm_thumb_ldr_rlo_rlo_i5((as), (reg_dest), (reg_base), 0)
-#define ASM_LOAD_REG_REG_OFFSET(as, reg_dest, reg_base, word_offset) asm_thumb_ldr_rlo_rlo_i5((as), (reg_dest), (reg_base), (word_offset))
+#define ASM_LOAD_REG_REG_OFFSET(as, reg_dest, reg_base, word_offset) asm_thumb_ldr_reg_reg_i12_optimised((as), (reg_dest), (reg_base), (word_offset))
 #define ASM_LOAD8_REG_REG(as, reg_dest, reg_base) asm_thumb_ldrb_rlo_rlo_i5((as), (reg_dest), (reg_base), 0)
 #define ASM_LOAD16_REG_REG(as, reg_dest, reg_base) asm_thumb_ldrh_rlo_rlo_i5((as), (reg_dest), (reg_base), 0)
 #define ASM_LOAD32_REG_REG(as, reg_dest, reg_base) asm_thumb_ldr_rlo_rlo_i5((as), (reg_dest), (reg_base), 0)
 
 #define ASM_STORE_REG_REG(as, reg_src, reg_base) asm_thumb_str_rlo_rlo_i5((as), (reg_src), (reg_base), 0)
-#define ASM_STORE_REG_REG_OFFSET(as, reg_src, reg_base, word_offset) asm_thumb_str_rlo_rlo_i5((as), (reg_src), (reg_base), (word_offset))
+#define ASM_STORE_REG_REG_OFFSET(as, reg_src, reg_base, word_offset) asm_thumb_str_reg_reg_i12_optimised((as), (reg_src), (reg_base), (word_offset))
 #define ASM_STORE8_REG_REG(as, reg_src, reg_base) asm_thumb_strb_rlo_rlo_i5((as), (reg_src), (reg_base), 0)
 #define ASM_STORE16_REG_REG(as, reg_src, reg_base) asm_thumb_strh_rlo_rlo_i5((as), (reg_src), (reg_base), 0)
 #define ASM_STORE32_REG_REG(as, reg_src, reg_base) asm_thumb_str_rlo_rlo_i5((as), (reg_src), (reg_base), 0)
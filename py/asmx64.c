@@ -83,6 +83,16 @@
 #define OPCODE_CALL_REL32        (0xe8)
 #define OPCODE_CALL_RM32         (0xff) /* /2 */
 #define OPCODE_LEAVE             (0xc9)
+#define OPCODE_MOVQ_RM64_TO_XMM  (0x6e) /* 0x66 0x0f 0x6e /r */
+#define OPCODE_MOVQ_XMM_TO_RM64  (0x7e) /* 0x66 0x0f 0x7e /r */
+#define OPCODE_MOVMSKPD          (0x50) /* 0x66 0x0f 0x50 /r */
+#define OPCODE_ADDSD             (0x58) /* 0xf2 0x0f 0x58 /r */
+#define OPCODE_MULSD             (0x59) /* 0xf2 0x0f 0x59 /r */
+#define OPCODE_SUBSD             (0x5c) /* 0xf2 0x0f 0x5c /r */
+#define OPCODE_DIVSD             (0x5e) /* 0xf2 0x0f 0x5e /r */
+#define OPCODE_CMPSD             (0xc2) /* 0xf2 0x0f 0xc2 /r ib */
+#define OPCODE_CVTSI2SD          (0x2a) /* 0xf2 0x0f 0x2a /r */
+#define OPCODE_CVTTSD2SI         (0x2c) /* 0xf2 0x0f 0x2c /r */
 
 #define MODRM_R64(x)    (((x) & 0x7) << 3)
 #define MODRM_RM_DISP0  (0x00)
@@ -92,6 +102,7 @@
 #define MODRM_RM_R64(x) ((x) & 0x7)
 
 #define OP_SIZE_PREFIX (0x66)
+#define SD_PREFIX (0xf2)
 
 #define REX_PREFIX  (0x40)
 #define REX_W       (0x08)  // width
@@ -190,7 +201,8 @@ STATIC void asm_x64_write_r64_disp(asm_x64_t *as, int r64, int disp_r64, int dis
         return;
     }
 
-    if (disp_offset == 0 && disp_r64 != ASM_X64_REG_RBP) {
+    // a zero offset can't be encoded with rbp or r13 as the base
+    if (disp_offset == 0 && (disp_r64 & 7) != ASM_X64_REG_RBP) {
         asm_x64_write_byte_1(as, MODRM_R64(r64) | MODRM_RM_DISP0 | MODRM_RM_R64(disp_r64));
     } else if (SIGNED_FIT8(disp_offset)) {
         asm_x64_write_byte_2(as, MODRM_R64(r64) | MODRM_RM_DISP8 | MODRM_RM_R64(disp_r64), IMM32_L0(disp_offset));
@@ -281,31 +293,28 @@ void asm_x64_mov_r64_to_mem64(asm_x64_t *as, int src_r64, int dest_r64, int dest
 }
 
 void asm_x64_mov_mem8_to_r64zx(asm_x64_t *as, int src_r64, int src_disp, int dest_r64) {
-    assert(src_r64 < 8);
-    if (dest_r64 < 8) {
+    if (src_r64 < 8 && dest_r64 < 8) {
         asm_x64_write_byte_2(as, 0x0f, OPCODE_MOVZX_RM8_TO_R64);
     } else {
-        asm_x64_write_byte_3(as, REX_PREFIX | REX_R, 0x0f, OPCODE_MOVZX_RM8_TO_R64);
+        asm_x64_write_byte_3(as, REX_PREFIX | REX_R_FROM_R64(dest_r64) | REX_B_FROM_R64(src_r64), 0x0f, OPCODE_MOVZX_RM8_TO_R64);
     }
     asm_x64_write_r64_disp(as, dest_r64, src_r64, src_disp);
 }
 
 void asm_x64_mov_mem16_to_r64zx(asm_x64_t *as, int src_r64, int src_disp, int dest_r64) {
-    assert(src_r64 < 8);
-    if (dest_r64 < 8) {
+    if (src_r64 < 8 && dest_r64 < 8) {
         asm_x64_write_byte_2(as, 0x0f, OPCODE_MOVZX_RM16_TO_R64);
     } else {
-        asm_x64_write_byte_3(as, REX_PREFIX | REX_R, 0x0f, OPCODE_MOVZX_RM16_TO_R64);
+        asm_x64_write_byte_3(as, REX_PREFIX | REX_R_FROM_R64(dest_r64) | REX_B_FROM_R64(src_r64), 0x0f, OPCODE_MOVZX_RM16_TO_R64);
     }
     asm_x64_write_r64_disp(as, dest_r64, src_r64, src_disp);
 }
 
 void asm_x64_mov_mem32_to_r64zx(asm_x64_t *as, int src_r64, int src_disp, int dest_r64) {
-    assert(src_r64 < 8);
-    if (dest_r64 < 8) {
+    if (src_r64 < 8 && dest_r64 < 8) {
         asm_x64_write_byte_1(as, OPCODE_MOV_RM64_TO_R64);
     } else {
-        asm_x64_write_byte_2(as, REX_PREFIX | REX_R, OPCODE_MOV_RM64_TO_R64);
+        asm_x64_write_byte_2(as, REX_PREFIX | REX_R_FROM_R64(dest_r64) | REX_B_FROM_R64(src_r64), OPCODE_MOV_RM64_TO_R64);
     }
     asm_x64_write_r64_disp(as, dest_r64, src_r64, src_disp);
 }
@@ -370,6 +379,12 @@ void asm_x64_mov_i64_to_r64_aligned(asm_x64_t *as, int64_t src_i64, int dest_r64
     asm_x64_mov_i64_to_r64(as, src_i64, dest_r64);
 }
 
+// as above, and returns the offset of the i64 in the code, so it can be patched
+size_t asm_x64_mov_i64_to_r64_fix_word(asm_x64_t *as, int64_t src_i64, int dest_r64) {
+    asm_x64_mov_i64_to_r64_aligned(as, src_i64, dest_r64);
+    return as->base.code_offset - WORD_SIZE;
+}
+
 void asm_x64_and_r64_r64(asm_x64_t *as, int dest_r64, int src_r64) {
     asm_x64_generic_r64_r64(as, dest_r64, src_r64, OPCODE_AND_R64_TO_RM64);
 }
@@ -404,6 +419,68 @@ void asm_x64_mul_r64_r64(asm_x64_t *as, int dest_r64, int src_r64) {
     asm_x64_write_byte_3(as, 0x0f, 0xaf, MODRM_R64(dest_r64) | MODRM_RM_REG | MODRM_RM_R64(src_r64));
 }
 
+// The scalar double ops below work on values held in general purpose
+// registers, and use xmm0 and xmm1 as scratch registers.
+
+STATIC void asm_x64_movq_r64_to_xmm(asm_x64_t *as, int src_r64, int dest_xmm) {
+    asm_x64_write_byte_2(as, OP_SIZE_PREFIX, REX_PREFIX | REX_W | REX_R_FROM_R64(dest_xmm) | REX_B_FROM_R64(src_r64));
+    asm_x64_write_byte_3(as, 0x0f, OPCODE_MOVQ_RM64_TO_XMM, MODRM_R64(dest_xmm) | MODRM_RM_REG | MODRM_RM_R64(src_r64));
+}
+
+STATIC void asm_x64_movq_xmm_to_r64(asm_x64_t *as, int src_xmm, int dest_r64) {
+    asm_x64_write_byte_2(as, OP_SIZE_PREFIX, REX_PREFIX | REX_W | REX_R_FROM_R64(src_xmm) | REX_B_FROM_R64(dest_r64));
+    asm_x64_write_byte_3(as, 0x0f, OPCODE_MOVQ_XMM_TO_RM64, MODRM_R64(src_xmm) | MODRM_RM_REG | MODRM_RM_R64(dest_r64));
+}
+
+STATIC void asm_x64_sse_sd_r64_r64(asm_x64_t *as, int dest_r64, int src_r64, int op) {
+    asm_x64_movq_r64_to_xmm(as, dest_r64, 0);
+    asm_x64_movq_r64_to_xmm(as, src_r64, 1);
+    asm_x64_write_byte_3(as, SD_PREFIX, 0x0f, op);
+    asm_x64_write_byte_1(as, MODRM_R64(0) | MODRM_RM_REG | MODRM_RM_R64(1));
+    asm_x64_movq_xmm_to_r64(as, 0, dest_r64);
+}
+
+void asm_x64_addsd_r64_r64(asm_x64_t *as, int dest_r64, int src_r64) {
+    asm_x64_sse_sd_r64_r64(as, dest_r64, src_r64, OPCODE_ADDSD);
+}
+
+void asm_x64_subsd_r64_r64(asm_x64_t *as, int dest_r64, int src_r64) {
+    asm_x64_sse_sd_r64_r64(as, dest_r64, src_r64, OPCODE_SUBSD);
+}
+
+void asm_x64_mulsd_r64_r64(asm_x64_t *as, int dest_r64, int src_r64) {
+    asm_x64_sse_sd_r64_r64(as, dest_r64, src_r64, OPCODE_MULSD);
+}
+
+void asm_x64_divsd_r64_r64(asm_x64_t *as, int dest_r64, int src_r64) {
+    asm_x64_sse_sd_r64_r64(as, dest_r64, src_r64, OPCODE_DIVSD);
+}
+
+// sets dest_r64 to 1 if the predicate holds for a and b, else 0
+void asm_x64_cmpsd_r64_r64(asm_x64_t *as, int pred, int dest_r64, int src_r64_a, int src_r64_b) {
+    asm_x64_movq_r64_to_xmm(as, src_r64_a, 0);
+    asm_x64_movq_r64_to_xmm(as, src_r64_b, 1);
+    asm_x64_write_byte_3(as, SD_PREFIX, 0x0f, OPCODE_CMPSD);
+    asm_x64_write_byte_2(as, MODRM_R64(0) | MODRM_RM_REG | MODRM_RM_R64(1), pred);
+    // the compare leaves a mask of all ones or zeros, so extract its sign bit
+    asm_x64_write_byte_2(as, OP_SIZE_PREFIX, REX_PREFIX | REX_R_FROM_R64(dest_r64));
+    asm_x64_write_byte_3(as, 0x0f, OPCODE_MOVMSKPD, MODRM_R64(dest_r64) | MODRM_RM_REG | MODRM_RM_R64(0));
+}
+
+// converts the integer in r64 to a double, in place
+void asm_x64_cvtsi2sd_r64(asm_x64_t *as, int r64) {
+    asm_x64_write_byte_2(as, SD_PREFIX, REX_PREFIX | REX_W | REX_B_FROM_R64(r64));
+    asm_x64_write_byte_3(as, 0x0f, OPCODE_CVTSI2SD, MODRM_R64(0) | MODRM_RM_REG | MODRM_RM_R64(r64));
+    asm_x64_movq_xmm_to_r64(as, 0, r64);
+}
+
+// converts the double in r64 to an integer, truncating it, in place
+void asm_x64_cvttsd2si_r64(asm_x64_t *as, int r64) {
+    asm_x64_movq_r64_to_xmm(as, r64, 0);
+    asm_x64_write_byte_2(as, SD_PREFIX, REX_PREFIX | REX_W | REX_R_FROM_R64(r64));
+    asm_x64_write_byte_3(as, 0x0f, OPCODE_CVTTSD2SI, MODRM_R64(r64) | MODRM_RM_REG | MODRM_RM_R64(0));
+}
+
 /*
 void asm_x64_sub_i32_from_r32(asm_x64_t *as, int src_i32, int dest_r32) {
     if (SIGNED_FIT8(src_i32)) {
@@ -536,10 +613,14 @@ void asm_x64_entry(asm_x64_t *as, int num_locals) {
     asm_x64_push_r64(as, ASM_X64_REG_RBX);
     asm_x64_push_r64(as, ASM_X64_REG_R12);
     asm_x64_push_r64(as, ASM_X64_REG_R13);
+    asm_x64_push_r64(as, ASM_X64_REG_R14);
+    asm_x64_push_r64(as, ASM_X64_REG_R15);
     as->num_locals = num_locals;
 }
 
 void asm_x64_exit(asm_x64_t *as) {
+    asm_x64_pop_r64(as, ASM_X64_REG_R15);
+    asm_x64_pop_r64(as, ASM_X64_REG_R14);
     asm_x64_pop_r64(as, ASM_X64_REG_R13);
     asm_x64_pop_r64(as, ASM_X64_REG_R12);
     asm_x64_pop_r64(as, ASM_X64_REG_RBX);
@@ -629,4 +710,12 @@ void asm_x64_call_ind(asm_x64_t *as, void *ptr, int temp_r64) {
     */
 }
 
+// the address of the function is stored as a full word, at the returned offset
+size_t asm_x64_call_ind_fix_word(asm_x64_t *as, void *ptr, int temp_r64) {
+    assert(temp_r64 < 8);
+    size_t offset = asm_x64_mov_i64_to_r64_fix_word(as, (int64_t)(uintptr_t)ptr, temp_r64);
+    asm_x64_write_byte_2(as, OPCODE_CALL_RM32, MODRM_R64(2) | MODRM_RM_REG | MODRM_RM_R64(temp_r64));
+    return offset;
+}
+
 #endif // MICROPY_EMIT_X64
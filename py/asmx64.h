@@ -70,6 +70,12 @@
 #define ASM_X64_CC_JLE (0xe) // less or equal, signed
 #define ASM_X64_CC_JG  (0xf) // greater, signed
 
+// predicates for cmpsd
+#define ASM_X64_CMPSD_EQ  (0)
+#define ASM_X64_CMPSD_LT  (1)
+#define ASM_X64_CMPSD_LE  (2)
+#define ASM_X64_CMPSD_NEQ (4)
+
 typedef struct _asm_x64_t {
     mp_asm_base_t base;
     int num_locals;
@@ -86,6 +92,7 @@ void asm_x64_mov_r64_r64(asm_x64_t* as, int dest_r64, int src_r64);
 void asm_x64_mov_i64_to_r64(asm_x64_t* as, int64_t src_i64, int dest_r64);
 void asm_x64_mov_i64_to_r64_optimised(asm_x64_t *as, int64_t src_i64, int dest_r64);
 void asm_x64_mov_i64_to_r64_aligned(asm_x64_t *as, int64_t src_i64, int dest_r64);
+size_t asm_x64_mov_i64_to_r64_fix_word(asm_x64_t *as, int64_t src_i64, int dest_r64);
 void asm_x64_mov_r8_to_mem8(asm_x64_t *as, int src_r64, int dest_r64, int dest_disp);
 void asm_x64_mov_r16_to_mem16(asm_x64_t *as, int src_r64, int dest_r64, int dest_disp);
 void asm_x64_mov_r32_to_mem32(asm_x64_t *as, int src_r64, int dest_r64, int dest_disp);
@@ -102,6 +109,13 @@ void asm_x64_sar_r64_cl(asm_x64_t* as, int dest_r64);
 void asm_x64_add_r64_r64(asm_x64_t* as, int dest_r64, int src_r64);
 void asm_x64_sub_r64_r64(asm_x64_t* as, int dest_r64, int src_r64);
 void asm_x64_mul_r64_r64(asm_x64_t* as, int dest_r64, int src_r64);
+void asm_x64_addsd_r64_r64(asm_x64_t *as, int dest_r64, int src_r64);
+void asm_x64_subsd_r64_r64(asm_x64_t *as, int dest_r64, int src_r64);
+void asm_x64_mulsd_r64_r64(asm_x64_t *as, int dest_r64, int src_r64);
+void asm_x64_divsd_r64_r64(asm_x64_t *as, int dest_r64, int src_r64);
+void asm_x64_cmpsd_r64_r64(asm_x64_t *as, int pred, int dest_r64, int src_r64_a, int src_r64_b);
+void asm_x64_cvtsi2sd_r64(asm_x64_t *as, int r64);
+void asm_x64_cvttsd2si_r64(asm_x64_t *as, int r64);
 void asm_x64_cmp_r64_with_r64(asm_x64_t* as, int src_r64_a, int src_r64_b);
 void asm_x64_test_r8_with_r8(asm_x64_t* as, int src_r64_a, int src_r64_b);
 void asm_x64_setcc_r8(asm_x64_t* as, int jcc_type, int dest_r8);
@@ -113,6 +127,7 @@ void asm_x64_mov_local_to_r64(asm_x64_t* as, int src_local_num, int dest_r64);
 void asm_x64_mov_r64_to_local(asm_x64_t* as, int src_r64, int dest_local_num);
 void asm_x64_mov_local_addr_to_r64(asm_x64_t* as, int local_num, int dest_r64);
 void asm_x64_call_ind(asm_x64_t* as, void* ptr, int temp_r32);
+size_t asm_x64_call_ind_fix_word(asm_x64_t *as, void *ptr, int temp_r64);
 
 #if GENERIC_ASM_API
 
@@ -137,7 +152,9 @@ void asm_x64_call_ind(asm_x64_t* as, void* ptr, int temp_r32);
 #define REG_LOCAL_1 ASM_X64_REG_RBX
 #define REG_LOCAL_2 ASM_X64_REG_R12
 #define REG_LOCAL_3 ASM_X64_REG_R13
-#define REG_LOCAL_NUM (3)
+#define REG_LOCAL_4 ASM_X64_REG_R14
+#define REG_LOCAL_5 ASM_X64_REG_R15
+#define REG_LOCAL_NUM (5)
 
 #define ASM_T               asm_x64_t
 #define ASM_END_PASS        asm_x64_end_pass
@@ -161,10 +178,12 @@ void asm_x64_call_ind(asm_x64_t* as, void* ptr, int temp_r32);
         asm_x64_jcc_label(as, ASM_X64_CC_JE, label); \
     } while (0)
 #define ASM_CALL_IND(as, ptr, idx) asm_x64_call_ind(as, ptr, ASM_X64_REG_RAX)
+#define ASM_CALL_IND_FIX_WORD(as, ptr, idx) asm_x64_call_ind_fix_word(as, ptr, ASM_X64_REG_RAX)
 
 #define ASM_MOV_REG_TO_LOCAL        asm_x64_mov_r64_to_local
 #define ASM_MOV_IMM_TO_REG          asm_x64_mov_i64_to_r64_optimised
 #define ASM_MOV_ALIGNED_IMM_TO_REG  asm_x64_mov_i64_to_r64_aligned
+#define ASM_MOV_IMM_TO_REG_FIX_WORD asm_x64_mov_i64_to_r64_fix_word
 #define ASM_MOV_IMM_TO_LOCAL_USING(as, imm, local_num, reg_temp) \
     do { \
         asm_x64_mov_i64_to_r64_optimised(as, (imm), (reg_temp)); \
@@ -183,6 +202,16 @@ void asm_x64_call_ind(asm_x64_t* as, void* ptr, int temp_r32);
 #define ASM_SUB_REG_REG(as, reg_dest, reg_src) asm_x64_sub_r64_r64((as), (reg_dest), (reg_src))
 #define ASM_MUL_REG_REG(as, reg_dest, reg_src) asm_x64_mul_r64_r64((as), (reg_dest), (reg_src))
 
+#if MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_DOUBLE
+// unboxed floats are held in the general purpose registers
+#define ASM_FLOAT_ADD_REG_REG(as, reg_dest, reg_src) asm_x64_addsd_r64_r64((as), (reg_dest), (reg_src))
+#define ASM_FLOAT_SUB_REG_REG(as, reg_dest, reg_src) asm_x64_subsd_r64_r64((as), (reg_dest), (reg_src))
+#define ASM_FLOAT_MUL_REG_REG(as, reg_dest, reg_src) asm_x64_mulsd_r64_r64((as), (reg_dest), (reg_src))
+#define ASM_FLOAT_DIV_REG_REG(as, reg_dest, reg_src) asm_x64_divsd_r64_r64((as), (reg_dest), (reg_src))
+#define ASM_FLOAT_FROM_INT_REG(as, reg) asm_x64_cvtsi2sd_r64((as), (reg))
+#define ASM_INT_FROM_FLOAT_REG(as, reg) asm_x64_cvttsd2si_r64((as), (reg))
+#endif
+
 #define ASM_LOAD_REG_REG(as, reg_dest, reg_base) asm_x64_mov_mem64_to_r64((as), (reg_base), 0, (reg_dest))
 #define ASM_LOAD_REG_REG_OFFSET(as, reg_dest, reg_base, word_offset) asm_x64_mov_mem64_to_r64((as), (reg_base), 8 * (word_offset), (reg_dest))
 #define ASM_LOAD8_REG_REG(as, reg_dest, reg_base) asm_x64_mov_mem8_to_r64zx((as), (reg_base), 0, (reg_dest))
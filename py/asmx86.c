@@ -238,6 +238,12 @@ void asm_x86_mov_i32_to_r32_aligned(asm_x86_t *as, int32_t src_i32, int dest_r32
     asm_x86_mov_i32_to_r32(as, src_i32, dest_r32);
 }
 
+// as above, and returns the offset of the i32 in the code, so it can be patched
+size_t asm_x86_mov_i32_to_r32_fix_word(asm_x86_t *as, int32_t src_i32, int dest_r32) {
+    asm_x86_mov_i32_to_r32_aligned(as, src_i32, dest_r32);
+    return as->base.code_offset - WORD_SIZE;
+}
+
 void asm_x86_and_r32_r32(asm_x86_t *as, int dest_r32, int src_r32) {
     asm_x86_generic_r32_r32(as, dest_r32, src_r32, OPCODE_AND_R32_TO_RM32);
 }
@@ -469,7 +475,7 @@ void asm_x86_push_local_addr(asm_x86_t *as, int local_num, int temp_r32)
 }
 #endif
 
-void asm_x86_call_ind(asm_x86_t *as, void *ptr, mp_uint_t n_args, int temp_r32) {
+STATIC size_t asm_x86_call_ind_helper(asm_x86_t *as, void *ptr, mp_uint_t n_args, int temp_r32, bool fix_word) {
     // TODO align stack on 16-byte boundary before the call
     assert(n_args <= 5);
     if (n_args > 4) {
@@ -487,14 +493,14 @@ void asm_x86_call_ind(asm_x86_t *as, void *ptr, mp_uint_t n_args, int temp_r32)
     if (n_args > 0) {
         asm_x86_push_r32(as, ASM_X86_REG_ARG_1);
     }
-#ifdef __LP64__
-    // We wouldn't run x86 code on an x64 machine.  This is here to enable
-    // testing of the x86 emitter only.
-    asm_x86_mov_i32_to_r32(as, (int32_t)(int64_t)ptr, temp_r32);
-#else
-    // If we get here, sizeof(int) == sizeof(void*).
-    asm_x86_mov_i32_to_r32(as, (int32_t)ptr, temp_r32);
-#endif
+    size_t ptr_offset = 0;
+    // We wouldn't run x86 code on an x64 machine, but the cast through
+    // intptr_t enables testing of the x86 emitter there.
+    if (fix_word) {
+        ptr_offset = asm_x86_mov_i32_to_r32_fix_word(as, (int32_t)(intptr_t)ptr, temp_r32);
+    } else {
+        asm_x86_mov_i32_to_r32(as, (int32_t)(intptr_t)ptr, temp_r32);
+    }
     asm_x86_write_byte_2(as, OPCODE_CALL_RM32, MODRM_R32(2) | MODRM_RM_REG | MODRM_RM_R32(temp_r32));
     // this reduces code size by 2 bytes per call, but doesn't seem to speed it up at all
     /*
@@ -506,6 +512,16 @@ void asm_x86_call_ind(asm_x86_t *as, void *ptr, mp_uint_t n_args, int temp_r32)
     if (n_args > 0) {
         asm_x86_add_i32_to_r32(as, WORD_SIZE * n_args, ASM_X86_REG_ESP);
     }
+    return ptr_offset;
+}
+
+void asm_x86_call_ind(asm_x86_t *as, void *ptr, mp_uint_t n_args, int temp_r32) {
+    asm_x86_call_ind_helper(as, ptr, n_args, temp_r32, false);
+}
+
+// the address of the function is stored as a full word, at the returned offset
+size_t asm_x86_call_ind_fix_word(asm_x86_t *as, void *ptr, mp_uint_t n_args, int temp_r32) {
+    return asm_x86_call_ind_helper(as, ptr, n_args, temp_r32, true);
 }
 
 #endif // MICROPY_EMIT_X86
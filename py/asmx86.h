@@ -85,6 +85,7 @@ static inline void asm_x86_end_pass(asm_x86_t *as) {
 void asm_x86_mov_r32_r32(asm_x86_t* as, int dest_r32, int src_r32);
 void asm_x86_mov_i32_to_r32(asm_x86_t *as, int32_t src_i32, int dest_r32);
 void asm_x86_mov_i32_to_r32_aligned(asm_x86_t *as, int32_t src_i32, int dest_r32);
+size_t asm_x86_mov_i32_to_r32_fix_word(asm_x86_t *as, int32_t src_i32, int dest_r32);
 void asm_x86_mov_r8_to_mem8(asm_x86_t *as, int src_r32, int dest_r32, int dest_disp);
 void asm_x86_mov_r16_to_mem16(asm_x86_t *as, int src_r32, int dest_r32, int dest_disp);
 void asm_x86_mov_r32_to_mem32(asm_x86_t *as, int src_r32, int dest_r32, int dest_disp);
@@ -111,6 +112,7 @@ void asm_x86_mov_local_to_r32(asm_x86_t* as, int src_local_num, int dest_r32);
 void asm_x86_mov_r32_to_local(asm_x86_t* as, int src_r32, int dest_local_num);
 void asm_x86_mov_local_addr_to_r32(asm_x86_t* as, int local_num, int dest_r32);
 void asm_x86_call_ind(asm_x86_t* as, void* ptr, mp_uint_t n_args, int temp_r32);
+size_t asm_x86_call_ind_fix_word(asm_x86_t *as, void *ptr, mp_uint_t n_args, int temp_r32);
 
 #if GENERIC_ASM_API
 
@@ -159,10 +161,12 @@ void asm_x86_call_ind(asm_x86_t* as, void* ptr, mp_uint_t n_args, int temp_r32);
         asm_x86_jcc_label(as, ASM_X86_CC_JE, label); \
     } while (0)
 #define ASM_CALL_IND(as, ptr, idx) asm_x86_call_ind(as, ptr, mp_f_n_args[idx], ASM_X86_REG_EAX)
+#define ASM_CALL_IND_FIX_WORD(as, ptr, idx) asm_x86_call_ind_fix_word(as, ptr, mp_f_n_args[idx], ASM_X86_REG_EAX)
 
 #define ASM_MOV_REG_TO_LOCAL        asm_x86_mov_r32_to_local
 #define ASM_MOV_IMM_TO_REG          asm_x86_mov_i32_to_r32
 #define ASM_MOV_ALIGNED_IMM_TO_REG  asm_x86_mov_i32_to_r32_aligned
+#define ASM_MOV_IMM_TO_REG_FIX_WORD asm_x86_mov_i32_to_r32_fix_word
 #define ASM_MOV_IMM_TO_LOCAL_USING(as, imm, local_num, reg_temp) \
     do { \
         asm_x86_mov_i32_to_r32(as, (imm), (reg_temp)); \
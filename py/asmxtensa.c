@@ -65,6 +65,7 @@ void asm_xtensa_entry(asm_xtensa_t *as, int num_locals) {
     // jump over the constants
     asm_xtensa_op_j(as, as->num_const * WORD_SIZE + 4 - 4);
     mp_asm_base_get_cur_to_write_bytes(&as->base, 1); // padding/alignment byte
+    as->const_table_offset = as->base.code_offset;
     as->const_table = (uint32_t*)mp_asm_base_get_cur_to_write_bytes(&as->base, as->num_const * 4);
 
     // adjust the stack-pointer to store a0, a12, a13, a14 and locals, 16-byte aligned
@@ -148,14 +149,27 @@ void asm_xtensa_mov_reg_i32(asm_xtensa_t *as, uint reg_dest, uint32_t i32) {
     if (SIGNED_FIT12(i32)) {
         asm_xtensa_op_movi(as, reg_dest, i32);
     } else {
-        // load the constant
-        asm_xtensa_op_l32r(as, reg_dest, as->base.code_offset, 4 + as->cur_const * WORD_SIZE);
-        // store the constant in the table
-        if (as->const_table != NULL) {
-            as->const_table[as->cur_const] = i32;
-        }
-        ++as->cur_const;
+        asm_xtensa_mov_reg_i32_fix_word(as, reg_dest, i32);
+    }
+}
+
+// the i32 is always put in the table of constants, and its offset is returned
+size_t asm_xtensa_mov_reg_i32_fix_word(asm_xtensa_t *as, uint reg_dest, uint32_t i32) {
+    // load the constant
+    size_t offset = as->const_table_offset + as->cur_const * WORD_SIZE;
+    asm_xtensa_op_l32r(as, reg_dest, as->base.code_offset, offset);
+    // store the constant in the table
+    if (as->const_table != NULL) {
+        as->const_table[as->cur_const] = i32;
     }
+    ++as->cur_const;
+    return offset;
+}
+
+size_t asm_xtensa_call_ind_fix_word(asm_xtensa_t *as, void *ptr) {
+    size_t offset = asm_xtensa_mov_reg_i32_fix_word(as, ASM_XTENSA_REG_A0, (uint32_t)(uintptr_t)ptr);
+    asm_xtensa_op_callx0(as, ASM_XTENSA_REG_A0);
+    return offset;
 }
 
 void asm_xtensa_mov_local_reg(asm_xtensa_t *as, int local_num, uint reg_src) {
@@ -167,8 +181,30 @@ void asm_xtensa_mov_reg_local(asm_xtensa_t *as, uint reg_dest, int local_num) {
 }
 
 void asm_xtensa_mov_reg_local_addr(asm_xtensa_t *as, uint reg_dest, int local_num) {
-    asm_xtensa_op_mov_n(as, reg_dest, ASM_XTENSA_REG_A1);
-    asm_xtensa_op_addi(as, reg_dest, reg_dest, (4 + local_num) * WORD_SIZE);
+    uint off = (4 + local_num) * WORD_SIZE;
+    if (off < 128) {
+        asm_xtensa_op_mov_n(as, reg_dest, ASM_XTENSA_REG_A1);
+        asm_xtensa_op_addi(as, reg_dest, reg_dest, off);
+    } else {
+        asm_xtensa_op_movi(as, reg_dest, off);
+        asm_xtensa_op_add(as, reg_dest, reg_dest, ASM_XTENSA_REG_A1);
+    }
+}
+
+void asm_xtensa_l32i_optimised(asm_xtensa_t *as, uint reg_dest, uint reg_base, uint word_offset) {
+    if (word_offset < 16) {
+        asm_xtensa_op_l32i_n(as, reg_dest, reg_base, word_offset);
+    } else {
+        asm_xtensa_op_l32i(as, reg_dest, reg_base, word_offset);
+    }
+}
+
+void asm_xtensa_s32i_optimised(asm_xtensa_t *as, uint reg_src, uint reg_base, uint word_offset) {
+    if (word_offset < 16) {
+        asm_xtensa_op_s32i_n(as, reg_src, reg_base, word_offset);
+    } else {
+        asm_xtensa_op_s32i(as, reg_src, reg_base, word_offset);
+    }
 }
 
 #endif // MICROPY_EMIT_XTENSA || MICROPY_EMIT_INLINE_XTENSA
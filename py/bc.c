@@ -70,6 +70,56 @@ const byte *mp_decode_uint_skip(const byte *ptr) {
     return ptr;
 }
 
+// Return the source line of the instruction at ip in the given bytecode, and
+// the name of the function and the file it comes from.
+size_t mp_bytecode_get_source_line(const byte *bytecode, const byte *ip, qstr *block_name, qstr *source_file) {
+    const byte *bc_info = bytecode;
+    bc_info = mp_decode_uint_skip(bc_info); // skip n_state
+    bc_info = mp_decode_uint_skip(bc_info); // skip n_exc_stack
+    bc_info++; // skip scope_params
+    bc_info++; // skip n_pos_args
+    bc_info++; // skip n_kwonly_args
+    bc_info++; // skip n_def_pos_args
+    size_t bc = ip - bc_info;
+    size_t code_info_size = mp_decode_uint_value(bc_info);
+    bc_info = mp_decode_uint_skip(bc_info); // skip code_info_size
+    bc -= code_info_size;
+    #if MICROPY_PERSISTENT_CODE
+    *block_name = bc_info[0] | (bc_info[1] << 8);
+    *source_file = bc_info[2] | (bc_info[3] << 8);
+    bc_info += 4;
+    #else
+    *block_name = mp_decode_uint_value(bc_info);
+    bc_info = mp_decode_uint_skip(bc_info);
+    *source_file = mp_decode_uint_value(bc_info);
+    bc_info = mp_decode_uint_skip(bc_info);
+    #endif
+    size_t source_line = 1;
+    size_t c;
+    while ((c = *bc_info)) {
+        size_t b, l;
+        if ((c & 0x80) == 0) {
+            // 0b0LLBBBBB encoding
+            b = c & 0x1f;
+            l = c >> 5;
+            bc_info += 1;
+        } else {
+            // 0b1LLLBBBB 0bLLLLLLLL encoding (l's LSB in second byte)
+            b = c & 0xf;
+            l = ((c << 4) & 0x700) | bc_info[1];
+            bc_info += 2;
+        }
+        if (bc >= b) {
+            bc -= b;
+            source_line += l;
+        } else {
+            // found source line corresponding to bytecode offset
+            break;
+        }
+    }
+    return source_line;
+}
+
 STATIC NORETURN void fun_pos_args_mismatch(mp_obj_fun_bc_t *f, size_t expected, size_t given) {
 #if MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_TERSE
     // generic message, used also for other argument issues
@@ -115,7 +165,7 @@ void mp_setup_code_state(mp_code_state_t *code_state, size_t n_args, size_t n_kw
     // ip comes in as an offset into bytecode, so turn it into a true pointer
     code_state->ip = self->bytecode + (size_t)code_state->ip;
 
-    #if MICROPY_STACKLESS
+    #if MICROPY_STACKLESS || MICROPY_TRACK_CODE_STATE
     code_state->prev = NULL;
     #endif
 
@@ -287,15 +337,20 @@ continue2:;
 #if MICROPY_PERSISTENT_CODE_LOAD || MICROPY_PERSISTENT_CODE_SAVE
 
 // The following table encodes the number of bytes that a specific opcode
-// takes up.  There are 3 special opcodes that always have an extra byte:
+// takes up.  There are 6 special opcodes that always have an extra byte:
 //     MP_BC_MAKE_CLOSURE
 //     MP_BC_MAKE_CLOSURE_DEFARGS
 //     MP_BC_RAISE_VARARGS
-// There are 4 special opcodes that have an extra byte only when
+//     MP_BC_LOAD_FAST_LOAD_FAST
+//     MP_BC_BINARY_OP_POP_JUMP_IF_TRUE
+//     MP_BC_BINARY_OP_POP_JUMP_IF_FALSE
+// and MP_BC_BINARY_OP_SMALL_INT always has 2 extra bytes.
+// There are 5 special opcodes that have an extra byte only when
 // MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE is enabled:
 //     MP_BC_LOAD_NAME
 //     MP_BC_LOAD_GLOBAL
 //     MP_BC_LOAD_ATTR
+//     MP_BC_LOAD_METHOD
 //     MP_BC_STORE_ATTR
 #define OC4(a, b, c, d) (a | (b << 2) | (c << 4) | (d << 6))
 #define U (0) // undefined opcode
@@ -322,7 +377,7 @@ STATIC const byte opcode_format_table[64] = {
     OC4(U, O, B, O), // 0x3c-0x3f
     OC4(O, B, B, O), // 0x40-0x43
     OC4(B, B, O, B), // 0x44-0x47
-    OC4(U, U, U, U), // 0x48-0x4b
+    OC4(B, B, O, O), // 0x48-0x4b
     OC4(U, U, U, U), // 0x4c-0x4f
     OC4(V, V, U, V), // 0x50-0x53
     OC4(B, U, V, V), // 0x54-0x57
@@ -386,19 +441,24 @@ uint mp_opcode_format(const byte *ip, size_t *opcode_size) {
     uint f = (opcode_format_table[*ip >> 2] >> (2 * (*ip & 3))) & 3;
     const byte *ip_start = ip;
     if (f == MP_OPCODE_QSTR) {
+        if (MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE_DYNAMIC && (
+            *ip == MP_BC_LOAD_NAME
+            || *ip == MP_BC_LOAD_GLOBAL
+            || *ip == MP_BC_LOAD_ATTR
+            || *ip == MP_BC_LOAD_METHOD
+            || *ip == MP_BC_STORE_ATTR)) {
+            ip += 1;
+        }
         ip += 3;
     } else {
         int extra_byte = (
             *ip == MP_BC_RAISE_VARARGS
             || *ip == MP_BC_MAKE_CLOSURE
             || *ip == MP_BC_MAKE_CLOSURE_DEFARGS
-            #if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
-            || *ip == MP_BC_LOAD_NAME
-            || *ip == MP_BC_LOAD_GLOBAL
-            || *ip == MP_BC_LOAD_ATTR
-            || *ip == MP_BC_STORE_ATTR
-            #endif
-        );
+            || *ip == MP_BC_LOAD_FAST_LOAD_FAST
+            || *ip == MP_BC_BINARY_OP_POP_JUMP_IF_TRUE
+            || *ip == MP_BC_BINARY_OP_POP_JUMP_IF_FALSE
+        ) + 2 * (*ip == MP_BC_BINARY_OP_SMALL_INT);
         ip += 1;
         if (f == MP_OPCODE_VAR_UINT) {
             while ((*ip++ & 0x80) != 0) {
@@ -80,7 +80,7 @@ typedef struct _mp_code_state_t {
     // bit 0 is saved currently_in_except_block value
     mp_exc_stack_t *exc_sp;
     mp_obj_dict_t *old_globals;
-    #if MICROPY_STACKLESS
+    #if MICROPY_STACKLESS || MICROPY_TRACK_CODE_STATE
     struct _mp_code_state_t *prev;
     #endif
     // Variable-length
@@ -92,9 +92,28 @@ typedef struct _mp_code_state_t {
 mp_uint_t mp_decode_uint(const byte **ptr);
 mp_uint_t mp_decode_uint_value(const byte *ptr);
 const byte *mp_decode_uint_skip(const byte *ptr);
+size_t mp_bytecode_get_source_line(const byte *bytecode, const byte *ip, qstr *block_name, qstr *source_file);
 
 mp_vm_return_kind_t mp_execute_bytecode(mp_code_state_t *code_state, volatile mp_obj_t inject_exc);
+
+#if MICROPY_VM_STATS
+// Number of times each opcode was executed, and each opcode (second index) was
+// executed straight after another (first index) in the same frame.  The first
+// opcode executed when entering or resuming a frame is counted after opcode 0.
+typedef struct _mp_vm_stats_t {
+    uint32_t op_count[256];
+    uint32_t pair_count[256][256];
+} mp_vm_stats_t;
+
+extern mp_vm_stats_t mp_vm_stats;
+
+// Print the non-zero counts as "op <opcode> <count>" and
+// "pair <opcode> <opcode> <count>" lines.
+void mp_vm_stats_dump(const mp_print_t *print);
+#endif
+
 mp_code_state_t *mp_obj_fun_bc_prepare_codestate(mp_obj_t func, size_t n_args, size_t n_kw, const mp_obj_t *args);
+void mp_obj_fun_bc_free_codestate(mp_code_state_t *code_state);
 void mp_setup_code_state(mp_code_state_t *code_state, size_t n_args, size_t n_kw, const mp_obj_t *args);
 void mp_bytecode_print(const void *descr, const byte *code, mp_uint_t len, const mp_uint_t *const_table);
 void mp_bytecode_print2(const byte *code, size_t len, const mp_uint_t *const_table);
@@ -82,6 +82,12 @@
 #define MP_BC_UNWIND_JUMP        (0x46) // rel byte code offset, 16-bit signed, in excess; then a byte
 #define MP_BC_GET_ITER_STACK     (0x47)
 
+// superinstructions
+#define MP_BC_LOAD_FAST_LOAD_FAST         (0x48) // byte: two local nums, 4 bits each
+#define MP_BC_BINARY_OP_SMALL_INT         (0x49) // byte: op; signed byte: rhs
+#define MP_BC_BINARY_OP_POP_JUMP_IF_TRUE  (0x4a) // byte: op; rel byte code offset, 16-bit signed, in excess
+#define MP_BC_BINARY_OP_POP_JUMP_IF_FALSE (0x4b) // byte: op; rel byte code offset, 16-bit signed, in excess
+
 #define MP_BC_BUILD_TUPLE        (0x50) // uint
 #define MP_BC_BUILD_LIST         (0x51) // uint
 #define MP_BC_BUILD_MAP          (0x53) // uint
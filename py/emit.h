@@ -159,11 +159,11 @@ extern const mp_emit_method_table_id_ops_t mp_emit_bc_method_table_store_id_ops;
 extern const mp_emit_method_table_id_ops_t mp_emit_bc_method_table_delete_id_ops;
 
 emit_t *emit_bc_new(void);
-emit_t *emit_native_x64_new(mp_obj_t *error_slot, mp_uint_t max_num_labels);
-emit_t *emit_native_x86_new(mp_obj_t *error_slot, mp_uint_t max_num_labels);
-emit_t *emit_native_thumb_new(mp_obj_t *error_slot, mp_uint_t max_num_labels);
-emit_t *emit_native_arm_new(mp_obj_t *error_slot, mp_uint_t max_num_labels);
-emit_t *emit_native_xtensa_new(mp_obj_t *error_slot, mp_uint_t max_num_labels);
+emit_t *emit_native_x64_new(mp_obj_t *error_slot, uint *label_slot, mp_uint_t max_num_labels);
+emit_t *emit_native_x86_new(mp_obj_t *error_slot, uint *label_slot, mp_uint_t max_num_labels);
+emit_t *emit_native_thumb_new(mp_obj_t *error_slot, uint *label_slot, mp_uint_t max_num_labels);
+emit_t *emit_native_arm_new(mp_obj_t *error_slot, uint *label_slot, mp_uint_t max_num_labels);
+emit_t *emit_native_xtensa_new(mp_obj_t *error_slot, uint *label_slot, mp_uint_t max_num_labels);
 
 void emit_bc_set_max_num_labels(emit_t* emit, mp_uint_t max_num_labels);
 
@@ -174,6 +174,29 @@ void emit_native_thumb_free(emit_t *emit);
 void emit_native_arm_free(emit_t *emit);
 void emit_native_xtensa_free(emit_t *emit);
 
+#if MICROPY_EMIT_NATIVE_TIERING
+mp_uint_t emit_native_x64_osr_entry(emit_t *emit, mp_uint_t label, mp_uint_t n_state_bc, mp_uint_t stack_depth, mp_uint_t ip_local);
+mp_uint_t emit_native_x86_osr_entry(emit_t *emit, mp_uint_t label, mp_uint_t n_state_bc, mp_uint_t stack_depth, mp_uint_t ip_local);
+mp_uint_t emit_native_thumb_osr_entry(emit_t *emit, mp_uint_t label, mp_uint_t n_state_bc, mp_uint_t stack_depth, mp_uint_t ip_local);
+mp_uint_t emit_native_arm_osr_entry(emit_t *emit, mp_uint_t label, mp_uint_t n_state_bc, mp_uint_t stack_depth, mp_uint_t ip_local);
+mp_uint_t emit_native_xtensa_osr_entry(emit_t *emit, mp_uint_t label, mp_uint_t n_state_bc, mp_uint_t stack_depth, mp_uint_t ip_local);
+void emit_native_x64_tier_entry(emit_t *emit, mp_uint_t ip_local);
+void emit_native_x86_tier_entry(emit_t *emit, mp_uint_t ip_local);
+void emit_native_thumb_tier_entry(emit_t *emit, mp_uint_t ip_local);
+void emit_native_arm_tier_entry(emit_t *emit, mp_uint_t ip_local);
+void emit_native_xtensa_tier_entry(emit_t *emit, mp_uint_t ip_local);
+void emit_native_x64_tier_set_ip(emit_t *emit, mp_uint_t ip_local, const byte *ip);
+void emit_native_x86_tier_set_ip(emit_t *emit, mp_uint_t ip_local, const byte *ip);
+void emit_native_thumb_tier_set_ip(emit_t *emit, mp_uint_t ip_local, const byte *ip);
+void emit_native_arm_tier_set_ip(emit_t *emit, mp_uint_t ip_local, const byte *ip);
+void emit_native_xtensa_tier_set_ip(emit_t *emit, mp_uint_t ip_local, const byte *ip);
+void emit_native_x64_tier_loop_hook(emit_t *emit);
+void emit_native_x86_tier_loop_hook(emit_t *emit);
+void emit_native_thumb_tier_loop_hook(emit_t *emit);
+void emit_native_arm_tier_loop_hook(emit_t *emit);
+void emit_native_xtensa_tier_loop_hook(emit_t *emit);
+#endif
+
 void mp_emit_bc_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scope);
 void mp_emit_bc_end_pass(emit_t *emit);
 bool mp_emit_bc_last_emit_was_return_value(emit_t *emit);
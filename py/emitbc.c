@@ -64,6 +64,13 @@ struct _emit_t {
     size_t bytecode_size;
     byte *code_base; // stores both byte code and code info
 
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    // the last instruction written, if it can start a superinstruction
+    size_t last_op_offset;
+    byte last_op;
+    byte last_op_arg;
+    #endif
+
     #if MICROPY_PERSISTENT_CODE
     uint16_t ct_cur_obj;
     uint16_t ct_num_obj;
@@ -306,6 +313,30 @@ STATIC void emit_write_bytecode_byte_signed_label(emit_t *emit, byte b1, mp_uint
     c[2] = bytecode_offset >> 8;
 }
 
+#if MICROPY_OPT_SUPERINSTRUCTIONS
+// Remember that the single byte instruction just written, from the group of
+// opcodes starting at op, may be fused with the one that follows it.
+STATIC void emit_bc_fusable(emit_t *emit, byte op, byte arg) {
+    emit->last_op_offset = emit->bytecode_offset - 1;
+    emit->last_op = op;
+    emit->last_op_arg = arg;
+}
+
+// If the instruction just written is from the group of opcodes starting at op,
+// and it is not followed by a label or the start of a new line, then rewind
+// over it so the caller can write a superinstruction in its place.
+STATIC bool emit_bc_fuse(emit_t *emit, byte op) {
+    if (emit->last_op != op
+        || emit->last_op_offset + 1 != emit->bytecode_offset
+        || emit->last_op_offset < emit->last_source_line_offset) {
+        return false;
+    }
+    emit->bytecode_offset = emit->last_op_offset;
+    emit->last_op = 0;
+    return true;
+}
+#endif
+
 void mp_emit_bc_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scope) {
     emit->pass = pass;
     emit->stack_size = 0;
@@ -318,6 +349,9 @@ void mp_emit_bc_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scope) {
     }
     emit->bytecode_offset = 0;
     emit->code_info_offset = 0;
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    emit->last_op = 0;
+    #endif
 
     // Write local state size and exception stack size.
     {
@@ -489,6 +523,10 @@ void mp_emit_bc_label_assign(emit_t *emit, mp_uint_t l) {
         return;
     }
     assert(l < emit->max_num_labels);
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    // the code after a label can't be fused with the code before it
+    emit->last_op = 0;
+    #endif
     if (emit->pass < MP_PASS_EMIT) {
         // assign label offset
         assert(emit->label_offsets[l] == (mp_uint_t)-1);
@@ -532,6 +570,9 @@ void mp_emit_bc_load_const_small_int(emit_t *emit, mp_int_t arg) {
     emit_bc_pre(emit, 1);
     if (-16 <= arg && arg <= 47) {
         emit_write_bytecode_byte(emit, MP_BC_LOAD_CONST_SMALL_INT_MULTI + 16 + arg);
+        #if MICROPY_OPT_SUPERINSTRUCTIONS
+        emit_bc_fusable(emit, MP_BC_LOAD_CONST_SMALL_INT_MULTI, arg);
+        #endif
     } else {
         emit_write_bytecode_byte_int(emit, MP_BC_LOAD_CONST_SMALL_INT, arg);
     }
@@ -556,7 +597,16 @@ void mp_emit_bc_load_fast(emit_t *emit, qstr qst, mp_uint_t local_num) {
     (void)qst;
     emit_bc_pre(emit, 1);
     if (local_num <= 15) {
+        #if MICROPY_OPT_SUPERINSTRUCTIONS
+        if (emit_bc_fuse(emit, MP_BC_LOAD_FAST_MULTI)) {
+            emit_write_bytecode_byte_byte(emit, MP_BC_LOAD_FAST_LOAD_FAST, emit->last_op_arg << 4 | local_num);
+            return;
+        }
+        #endif
         emit_write_bytecode_byte(emit, MP_BC_LOAD_FAST_MULTI + local_num);
+        #if MICROPY_OPT_SUPERINSTRUCTIONS
+        emit_bc_fusable(emit, MP_BC_LOAD_FAST_MULTI, local_num);
+        #endif
     } else {
         emit_write_bytecode_byte_uint(emit, MP_BC_LOAD_FAST_N, local_num);
     }
@@ -597,6 +647,9 @@ void mp_emit_bc_load_attr(emit_t *emit, qstr qst) {
 void mp_emit_bc_load_method(emit_t *emit, qstr qst, bool is_super) {
     emit_bc_pre(emit, 1 - 2 * is_super);
     emit_write_bytecode_byte_qstr(emit, is_super ? MP_BC_LOAD_SUPER_METHOD : MP_BC_LOAD_METHOD, qst);
+    if (MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE_DYNAMIC && !is_super) {
+        emit_write_bytecode_byte(emit, 0);
+    }
 }
 
 void mp_emit_bc_load_build_class(emit_t *emit) {
@@ -712,6 +765,14 @@ void mp_emit_bc_jump(emit_t *emit, mp_uint_t label) {
 
 void mp_emit_bc_pop_jump_if(emit_t *emit, bool cond, mp_uint_t label) {
     emit_bc_pre(emit, -1);
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    if (emit_bc_fuse(emit, MP_BC_BINARY_OP_MULTI)) {
+        // the jump offset is relative to the end of the whole instruction
+        emit_write_bytecode_byte(emit, cond ? MP_BC_BINARY_OP_POP_JUMP_IF_TRUE : MP_BC_BINARY_OP_POP_JUMP_IF_FALSE);
+        emit_write_bytecode_byte_signed_label(emit, emit->last_op_arg, label);
+        return;
+    }
+    #endif
     if (cond) {
         emit_write_bytecode_byte_signed_label(emit, MP_BC_POP_JUMP_IF_TRUE, label);
     } else {
@@ -816,7 +877,20 @@ void mp_emit_bc_binary_op(emit_t *emit, mp_binary_op_t op) {
         op = MP_BINARY_OP_IS;
     }
     emit_bc_pre(emit, -1);
-    emit_write_bytecode_byte(emit, MP_BC_BINARY_OP_MULTI + op);
+    #if MICROPY_OPT_SUPERINSTRUCTIONS
+    if (emit_bc_fuse(emit, MP_BC_LOAD_CONST_SMALL_INT_MULTI)) {
+        byte *c = emit_get_cur_to_write_bytecode(emit, 3);
+        c[0] = MP_BC_BINARY_OP_SMALL_INT;
+        c[1] = op;
+        c[2] = emit->last_op_arg;
+    } else
+    #endif
+    {
+        emit_write_bytecode_byte(emit, MP_BC_BINARY_OP_MULTI + op);
+        #if MICROPY_OPT_SUPERINSTRUCTIONS
+        emit_bc_fusable(emit, MP_BC_BINARY_OP_MULTI, op);
+        #endif
+    }
     if (invert) {
         emit_bc_pre(emit, 0);
         emit_write_bytecode_byte(emit, MP_BC_UNARY_OP_MULTI + MP_UNARY_OP_NOT);
@@ -39,6 +39,36 @@ typedef enum {
     MP_CODE_NATIVE_ASM,
 } mp_raw_code_kind_t;
 
+// Words in native code that depend on the runtime it runs in, and so are
+// patched when the code is loaded from a .mpy file.  The value of a word is
+// given by mp_native_reloc_value from its kind and the value stored with it.
+typedef enum {
+    MP_NATIVE_RELOC_FUN_TABLE,  // address of mp_fun_table
+    MP_NATIVE_RELOC_FUN,        // value is an index into mp_fun_table
+    MP_NATIVE_RELOC_CONST,      // value is one of mp_native_const_t
+    MP_NATIVE_RELOC_QSTR,       // value is a qstr
+    MP_NATIVE_RELOC_QSTR16,     // value is a qstr, stored as 16 bits in the code
+    MP_NATIVE_RELOC_QSTR_OBJ,   // value is a qstr, stored as an object
+    MP_NATIVE_RELOC_OBJ,        // value is a constant object
+    MP_NATIVE_RELOC_RAW_CODE,   // value is a child mp_raw_code_t
+} mp_native_reloc_kind_t;
+
+typedef enum {
+    MP_NATIVE_CONST_NONE,
+    MP_NATIVE_CONST_FALSE,
+    MP_NATIVE_CONST_TRUE,
+    MP_NATIVE_CONST_ELLIPSIS,
+    MP_NATIVE_CONST_TYPE_RUNTIME_ERROR,
+    MP_NATIVE_CONST_STOP_ITERATION, // these two differ in debug builds
+    MP_NATIVE_CONST_SENTINEL,
+} mp_native_const_t;
+
+typedef struct _mp_native_reloc_t {
+    uint32_t offset;
+    uint32_t kind;
+    mp_uint_t value;
+} mp_native_reloc_t;
+
 typedef struct _mp_raw_code_t {
     mp_raw_code_kind_t kind : 3;
     mp_uint_t scope_flags : 7;
@@ -57,6 +87,11 @@ typedef struct _mp_raw_code_t {
             void *fun_data;
             const mp_uint_t *const_table;
             mp_uint_t type_sig; // for viper, compressed as 2-bit types; ret is MSB, then arg0, arg1, etc
+            #if MICROPY_PERSISTENT_CODE_SAVE
+            mp_uint_t fun_len;
+            const mp_native_reloc_t *relocs;
+            uint16_t n_reloc;
+            #endif
         } u_native;
     } data;
 } mp_raw_code_t;
@@ -69,7 +104,14 @@ void mp_emit_glue_assign_bytecode(mp_raw_code_t *rc, const byte *code, mp_uint_t
     uint16_t n_obj, uint16_t n_raw_code,
     #endif
     mp_uint_t scope_flags);
-void mp_emit_glue_assign_native(mp_raw_code_t *rc, mp_raw_code_kind_t kind, void *fun_data, mp_uint_t fun_len, const mp_uint_t *const_table, mp_uint_t n_pos_args, mp_uint_t scope_flags, mp_uint_t type_sig);
+void mp_emit_glue_assign_native(mp_raw_code_t *rc, mp_raw_code_kind_t kind, void *fun_data, mp_uint_t fun_len,
+    const mp_uint_t *const_table,
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    const mp_native_reloc_t *relocs, uint16_t n_reloc,
+    #endif
+    mp_uint_t n_pos_args, mp_uint_t scope_flags, mp_uint_t type_sig);
+
+mp_uint_t mp_native_reloc_value(mp_native_reloc_kind_t kind, mp_uint_t value);
 
 mp_obj_t mp_make_function_from_raw_code(const mp_raw_code_t *rc, mp_obj_t def_args, mp_obj_t def_kw_args);
 mp_obj_t mp_make_closure_from_raw_code(const mp_raw_code_t *rc, mp_uint_t n_closed_over, const mp_obj_t *args);
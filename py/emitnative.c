@@ -125,6 +125,9 @@ STATIC byte mp_f_n_args[MP_F_NUMBER_OF] = {
     [MP_F_SETUP_CODE_STATE] = 5,
     [MP_F_SMALL_INT_FLOOR_DIVIDE] = 2,
     [MP_F_SMALL_INT_MODULO] = 2,
+    [MP_F_NATIVE_YIELD_FROM] = 3,
+    [MP_F_NATIVE_TIER_IP] = 0,
+    [MP_F_NATIVE_TIER_LOOP_HOOK] = 0,
 };
 
 #include "py/asmx86.h"
@@ -154,6 +157,13 @@ STATIC byte mp_f_n_args[MP_F_NUMBER_OF] = {
 
 #endif
 
+// whether viper code can use the float type with this emitter
+#if MICROPY_EMIT_NATIVE_FLOAT && defined(ASM_FLOAT_ADD_REG_REG)
+#define N_FLOAT (1)
+#else
+#define N_FLOAT (0)
+#endif
+
 #define EMIT_NATIVE_VIPER_TYPE_ERROR(emit, ...) do { \
         *emit->error_slot = mp_obj_new_exception_msg_varg(&mp_type_ViperTypeError, __VA_ARGS__); \
     } while (0)
@@ -175,6 +185,7 @@ typedef enum {
     VTYPE_PTR8 = 0x00 | MP_NATIVE_TYPE_PTR8,
     VTYPE_PTR16 = 0x00 | MP_NATIVE_TYPE_PTR16,
     VTYPE_PTR32 = 0x00 | MP_NATIVE_TYPE_PTR32,
+    VTYPE_FLOAT = 0x00 | MP_NATIVE_TYPE_FLOAT,
 
     VTYPE_PTR_NONE = 0x50 | MP_NATIVE_TYPE_PTR,
 
@@ -192,6 +203,9 @@ STATIC qstr vtype_to_qstr(vtype_kind_t vtype) {
         case VTYPE_PTR8: return MP_QSTR_ptr8;
         case VTYPE_PTR16: return MP_QSTR_ptr16;
         case VTYPE_PTR32: return MP_QSTR_ptr32;
+        #if N_FLOAT
+        case VTYPE_FLOAT: return MP_QSTR_float;
+        #endif
         case VTYPE_PTR_NONE: default: return MP_QSTR_None;
     }
 }
@@ -205,24 +219,83 @@ typedef struct _stack_info_t {
     } data;
 } stack_info_t;
 
+// kinds of entries in the compile-time stack of exception handlers
+#define EXC_KIND_EXCEPT (0)
+#define EXC_KIND_FINALLY (1)
+#define EXC_KIND_WITH (2)
+
+typedef struct _exc_stack_entry_t {
+    mp_uint_t label;
+    uint16_t kind;
+    uint16_t serial; // identifies the entry within the scope
+    uint16_t stack_base; // stack size at the start of an except handler
+    bool is_active; // false once the handler itself is running
+} exc_stack_entry_t;
+
+// A break/continue/return that goes through a finally block leaves the block
+// with the given unwind id, and the end of the block must then jump to dest.
+typedef struct _unwind_record_t {
+    uint16_t serial;
+    mp_uint_t unwind_id;
+    mp_uint_t dest;
+} unwind_record_t;
+
+// A use of a local, recorded in the stack-size pass to choose which locals to
+// keep in registers.  loop_depth is the number of loops around the use.
+typedef struct _local_use_t {
+    uint16_t local_num;
+    uint16_t loop_depth;
+} local_use_t;
+
 struct _emit_t {
     mp_obj_t *error_slot;
+    uint *label_slot;
+    uint exit_label;
     int pass;
 
     bool do_viper_types;
+    bool is_gen;
 
     vtype_kind_t return_vtype;
 
     mp_uint_t local_vtype_alloc;
     vtype_kind_t *local_vtype;
+    uint8_t *local_reg; // 1 + index into reg_local_table, or 0 if in the frame
+
+    size_t local_use_alloc;
+    size_t local_use_len;
+    local_use_t *local_use;
+    mp_uint_t max_num_labels;
+    size_t *label_use_pos;
 
     mp_uint_t stack_info_alloc;
     stack_info_t *stack_info;
     vtype_kind_t saved_stack_vtype;
 
+    size_t exc_stack_alloc;
+    size_t exc_stack_size;
+    exc_stack_entry_t *exc_stack;
+    size_t exc_serial;
+
+    size_t unwind_alloc;
+    size_t unwind_len;
+    unwind_record_t *unwind;
+
+    size_t dispatch_alloc;
+    size_t dispatch_len;
+    mp_uint_t *dispatch_label;
+
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    size_t reloc_alloc;
+    size_t reloc_len;
+    mp_native_reloc_t *reloc;
+    #endif
+
     int prelude_offset;
     int const_table_offset;
     int n_state;
+    int code_state_start;
+    int state_start;
     int stack_start;
     int stack_size;
 
@@ -233,11 +306,14 @@ struct _emit_t {
     ASM_T *as;
 };
 
-emit_t *EXPORT_FUN(new)(mp_obj_t *error_slot, mp_uint_t max_num_labels) {
+emit_t *EXPORT_FUN(new)(mp_obj_t *error_slot, uint *label_slot, mp_uint_t max_num_labels) {
     emit_t *emit = m_new0(emit_t, 1);
     emit->error_slot = error_slot;
+    emit->label_slot = label_slot;
     emit->as = m_new0(ASM_T, 1);
     mp_asm_base_init(&emit->as->base, max_num_labels);
+    emit->max_num_labels = max_num_labels;
+    emit->label_use_pos = m_new(size_t, max_num_labels);
     return emit;
 }
 
@@ -245,7 +321,16 @@ void EXPORT_FUN(free)(emit_t *emit) {
     mp_asm_base_deinit(&emit->as->base, false);
     m_del_obj(ASM_T, emit->as);
     m_del(vtype_kind_t, emit->local_vtype, emit->local_vtype_alloc);
+    m_del(uint8_t, emit->local_reg, emit->local_vtype_alloc);
+    m_del(local_use_t, emit->local_use, emit->local_use_alloc);
+    m_del(size_t, emit->label_use_pos, emit->max_num_labels);
     m_del(stack_info_t, emit->stack_info, emit->stack_info_alloc);
+    m_del(exc_stack_entry_t, emit->exc_stack, emit->exc_stack_alloc);
+    m_del(unwind_record_t, emit->unwind, emit->unwind_alloc);
+    m_del(mp_uint_t, emit->dispatch_label, emit->dispatch_alloc);
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    m_del(mp_native_reloc_t, emit->reloc, emit->reloc_alloc);
+    #endif
     m_del_obj(emit_t, emit);
 }
 
@@ -266,6 +351,9 @@ STATIC void emit_native_set_native_type(emit_t *emit, mp_uint_t op, mp_uint_t ar
                 case MP_QSTR_ptr8: type = VTYPE_PTR8; break;
                 case MP_QSTR_ptr16: type = VTYPE_PTR16; break;
                 case MP_QSTR_ptr32: type = VTYPE_PTR32; break;
+                #if N_FLOAT
+                case MP_QSTR_float: type = VTYPE_FLOAT; break;
+                #endif
                 default: EMIT_NATIVE_VIPER_TYPE_ERROR(emit, "unknown type '%q'", arg2); return;
             }
             if (op == MP_EMIT_NATIVE_TYPE_RETURN) {
@@ -283,24 +371,345 @@ STATIC void emit_pre_pop_reg(emit_t *emit, vtype_kind_t *vtype, int reg_dest);
 STATIC void emit_post_push_reg(emit_t *emit, vtype_kind_t vtype, int reg);
 STATIC void emit_native_load_fast(emit_t *emit, qstr qst, mp_uint_t local_num);
 STATIC void emit_native_store_fast(emit_t *emit, qstr qst, mp_uint_t local_num);
+STATIC void emit_call(emit_t *emit, mp_fun_kind_t fun_kind);
 
 #define STATE_START (sizeof(mp_code_state_t) / sizeof(mp_uint_t))
 
+// Functions with exception handlers, and generators, run all their code under
+// one nlr_buf_t that is pushed at the start of the function.  When it catches
+// an exception it jumps to the handler whose id (its label plus one) is in the
+// EXC_HANDLER_PC slot of the frame, after pushing the nlr_buf_t again.  The
+// handlers themselves are tracked at compile time in emit->exc_stack, so there
+// is no exception stack at run time.  Because the registers are restored by
+// nlr_jump, such functions keep all their locals in the frame.
+//
+// The frame (the locals of the assembler) is laid out as follows, where the
+// state is that of a mp_code_state_t and is at the end of the frame:
+//
+//     nlr_buf_t (only with the global exception handler)
+//     EXC_HANDLER_UNWIND (only with the global exception handler)
+//     mp_code_state_t header (not for viper)
+//     state[0]: Python value stack
+//     saved exceptions (one per exception level)
+//     RET_VAL
+//     EXC_HANDLER_PC
+//     locals, in reverse order
+//
+// A native generator keeps everything from the mp_code_state_t onwards in the
+// heap, in its generator instance, so it is preserved across a yield.
+#define NLR_BUF_SIZE (sizeof(nlr_buf_t) / sizeof(uintptr_t))
+#define NEED_GLOBAL_EXC_HANDLER(emit) ((emit)->scope->exc_stack_size > 0 || (emit)->is_gen)
+#define CAN_USE_REGS_FOR_LOCALS(emit) (!NEED_GLOBAL_EXC_HANDLER(emit))
+
+#define LOCAL_IDX_EXC_VAL(emit) (offsetof(nlr_buf_t, ret_val) / sizeof(uintptr_t))
+#define LOCAL_IDX_EXC_HANDLER_UNWIND(emit) (NLR_BUF_SIZE)
+#define LOCAL_IDX_EXC_HANDLER_PC(emit) ((emit)->state_start + (emit)->n_state - 1 - (emit)->scope->num_locals)
+#define LOCAL_IDX_RET_VAL(emit) (LOCAL_IDX_EXC_HANDLER_PC(emit) - 1)
+#define LOCAL_IDX_SAVED_EXC(emit, level) (LOCAL_IDX_RET_VAL(emit) - 1 - (level))
+#define LOCAL_IDX_CODE_STATE(emit, field) ((emit)->code_state_start + offsetof(mp_code_state_t, field) / sizeof(uintptr_t))
+
+// labels reserved by the compiler for each scope
+#define LABEL_EXIT(emit) ((emit)->exit_label)
+#define LABEL_NLR(emit) ((emit)->exit_label + 1)
+#define LABEL_GLOBAL_EXCEPT(emit) ((emit)->exit_label + 2)
+#define LABEL_DISPATCH(emit) ((emit)->exit_label + 3)
+#define LABEL_START(emit) ((emit)->exit_label + 4)
+#define LABEL_UNHANDLED(emit) ((emit)->exit_label + 5)
+
+// registers that hold values for the whole function, when there is a global
+// exception handler (and so locals aren't kept in registers)
+#define REG_GENERATOR_STATE (REG_LOCAL_1)
+#define REG_DISPATCH (REG_LOCAL_2)
+
+STATIC const uint8_t reg_local_table[REG_LOCAL_NUM] = {
+    REG_LOCAL_1, REG_LOCAL_2, REG_LOCAL_3,
+    #if REG_LOCAL_NUM > 3
+    REG_LOCAL_4, REG_LOCAL_5,
+    #endif
+};
+
+STATIC int local_idx(emit_t *emit, mp_uint_t local_num) {
+    if (emit->do_viper_types && CAN_USE_REGS_FOR_LOCALS(emit)) {
+        return local_num;
+    } else {
+        return emit->state_start + emit->n_state - 1 - local_num;
+    }
+}
+
+// Returns the register that holds the given local, or -1 if it's in the frame
+STATIC int local_reg(emit_t *emit, mp_uint_t local_num) {
+    if (!CAN_USE_REGS_FOR_LOCALS(emit) || emit->local_reg[local_num] == 0) {
+        return -1;
+    }
+    return reg_local_table[emit->local_reg[local_num] - 1];
+}
+
+// Register allocation for locals: the stack-size pass records each use of a
+// local, and the loops that it is in (found from the backward jumps), then the
+// locals with the most uses, weighted by loop depth, are kept in registers for
+// the following passes.  The registers are callee-saved so a local keeps its
+// register for the whole function, across calls and control flow.
+STATIC void emit_native_record_local_use(emit_t *emit, mp_uint_t local_num) {
+    if (emit->pass != MP_PASS_STACK_SIZE) {
+        return;
+    }
+    if (emit->local_use_len >= emit->local_use_alloc) {
+        emit->local_use = m_renew(local_use_t, emit->local_use, emit->local_use_alloc, emit->local_use_alloc + 32);
+        emit->local_use_alloc += 32;
+    }
+    local_use_t *u = &emit->local_use[emit->local_use_len++];
+    u->local_num = local_num;
+    u->loop_depth = 0;
+}
+
+STATIC void emit_native_record_label(emit_t *emit, mp_uint_t label) {
+    if (emit->pass == MP_PASS_STACK_SIZE && label < emit->max_num_labels) {
+        emit->label_use_pos[label] = emit->local_use_len;
+    }
+}
+
+STATIC void emit_native_record_jump(emit_t *emit, mp_uint_t label) {
+    if (emit->pass == MP_PASS_STACK_SIZE && label < emit->max_num_labels
+        && emit->label_use_pos[label] != (size_t)-1) {
+        // a backward jump, so the uses since the label are in a loop
+        for (size_t i = emit->label_use_pos[label]; i < emit->local_use_len; ++i) {
+            if (emit->local_use[i].loop_depth < 3) {
+                emit->local_use[i].loop_depth += 1;
+            }
+        }
+    }
+}
+
+STATIC void emit_native_alloc_local_regs(emit_t *emit) {
+    size_t num_locals = emit->scope->num_locals;
+    memset(emit->local_reg, 0, num_locals);
+    if (!CAN_USE_REGS_FOR_LOCALS(emit) || num_locals == 0) {
+        return;
+    }
+
+    // weigh each use by 8 for each loop that it is in
+    mp_uint_t *weight = m_new0(mp_uint_t, num_locals);
+    for (size_t i = 0; i < emit->local_use_len; ++i) {
+        local_use_t *u = &emit->local_use[i];
+        weight[u->local_num] += 1 << (3 * u->loop_depth);
+    }
+
+    // give the registers to the heaviest locals, the lowest numbered first
+    for (size_t r = 0; r < REG_LOCAL_NUM; ++r) {
+        size_t best = num_locals;
+        for (size_t i = 0; i < num_locals; ++i) {
+            if (emit->local_reg[i] == 0 && (best == num_locals || weight[i] > weight[best])) {
+                best = i;
+            }
+        }
+        if (best == num_locals) {
+            break;
+        }
+        emit->local_reg[best] = 1 + r;
+    }
+    m_del(mp_uint_t, weight, num_locals);
+}
+
+// Accessors for slots of the frame, which are in the heap for generators
+STATIC bool frame_slot_in_heap(emit_t *emit, int local_num) {
+    return emit->is_gen && local_num >= emit->code_state_start;
+}
+
+STATIC void emit_native_mov_state_reg(emit_t *emit, int local_num, int reg_dest) {
+    if (frame_slot_in_heap(emit, local_num)) {
+        ASM_LOAD_REG_REG_OFFSET(emit->as, reg_dest, REG_GENERATOR_STATE, local_num - emit->code_state_start);
+    } else {
+        ASM_MOV_LOCAL_TO_REG(emit->as, local_num, reg_dest);
+    }
+}
+
+STATIC void emit_native_mov_reg_state(emit_t *emit, int reg_src, int local_num) {
+    if (frame_slot_in_heap(emit, local_num)) {
+        ASM_STORE_REG_REG_OFFSET(emit->as, reg_src, REG_GENERATOR_STATE, local_num - emit->code_state_start);
+    } else {
+        ASM_MOV_REG_TO_LOCAL(emit->as, reg_src, local_num);
+    }
+}
+
+STATIC void emit_native_mov_state_imm_via(emit_t *emit, int local_num, mp_uint_t imm, int reg_temp) {
+    if (frame_slot_in_heap(emit, local_num)) {
+        ASM_MOV_IMM_TO_REG(emit->as, imm, reg_temp);
+        ASM_STORE_REG_REG_OFFSET(emit->as, reg_temp, REG_GENERATOR_STATE, local_num - emit->code_state_start);
+    } else {
+        ASM_MOV_IMM_TO_LOCAL_USING(emit->as, imm, local_num, reg_temp);
+    }
+}
+
+STATIC void emit_native_mov_reg_state_addr(emit_t *emit, int reg_dest, int local_num) {
+    if (frame_slot_in_heap(emit, local_num)) {
+        ASM_MOV_IMM_TO_REG(emit->as, (local_num - emit->code_state_start) * ASM_WORD_SIZE, reg_dest);
+        ASM_ADD_REG_REG(emit->as, reg_dest, REG_GENERATOR_STATE);
+    } else {
+        ASM_MOV_LOCAL_ADDR_TO_REG(emit->as, local_num, reg_dest);
+    }
+}
+
+#if MICROPY_PERSISTENT_CODE_SAVE
+STATIC void emit_native_add_reloc(emit_t *emit, size_t offset, mp_native_reloc_kind_t kind, mp_uint_t value) {
+    if (emit->pass != MP_PASS_EMIT) {
+        return;
+    }
+    if (emit->reloc_len >= emit->reloc_alloc) {
+        emit->reloc = m_renew(mp_native_reloc_t, emit->reloc, emit->reloc_alloc, emit->reloc_alloc + 16);
+        emit->reloc_alloc += 16;
+    }
+    mp_native_reloc_t *r = &emit->reloc[emit->reloc_len++];
+    r->offset = offset;
+    r->kind = kind;
+    r->value = value;
+}
+#endif
+
+// Load a word that depends on the runtime into a register.  When the code
+// may be saved to a .mpy file the word is put where it can be patched on load.
+STATIC void emit_native_mov_reg_reloc(emit_t *emit, int reg_dest, mp_native_reloc_kind_t kind, mp_uint_t value) {
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    size_t offset = ASM_MOV_IMM_TO_REG_FIX_WORD(emit->as, mp_native_reloc_value(kind, value), reg_dest);
+    emit_native_add_reloc(emit, offset, kind, value);
+    #else
+    if (kind == MP_NATIVE_RELOC_OBJ || kind == MP_NATIVE_RELOC_RAW_CODE) {
+        // store the pointer aligned so the GC can find it in the code
+        ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, value, reg_dest);
+    } else {
+        ASM_MOV_IMM_TO_REG(emit->as, mp_native_reloc_value(kind, value), reg_dest);
+    }
+    #endif
+}
+
+STATIC void emit_native_mov_state_reloc_via(emit_t *emit, int local_num, mp_native_reloc_kind_t kind, mp_uint_t value, int reg_temp) {
+    emit_native_mov_reg_reloc(emit, reg_temp, kind, value);
+    emit_native_mov_reg_state(emit, reg_temp, local_num);
+}
+
+STATIC void emit_native_call_ind(emit_t *emit, mp_fun_kind_t fun_kind) {
+    #if MICROPY_PERSISTENT_CODE_SAVE && !N_THUMB && !N_ARM
+    // thumb and arm call via the table in r7, so only need it relocated
+    size_t offset = ASM_CALL_IND_FIX_WORD(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_add_reloc(emit, offset, MP_NATIVE_RELOC_FUN, fun_kind);
+    #else
+    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    #endif
+}
+
+STATIC void emit_native_add_dispatch(emit_t *emit, mp_uint_t label) {
+    if (emit->dispatch_len >= emit->dispatch_alloc) {
+        emit->dispatch_label = m_renew(mp_uint_t, emit->dispatch_label, emit->dispatch_alloc, emit->dispatch_alloc + 8);
+        emit->dispatch_alloc += 8;
+    }
+    emit->dispatch_label[emit->dispatch_len++] = label;
+}
+
+STATIC void emit_native_global_exc_entry(emit_t *emit) {
+    // push the nlr_buf_t that catches all exceptions in the function; after
+    // an exception the global handler comes back here with REG_DISPATCH set
+    mp_asm_base_label_assign(&emit->as->base, LABEL_NLR(emit));
+    ASM_MOV_LOCAL_ADDR_TO_REG(emit->as, 0, REG_ARG_1);
+    emit_call(emit, MP_F_NLR_PUSH);
+    ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, LABEL_GLOBAL_EXCEPT(emit));
+    ASM_JUMP(emit->as, LABEL_DISPATCH(emit));
+
+    // start of the code proper, which is also a point to dispatch to
+    mp_asm_base_label_assign(&emit->as->base, LABEL_START(emit));
+    emit_native_add_dispatch(emit, LABEL_START(emit));
+    if (emit->is_gen) {
+        // first time the generator runs: throw the value given to it, if any
+        ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_EXC_VAL(emit), REG_ARG_1);
+        emit_call(emit, MP_F_NATIVE_RAISE);
+    }
+}
+
+STATIC void emit_native_global_exc_exit(emit_t *emit) {
+    // normal exit from the function, with the return value in RET_VAL
+    mp_asm_base_label_assign(&emit->as->base, LABEL_EXIT(emit));
+    emit_call(emit, MP_F_NLR_POP);
+    if (emit->is_gen) {
+        // the return value is left in the state, pointed to by code_state.sp
+        emit_native_mov_reg_state_addr(emit, REG_TEMP0, LOCAL_IDX_RET_VAL(emit));
+        emit_native_mov_reg_state(emit, REG_TEMP0, LOCAL_IDX_CODE_STATE(emit, sp));
+        ASM_MOV_IMM_TO_REG(emit->as, MP_VM_RETURN_NORMAL, REG_RET);
+    } else {
+        emit_native_mov_state_reg(emit, LOCAL_IDX_RET_VAL(emit), REG_RET);
+    }
+    ASM_EXIT(emit->as);
+
+    // global exception handler: go to the active handler, if there is one
+    mp_asm_base_label_assign(&emit->as->base, LABEL_GLOBAL_EXCEPT(emit));
+    emit_native_mov_state_reg(emit, LOCAL_IDX_EXC_HANDLER_PC(emit), REG_DISPATCH);
+    ASM_MOV_IMM_TO_REG(emit->as, 0, REG_TEMP0);
+    ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, LOCAL_IDX_EXC_HANDLER_UNWIND(emit));
+    ASM_JUMP_IF_REG_EQ(emit->as, REG_DISPATCH, REG_TEMP0, LABEL_UNHANDLED(emit));
+    ASM_JUMP(emit->as, LABEL_NLR(emit));
+
+    // otherwise the exception propagates out of the function
+    mp_asm_base_label_assign(&emit->as->base, LABEL_UNHANDLED(emit));
+    if (emit->is_gen) {
+        // the exception is left in state[n_state - 1] for mp_obj_gen_resume
+        ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_EXC_VAL(emit), REG_TEMP0);
+        emit_native_mov_reg_state(emit, REG_TEMP0, local_idx(emit, 0));
+        ASM_MOV_IMM_TO_REG(emit->as, MP_VM_RETURN_EXCEPTION, REG_RET);
+        ASM_EXIT(emit->as);
+    } else {
+        ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_EXC_VAL(emit), REG_ARG_1);
+        emit_call(emit, MP_F_NATIVE_RAISE);
+    }
+
+    // jump to the handler, or resume point of a generator, given by REG_DISPATCH
+    mp_asm_base_label_assign(&emit->as->base, LABEL_DISPATCH(emit));
+    for (size_t i = 0; i < emit->dispatch_len; ++i) {
+        ASM_MOV_IMM_TO_REG(emit->as, emit->dispatch_label[i] + 1, REG_TEMP0);
+        ASM_JUMP_IF_REG_EQ(emit->as, REG_DISPATCH, REG_TEMP0, emit->dispatch_label[i]);
+    }
+}
+
 STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scope) {
     DEBUG_printf("start_pass(pass=%u, scope=%p)\n", pass, scope);
 
     emit->pass = pass;
+    emit->is_gen = !emit->do_viper_types && (scope->scope_flags & MP_SCOPE_FLAG_GENERATOR);
     emit->stack_start = 0;
     emit->stack_size = 0;
     emit->last_emit_was_return_value = false;
     emit->scope = scope;
+    emit->exit_label = *emit->label_slot;
+    emit->exc_stack_size = 0;
+    emit->exc_serial = 0;
+    emit->unwind_len = 0;
+    emit->dispatch_len = 0;
+    emit->const_table_offset = 0; // viper functions have no constant table
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    emit->reloc_len = 0;
+    #endif
 
     // allocate memory for keeping track of the types of locals
     if (emit->local_vtype_alloc < scope->num_locals) {
         emit->local_vtype = m_renew(vtype_kind_t, emit->local_vtype, emit->local_vtype_alloc, scope->num_locals);
+        emit->local_reg = m_renew(uint8_t, emit->local_reg, emit->local_vtype_alloc, scope->num_locals);
         emit->local_vtype_alloc = scope->num_locals;
     }
 
+    // choose the registers for locals, from the uses seen in the stack-size pass
+    if (pass == MP_PASS_STACK_SIZE) {
+        emit->local_use_len = 0;
+        memset(emit->label_use_pos, 0xff, emit->max_num_labels * sizeof(size_t));
+        // until then, give the registers to the first locals
+        for (mp_uint_t i = 0; i < scope->num_locals; i++) {
+            emit->local_reg[i] = i < REG_LOCAL_NUM ? 1 + i : 0;
+        }
+    } else if (pass == MP_PASS_CODE_SIZE) {
+        emit_native_alloc_local_regs(emit);
+    }
+
+    // allocate memory for keeping track of the exception handlers
+    if (emit->exc_stack_alloc < scope->exc_stack_size) {
+        emit->exc_stack = m_renew(exc_stack_entry_t, emit->exc_stack, emit->exc_stack_alloc, scope->exc_stack_size);
+        emit->exc_stack_alloc = scope->exc_stack_size;
+    }
+
     // allocate memory for keeping track of the objects on the stack
     // XXX don't know stack size on entry, and it should be maximum over all scopes
     // XXX this is such a big hack and really needs to be fixed
@@ -350,100 +759,136 @@ STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scop
         // entry to function
         int num_locals = 0;
         if (pass > MP_PASS_SCOPE) {
-            num_locals = scope->num_locals - REG_LOCAL_NUM;
-            if (num_locals < 0) {
-                num_locals = 0;
+            if (NEED_GLOBAL_EXC_HANDLER(emit)) {
+                // all locals are in the frame, after the nlr_buf_t
+                emit->code_state_start = NLR_BUF_SIZE + 1;
+                emit->state_start = emit->code_state_start;
+                emit->n_state = scope->num_locals + scope->stack_size + 2 + scope->exc_stack_size;
+                emit->stack_start = emit->state_start;
+                num_locals = emit->state_start + emit->n_state;
+            } else {
+                // every local has a slot, though some are kept in registers
+                num_locals = scope->num_locals;
+                emit->stack_start = num_locals;
+                num_locals += scope->stack_size;
             }
-            emit->stack_start = num_locals;
-            num_locals += scope->stack_size;
         }
         ASM_ENTRY(emit->as, num_locals);
 
         // TODO don't load r7 if we don't need it
         #if N_THUMB
-        asm_thumb_mov_reg_i32(emit->as, ASM_THUMB_REG_R7, (mp_uint_t)mp_fun_table);
+        emit_native_mov_reg_reloc(emit, ASM_THUMB_REG_R7, MP_NATIVE_RELOC_FUN_TABLE, 0);
         #elif N_ARM
-        asm_arm_mov_reg_i32(emit->as, ASM_ARM_REG_R7, (mp_uint_t)mp_fun_table);
+        emit_native_mov_reg_reloc(emit, ASM_ARM_REG_R7, MP_NATIVE_RELOC_FUN_TABLE, 0);
         #endif
 
         #if N_X86
         for (int i = 0; i < scope->num_pos_args; i++) {
-            if (i == 0) {
-                asm_x86_mov_arg_to_r32(emit->as, i, REG_LOCAL_1);
-            } else if (i == 1) {
-                asm_x86_mov_arg_to_r32(emit->as, i, REG_LOCAL_2);
-            } else if (i == 2) {
-                asm_x86_mov_arg_to_r32(emit->as, i, REG_LOCAL_3);
+            if (local_reg(emit, i) >= 0) {
+                asm_x86_mov_arg_to_r32(emit->as, i, local_reg(emit, i));
             } else {
                 asm_x86_mov_arg_to_r32(emit->as, i, REG_TEMP0);
-                asm_x86_mov_r32_to_local(emit->as, REG_TEMP0, i - REG_LOCAL_NUM);
+                emit_native_mov_reg_state(emit, REG_TEMP0, local_idx(emit, i));
             }
         }
         #else
+        static const uint8_t reg_arg_table[4] = {REG_ARG_1, REG_ARG_2, REG_ARG_3, REG_ARG_4};
         for (int i = 0; i < scope->num_pos_args; i++) {
-            if (i == 0) {
-                ASM_MOV_REG_REG(emit->as, REG_LOCAL_1, REG_ARG_1);
-            } else if (i == 1) {
-                ASM_MOV_REG_REG(emit->as, REG_LOCAL_2, REG_ARG_2);
-            } else if (i == 2) {
-                ASM_MOV_REG_REG(emit->as, REG_LOCAL_3, REG_ARG_3);
+            if (local_reg(emit, i) >= 0) {
+                ASM_MOV_REG_REG(emit->as, local_reg(emit, i), reg_arg_table[i]);
             } else {
-                assert(i == 3); // should be true; max 4 args is checked above
-                ASM_MOV_REG_TO_LOCAL(emit->as, REG_ARG_4, i - REG_LOCAL_NUM);
+                assert(i < 4); // should be true; max 4 args is checked above
+                emit_native_mov_reg_state(emit, reg_arg_table[i], local_idx(emit, i));
             }
         }
         #endif
 
     } else {
-        // work out size of state (locals plus stack)
+        // work out size of state (locals plus stack, plus the slots used by
+        // the global exception handler)
         emit->n_state = scope->num_locals + scope->stack_size;
+        if (NEED_GLOBAL_EXC_HANDLER(emit)) {
+            emit->code_state_start = NLR_BUF_SIZE + 1;
+            emit->n_state += 2 + scope->exc_stack_size;
+        } else {
+            emit->code_state_start = 0;
+        }
+        emit->state_start = emit->code_state_start + STATE_START;
+        if (NEED_GLOBAL_EXC_HANDLER(emit)) {
+            emit->stack_start = emit->state_start;
+        }
 
-        // allocate space on C-stack for code_state structure, which includes state
-        ASM_ENTRY(emit->as, STATE_START + emit->n_state);
+        if (emit->is_gen) {
+            // the code of a generator starts with the offset of its prelude
+            // and the id of the point to start running from
+            mp_asm_base_data(&emit->as->base, ASM_WORD_SIZE, emit->prelude_offset);
+            mp_asm_base_data(&emit->as->base, ASM_WORD_SIZE, LABEL_START(emit) + 1);
 
-        // TODO don't load r7 if we don't need it
-        #if N_THUMB
-        asm_thumb_mov_reg_i32(emit->as, ASM_THUMB_REG_R7, (mp_uint_t)mp_fun_table);
-        #elif N_ARM
-        asm_arm_mov_reg_i32(emit->as, ASM_ARM_REG_R7, (mp_uint_t)mp_fun_table);
-        #endif
+            // the code_state structure is in the generator instance
+            ASM_ENTRY(emit->as, emit->code_state_start);
 
-        // prepare incoming arguments for call to mp_setup_code_state
+            #if N_THUMB
+            emit_native_mov_reg_reloc(emit, ASM_THUMB_REG_R7, MP_NATIVE_RELOC_FUN_TABLE, 0);
+            #elif N_ARM
+            emit_native_mov_reg_reloc(emit, ASM_ARM_REG_R7, MP_NATIVE_RELOC_FUN_TABLE, 0);
+            #endif
 
-        #if N_X86
-        asm_x86_mov_arg_to_r32(emit->as, 0, REG_ARG_1);
-        asm_x86_mov_arg_to_r32(emit->as, 1, REG_ARG_2);
-        asm_x86_mov_arg_to_r32(emit->as, 2, REG_ARG_3);
-        asm_x86_mov_arg_to_r32(emit->as, 3, REG_ARG_4);
-        #endif
+            // the arguments are the code_state and the value to throw
+            #if N_X86
+            asm_x86_mov_arg_to_r32(emit->as, 0, REG_GENERATOR_STATE);
+            asm_x86_mov_arg_to_r32(emit->as, 1, REG_TEMP0);
+            ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, LOCAL_IDX_EXC_VAL(emit));
+            #else
+            ASM_MOV_REG_REG(emit->as, REG_GENERATOR_STATE, REG_ARG_1);
+            ASM_MOV_REG_TO_LOCAL(emit->as, REG_ARG_2, LOCAL_IDX_EXC_VAL(emit));
+            #endif
 
-        // set code_state.fun_bc
-        ASM_MOV_REG_TO_LOCAL(emit->as, REG_ARG_1, offsetof(mp_code_state_t, fun_bc) / sizeof(uintptr_t));
+            // code_state.ip holds the id of the point to resume from
+            emit_native_mov_state_reg(emit, LOCAL_IDX_CODE_STATE(emit, ip), REG_DISPATCH);
+        } else {
+            // allocate space on C-stack for code_state structure, which includes state
+            ASM_ENTRY(emit->as, emit->state_start + emit->n_state);
 
-        // set code_state.ip (offset from start of this function to prelude info)
-        // XXX this encoding may change size
-        ASM_MOV_IMM_TO_LOCAL_USING(emit->as, emit->prelude_offset, offsetof(mp_code_state_t, ip) / sizeof(uintptr_t), REG_ARG_1);
+            // TODO don't load r7 if we don't need it
+            #if N_THUMB
+            emit_native_mov_reg_reloc(emit, ASM_THUMB_REG_R7, MP_NATIVE_RELOC_FUN_TABLE, 0);
+            #elif N_ARM
+            emit_native_mov_reg_reloc(emit, ASM_ARM_REG_R7, MP_NATIVE_RELOC_FUN_TABLE, 0);
+            #endif
 
-        // put address of code_state into first arg
-        ASM_MOV_LOCAL_ADDR_TO_REG(emit->as, 0, REG_ARG_1);
+            // prepare incoming arguments for call to mp_setup_code_state
 
-        // call mp_setup_code_state to prepare code_state structure
-        #if N_THUMB
-        asm_thumb_bl_ind(emit->as, mp_fun_table[MP_F_SETUP_CODE_STATE], MP_F_SETUP_CODE_STATE, ASM_THUMB_REG_R4);
-        #elif N_ARM
-        asm_arm_bl_ind(emit->as, mp_fun_table[MP_F_SETUP_CODE_STATE], MP_F_SETUP_CODE_STATE, ASM_ARM_REG_R4);
-        #else
-        ASM_CALL_IND(emit->as, mp_fun_table[MP_F_SETUP_CODE_STATE], MP_F_SETUP_CODE_STATE);
-        #endif
+            #if N_X86
+            asm_x86_mov_arg_to_r32(emit->as, 0, REG_ARG_1);
+            asm_x86_mov_arg_to_r32(emit->as, 1, REG_ARG_2);
+            asm_x86_mov_arg_to_r32(emit->as, 2, REG_ARG_3);
+            asm_x86_mov_arg_to_r32(emit->as, 3, REG_ARG_4);
+            #endif
+
+            // set code_state.fun_bc
+            ASM_MOV_REG_TO_LOCAL(emit->as, REG_ARG_1, LOCAL_IDX_CODE_STATE(emit, fun_bc));
+
+            // set code_state.ip (offset from start of this function to prelude info)
+            // XXX this encoding may change size
+            ASM_MOV_IMM_TO_LOCAL_USING(emit->as, emit->prelude_offset, LOCAL_IDX_CODE_STATE(emit, ip), REG_ARG_1);
+
+            // put address of code_state into first arg
+            ASM_MOV_LOCAL_ADDR_TO_REG(emit->as, emit->code_state_start, REG_ARG_1);
+
+            // call mp_setup_code_state to prepare code_state structure
+            #if N_THUMB
+            asm_thumb_bl_ind(emit->as, mp_fun_table[MP_F_SETUP_CODE_STATE], MP_F_SETUP_CODE_STATE, ASM_THUMB_REG_R4);
+            #elif N_ARM
+            asm_arm_bl_ind(emit->as, mp_fun_table[MP_F_SETUP_CODE_STATE], MP_F_SETUP_CODE_STATE, ASM_ARM_REG_R4);
+            #else
+            emit_native_call_ind(emit, MP_F_SETUP_CODE_STATE);
+            #endif
+        }
 
         // cache some locals in registers
-        if (scope->num_locals > 0) {
-            ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - 0, REG_LOCAL_1);
-            if (scope->num_locals > 1) {
-                ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - 1, REG_LOCAL_2);
-                if (scope->num_locals > 2) {
-                    ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - 2, REG_LOCAL_3);
-                }
+        for (int i = 0; i < scope->num_locals; ++i) {
+            if (local_reg(emit, i) >= 0) {
+                ASM_MOV_LOCAL_TO_REG(emit->as, local_idx(emit, i), local_reg(emit, i));
             }
         }
 
@@ -456,10 +901,21 @@ STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scop
         }
     }
 
+    if (NEED_GLOBAL_EXC_HANDLER(emit)) {
+        if (!emit->is_gen) {
+            // no handler is active, and start the code from the beginning
+            emit_native_mov_state_imm_via(emit, LOCAL_IDX_EXC_HANDLER_PC(emit), 0, REG_TEMP0);
+            ASM_MOV_IMM_TO_REG(emit->as, LABEL_START(emit) + 1, REG_DISPATCH);
+        }
+        emit_native_global_exc_entry(emit);
+    }
 }
 
 STATIC void emit_native_end_pass(emit_t *emit) {
-    if (!emit->last_emit_was_return_value) {
+    if (NEED_GLOBAL_EXC_HANDLER(emit)) {
+        // falls through to the exit, like a return
+        emit_native_global_exc_exit(emit);
+    } else if (!emit->last_emit_was_return_value) {
         ASM_EXIT(emit->as);
     }
 
@@ -476,6 +932,10 @@ STATIC void emit_native_end_pass(emit_t *emit) {
         // write code info
         #if MICROPY_PERSISTENT_CODE
         mp_asm_base_data(&emit->as->base, 1, 5);
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        emit_native_add_reloc(emit, mp_asm_base_get_code_pos(&emit->as->base), MP_NATIVE_RELOC_QSTR16, emit->scope->simple_name);
+        emit_native_add_reloc(emit, mp_asm_base_get_code_pos(&emit->as->base) + 2, MP_NATIVE_RELOC_QSTR16, emit->scope->source_file);
+        #endif
         mp_asm_base_data(&emit->as->base, 1, emit->scope->simple_name);
         mp_asm_base_data(&emit->as->base, 1, emit->scope->simple_name >> 8);
         mp_asm_base_data(&emit->as->base, 1, emit->scope->source_file);
@@ -508,6 +968,9 @@ STATIC void emit_native_end_pass(emit_t *emit) {
                     break;
                 }
             }
+            #if MICROPY_PERSISTENT_CODE_SAVE
+            emit_native_add_reloc(emit, mp_asm_base_get_code_pos(&emit->as->base), MP_NATIVE_RELOC_QSTR_OBJ, qst);
+            #endif
             mp_asm_base_data(&emit->as->base, ASM_WORD_SIZE, (mp_uint_t)MP_OBJ_NEW_QSTR(qst));
         }
 
@@ -529,9 +992,18 @@ STATIC void emit_native_end_pass(emit_t *emit) {
             type_sig |= (emit->local_vtype[i] & 0xf) << (i * 4 + 4);
         }
 
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        // the relocations are kept with the raw code, so it can be saved
+        mp_native_reloc_t *relocs = m_new(mp_native_reloc_t, emit->reloc_len);
+        memcpy(relocs, emit->reloc, emit->reloc_len * sizeof(mp_native_reloc_t));
+        #endif
+
         mp_emit_glue_assign_native(emit->scope->raw_code,
             emit->do_viper_types ? MP_CODE_NATIVE_VIPER : MP_CODE_NATIVE_PY,
             f, f_len, (mp_uint_t*)((byte*)f + emit->const_table_offset),
+            #if MICROPY_PERSISTENT_CODE_SAVE
+            relocs, emit->reloc_len,
+            #endif
             emit->scope->num_pos_args, emit->scope->scope_flags, type_sig);
     }
 }
@@ -570,6 +1042,13 @@ STATIC void emit_native_adjust_stack_size(emit_t *emit, mp_int_t delta) {
         // hack to get the case of multi comparison working.
         if (delta == 1) {
             si->vtype = emit->saved_stack_vtype;
+            if (emit->exc_stack_size > 0) {
+                // the exception being handled, when jumping to the next except clause
+                exc_stack_entry_t *e = &emit->exc_stack[emit->exc_stack_size - 1];
+                if (e->kind == EXC_KIND_EXCEPT && !e->is_active && e->stack_base == emit->stack_size) {
+                    si->vtype = VTYPE_PYOBJ;
+                }
+            }
         } else {
             si->vtype = VTYPE_PYOBJ;
         }
@@ -606,7 +1085,7 @@ STATIC void need_reg_single(emit_t *emit, int reg_needed, int skip_stack_pos) {
             stack_info_t *si = &emit->stack_info[i];
             if (si->kind == STACK_REG && si->data.u_reg == reg_needed) {
                 si->kind = STACK_VALUE;
-                ASM_MOV_REG_TO_LOCAL(emit->as, si->data.u_reg, emit->stack_start + i);
+                emit_native_mov_reg_state(emit, si->data.u_reg, emit->stack_start + i);
             }
         }
     }
@@ -617,7 +1096,7 @@ STATIC void need_reg_all(emit_t *emit) {
         stack_info_t *si = &emit->stack_info[i];
         if (si->kind == STACK_REG) {
             si->kind = STACK_VALUE;
-            ASM_MOV_REG_TO_LOCAL(emit->as, si->data.u_reg, emit->stack_start + i);
+            emit_native_mov_reg_state(emit, si->data.u_reg, emit->stack_start + i);
         }
     }
 }
@@ -629,7 +1108,7 @@ STATIC void need_stack_settled(emit_t *emit) {
         if (si->kind == STACK_REG) {
             DEBUG_printf("    reg(%u) to local(%u)\n", si->data.u_reg, emit->stack_start + i);
             si->kind = STACK_VALUE;
-            ASM_MOV_REG_TO_LOCAL(emit->as, si->data.u_reg, emit->stack_start + i);
+            emit_native_mov_reg_state(emit, si->data.u_reg, emit->stack_start + i);
         }
     }
     for (int i = 0; i < emit->stack_size; i++) {
@@ -637,7 +1116,7 @@ STATIC void need_stack_settled(emit_t *emit) {
         if (si->kind == STACK_IMM) {
             DEBUG_printf("    imm(" INT_FMT ") to local(%u)\n", si->data.u_imm, emit->stack_start + i);
             si->kind = STACK_VALUE;
-            ASM_MOV_IMM_TO_LOCAL_USING(emit->as, si->data.u_imm, emit->stack_start + i, REG_TEMP0);
+            emit_native_mov_state_imm_via(emit, emit->stack_start + i, si->data.u_imm, REG_TEMP0);
         }
     }
 }
@@ -649,7 +1128,7 @@ STATIC void emit_access_stack(emit_t *emit, int pos, vtype_kind_t *vtype, int re
     *vtype = si->vtype;
     switch (si->kind) {
         case STACK_VALUE:
-            ASM_MOV_LOCAL_TO_REG(emit->as, emit->stack_start + emit->stack_size - pos, reg_dest);
+            emit_native_mov_state_reg(emit, emit->stack_start + emit->stack_size - pos, reg_dest);
             break;
 
         case STACK_REG:
@@ -671,7 +1150,7 @@ STATIC void emit_fold_stack_top(emit_t *emit, int reg_dest) {
     si[0] = si[1];
     if (si->kind == STACK_VALUE) {
         // if folded element was on the stack we need to put it in a register
-        ASM_MOV_LOCAL_TO_REG(emit->as, emit->stack_start + emit->stack_size - 1, reg_dest);
+        emit_native_mov_state_reg(emit, emit->stack_start + emit->stack_size - 1, reg_dest);
         si->kind = STACK_REG;
         si->data.u_reg = reg_dest;
     }
@@ -740,6 +1219,18 @@ STATIC void emit_post_push_imm(emit_t *emit, vtype_kind_t vtype, mp_int_t imm) {
     adjust_stack(emit, 1);
 }
 
+// Push a word that depends on the runtime; it can't be kept as an immediate
+// on the stack if the code may be saved, so it goes in a register.
+STATIC void emit_post_push_reloc(emit_t *emit, vtype_kind_t vtype, mp_native_reloc_kind_t kind, mp_uint_t value) {
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    need_reg_single(emit, REG_RET, 0);
+    emit_native_mov_reg_reloc(emit, REG_RET, kind, value);
+    emit_post_push_reg(emit, vtype, REG_RET);
+    #else
+    emit_post_push_imm(emit, vtype, mp_native_reloc_value(kind, value));
+    #endif
+}
+
 STATIC void emit_post_push_reg_reg(emit_t *emit, vtype_kind_t vtypea, int rega, vtype_kind_t vtypeb, int regb) {
     emit_post_push_reg(emit, vtypea, rega);
     emit_post_push_reg(emit, vtypeb, regb);
@@ -760,36 +1251,30 @@ STATIC void emit_post_push_reg_reg_reg_reg(emit_t *emit, vtype_kind_t vtypea, in
 
 STATIC void emit_call(emit_t *emit, mp_fun_kind_t fun_kind) {
     need_reg_all(emit);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_call_ind(emit, fun_kind);
 }
 
 STATIC void emit_call_with_imm_arg(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val, int arg_reg) {
     need_reg_all(emit);
     ASM_MOV_IMM_TO_REG(emit->as, arg_val, arg_reg);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_call_ind(emit, fun_kind);
 }
 
-// the first arg is stored in the code aligned on a mp_uint_t boundary
-STATIC void emit_call_with_imm_arg_aligned(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val, int arg_reg) {
+STATIC void emit_call_with_reloc_arg(emit_t *emit, mp_fun_kind_t fun_kind, mp_native_reloc_kind_t kind, mp_uint_t value, int arg_reg) {
     need_reg_all(emit);
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, arg_val, arg_reg);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_mov_reg_reloc(emit, arg_reg, kind, value);
+    emit_native_call_ind(emit, fun_kind);
 }
 
-STATIC void emit_call_with_2_imm_args(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val1, int arg_reg1, mp_int_t arg_val2, int arg_reg2) {
-    need_reg_all(emit);
-    ASM_MOV_IMM_TO_REG(emit->as, arg_val1, arg_reg1);
-    ASM_MOV_IMM_TO_REG(emit->as, arg_val2, arg_reg2);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+STATIC void emit_call_with_qstr_arg(emit_t *emit, mp_fun_kind_t fun_kind, qstr qst, int arg_reg) {
+    emit_call_with_reloc_arg(emit, fun_kind, MP_NATIVE_RELOC_QSTR, qst, arg_reg);
 }
 
-// the first arg is stored in the code aligned on a mp_uint_t boundary
-STATIC void emit_call_with_3_imm_args_and_first_aligned(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val1, int arg_reg1, mp_int_t arg_val2, int arg_reg2, mp_int_t arg_val3, int arg_reg3) {
+STATIC void emit_call_with_2_imm_args(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val1, int arg_reg1, mp_int_t arg_val2, int arg_reg2) {
     need_reg_all(emit);
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, arg_val1, arg_reg1);
+    ASM_MOV_IMM_TO_REG(emit->as, arg_val1, arg_reg1);
     ASM_MOV_IMM_TO_REG(emit->as, arg_val2, arg_reg2);
-    ASM_MOV_IMM_TO_REG(emit->as, arg_val3, arg_reg3);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_call_ind(emit, fun_kind);
 }
 
 // vtype of all n_pop objects is VTYPE_PYOBJ
@@ -808,21 +1293,27 @@ STATIC void emit_get_stack_pointer_to_reg_for_pop(emit_t *emit, mp_uint_t reg_de
             si->kind = STACK_VALUE;
             switch (si->vtype) {
                 case VTYPE_PYOBJ:
-                    ASM_MOV_IMM_TO_LOCAL_USING(emit->as, si->data.u_imm, emit->stack_start + emit->stack_size - 1 - i, reg_dest);
+                    emit_native_mov_state_imm_via(emit, emit->stack_start + emit->stack_size - 1 - i, si->data.u_imm, reg_dest);
                     break;
                 case VTYPE_BOOL:
                     if (si->data.u_imm == 0) {
-                        ASM_MOV_IMM_TO_LOCAL_USING(emit->as, (mp_uint_t)mp_const_false, emit->stack_start + emit->stack_size - 1 - i, reg_dest);
+                        emit_native_mov_state_reloc_via(emit, emit->stack_start + emit->stack_size - 1 - i, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_FALSE, reg_dest);
                     } else {
-                        ASM_MOV_IMM_TO_LOCAL_USING(emit->as, (mp_uint_t)mp_const_true, emit->stack_start + emit->stack_size - 1 - i, reg_dest);
+                        emit_native_mov_state_reloc_via(emit, emit->stack_start + emit->stack_size - 1 - i, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_TRUE, reg_dest);
                     }
                     si->vtype = VTYPE_PYOBJ;
                     break;
                 case VTYPE_INT:
                 case VTYPE_UINT:
-                    ASM_MOV_IMM_TO_LOCAL_USING(emit->as, (uintptr_t)MP_OBJ_NEW_SMALL_INT(si->data.u_imm), emit->stack_start + emit->stack_size - 1 - i, reg_dest);
+                    emit_native_mov_state_imm_via(emit, emit->stack_start + emit->stack_size - 1 - i, (uintptr_t)MP_OBJ_NEW_SMALL_INT(si->data.u_imm), reg_dest);
                     si->vtype = VTYPE_PYOBJ;
                     break;
+                #if N_FLOAT
+                case VTYPE_FLOAT:
+                    // boxed below, along with non-immediate floats
+                    emit_native_mov_state_imm_via(emit, emit->stack_start + emit->stack_size - 1 - i, si->data.u_imm, reg_dest);
+                    break;
+                #endif
                 default:
                     // not handled
                     mp_raise_NotImplementedError("conversion to object");
@@ -838,9 +1329,9 @@ STATIC void emit_get_stack_pointer_to_reg_for_pop(emit_t *emit, mp_uint_t reg_de
         stack_info_t *si = &emit->stack_info[emit->stack_size - 1 - i];
         if (si->vtype != VTYPE_PYOBJ) {
             mp_uint_t local_num = emit->stack_start + emit->stack_size - 1 - i;
-            ASM_MOV_LOCAL_TO_REG(emit->as, local_num, REG_ARG_1);
+            emit_native_mov_state_reg(emit, local_num, REG_ARG_1);
             emit_call_with_imm_arg(emit, MP_F_CONVERT_NATIVE_TO_OBJ, si->vtype, REG_ARG_2); // arg2 = type
-            ASM_MOV_REG_TO_LOCAL(emit->as, REG_RET, local_num);
+            emit_native_mov_reg_state(emit, REG_RET, local_num);
             si->vtype = VTYPE_PYOBJ;
             DEBUG_printf("  convert_native_to_obj(local_num=" UINT_FMT ")\n", local_num);
         }
@@ -848,7 +1339,7 @@ STATIC void emit_get_stack_pointer_to_reg_for_pop(emit_t *emit, mp_uint_t reg_de
 
     // Adujust the stack for a pop of n_pop items, and load the stack pointer into reg_dest.
     adjust_stack(emit, -n_pop);
-    ASM_MOV_LOCAL_ADDR_TO_REG(emit->as, emit->stack_start + emit->stack_size, reg_dest);
+    emit_native_mov_reg_state_addr(emit, reg_dest, emit->stack_start + emit->stack_size);
 }
 
 // vtype of all n_push objects is VTYPE_PYOBJ
@@ -858,16 +1349,95 @@ STATIC void emit_get_stack_pointer_to_reg_for_push(emit_t *emit, mp_uint_t reg_d
         emit->stack_info[emit->stack_size + i].kind = STACK_VALUE;
         emit->stack_info[emit->stack_size + i].vtype = VTYPE_PYOBJ;
     }
-    ASM_MOV_LOCAL_ADDR_TO_REG(emit->as, emit->stack_start + emit->stack_size, reg_dest);
+    emit_native_mov_reg_state_addr(emit, reg_dest, emit->stack_start + emit->stack_size);
     adjust_stack(emit, n_push);
 }
 
+STATIC void emit_native_push_exc_stack(emit_t *emit, mp_uint_t label, int kind) {
+    assert(emit->exc_stack_size < emit->exc_stack_alloc);
+    exc_stack_entry_t *e = &emit->exc_stack[emit->exc_stack_size++];
+    e->label = label;
+    e->kind = kind;
+    e->serial = emit->exc_serial++;
+    e->stack_base = 0;
+    e->is_active = true;
+}
+
+// Returns the id of the innermost active handler below the given level of the
+// exception stack, or 0 if there is none.
+STATIC mp_uint_t emit_native_outer_handler_id(emit_t *emit, size_t level) {
+    while (level-- > 0) {
+        exc_stack_entry_t *e = &emit->exc_stack[level];
+        if (e->is_active) {
+            return e->label + 1;
+        }
+    }
+    return 0;
+}
+
+STATIC void emit_native_set_handler(emit_t *emit, mp_uint_t handler_id) {
+    need_reg_single(emit, REG_TEMP0, 0);
+    emit_native_mov_state_imm_via(emit, LOCAL_IDX_EXC_HANDLER_PC(emit), handler_id, REG_TEMP0);
+}
+
+STATIC void emit_native_add_unwind(emit_t *emit, size_t serial, mp_uint_t unwind_id, mp_uint_t dest) {
+    for (size_t i = 0; i < emit->unwind_len; ++i) {
+        unwind_record_t *u = &emit->unwind[i];
+        if (u->serial == serial && u->unwind_id == unwind_id) {
+            assert(u->dest == dest);
+            return;
+        }
+    }
+    if (emit->unwind_len >= emit->unwind_alloc) {
+        emit->unwind = m_renew(unwind_record_t, emit->unwind, emit->unwind_alloc, emit->unwind_alloc + 4);
+        emit->unwind_alloc += 4;
+    }
+    unwind_record_t *u = &emit->unwind[emit->unwind_len++];
+    u->serial = serial;
+    u->unwind_id = unwind_id;
+    u->dest = dest;
+}
+
+// Start of a finally block (or with cleanup), which is entered either by
+// falling into it, by an exception, or by an unwinding break/continue/return.
+// The stack must be settled.  Pushes the unwind id and the exception (or None).
+STATIC void emit_native_finally_label(emit_t *emit, mp_uint_t label) {
+    mp_asm_base_label_assign(&emit->as->base, label);
+    size_t level = emit->exc_stack_size - 1;
+    emit_native_set_handler(emit, emit_native_outer_handler_id(emit, level));
+    ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_EXC_HANDLER_UNWIND(emit), REG_TEMP0);
+    ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_EXC_VAL(emit), REG_TEMP1);
+    emit_native_mov_reg_state(emit, REG_TEMP1, LOCAL_IDX_SAVED_EXC(emit, level));
+    emit_post_push_reg_reg(emit, VTYPE_PYOBJ, REG_TEMP0, VTYPE_PYOBJ, REG_TEMP1);
+}
+
 STATIC void emit_native_label_assign(emit_t *emit, mp_uint_t l) {
     DEBUG_printf("label_assign(" UINT_FMT ")\n", l);
     emit_native_pre(emit);
+
+    // check if this is the start of a finally block
+    bool is_finally = false;
+    if (emit->exc_stack_size > 0) {
+        exc_stack_entry_t *e = &emit->exc_stack[emit->exc_stack_size - 1];
+        is_finally = e->kind == EXC_KIND_FINALLY && !e->is_active && e->label == l;
+    }
+    if (is_finally) {
+        // falling into the finally block: discard the None pushed by the
+        // compiler, and enter the block with no exception and no unwind
+        emit_pre_pop_discard(emit);
+    }
+
     // need to commit stack because we can jump here from elsewhere
     need_stack_settled(emit);
-    mp_asm_base_label_assign(&emit->as->base, l);
+
+    emit_native_record_label(emit, l);
+    if (is_finally) {
+        emit_native_mov_state_reloc_via(emit, LOCAL_IDX_EXC_VAL(emit), MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE, REG_TEMP0);
+        ASM_MOV_IMM_TO_LOCAL_USING(emit->as, 0, LOCAL_IDX_EXC_HANDLER_UNWIND(emit), REG_TEMP0);
+        emit_native_finally_label(emit, l);
+    } else {
+        mp_asm_base_label_assign(&emit->as->base, l);
+    }
     emit_post(emit);
 }
 
@@ -881,7 +1451,7 @@ STATIC void emit_native_import_name(emit_t *emit, qstr qst) {
         stack_info_t *top = peek_stack(emit, 0);
         if (top->vtype == VTYPE_PTR_NONE) {
             emit_pre_pop_discard(emit);
-            ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)mp_const_none, REG_ARG_2);
+            emit_native_mov_reg_reloc(emit, REG_ARG_2, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE);
         } else {
             vtype_kind_t vtype_fromlist;
             emit_pre_pop_reg(emit, &vtype_fromlist, REG_ARG_2);
@@ -902,7 +1472,7 @@ STATIC void emit_native_import_name(emit_t *emit, qstr qst) {
         assert(vtype_level == VTYPE_PYOBJ);
     }
 
-    emit_call_with_imm_arg(emit, MP_F_IMPORT_NAME, qst, REG_ARG_1); // arg1 = import name
+    emit_call_with_qstr_arg(emit, MP_F_IMPORT_NAME, qst, REG_ARG_1); // arg1 = import name
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -912,7 +1482,7 @@ STATIC void emit_native_import_from(emit_t *emit, qstr qst) {
     vtype_kind_t vtype_module;
     emit_access_stack(emit, 1, &vtype_module, REG_ARG_1); // arg1 = module
     assert(vtype_module == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_IMPORT_FROM, qst, REG_ARG_2); // arg2 = import name
+    emit_call_with_qstr_arg(emit, MP_F_IMPORT_FROM, qst, REG_ARG_2); // arg2 = import name
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -928,29 +1498,24 @@ STATIC void emit_native_import_star(emit_t *emit) {
 STATIC void emit_native_load_const_tok(emit_t *emit, mp_token_kind_t tok) {
     DEBUG_printf("load_const_tok(tok=%u)\n", tok);
     emit_native_pre(emit);
-    vtype_kind_t vtype;
-    mp_uint_t val;
     if (emit->do_viper_types) {
         switch (tok) {
-            case MP_TOKEN_KW_NONE: vtype = VTYPE_PTR_NONE; val = 0; break;
-            case MP_TOKEN_KW_FALSE: vtype = VTYPE_BOOL; val = 0; break;
-            case MP_TOKEN_KW_TRUE: vtype = VTYPE_BOOL; val = 1; break;
-            default:
-                assert(tok == MP_TOKEN_ELLIPSIS);
-                vtype = VTYPE_PYOBJ; val = (mp_uint_t)&mp_const_ellipsis_obj; break;
-        }
-    } else {
-        vtype = VTYPE_PYOBJ;
-        switch (tok) {
-            case MP_TOKEN_KW_NONE: val = (mp_uint_t)mp_const_none; break;
-            case MP_TOKEN_KW_FALSE: val = (mp_uint_t)mp_const_false; break;
-            case MP_TOKEN_KW_TRUE: val = (mp_uint_t)mp_const_true; break;
-            default:
-                assert(tok == MP_TOKEN_ELLIPSIS);
-                val = (mp_uint_t)&mp_const_ellipsis_obj; break;
+            case MP_TOKEN_KW_NONE: emit_post_push_imm(emit, VTYPE_PTR_NONE, 0); return;
+            case MP_TOKEN_KW_FALSE: emit_post_push_imm(emit, VTYPE_BOOL, 0); return;
+            case MP_TOKEN_KW_TRUE: emit_post_push_imm(emit, VTYPE_BOOL, 1); return;
+            default: break;
         }
     }
-    emit_post_push_imm(emit, vtype, val);
+    mp_uint_t val;
+    switch (tok) {
+        case MP_TOKEN_KW_NONE: val = MP_NATIVE_CONST_NONE; break;
+        case MP_TOKEN_KW_FALSE: val = MP_NATIVE_CONST_FALSE; break;
+        case MP_TOKEN_KW_TRUE: val = MP_NATIVE_CONST_TRUE; break;
+        default:
+            assert(tok == MP_TOKEN_ELLIPSIS);
+            val = MP_NATIVE_CONST_ELLIPSIS; break;
+    }
+    emit_post_push_reloc(emit, VTYPE_PYOBJ, MP_NATIVE_RELOC_CONST, val);
 }
 
 STATIC void emit_native_load_const_small_int(emit_t *emit, mp_int_t arg) {
@@ -974,14 +1539,23 @@ STATIC void emit_native_load_const_str(emit_t *emit, qstr qst) {
     } else
     */
     {
-        emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)MP_OBJ_NEW_QSTR(qst));
+        emit_post_push_reloc(emit, VTYPE_PYOBJ, MP_NATIVE_RELOC_QSTR_OBJ, qst);
     }
 }
 
 STATIC void emit_native_load_const_obj(emit_t *emit, mp_obj_t obj) {
     emit_native_pre(emit);
+    #if N_FLOAT
+    if (emit->do_viper_types && mp_obj_is_float(obj)) {
+        // load the float unboxed
+        union { mp_float_t f; mp_uint_t u; } val = { .u = 0 };
+        val.f = mp_obj_float_get(obj);
+        emit_post_push_imm(emit, VTYPE_FLOAT, val.u);
+        return;
+    }
+    #endif
     need_reg_single(emit, REG_RET, 0);
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, (mp_uint_t)obj, REG_RET);
+    emit_native_mov_reg_reloc(emit, REG_RET, MP_NATIVE_RELOC_OBJ, (mp_uint_t)obj);
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -997,19 +1571,12 @@ STATIC void emit_native_load_fast(emit_t *emit, qstr qst, mp_uint_t local_num) {
         EMIT_NATIVE_VIPER_TYPE_ERROR(emit, "local '%q' used before type known", qst);
     }
     emit_native_pre(emit);
-    if (local_num == 0) {
-        emit_post_push_reg(emit, vtype, REG_LOCAL_1);
-    } else if (local_num == 1) {
-        emit_post_push_reg(emit, vtype, REG_LOCAL_2);
-    } else if (local_num == 2) {
-        emit_post_push_reg(emit, vtype, REG_LOCAL_3);
+    emit_native_record_local_use(emit, local_num);
+    if (local_reg(emit, local_num) >= 0) {
+        emit_post_push_reg(emit, vtype, local_reg(emit, local_num));
     } else {
         need_reg_single(emit, REG_TEMP0, 0);
-        if (emit->do_viper_types) {
-            ASM_MOV_LOCAL_TO_REG(emit->as, local_num - REG_LOCAL_NUM, REG_TEMP0);
-        } else {
-            ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - local_num, REG_TEMP0);
-        }
+        emit_native_mov_state_reg(emit, local_idx(emit, local_num), REG_TEMP0);
         emit_post_push_reg(emit, vtype, REG_TEMP0);
     }
 }
@@ -1029,7 +1596,7 @@ STATIC void emit_native_load_deref(emit_t *emit, qstr qst, mp_uint_t local_num)
 STATIC void emit_native_load_name(emit_t *emit, qstr qst) {
     DEBUG_printf("load_name(%s)\n", qstr_str(qst));
     emit_native_pre(emit);
-    emit_call_with_imm_arg(emit, MP_F_LOAD_NAME, qst, REG_ARG_1);
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_NAME, qst, REG_ARG_1);
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -1049,8 +1616,12 @@ STATIC void emit_native_load_global(emit_t *emit, qstr qst) {
         emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_PTR16);
     } else if (emit->do_viper_types && qst == MP_QSTR_ptr32) {
         emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_PTR32);
+    #if N_FLOAT
+    } else if (emit->do_viper_types && qst == MP_QSTR_float) {
+        emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_FLOAT);
+    #endif
     } else {
-        emit_call_with_imm_arg(emit, MP_F_LOAD_GLOBAL, qst, REG_ARG_1);
+        emit_call_with_qstr_arg(emit, MP_F_LOAD_GLOBAL, qst, REG_ARG_1);
         emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
     }
 }
@@ -1063,7 +1634,7 @@ STATIC void emit_native_load_attr(emit_t *emit, qstr qst) {
     vtype_kind_t vtype_base;
     emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1); // arg1 = base
     assert(vtype_base == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_LOAD_ATTR, qst, REG_ARG_2); // arg2 = attribute name
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_ATTR, qst, REG_ARG_2); // arg2 = attribute name
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -1071,13 +1642,13 @@ STATIC void emit_native_load_method(emit_t *emit, qstr qst, bool is_super) {
     if (is_super) {
         emit_get_stack_pointer_to_reg_for_pop(emit, REG_ARG_2, 3); // arg2 = dest ptr
         emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_2, 2); // arg2 = dest ptr
-        emit_call_with_imm_arg(emit, MP_F_LOAD_SUPER_METHOD, qst, REG_ARG_1); // arg1 = method name
+        emit_call_with_qstr_arg(emit, MP_F_LOAD_SUPER_METHOD, qst, REG_ARG_1); // arg1 = method name
     } else {
         vtype_kind_t vtype_base;
         emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1); // arg1 = base
         assert(vtype_base == VTYPE_PYOBJ);
         emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_3, 2); // arg3 = dest ptr
-        emit_call_with_imm_arg(emit, MP_F_LOAD_METHOD, qst, REG_ARG_2); // arg2 = method name
+        emit_call_with_qstr_arg(emit, MP_F_LOAD_METHOD, qst, REG_ARG_2); // arg2 = method name
     }
 }
 
@@ -1107,7 +1678,7 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
             ASM_MOV_REG_REG(emit->as, REG_ARG_2, REG_RET);
         }
         emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1);
-        emit_call_with_imm_arg(emit, MP_F_OBJ_SUBSCR, (mp_uint_t)MP_OBJ_SENTINEL, REG_ARG_3);
+        emit_call_with_reloc_arg(emit, MP_F_OBJ_SUBSCR, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_SENTINEL, REG_ARG_3);
         emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
     } else {
         // viper load
@@ -1122,6 +1693,9 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
             int reg_base = REG_ARG_1;
             int reg_index = REG_ARG_2;
             emit_pre_pop_reg_flexible(emit, &vtype_base, &reg_base, reg_index, reg_index);
+            // the rest of the stack may hold values in the registers written below
+            need_reg_single(emit, reg_index, 0);
+            need_reg_single(emit, REG_RET, 0);
             switch (vtype_base) {
                 case VTYPE_PTR8: {
                     // pointer to 8-bit memory
@@ -1185,6 +1759,7 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
             int reg_index = REG_ARG_2;
             emit_pre_pop_reg_flexible(emit, &vtype_index, &reg_index, REG_ARG_1, REG_ARG_1);
             emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1);
+            need_reg_single(emit, REG_RET, 0);
             if (vtype_index != VTYPE_INT && vtype_index != VTYPE_UINT) {
                 EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                     "can't load with '%q' index", vtype_to_qstr(vtype_index));
@@ -1224,19 +1799,12 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
 
 STATIC void emit_native_store_fast(emit_t *emit, qstr qst, mp_uint_t local_num) {
     vtype_kind_t vtype;
-    if (local_num == 0) {
-        emit_pre_pop_reg(emit, &vtype, REG_LOCAL_1);
-    } else if (local_num == 1) {
-        emit_pre_pop_reg(emit, &vtype, REG_LOCAL_2);
-    } else if (local_num == 2) {
-        emit_pre_pop_reg(emit, &vtype, REG_LOCAL_3);
+    emit_native_record_local_use(emit, local_num);
+    if (local_reg(emit, local_num) >= 0) {
+        emit_pre_pop_reg(emit, &vtype, local_reg(emit, local_num));
     } else {
         emit_pre_pop_reg(emit, &vtype, REG_TEMP0);
-        if (emit->do_viper_types) {
-            ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, local_num - REG_LOCAL_NUM);
-        } else {
-            ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, STATE_START + emit->n_state - 1 - local_num);
-        }
+        emit_native_mov_reg_state(emit, REG_TEMP0, local_idx(emit, local_num));
     }
     emit_post(emit);
 
@@ -1271,7 +1839,7 @@ STATIC void emit_native_store_name(emit_t *emit, qstr qst) {
     vtype_kind_t vtype;
     emit_pre_pop_reg(emit, &vtype, REG_ARG_2);
     assert(vtype == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_STORE_NAME, qst, REG_ARG_1); // arg1 = name
+    emit_call_with_qstr_arg(emit, MP_F_STORE_NAME, qst, REG_ARG_1); // arg1 = name
     emit_post(emit);
 }
 
@@ -1284,7 +1852,7 @@ STATIC void emit_native_store_global(emit_t *emit, qstr qst) {
         emit_call_with_imm_arg(emit, MP_F_CONVERT_NATIVE_TO_OBJ, vtype, REG_ARG_2); // arg2 = type
         ASM_MOV_REG_REG(emit->as, REG_ARG_2, REG_RET);
     }
-    emit_call_with_imm_arg(emit, MP_F_STORE_GLOBAL, qst, REG_ARG_1); // arg1 = name
+    emit_call_with_qstr_arg(emit, MP_F_STORE_GLOBAL, qst, REG_ARG_1); // arg1 = name
     emit_post(emit);
 }
 
@@ -1293,7 +1861,7 @@ STATIC void emit_native_store_attr(emit_t *emit, qstr qst) {
     emit_pre_pop_reg_reg(emit, &vtype_base, REG_ARG_1, &vtype_val, REG_ARG_3); // arg1 = base, arg3 = value
     assert(vtype_base == VTYPE_PYOBJ);
     assert(vtype_val == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_STORE_ATTR, qst, REG_ARG_2); // arg2 = attribute name
+    emit_call_with_qstr_arg(emit, MP_F_STORE_ATTR, qst, REG_ARG_2); // arg2 = attribute name
     emit_post(emit);
 }
 
@@ -1338,6 +1906,7 @@ STATIC void emit_native_store_subscr(emit_t *emit) {
             #else
             emit_pre_pop_reg_flexible(emit, &vtype_value, &reg_value, reg_base, reg_index);
             #endif
+            need_reg_single(emit, reg_index, 0);
             if (vtype_value != VTYPE_BOOL && vtype_value != VTYPE_INT && vtype_value != VTYPE_UINT) {
                 EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                     "can't store '%q'", vtype_to_qstr(vtype_value));
@@ -1494,13 +2063,13 @@ STATIC void emit_native_delete_deref(emit_t *emit, qstr qst, mp_uint_t local_num
 
 STATIC void emit_native_delete_name(emit_t *emit, qstr qst) {
     emit_native_pre(emit);
-    emit_call_with_imm_arg(emit, MP_F_DELETE_NAME, qst, REG_ARG_1);
+    emit_call_with_qstr_arg(emit, MP_F_DELETE_NAME, qst, REG_ARG_1);
     emit_post(emit);
 }
 
 STATIC void emit_native_delete_global(emit_t *emit, qstr qst) {
     emit_native_pre(emit);
-    emit_call_with_imm_arg(emit, MP_F_DELETE_GLOBAL, qst, REG_ARG_1);
+    emit_call_with_qstr_arg(emit, MP_F_DELETE_GLOBAL, qst, REG_ARG_1);
     emit_post(emit);
 }
 
@@ -1508,7 +2077,9 @@ STATIC void emit_native_delete_attr(emit_t *emit, qstr qst) {
     vtype_kind_t vtype_base;
     emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1); // arg1 = base
     assert(vtype_base == VTYPE_PYOBJ);
-    emit_call_with_2_imm_args(emit, MP_F_STORE_ATTR, qst, REG_ARG_2, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3); // arg2 = attribute name, arg3 = value (null for delete)
+    need_reg_all(emit);
+    ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3); // arg3 = value (null for delete)
+    emit_call_with_qstr_arg(emit, MP_F_STORE_ATTR, qst, REG_ARG_2); // arg2 = attribute name
     emit_post(emit);
 }
 
@@ -1557,6 +2128,7 @@ STATIC void emit_native_rot_three(emit_t *emit) {
 STATIC void emit_native_jump(emit_t *emit, mp_uint_t label) {
     DEBUG_printf("jump(label=" UINT_FMT ")\n", label);
     emit_native_pre(emit);
+    emit_native_record_jump(emit, label);
     // need to commit stack because we are jumping elsewhere
     need_stack_settled(emit);
     ASM_JUMP(emit->as, label);
@@ -1593,6 +2165,7 @@ STATIC void emit_native_jump_helper(emit_t *emit, bool pop) {
 STATIC void emit_native_pop_jump_if(emit_t *emit, bool cond, mp_uint_t label) {
     DEBUG_printf("pop_jump_if(cond=%u, label=" UINT_FMT ")\n", cond, label);
     emit_native_jump_helper(emit, true);
+    emit_native_record_jump(emit, label);
     if (cond) {
         ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
     } else {
@@ -1604,6 +2177,7 @@ STATIC void emit_native_pop_jump_if(emit_t *emit, bool cond, mp_uint_t label) {
 STATIC void emit_native_jump_if_or_pop(emit_t *emit, bool cond, mp_uint_t label) {
     DEBUG_printf("jump_if_or_pop(cond=%u, label=" UINT_FMT ")\n", cond, label);
     emit_native_jump_helper(emit, false);
+    emit_native_record_jump(emit, label);
     if (cond) {
         ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
     } else {
@@ -1613,14 +2187,83 @@ STATIC void emit_native_jump_if_or_pop(emit_t *emit, bool cond, mp_uint_t label)
     emit_post(emit);
 }
 
+// Jump to the given label, out of except_depth levels of the exception stack,
+// running the finally blocks (and with cleanups) along the way.  Each one is
+// entered with its unwind id set, and its end_finally then continues the
+// unwinding, using the unwind records kept for it.
+STATIC void emit_native_unwind_jump(emit_t *emit, mp_uint_t label, mp_uint_t except_depth) {
+    if (except_depth == 0) {
+        emit_native_jump(emit, label);
+        return;
+    }
+
+    emit_native_pre(emit);
+    need_stack_settled(emit);
+
+    size_t level_end = emit->exc_stack_size - except_depth;
+    bool to_exit = label == LABEL_EXIT(emit);
+    mp_uint_t unwind_id;
+    mp_uint_t final_dest;
+    if (to_exit) {
+        // a return, which goes straight to the exit once the unwinding is done
+        unwind_id = LABEL_EXIT(emit) + 1;
+        final_dest = LABEL_EXIT(emit);
+    } else {
+        // a break or continue, which needs to restore the handler first
+        final_dest = *emit->label_slot;
+        unwind_id = final_dest + 1;
+    }
+
+    exc_stack_entry_t *first = NULL;
+    exc_stack_entry_t *prev = NULL;
+    for (size_t i = emit->exc_stack_size; i-- > level_end;) {
+        exc_stack_entry_t *e = &emit->exc_stack[i];
+        if (e->is_active && e->kind != EXC_KIND_EXCEPT) {
+            if (prev == NULL) {
+                first = e;
+            } else {
+                emit_native_add_unwind(emit, prev->serial, unwind_id, e->label);
+            }
+            prev = e;
+        }
+    }
+
+    if (first == NULL) {
+        // no finally blocks to run, just jump there
+        if (!to_exit) {
+            emit_native_set_handler(emit, emit_native_outer_handler_id(emit, level_end));
+        }
+        ASM_JUMP(emit->as, label);
+    } else {
+        emit_native_add_unwind(emit, prev->serial, unwind_id, final_dest);
+        emit_native_mov_state_reloc_via(emit, LOCAL_IDX_EXC_VAL(emit), MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE, REG_TEMP0);
+        ASM_MOV_IMM_TO_LOCAL_USING(emit->as, unwind_id, LOCAL_IDX_EXC_HANDLER_UNWIND(emit), REG_TEMP0);
+        ASM_JUMP(emit->as, first->label);
+        if (!to_exit) {
+            mp_asm_base_label_assign(&emit->as->base, final_dest);
+            emit_native_set_handler(emit, emit_native_outer_handler_id(emit, level_end));
+            ASM_JUMP(emit->as, label);
+        }
+    }
+    emit_post(emit);
+}
+
 STATIC void emit_native_break_loop(emit_t *emit, mp_uint_t label, mp_uint_t except_depth) {
-    (void)except_depth;
-    emit_native_jump(emit, label & ~MP_EMIT_BREAK_FROM_FOR); // TODO properly
+    emit_native_unwind_jump(emit, label & ~MP_EMIT_BREAK_FROM_FOR, except_depth);
 }
 
 STATIC void emit_native_continue_loop(emit_t *emit, mp_uint_t label, mp_uint_t except_depth) {
-    (void)except_depth;
-    emit_native_jump(emit, label); // TODO properly
+    emit_native_unwind_jump(emit, label, except_depth);
+}
+
+STATIC void emit_native_setup_block(emit_t *emit, mp_uint_t label, int kind) {
+    emit_native_pre(emit);
+    // need to commit stack because we may jump elsewhere
+    need_stack_settled(emit);
+    emit_native_push_exc_stack(emit, label, kind);
+    emit_native_set_handler(emit, label + 1);
+    emit_native_add_dispatch(emit, label);
+    emit_post(emit);
 }
 
 STATIC void emit_native_setup_with(emit_t *emit, mp_uint_t label) {
@@ -1632,7 +2275,7 @@ STATIC void emit_native_setup_with(emit_t *emit, mp_uint_t label) {
     emit_access_stack(emit, 1, &vtype, REG_ARG_1); // arg1 = ctx_mgr
     assert(vtype == VTYPE_PYOBJ);
     emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_3, 2); // arg3 = dest ptr
-    emit_call_with_imm_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___exit__, REG_ARG_2);
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___exit__, REG_ARG_2);
     // stack: (..., ctx_mgr, __exit__, self)
 
     emit_pre_pop_reg(emit, &vtype, REG_ARG_3); // self
@@ -1645,7 +2288,7 @@ STATIC void emit_native_setup_with(emit_t *emit, mp_uint_t label) {
 
     // get __enter__ method
     emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_3, 2); // arg3 = dest ptr
-    emit_call_with_imm_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___enter__, REG_ARG_2); // arg2 = method name
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___enter__, REG_ARG_2); // arg2 = method name
     // stack: (..., __exit__, self, __enter__, self)
 
     // call __enter__ method
@@ -1654,110 +2297,120 @@ STATIC void emit_native_setup_with(emit_t *emit, mp_uint_t label) {
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET); // push return value of __enter__
     // stack: (..., __exit__, self, as_value)
 
-    // need to commit stack because we may jump elsewhere
-    need_stack_settled(emit);
-    emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_1, sizeof(nlr_buf_t) / sizeof(mp_uint_t)); // arg1 = pointer to nlr buf
-    emit_call(emit, MP_F_NLR_PUSH);
-    ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
-
-    emit_access_stack(emit, sizeof(nlr_buf_t) / sizeof(mp_uint_t) + 1, &vtype, REG_RET); // access return value of __enter__
-    emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET); // push return value of __enter__
-    // stack: (..., __exit__, self, as_value, nlr_buf, as_value)
+    // the with block is protected like a finally block, and its handler is
+    // entered with the stack at (..., __exit__, self)
+    emit_native_setup_block(emit, label, EXC_KIND_WITH);
 }
 
 STATIC void emit_native_with_cleanup(emit_t *emit, mp_uint_t label) {
-    // note: label+1 is available as an auxiliary label
+    // note: label+1 and label+2 are available as auxiliary labels
 
-    // stack: (..., __exit__, self, as_value, nlr_buf)
-    emit_native_pre(emit);
-    emit_call(emit, MP_F_NLR_POP);
-    adjust_stack(emit, -(mp_int_t)(sizeof(nlr_buf_t) / sizeof(mp_uint_t)) - 1);
     // stack: (..., __exit__, self)
+    emit_native_pre(emit);
 
-    // call __exit__
-    emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)mp_const_none);
-    emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)mp_const_none);
-    emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)mp_const_none);
-    emit_get_stack_pointer_to_reg_for_pop(emit, REG_ARG_3, 5);
-    emit_call_with_2_imm_args(emit, MP_F_CALL_METHOD_N_KW, 3, REG_ARG_1, 0, REG_ARG_2);
-
-    // jump to after with cleanup nlr_catch block
-    adjust_stack(emit, 1); // dummy nlr_buf.prev
-    emit_native_load_const_tok(emit, MP_TOKEN_KW_NONE); // nlr_buf.ret_val = no exception
-    emit_native_jump(emit, label + 1);
-
-    // nlr_catch
-    emit_native_label_assign(emit, label);
-
-    // adjust stack counter for: __exit__, self, as_value
-    adjust_stack(emit, 3);
-    // stack: (..., __exit__, self, as_value, nlr_buf.prev, nlr_buf.ret_val)
+    // the with block is finished, enter the cleanup like a finally block
+    emit->exc_stack[emit->exc_stack_size - 1].is_active = false;
+    need_stack_settled(emit);
+    emit_native_mov_state_reloc_via(emit, LOCAL_IDX_EXC_VAL(emit), MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE, REG_TEMP0);
+    ASM_MOV_IMM_TO_LOCAL_USING(emit->as, 0, LOCAL_IDX_EXC_HANDLER_UNWIND(emit), REG_TEMP0);
+    emit_native_finally_label(emit, label);
+    need_stack_settled(emit);
+    // stack: (..., __exit__, self, unwind, exc)
 
     vtype_kind_t vtype;
-    emit_pre_pop_reg(emit, &vtype, REG_ARG_1); // get the thrown value (exc)
-    adjust_stack(emit, -2); // discard nlr_buf.prev and as_value
-    // stack: (..., __exit__, self)
-    // REG_ARG_1=exc
-
-    emit_pre_pop_reg(emit, &vtype, REG_ARG_2); // self
-    emit_pre_pop_reg(emit, &vtype, REG_ARG_3); // __exit__
-    adjust_stack(emit, 1); // dummy nlr_buf.prev
-    emit_post_push_reg(emit, vtype, REG_ARG_1); // push exc to save it for later
-    emit_post_push_reg(emit, vtype, REG_ARG_3); // __exit__
-    emit_post_push_reg(emit, vtype, REG_ARG_2); // self
-    // stack: (..., exc, __exit__, self)
-    // REG_ARG_1=exc
-
+    emit_access_stack(emit, 1, &vtype, REG_ARG_1); // get exc
+    emit_native_mov_reg_reloc(emit, REG_ARG_2, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE);
+    ASM_JUMP_IF_REG_EQ(emit->as, REG_ARG_1, REG_ARG_2, label + 1);
+
+    // an exception: call __exit__(type(exc), exc, None)
+    emit_access_stack(emit, 4, &vtype, REG_ARG_2); // __exit__
+    emit_access_stack(emit, 3, &vtype, REG_ARG_3); // self
+    emit_post_push_reg_reg(emit, VTYPE_PYOBJ, REG_ARG_2, VTYPE_PYOBJ, REG_ARG_3);
+    need_stack_settled(emit);
+    emit_access_stack(emit, 3, &vtype, REG_ARG_1); // exc
     ASM_LOAD_REG_REG_OFFSET(emit->as, REG_ARG_2, REG_ARG_1, 0); // get type(exc)
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_ARG_2); // push type(exc)
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_ARG_1); // push exc value
-    emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)mp_const_none); // traceback info
-    // stack: (..., exc, __exit__, self, type(exc), exc, traceback)
-
-    // call __exit__ method
+    emit_post_push_reloc(emit, VTYPE_PYOBJ, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE); // traceback info
+    // stack: (..., __exit__, self, unwind, exc, __exit__, self, type(exc), exc, traceback)
     emit_get_stack_pointer_to_reg_for_pop(emit, REG_ARG_3, 5);
     emit_call_with_2_imm_args(emit, MP_F_CALL_METHOD_N_KW, 3, REG_ARG_1, 0, REG_ARG_2);
-    // stack: (..., exc)
+    // stack: (..., __exit__, self, unwind, exc)
 
-    // if REG_RET is true then we need to replace top-of-stack with None (swallow exception)
+    // if __exit__ returned true then swallow the exception, by replacing it with None
     if (REG_ARG_1 != REG_RET) {
         ASM_MOV_REG_REG(emit->as, REG_ARG_1, REG_RET);
     }
     emit_call(emit, MP_F_OBJ_IS_TRUE);
-    ASM_JUMP_IF_REG_ZERO(emit->as, REG_RET, label + 1);
-
-    // replace exc with None
-    emit_pre_pop_discard(emit);
-    emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)mp_const_none);
+    ASM_JUMP_IF_REG_ZERO(emit->as, REG_RET, label + 2);
+    emit_native_mov_state_reloc_via(emit, emit->stack_start + emit->stack_size - 1, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE, REG_TEMP0);
+    ASM_JUMP(emit->as, label + 2);
+
+    // no exception: call __exit__(None, None, None)
+    mp_asm_base_label_assign(&emit->as->base, label + 1);
+    emit_access_stack(emit, 4, &vtype, REG_ARG_2); // __exit__
+    emit_access_stack(emit, 3, &vtype, REG_ARG_3); // self
+    emit_post_push_reg_reg(emit, VTYPE_PYOBJ, REG_ARG_2, VTYPE_PYOBJ, REG_ARG_3);
+    emit_post_push_reloc(emit, VTYPE_PYOBJ, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE);
+    emit_post_push_reloc(emit, VTYPE_PYOBJ, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE);
+    emit_post_push_reloc(emit, VTYPE_PYOBJ, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE);
+    emit_get_stack_pointer_to_reg_for_pop(emit, REG_ARG_3, 5);
+    emit_call_with_2_imm_args(emit, MP_F_CALL_METHOD_N_KW, 3, REG_ARG_1, 0, REG_ARG_2);
 
-    // end of with cleanup nlr_catch block
-    emit_native_label_assign(emit, label + 1);
+    // discard __exit__ and self, leaving the state for end_finally
+    mp_asm_base_label_assign(&emit->as->base, label + 2);
+    emit_pre_pop_reg(emit, &vtype, REG_ARG_1); // exc
+    emit_pre_pop_reg(emit, &vtype, REG_ARG_2); // unwind
+    adjust_stack(emit, -2);
+    emit_post_push_reg_reg(emit, VTYPE_PYOBJ, REG_ARG_2, VTYPE_PYOBJ, REG_ARG_1);
+    // stack: (..., unwind, exc)
+    emit_post(emit);
 }
 
 STATIC void emit_native_setup_except(emit_t *emit, mp_uint_t label) {
-    emit_native_pre(emit);
-    // need to commit stack because we may jump elsewhere
-    need_stack_settled(emit);
-    emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_1, sizeof(nlr_buf_t) / sizeof(mp_uint_t)); // arg1 = pointer to nlr buf
-    emit_call(emit, MP_F_NLR_PUSH);
-    ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
-    emit_post(emit);
+    emit_native_setup_block(emit, label, EXC_KIND_EXCEPT);
 }
 
 STATIC void emit_native_setup_finally(emit_t *emit, mp_uint_t label) {
-    emit_native_setup_except(emit, label);
+    emit_native_setup_block(emit, label, EXC_KIND_FINALLY);
 }
 
 STATIC void emit_native_end_finally(emit_t *emit) {
     // logic:
     //   exc = pop_stack
-    //   if exc == None: pass
-    //   else: raise exc
+    //   if exc != None: raise exc
+    //   for finally blocks:
+    //     unwind = pop_stack
+    //     if unwind != 0: continue the unwinding
     // the check if exc is None is done in the MP_F_NATIVE_RAISE stub
+    emit_native_pre(emit);
+    exc_stack_entry_t *e = &emit->exc_stack[--emit->exc_stack_size];
     vtype_kind_t vtype;
-    emit_pre_pop_reg(emit, &vtype, REG_ARG_1); // get nlr_buf.ret_val
-    emit_pre_pop_discard(emit); // discard nlr_buf.prev
+    emit_pre_pop_reg(emit, &vtype, REG_ARG_1); // get the exception
     emit_call(emit, MP_F_NATIVE_RAISE);
+    if (e->kind == EXC_KIND_EXCEPT) {
+        emit_post(emit);
+        return;
+    }
+
+    emit_pre_pop_reg(emit, &vtype, REG_ARG_2); // get the unwind id
+    bool have_unwind = false;
+    for (size_t i = 0; i < emit->unwind_len; ++i) {
+        unwind_record_t *u = &emit->unwind[i];
+        if (u->serial != e->serial) {
+            continue;
+        }
+        if (!have_unwind) {
+            // the next finally block (if any) is entered with no exception
+            // and the same unwind id
+            need_stack_settled(emit);
+            emit_native_mov_state_reloc_via(emit, LOCAL_IDX_EXC_VAL(emit), MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE, REG_TEMP0);
+            ASM_MOV_REG_TO_LOCAL(emit->as, REG_ARG_2, LOCAL_IDX_EXC_HANDLER_UNWIND(emit));
+            have_unwind = true;
+        }
+        ASM_MOV_IMM_TO_REG(emit->as, u->unwind_id, REG_TEMP0);
+        ASM_JUMP_IF_REG_EQ(emit->as, REG_ARG_2, REG_TEMP0, u->dest);
+    }
     emit_post(emit);
 }
 
@@ -1784,7 +2437,7 @@ STATIC void emit_native_for_iter(emit_t *emit, mp_uint_t label) {
     emit_get_stack_pointer_to_reg_for_pop(emit, REG_ARG_1, MP_OBJ_ITER_BUF_NSLOTS);
     adjust_stack(emit, MP_OBJ_ITER_BUF_NSLOTS);
     emit_call(emit, MP_F_NATIVE_ITERNEXT);
-    ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)MP_OBJ_STOP_ITERATION, REG_TEMP1);
+    emit_native_mov_reg_reloc(emit, REG_TEMP1, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_STOP_ITERATION);
     ASM_JUMP_IF_REG_EQ(emit->as, REG_RET, REG_TEMP1, label);
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
@@ -1798,8 +2451,10 @@ STATIC void emit_native_for_iter_end(emit_t *emit) {
 
 STATIC void emit_native_pop_block(emit_t *emit) {
     emit_native_pre(emit);
-    emit_call(emit, MP_F_NLR_POP);
-    adjust_stack(emit, -(mp_int_t)(sizeof(nlr_buf_t) / sizeof(mp_uint_t)) + 1);
+    // the handler is no longer active, so restore the one outside it
+    size_t level = emit->exc_stack_size - 1;
+    emit->exc_stack[level].is_active = false;
+    emit_native_set_handler(emit, emit_native_outer_handler_id(emit, level));
     emit_post(emit);
 }
 
@@ -1813,6 +2468,15 @@ STATIC void emit_native_unary_op(emit_t *emit, mp_unary_op_t op) {
     if (vtype == VTYPE_PYOBJ) {
         emit_call_with_imm_arg(emit, MP_F_UNARY_OP, op, REG_ARG_1);
         emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
+    #if N_FLOAT
+    } else if (vtype == VTYPE_FLOAT && (op == MP_UNARY_OP_POSITIVE || op == MP_UNARY_OP_NEGATIVE)) {
+        if (op == MP_UNARY_OP_NEGATIVE) {
+            // flip the sign bit
+            ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)1 << (8 * sizeof(mp_float_t) - 1), REG_ARG_3);
+            ASM_XOR_REG_REG(emit->as, REG_ARG_2, REG_ARG_3);
+        }
+        emit_post_push_reg(emit, VTYPE_FLOAT, REG_ARG_2);
+    #endif
     } else {
         adjust_stack(emit, 1);
         EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
@@ -1820,6 +2484,75 @@ STATIC void emit_native_unary_op(emit_t *emit, mp_unary_op_t op) {
     }
 }
 
+#if N_FLOAT
+// floats are operated on unboxed, with an int operand converted to a float
+STATIC void emit_native_binary_op_float(emit_t *emit, mp_binary_op_t op) {
+    if (MP_BINARY_OP_INPLACE_OR <= op && op <= MP_BINARY_OP_INPLACE_POWER) {
+        op += MP_BINARY_OP_OR - MP_BINARY_OP_INPLACE_OR;
+    }
+    vtype_kind_t vtype_lhs, vtype_rhs;
+    emit_pre_pop_reg_reg(emit, &vtype_rhs, REG_ARG_3, &vtype_lhs, REG_ARG_2);
+    if (vtype_lhs == VTYPE_INT) {
+        ASM_FLOAT_FROM_INT_REG(emit->as, REG_ARG_2);
+    }
+    if (vtype_rhs == VTYPE_INT) {
+        ASM_FLOAT_FROM_INT_REG(emit->as, REG_ARG_3);
+    }
+    if (op == MP_BINARY_OP_ADD) {
+        ASM_FLOAT_ADD_REG_REG(emit->as, REG_ARG_2, REG_ARG_3);
+    } else if (op == MP_BINARY_OP_SUBTRACT) {
+        ASM_FLOAT_SUB_REG_REG(emit->as, REG_ARG_2, REG_ARG_3);
+    } else if (op == MP_BINARY_OP_MULTIPLY) {
+        ASM_FLOAT_MUL_REG_REG(emit->as, REG_ARG_2, REG_ARG_3);
+    } else if (op == MP_BINARY_OP_TRUE_DIVIDE) {
+        ASM_FLOAT_DIV_REG_REG(emit->as, REG_ARG_2, REG_ARG_3);
+    } else if (MP_BINARY_OP_LESS <= op && op <= MP_BINARY_OP_NOT_EQUAL) {
+        // comparisons are false if either operand is nan, except for not-equal
+        need_reg_single(emit, REG_RET, 0);
+        #if N_X64
+        static const byte ops[6][2] = {
+            { ASM_X64_CMPSD_LT, 0 },
+            { ASM_X64_CMPSD_LT, 1 }, // swap args for MORE
+            { ASM_X64_CMPSD_EQ, 0 },
+            { ASM_X64_CMPSD_LE, 0 },
+            { ASM_X64_CMPSD_LE, 1 }, // swap args for MORE_EQUAL
+            { ASM_X64_CMPSD_NEQ, 0 },
+        };
+        const byte *cmp = ops[op - MP_BINARY_OP_LESS];
+        if (cmp[1]) {
+            asm_x64_cmpsd_r64_r64(emit->as, cmp[0], REG_RET, REG_ARG_3, REG_ARG_2);
+        } else {
+            asm_x64_cmpsd_r64_r64(emit->as, cmp[0], REG_RET, REG_ARG_2, REG_ARG_3);
+        }
+        #elif N_THUMB
+        asm_thumb_vfp_cmp_reg_reg(emit->as, REG_ARG_2, REG_ARG_3);
+        static const uint16_t ops[6] = {
+            ASM_THUMB_OP_ITE_MI,
+            ASM_THUMB_OP_ITE_GT,
+            ASM_THUMB_OP_ITE_EQ,
+            ASM_THUMB_OP_ITE_HI,
+            ASM_THUMB_OP_ITE_GE,
+            ASM_THUMB_OP_ITE_EQ,
+        };
+        static const byte ret[6] = { 1, 1, 1, 0, 1, 0, };
+        asm_thumb_op16(emit->as, ops[op - MP_BINARY_OP_LESS]);
+        asm_thumb_mov_rlo_i8(emit->as, REG_RET, ret[op - MP_BINARY_OP_LESS]);
+        asm_thumb_mov_rlo_i8(emit->as, REG_RET, ret[op - MP_BINARY_OP_LESS] ^ 1);
+        #else
+            #error not implemented
+        #endif
+        emit_post_push_reg(emit, VTYPE_BOOL, REG_RET);
+        return;
+    } else {
+        adjust_stack(emit, 1);
+        EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
+            "binary op %q not implemented", mp_binary_op_method_name[op]);
+        return;
+    }
+    emit_post_push_reg(emit, VTYPE_FLOAT, REG_ARG_2);
+}
+#endif
+
 STATIC void emit_native_binary_op(emit_t *emit, mp_binary_op_t op) {
     DEBUG_printf("binary_op(" UINT_FMT ")\n", op);
     vtype_kind_t vtype_lhs = peek_vtype(emit, 1);
@@ -1974,6 +2707,11 @@ STATIC void emit_native_binary_op(emit_t *emit, mp_binary_op_t op) {
             EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                 "binary op %q not implemented", mp_binary_op_method_name[op]);
         }
+    #if N_FLOAT
+    } else if ((vtype_lhs == VTYPE_FLOAT && (vtype_rhs == VTYPE_FLOAT || vtype_rhs == VTYPE_INT))
+        || (vtype_lhs == VTYPE_INT && vtype_rhs == VTYPE_FLOAT)) {
+        emit_native_binary_op_float(emit, op);
+    #endif
     } else if (vtype_lhs == VTYPE_PYOBJ && vtype_rhs == VTYPE_PYOBJ) {
         emit_pre_pop_reg_reg(emit, &vtype_rhs, REG_ARG_3, &vtype_lhs, REG_ARG_2);
         bool invert = false;
@@ -2047,7 +2785,7 @@ STATIC void emit_native_build_slice(emit_t *emit, mp_uint_t n_args) {
         emit_pre_pop_reg_reg(emit, &vtype_stop, REG_ARG_2, &vtype_start, REG_ARG_1); // arg1 = start, arg2 = stop
         assert(vtype_start == VTYPE_PYOBJ);
         assert(vtype_stop == VTYPE_PYOBJ);
-        emit_call_with_imm_arg(emit, MP_F_NEW_SLICE, (mp_uint_t)mp_const_none, REG_ARG_3); // arg3 = step
+        emit_call_with_reloc_arg(emit, MP_F_NEW_SLICE, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE, REG_ARG_3); // arg3 = step
         emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
     } else {
         assert(n_args == 3);
@@ -2113,13 +2851,16 @@ STATIC void emit_native_make_function(emit_t *emit, scope_t *scope, mp_uint_t n_
     // call runtime, with type info for args, or don't support dict/default params, or only support Python objects for them
     emit_native_pre(emit);
     if (n_pos_defaults == 0 && n_kw_defaults == 0) {
-        emit_call_with_3_imm_args_and_first_aligned(emit, MP_F_MAKE_FUNCTION_FROM_RAW_CODE, (mp_uint_t)scope->raw_code, REG_ARG_1, (mp_uint_t)MP_OBJ_NULL, REG_ARG_2, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3);
+        need_reg_all(emit);
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)MP_OBJ_NULL, REG_ARG_2);
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3);
+        emit_call_with_reloc_arg(emit, MP_F_MAKE_FUNCTION_FROM_RAW_CODE, MP_NATIVE_RELOC_RAW_CODE, (mp_uint_t)scope->raw_code, REG_ARG_1);
     } else {
         vtype_kind_t vtype_def_tuple, vtype_def_dict;
         emit_pre_pop_reg_reg(emit, &vtype_def_dict, REG_ARG_3, &vtype_def_tuple, REG_ARG_2);
         assert(vtype_def_tuple == VTYPE_PYOBJ);
         assert(vtype_def_dict == VTYPE_PYOBJ);
-        emit_call_with_imm_arg_aligned(emit, MP_F_MAKE_FUNCTION_FROM_RAW_CODE, (mp_uint_t)scope->raw_code, REG_ARG_1);
+        emit_call_with_reloc_arg(emit, MP_F_MAKE_FUNCTION_FROM_RAW_CODE, MP_NATIVE_RELOC_RAW_CODE, (mp_uint_t)scope->raw_code, REG_ARG_1);
     }
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
@@ -2133,8 +2874,8 @@ STATIC void emit_native_make_closure(emit_t *emit, scope_t *scope, mp_uint_t n_c
         emit_get_stack_pointer_to_reg_for_pop(emit, REG_ARG_3, n_closed_over + 2);
         ASM_MOV_IMM_TO_REG(emit->as, 0x100 | n_closed_over, REG_ARG_2);
     }
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, (mp_uint_t)scope->raw_code, REG_ARG_1);
-    ASM_CALL_IND(emit->as, mp_fun_table[MP_F_MAKE_CLOSURE_FROM_RAW_CODE], MP_F_MAKE_CLOSURE_FROM_RAW_CODE);
+    emit_native_mov_reg_reloc(emit, REG_ARG_1, MP_NATIVE_RELOC_RAW_CODE, (mp_uint_t)scope->raw_code);
+    emit_native_call_ind(emit, MP_F_MAKE_CLOSURE_FROM_RAW_CODE);
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -2152,7 +2893,26 @@ STATIC void emit_native_call_function(emit_t *emit, mp_uint_t n_positional, mp_u
         assert(!star_flags);
         DEBUG_printf("  cast to %d\n", vtype_fun);
         vtype_kind_t vtype_cast = peek_stack(emit, 1)->data.u_imm;
-        switch (peek_vtype(emit, 0)) {
+        vtype_kind_t vtype_arg = peek_vtype(emit, 0);
+        #if N_FLOAT
+        if ((vtype_cast == VTYPE_FLOAT) != (vtype_arg == VTYPE_FLOAT) && vtype_arg != VTYPE_PYOBJ) {
+            // convert the value between float and integer
+            if (vtype_cast == VTYPE_FLOAT && vtype_arg != VTYPE_INT) {
+                EMIT_NATIVE_VIPER_TYPE_ERROR(emit, "can't convert '%q' to float", vtype_to_qstr(vtype_arg));
+            }
+            vtype_kind_t vtype;
+            emit_pre_pop_reg(emit, &vtype, REG_RET);
+            emit_pre_pop_discard(emit);
+            if (vtype_cast == VTYPE_FLOAT) {
+                ASM_FLOAT_FROM_INT_REG(emit->as, REG_RET);
+            } else {
+                ASM_INT_FROM_FLOAT_REG(emit->as, REG_RET);
+            }
+            emit_post_push_reg(emit, vtype_cast, REG_RET);
+            return;
+        }
+        #endif
+        switch (vtype_arg) {
             case VTYPE_PYOBJ: {
                 vtype_kind_t vtype;
                 emit_pre_pop_reg(emit, &vtype, REG_ARG_1);
@@ -2161,6 +2921,9 @@ STATIC void emit_native_call_function(emit_t *emit, mp_uint_t n_positional, mp_u
                 emit_post_push_reg(emit, vtype_cast, REG_RET);
                 break;
             }
+            #if N_FLOAT
+            case VTYPE_FLOAT:
+            #endif
             case VTYPE_BOOL:
             case VTYPE_INT:
             case VTYPE_UINT:
@@ -2212,7 +2975,7 @@ STATIC void emit_native_return_value(emit_t *emit) {
         if (peek_vtype(emit, 0) == VTYPE_PTR_NONE) {
             emit_pre_pop_discard(emit);
             if (emit->return_vtype == VTYPE_PYOBJ) {
-                ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)mp_const_none, REG_RET);
+                emit_native_mov_reg_reloc(emit, REG_RET, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_NONE);
             } else {
                 ASM_MOV_IMM_TO_REG(emit->as, 0, REG_RET);
             }
@@ -2230,13 +2993,42 @@ STATIC void emit_native_return_value(emit_t *emit) {
         emit_pre_pop_reg(emit, &vtype, REG_RET);
         assert(vtype == VTYPE_PYOBJ);
     }
-    emit->last_emit_was_return_value = true;
-    ASM_EXIT(emit->as);
+    if (NEED_GLOBAL_EXC_HANDLER(emit)) {
+        // save the return value and go to the exit, via any finally blocks
+        emit_native_mov_reg_state(emit, REG_RET, LOCAL_IDX_RET_VAL(emit));
+        emit_native_unwind_jump(emit, LABEL_EXIT(emit), emit->exc_stack_size);
+        emit->last_emit_was_return_value = true;
+    } else {
+        emit->last_emit_was_return_value = true;
+        ASM_EXIT(emit->as);
+    }
 }
 
 STATIC void emit_native_raise_varargs(emit_t *emit, mp_uint_t n_args) {
-    assert(n_args == 1);
     vtype_kind_t vtype_exc;
+    if (n_args == 0) {
+        // re-raise the exception being handled, which was saved on entry to
+        // the innermost except or finally block that we are in
+        emit_native_pre(emit);
+        for (size_t i = emit->exc_stack_size; i-- > 0;) {
+            exc_stack_entry_t *e = &emit->exc_stack[i];
+            if (!e->is_active) {
+                emit_native_mov_state_reg(emit, LOCAL_IDX_SAVED_EXC(emit, i), REG_ARG_1);
+                emit_call(emit, MP_F_NATIVE_RAISE);
+                if (e->kind == EXC_KIND_EXCEPT) {
+                    // there is always an exception in an except block
+                    return;
+                }
+            }
+        }
+        emit_native_mov_reg_reloc(emit, REG_ARG_1, MP_NATIVE_RELOC_CONST, MP_NATIVE_CONST_TYPE_RUNTIME_ERROR);
+        emit_call(emit, MP_F_NATIVE_RAISE);
+        return;
+    }
+    if (n_args == 2) {
+        // the cause of the exception is not supported, so just discard it
+        emit_pre_pop_discard(emit);
+    }
     emit_pre_pop_reg(emit, &vtype_exc, REG_ARG_1); // arg1 = object to raise
     if (vtype_exc != VTYPE_PYOBJ) {
         EMIT_NATIVE_VIPER_TYPE_ERROR(emit, "must raise an object");
@@ -2245,32 +3037,192 @@ STATIC void emit_native_raise_varargs(emit_t *emit, mp_uint_t n_args) {
     emit_call(emit, MP_F_NATIVE_RAISE);
 }
 
+// Yield the value on the top of the stack out of the generator.  It resumes
+// at the given label with the value sent to it on the top of the stack.
+STATIC void emit_native_yield(emit_t *emit, mp_uint_t resume) {
+    need_stack_settled(emit);
+    emit_get_stack_pointer_to_reg_for_pop(emit, REG_ARG_1, 1);
+    emit_native_mov_reg_state(emit, REG_ARG_1, LOCAL_IDX_CODE_STATE(emit, sp));
+    emit_native_mov_state_imm_via(emit, LOCAL_IDX_CODE_STATE(emit, ip), resume + 1, REG_ARG_1);
+    emit_call(emit, MP_F_NLR_POP);
+    ASM_MOV_IMM_TO_REG(emit->as, MP_VM_RETURN_YIELD, REG_RET);
+    ASM_EXIT(emit->as);
+
+    mp_asm_base_label_assign(&emit->as->base, resume);
+    emit_native_add_dispatch(emit, resume);
+    stack_info_t *si = &emit->stack_info[emit->stack_size];
+    si->kind = STACK_VALUE;
+    si->vtype = VTYPE_PYOBJ;
+    adjust_stack(emit, 1);
+}
+
 STATIC void emit_native_yield_value(emit_t *emit) {
-    // not supported (for now)
-    (void)emit;
-    mp_raise_NotImplementedError("native yield");
+    if (emit->do_viper_types) {
+        mp_raise_NotImplementedError("native yield");
+    }
+    emit_native_pre(emit);
+    emit_native_yield(emit, *emit->label_slot);
+
+    // throw the value given to the generator, if any
+    ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_EXC_VAL(emit), REG_ARG_1);
+    emit_call(emit, MP_F_NATIVE_RAISE);
+    emit_post(emit);
 }
+
 STATIC void emit_native_yield_from(emit_t *emit) {
-    // not supported (for now)
-    (void)emit;
-    mp_raise_NotImplementedError("native yield from");
+    // note: resume, resume+1 and resume+2 are available as auxiliary labels
+    if (emit->do_viper_types) {
+        mp_raise_NotImplementedError("native yield from");
+    }
+    emit_native_pre(emit);
+    mp_uint_t resume = *emit->label_slot;
+
+    // stack: (..., iter, send_value)
+    need_stack_settled(emit);
+    ASM_MOV_IMM_TO_LOCAL_USING(emit->as, (mp_uint_t)MP_OBJ_NULL, LOCAL_IDX_EXC_VAL(emit), REG_TEMP0);
+    ASM_JUMP(emit->as, resume + 2);
+
+    // pass on the value yielded by the iterator
+    mp_asm_base_label_assign(&emit->as->base, resume + 1);
+    emit_native_yield(emit, resume);
+
+    // send the value to the iterator, or throw the value given to the generator
+    mp_asm_base_label_assign(&emit->as->base, resume + 2);
+    vtype_kind_t vtype;
+    emit_pre_pop_reg(emit, &vtype, REG_ARG_2); // send_value
+    emit_access_stack(emit, 1, &vtype, REG_ARG_1); // iter
+    ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_EXC_VAL(emit), REG_ARG_3); // throw_value
+    emit_post_push_reg(emit, VTYPE_PYOBJ, REG_ARG_3);
+    emit_get_stack_pointer_to_reg_for_pop(emit, REG_ARG_3, 1);
+    emit_call(emit, MP_F_NATIVE_YIELD_FROM);
+    ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, resume + 1);
+
+    // the iterator finished, replace it with its return value
+    adjust_stack(emit, 1);
+    emit_fold_stack_top(emit, REG_ARG_1);
+    emit_post(emit);
 }
 
 STATIC void emit_native_start_except_handler(emit_t *emit) {
-    // This instruction follows an nlr_pop, so the stack counter is back to zero, when really
-    // it should be up by a whole nlr_buf_t.  We then want to pop the nlr_buf_t here, but save
-    // the first 2 elements, so we can get the thrown value.
-    adjust_stack(emit, 1);
-    vtype_kind_t vtype_nlr;
-    emit_pre_pop_reg(emit, &vtype_nlr, REG_ARG_1); // get the thrown value
-    emit_pre_pop_discard(emit); // discard the linked-list pointer in the nlr_buf
-    emit_post_push_reg_reg_reg(emit, VTYPE_PYOBJ, REG_ARG_1, VTYPE_PYOBJ, REG_ARG_1, VTYPE_PYOBJ, REG_ARG_1); // push the 3 exception items
+    // We get here with the stack as it was at the start of the try block, and
+    // the exception in EXC_VAL.  Save it for a bare raise and push it.
+    size_t level = emit->exc_stack_size - 1;
+    exc_stack_entry_t *e = &emit->exc_stack[level];
+    assert(!e->is_active);
+    e->stack_base = emit->stack_size;
+    emit_native_set_handler(emit, emit_native_outer_handler_id(emit, level));
+    ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_EXC_VAL(emit), REG_TEMP0);
+    emit_native_mov_reg_state(emit, REG_TEMP0, LOCAL_IDX_SAVED_EXC(emit, level));
+    emit_post_push_reg(emit, VTYPE_PYOBJ, REG_TEMP0);
 }
 
 STATIC void emit_native_end_except_handler(emit_t *emit) {
-    adjust_stack(emit, -1);
+    // the exception was popped by end_finally
+    (void)emit;
+}
+
+#if MICROPY_EMIT_NATIVE_TIERING
+// Emit an entry point that continues the function at the given label, taking
+// its locals and stack from the state of a bytecode frame (of size n_state_bc,
+// with stack_depth values on its stack) that is passed as the first argument.
+// The second argument is where to record the position in the bytecode, and
+// goes in the local ip_local instead of a local of the bytecode frame.  This
+// is used after the end of the main code, and the stack must be settled at
+// the label.  Returns the offset of the entry point.
+mp_uint_t EXPORT_FUN(osr_entry)(emit_t *emit, mp_uint_t label, mp_uint_t n_state_bc, mp_uint_t stack_depth, mp_uint_t ip_local) {
+    mp_uint_t entry = mp_asm_base_get_code_pos(&emit->as->base);
+
+    // same frame as the main entry to the function
+    ASM_ENTRY(emit->as, emit->state_start + emit->n_state);
+
+    #if N_THUMB
+    emit_native_mov_reg_reloc(emit, ASM_THUMB_REG_R7, MP_NATIVE_RELOC_FUN_TABLE, 0);
+    #elif N_ARM
+    emit_native_mov_reg_reloc(emit, ASM_ARM_REG_R7, MP_NATIVE_RELOC_FUN_TABLE, 0);
+    #endif
+
+    // REG_TEMP1 points to the state of the bytecode frame, and REG_TEMP2 is
+    // where to record the position
+    #if N_X86
+    asm_x86_mov_arg_to_r32(emit->as, 0, REG_TEMP1);
+    asm_x86_mov_arg_to_r32(emit->as, 1, REG_TEMP2);
+    #else
+    if (REG_TEMP2 != REG_ARG_2) {
+        ASM_MOV_REG_REG(emit->as, REG_TEMP2, REG_ARG_2);
+    }
+    if (REG_TEMP1 != REG_ARG_1) {
+        ASM_MOV_REG_REG(emit->as, REG_TEMP1, REG_ARG_1);
+    }
+    #endif
+
+    // the stack of the bytecode frame starts at state[0]
+    for (mp_uint_t i = 0; i < stack_depth; i++) {
+        ASM_LOAD_REG_REG_OFFSET(emit->as, REG_TEMP0, REG_TEMP1, i);
+        ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, emit->stack_start + i);
+    }
+
+    // and local i is in state[n_state_bc - 1 - i]
+    for (mp_uint_t i = 0; i < emit->scope->num_locals; i++) {
+        mp_uint_t offset = n_state_bc - 1 - i;
+        if (i == ip_local) {
+            if (local_reg(emit, i) >= 0) {
+                ASM_MOV_REG_REG(emit->as, local_reg(emit, i), REG_TEMP2);
+            } else {
+                ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP2, local_idx(emit, i));
+            }
+        } else if (local_reg(emit, i) >= 0) {
+            ASM_LOAD_REG_REG_OFFSET(emit->as, local_reg(emit, i), REG_TEMP1, offset);
+        } else {
+            ASM_LOAD_REG_REG_OFFSET(emit->as, REG_TEMP0, REG_TEMP1, offset);
+            ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, local_idx(emit, i));
+        }
+    }
+
+    ASM_JUMP(emit->as, label);
+
+    // no code falls through past the jump, so end_pass needn't add an exit
+    emit->last_emit_was_return_value = true;
+
+    return entry;
 }
 
+// Emit code at the start of the function that puts in the local ip_local
+// where to record the position in the bytecode, for a call that doesn't come
+// from the bytecode.
+void EXPORT_FUN(tier_entry)(emit_t *emit, mp_uint_t ip_local) {
+    emit_native_pre(emit);
+    emit_call(emit, MP_F_NATIVE_TIER_IP);
+    if (local_reg(emit, ip_local) >= 0) {
+        ASM_MOV_REG_REG(emit->as, local_reg(emit, ip_local), REG_RET);
+    } else {
+        emit_native_mov_reg_state(emit, REG_RET, local_idx(emit, ip_local));
+    }
+}
+
+// Emit code that records the given position in the bytecode, at the address
+// in the local ip_local, for the traceback of an exception raised by the code
+// that follows.
+void EXPORT_FUN(tier_set_ip)(emit_t *emit, mp_uint_t ip_local, const byte *ip) {
+    emit_native_pre(emit);
+    emit_native_record_local_use(emit, ip_local);
+    need_reg_all(emit);
+    int reg_base = local_reg(emit, ip_local);
+    if (reg_base < 0) {
+        reg_base = REG_TEMP1;
+        emit_native_mov_state_reg(emit, local_idx(emit, ip_local), reg_base);
+    }
+    ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)ip, REG_TEMP0);
+    ASM_STORE_REG_REG_OFFSET(emit->as, REG_TEMP0, reg_base, 0);
+}
+
+// Emit a call to the hook for backward jumps, which handles pending
+// exceptions and lets other threads run.  The stack must be settled.
+void EXPORT_FUN(tier_loop_hook)(emit_t *emit) {
+    emit_native_pre(emit);
+    emit_call(emit, MP_F_NATIVE_TIER_LOOP_HOOK);
+}
+#endif
+
 const emit_method_table_t EXPORT_FUN(method_table) = {
     emit_native_set_native_type,
     emit_native_start_pass,
@@ -31,6 +31,16 @@
 #include "py/gc.h"
 #include "py/runtime.h"
 
+#if MICROPY_GC_PAUSE_STATS
+#include "py/mphal.h"
+#include "py/smallint.h"
+#endif
+
+#if MICROPY_GC_COMPACT
+#include "py/objlist.h"
+#include "py/objtype.h"
+#endif
+
 #if MICROPY_ENABLE_GC
 
 #if MICROPY_DEBUG_VERBOSE // print debugging info
@@ -70,26 +80,52 @@
 #define ATB_3_IS_FREE(a) (((a) & ATB_MASK_3) == 0)
 
 #define BLOCK_SHIFT(block) (2 * ((block) & (BLOCKS_PER_ATB - 1)))
-#define ATB_GET_KIND(block) ((MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
-#define ATB_ANY_TO_FREE(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
-#define ATB_FREE_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_HEAD << BLOCK_SHIFT(block)); } while (0)
-#define ATB_FREE_TO_TAIL(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_TAIL << BLOCK_SHIFT(block)); } while (0)
-#define ATB_HEAD_TO_MARK(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
-#define ATB_MARK_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
-
-#define BLOCK_FROM_PTR(ptr) (((byte*)(ptr) - MP_STATE_MEM(gc_pool_start)) / BYTES_PER_BLOCK)
-#define PTR_FROM_BLOCK(block) (((block) * BYTES_PER_BLOCK + (uintptr_t)MP_STATE_MEM(gc_pool_start)))
+#define ATB_GET_KIND(area, block) (((area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
+#if MICROPY_GC_THREAD_ALLOC_BUF
+// Threads carve objects out of their allocation buffers without holding the
+// GC mutex, so ATB bytes may be shared with another writer and outside of a
+// collection must be updated atomically.
+#define ATB_OR(area, block, bits) ((void)__atomic_fetch_or(&(area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB], (bits), __ATOMIC_RELAXED))
+#define ATB_AND(area, block, bits) ((void)__atomic_fetch_and(&(area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB], (bits), __ATOMIC_RELAXED))
+#define ATB_XOR(area, block, bits) ((void)__atomic_fetch_xor(&(area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB], (bits), __ATOMIC_RELAXED))
+#else
+#define ATB_OR(area, block, bits) ((area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (bits))
+#define ATB_AND(area, block, bits) ((area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (bits))
+#define ATB_XOR(area, block, bits) ((area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] ^= (bits))
+#endif
+#define ATB_ANY_TO_FREE(area, block) do { ATB_AND(area, block, ~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
+#define ATB_FREE_TO_HEAD(area, block) do { ATB_OR(area, block, AT_HEAD << BLOCK_SHIFT(block)); } while (0)
+#define ATB_FREE_TO_TAIL(area, block) do { ATB_OR(area, block, AT_TAIL << BLOCK_SHIFT(block)); } while (0)
+#define ATB_TAIL_TO_HEAD(area, block) do { ATB_XOR(area, block, AT_MARK << BLOCK_SHIFT(block)); } while (0)
+// The mark and sweep never touch an ATB shared with a thread's allocation
+// buffer (they are emptied by a collection, and the lazy sweep stays ahead
+// of all allocations), so the following are not atomic.
+#define ATB_UNMARKED_TO_FREE(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
+#define ATB_HEAD_TO_MARK(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
+#define ATB_MARK_TO_HEAD(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
+
+#define BLOCK_FROM_PTR(area, ptr) (((byte*)(ptr) - (area)->gc_pool_start) / BYTES_PER_BLOCK)
+#define PTR_FROM_BLOCK(area, block) (((block) * BYTES_PER_BLOCK + (uintptr_t)(area)->gc_pool_start))
 #define ATB_FROM_BLOCK(bl) ((bl) / BLOCKS_PER_ATB)
 
+// total number of blocks in the pool of an area
+#define AREA_MAX_BLOCK(area) ((area)->gc_alloc_table_byte_len * BLOCKS_PER_ATB)
+
+#if MICROPY_GC_SPLIT_HEAP
+#define NEXT_AREA(area) ((area)->next)
+#else
+#define NEXT_AREA(area) (NULL)
+#endif
+
 #if MICROPY_ENABLE_FINALISER
 // FTB = finaliser table byte
 // if set, then the corresponding block may have a finaliser
 
 #define BLOCKS_PER_FTB (8)
 
-#define FTB_GET(block) ((MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
-#define FTB_SET(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
-#define FTB_CLEAR(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
+#define FTB_GET(area, block) (((area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
+#define FTB_SET(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
+#define FTB_CLEAR(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
 #endif
 
 #if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
@@ -100,8 +136,32 @@
 #define GC_EXIT()
 #endif
 
+#if MICROPY_GC_SIZE_CLASSES
+STATIC void gc_free_run_push(mp_state_mem_area_t *area, size_t block, size_t n_blocks);
+#endif
+
+#if MICROPY_GC_LAZY_SWEEP
+#if MICROPY_GC_SIZE_CLASSES
+#error MICROPY_GC_LAZY_SWEEP is not compatible with MICROPY_GC_SIZE_CLASSES
+#endif
+// number of ATBs that gc_alloc sweeps at a time
+#define GC_LAZY_SWEEP_ATBS (16)
+#endif
+
+#if MICROPY_GC_THREAD_ALLOC_BUF
+#if !MICROPY_PY_THREAD || MICROPY_PY_THREAD_GIL
+#error MICROPY_GC_THREAD_ALLOC_BUF requires MICROPY_PY_THREAD without the GIL
+#endif
+// largest object, in blocks, that is allocated from a thread's buffer
+#define GC_ALLOC_BUF_MAX_BLOCKS (MICROPY_GC_THREAD_ALLOC_BUF / 16)
+// A buffer's lock is only ever held for a few instructions, and is taken on
+// every allocation from it, so it is a spin lock rather than a mutex.
+#define GC_ALLOC_BUF_LOCK(buf) do { while (__atomic_exchange_n(&(buf)->locked, 1, __ATOMIC_ACQUIRE)) { } } while (0)
+#define GC_ALLOC_BUF_UNLOCK(buf) __atomic_store_n(&(buf)->locked, 0, __ATOMIC_RELEASE)
+#endif
+
 // TODO waste less memory; currently requires that all entries in alloc_table have a corresponding block in pool
-void gc_init(void *start, void *end) {
+STATIC void gc_setup_area(mp_state_mem_area_t *area, void *start, void *end) {
     // align end pointer on block boundary
     end = (void*)((uintptr_t)end & (~(BYTES_PER_BLOCK - 1)));
     DEBUG_printf("Initializing GC heap: %p..%p = " UINT_FMT " bytes\n", start, end, (byte*)end - (byte*)start);
@@ -113,36 +173,73 @@ void gc_init(void *start, void *end) {
     // => T = A * (1 + BLOCKS_PER_ATB / BLOCKS_PER_FTB + BLOCKS_PER_ATB * BYTES_PER_BLOCK)
     size_t total_byte_len = (byte*)end - (byte*)start;
 #if MICROPY_ENABLE_FINALISER
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len * BITS_PER_BYTE / (BITS_PER_BYTE + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
+    area->gc_alloc_table_byte_len = total_byte_len * BITS_PER_BYTE / (BITS_PER_BYTE + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
 #else
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len / (1 + BITS_PER_BYTE / 2 * BYTES_PER_BLOCK);
+    area->gc_alloc_table_byte_len = total_byte_len / (1 + BITS_PER_BYTE / 2 * BYTES_PER_BLOCK);
 #endif
 
-    MP_STATE_MEM(gc_alloc_table_start) = (byte*)start;
+    area->gc_alloc_table_start = (byte*)start;
 
 #if MICROPY_ENABLE_FINALISER
-    size_t gc_finaliser_table_byte_len = (MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
-    MP_STATE_MEM(gc_finaliser_table_start) = MP_STATE_MEM(gc_alloc_table_start) + MP_STATE_MEM(gc_alloc_table_byte_len);
+    size_t gc_finaliser_table_byte_len = (area->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
+    area->gc_finaliser_table_start = area->gc_alloc_table_start + area->gc_alloc_table_byte_len;
 #endif
 
-    size_t gc_pool_block_len = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
-    MP_STATE_MEM(gc_pool_start) = (byte*)end - gc_pool_block_len * BYTES_PER_BLOCK;
-    MP_STATE_MEM(gc_pool_end) = end;
+    size_t gc_pool_block_len = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    area->gc_pool_start = (byte*)end - gc_pool_block_len * BYTES_PER_BLOCK;
+    area->gc_pool_end = end;
 
 #if MICROPY_ENABLE_FINALISER
-    assert(MP_STATE_MEM(gc_pool_start) >= MP_STATE_MEM(gc_finaliser_table_start) + gc_finaliser_table_byte_len);
+    assert(area->gc_pool_start >= area->gc_finaliser_table_start + gc_finaliser_table_byte_len);
 #endif
 
     // clear ATBs
-    memset(MP_STATE_MEM(gc_alloc_table_start), 0, MP_STATE_MEM(gc_alloc_table_byte_len));
+    memset(area->gc_alloc_table_start, 0, area->gc_alloc_table_byte_len);
 
 #if MICROPY_ENABLE_FINALISER
     // clear FTBs
-    memset(MP_STATE_MEM(gc_finaliser_table_start), 0, gc_finaliser_table_byte_len);
+    memset(area->gc_finaliser_table_start, 0, gc_finaliser_table_byte_len);
 #endif
 
     // set last free ATB index to start of heap
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
+    area->gc_last_free_atb_index = 0;
+    #if MICROPY_GC_THREAD_ALLOC_BUF
+    area->gc_alloc_buf_atb_index = 0;
+    #endif
+
+    #if MICROPY_GC_LAZY_SWEEP
+    // no sweep pending
+    area->gc_sweep_block = gc_pool_block_len;
+    area->gc_sweep_free_tail = 0;
+    #endif
+
+    #if MICROPY_GC_SIZE_CLASSES
+    // the whole pool is one free run
+    memset(area->gc_free_runs, 0, sizeof(area->gc_free_runs));
+    if (gc_pool_block_len > 0) {
+        gc_free_run_push(area, 0, gc_pool_block_len);
+    }
+    #endif
+
+    #if MICROPY_GC_SPLIT_HEAP
+    area->next = NULL;
+    #endif
+
+    DEBUG_printf("GC layout:\n");
+    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_alloc_table_start, area->gc_alloc_table_byte_len, area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
+#if MICROPY_ENABLE_FINALISER
+    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_finaliser_table_start, gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
+#endif
+    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_pool_start, gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
+}
+
+void gc_init(void *start, void *end) {
+    gc_setup_area(&MP_STATE_MEM(area), start, end);
+
+    #if MICROPY_GC_SPLIT_HEAP
+    MP_STATE_MEM(gc_lowest_ptr) = MP_STATE_MEM(area).gc_pool_start;
+    MP_STATE_MEM(gc_highest_ptr) = MP_STATE_MEM(area).gc_pool_end;
+    #endif
 
     // unlock the GC
     MP_STATE_MEM(gc_lock_depth) = 0;
@@ -150,6 +247,21 @@ void gc_init(void *start, void *end) {
     // allow auto collection
     MP_STATE_MEM(gc_auto_collect_enabled) = 1;
 
+    #if MICROPY_GC_PAUSE_STATS
+    MP_STATE_MEM(gc_pause_last_us) = 0;
+    MP_STATE_MEM(gc_pause_max_us) = 0;
+    MP_STATE_MEM(gc_pause_total_us) = 0;
+    MP_STATE_MEM(gc_num_collections) = 0;
+    #endif
+
+    #if MICROPY_GC_COMPACT
+    MP_STATE_MEM(gc_compact_n_objs) = 0;
+    MP_STATE_MEM(gc_compact_count) = 0;
+    MP_STATE_MEM(gc_compact_moved) = 0;
+    MP_STATE_MEM(gc_compact_max_free_before) = 0;
+    MP_STATE_MEM(gc_compact_max_free_after) = 0;
+    #endif
+
     #if MICROPY_GC_ALLOC_THRESHOLD
     // by default, maxuint for gc threshold, effectively turning gc-by-threshold off
     MP_STATE_MEM(gc_alloc_threshold) = (size_t)-1;
@@ -160,14 +272,39 @@ void gc_init(void *start, void *end) {
     mp_thread_mutex_init(&MP_STATE_MEM(gc_mutex));
     #endif
 
-    DEBUG_printf("GC layout:\n");
-    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_alloc_table_start), MP_STATE_MEM(gc_alloc_table_byte_len), MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
-#if MICROPY_ENABLE_FINALISER
-    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_finaliser_table_start), gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
-#endif
-    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_pool_start), gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
+    #if MICROPY_GC_THREAD_ALLOC_BUF
+    // any buffer of the calling thread was in the old heap, eg before a soft reset
+    MP_STATE_MEM(gc_alloc_bufs) = NULL;
+    gc_thread_alloc_buf_init();
+    #endif
 }
 
+#if MICROPY_GC_SPLIT_HEAP
+void gc_add(void *start, void *end) {
+    // the area structure goes at the (word aligned) start of the region
+    mp_state_mem_area_t *area = (mp_state_mem_area_t*)(((uintptr_t)start + sizeof(void*) - 1) & ~(sizeof(void*) - 1));
+    if ((byte*)end < (byte*)(area + 1)) {
+        return;
+    }
+    gc_setup_area(area, area + 1, end);
+
+    // append it to the list of areas
+    GC_ENTER();
+    mp_state_mem_area_t *prev = &MP_STATE_MEM(area);
+    while (prev->next != NULL) {
+        prev = prev->next;
+    }
+    prev->next = area;
+    if (area->gc_pool_start < MP_STATE_MEM(gc_lowest_ptr)) {
+        MP_STATE_MEM(gc_lowest_ptr) = area->gc_pool_start;
+    }
+    if (area->gc_pool_end > MP_STATE_MEM(gc_highest_ptr)) {
+        MP_STATE_MEM(gc_highest_ptr) = area->gc_pool_end;
+    }
+    GC_EXIT();
+}
+#endif
+
 void gc_lock(void) {
     GC_ENTER();
     MP_STATE_MEM(gc_lock_depth)++;
@@ -185,23 +322,164 @@ bool gc_is_locked(void) {
 }
 
 // ptr should be of type void*
-#define VERIFY_PTR(ptr) ( \
+#define VERIFY_PTR(area, ptr) ( \
         ((uintptr_t)(ptr) & (BYTES_PER_BLOCK - 1)) == 0      /* must be aligned on a block */ \
-        && ptr >= (void*)MP_STATE_MEM(gc_pool_start)     /* must be above start of pool */ \
-        && ptr < (void*)MP_STATE_MEM(gc_pool_end)        /* must be below end of pool */ \
+        && ptr >= (void*)(area)->gc_pool_start     /* must be above start of pool */ \
+        && ptr < (void*)(area)->gc_pool_end        /* must be below end of pool */ \
     )
 
+// Return the area whose pool contains ptr, or NULL if ptr is not a pointer
+// to the start of a block in the heap.
+static inline mp_state_mem_area_t *gc_get_ptr_area(const void *ptr) {
+    #if MICROPY_GC_SPLIT_HEAP
+    // cheap rejection of unaligned pointers and those outside all the pools
+    if (((uintptr_t)ptr & (BYTES_PER_BLOCK - 1)) != 0
+        || ptr < (void*)MP_STATE_MEM(gc_lowest_ptr) || ptr >= (void*)MP_STATE_MEM(gc_highest_ptr)) {
+        return NULL;
+    }
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = area->next) {
+        if (ptr >= (void*)area->gc_pool_start && ptr < (void*)area->gc_pool_end) {
+            return area;
+        }
+    }
+    return NULL;
+    #else
+    if (VERIFY_PTR(&MP_STATE_MEM(area), ptr)) {
+        return &MP_STATE_MEM(area);
+    }
+    return NULL;
+    #endif
+}
+
+#if MICROPY_GC_STACK_SPILL
+
+// When the fixed GC stack fills up its entries are moved to segments made
+// from runs of free heap blocks, which are otherwise unused while marking.
+// A segment lives in its run's blocks but they stay free in the ATB.
+typedef struct _gc_stack_seg_t {
+    struct _gc_stack_seg_t *prev;
+    size_t len;
+    size_t alloc;
+    void *items[];
+} gc_stack_seg_t;
+
+#define GC_STACK_SEG_MAX_BLOCKS ((sizeof(gc_stack_seg_t) + MICROPY_ALLOC_GC_STACK_SIZE * sizeof(void*) + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK)
+
+#if MICROPY_GC_SPLIT_HEAP
+#define GC_STACK_SEG_AREA MP_STATE_MEM(gc_stack_seg_area)
+#else
+#define GC_STACK_SEG_AREA (&MP_STATE_MEM(area))
+#endif
+
+// Get a segment, reusing an emptied one if possible, else from the next run
+// of free blocks after the ones used so far.
+STATIC gc_stack_seg_t *gc_stack_seg_new(void) {
+    gc_stack_seg_t *seg = MP_STATE_MEM(gc_stack_seg_spare);
+    if (seg != NULL) {
+        MP_STATE_MEM(gc_stack_seg_spare) = seg->prev;
+    } else {
+        mp_state_mem_area_t *area = GC_STACK_SEG_AREA;
+        size_t block = MP_STATE_MEM(gc_stack_seg_block);
+        size_t n_blocks = 0;
+        while (n_blocks * BYTES_PER_BLOCK <= sizeof(gc_stack_seg_t)) {
+            size_t max_block = AREA_MAX_BLOCK(area);
+            block += n_blocks;
+            while (block < max_block && ATB_GET_KIND(area, block) != AT_FREE) {
+                block++;
+            }
+            if (block >= max_block) {
+                #if MICROPY_GC_SPLIT_HEAP
+                if (area->next != NULL) {
+                    // carry on searching in the next area
+                    area = MP_STATE_MEM(gc_stack_seg_area) = area->next;
+                    block = 0;
+                    n_blocks = 0;
+                    continue;
+                }
+                #endif
+                MP_STATE_MEM(gc_stack_seg_block) = max_block;
+                return NULL;
+            }
+            n_blocks = 0;
+            while (block + n_blocks < max_block && n_blocks < GC_STACK_SEG_MAX_BLOCKS
+                && ATB_GET_KIND(area, block + n_blocks) == AT_FREE) {
+                n_blocks++;
+            }
+        }
+        MP_STATE_MEM(gc_stack_seg_block) = block + n_blocks;
+        seg = (gc_stack_seg_t*)PTR_FROM_BLOCK(area, block);
+        seg->alloc = (n_blocks * BYTES_PER_BLOCK - sizeof(gc_stack_seg_t)) / sizeof(void*);
+    }
+    seg->prev = MP_STATE_MEM(gc_stack_seg);
+    seg->len = 0;
+    MP_STATE_MEM(gc_stack_seg) = seg;
+    return seg;
+}
+
+// Move entries from the full GC stack to segments.  Returns true if there is
+// now room on the GC stack.
+STATIC bool gc_stack_spill(void) {
+    void **src = MP_STATE_MEM(gc_stack);
+    void **top = MP_STATE_MEM(gc_sp);
+    while (src < top) {
+        gc_stack_seg_t *seg = MP_STATE_MEM(gc_stack_seg);
+        if (seg == NULL || seg->len == seg->alloc) {
+            seg = gc_stack_seg_new();
+            if (seg == NULL) {
+                break;
+            }
+        }
+        size_t n = MIN((size_t)(top - src), seg->alloc - seg->len);
+        memcpy(&seg->items[seg->len], src, n * sizeof(void*));
+        seg->len += n;
+        src += n;
+    }
+    memmove(MP_STATE_MEM(gc_stack), src, (top - src) * sizeof(void*));
+    MP_STATE_MEM(gc_sp) -= src - MP_STATE_MEM(gc_stack);
+    return src > MP_STATE_MEM(gc_stack);
+}
+
+// Refill the empty GC stack from the top segment.  Returns false if there
+// are no entries left in any segment.
+STATIC bool gc_stack_unspill(void) {
+    gc_stack_seg_t *seg = MP_STATE_MEM(gc_stack_seg);
+    if (seg == NULL) {
+        return false;
+    }
+    size_t n = MIN(seg->len, (size_t)MICROPY_ALLOC_GC_STACK_SIZE);
+    seg->len -= n;
+    memcpy(MP_STATE_MEM(gc_stack), &seg->items[seg->len], n * sizeof(void*));
+    MP_STATE_MEM(gc_sp) = MP_STATE_MEM(gc_stack) + n;
+    if (seg->len == 0) {
+        MP_STATE_MEM(gc_stack_seg) = seg->prev;
+        seg->prev = MP_STATE_MEM(gc_stack_seg_spare);
+        MP_STATE_MEM(gc_stack_seg_spare) = seg;
+    }
+    return true;
+}
+
+#define GC_STACK_SPILL() gc_stack_spill()
+
+#else
+
+#define GC_STACK_SPILL() (false)
+
+#endif // MICROPY_GC_STACK_SPILL
+
 // ptr should be of type void*
+// The GC stack holds pointers to the marked heads, so entries from any area
+// can be mixed on it.
 #define VERIFY_MARK_AND_PUSH(ptr) \
     do { \
-        if (VERIFY_PTR(ptr)) { \
-            size_t _block = BLOCK_FROM_PTR(ptr); \
-            if (ATB_GET_KIND(_block) == AT_HEAD) { \
+        mp_state_mem_area_t *_area = gc_get_ptr_area(ptr); \
+        if (_area != NULL) { \
+            size_t _block = BLOCK_FROM_PTR(_area, ptr); \
+            if (ATB_GET_KIND(_area, _block) == AT_HEAD) { \
                 /* an unmarked head, mark it, and push it on gc stack */ \
                 DEBUG_printf("gc_mark(%p)\n", ptr); \
-                ATB_HEAD_TO_MARK(_block); \
-                if (MP_STATE_MEM(gc_sp) < &MP_STATE_MEM(gc_stack)[MICROPY_ALLOC_GC_STACK_SIZE]) { \
-                    *MP_STATE_MEM(gc_sp)++ = _block; \
+                ATB_HEAD_TO_MARK(_area, _block); \
+                if (MP_STATE_MEM(gc_sp) < &MP_STATE_MEM(gc_stack)[MICROPY_ALLOC_GC_STACK_SIZE] || GC_STACK_SPILL()) { \
+                    *MP_STATE_MEM(gc_sp)++ = ptr; \
                 } else { \
                     MP_STATE_MEM(gc_stack_overflow) = 1; \
                 } \
@@ -209,21 +487,151 @@ bool gc_is_locked(void) {
         } \
     } while (0)
 
+#if MICROPY_GC_COMPACT
+
+#if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
+#error MICROPY_GC_COMPACT requires the GIL if MICROPY_PY_THREAD is enabled
+#endif
+
+// Count the words seen by the marking that point into one of the arrays that
+// gc_compact intends to move.  The end of the used part of an array is only
+// inside its chain of blocks if the array doesn't fill the chain, but a
+// pointer to just past the blocks can't be told apart from one to the next
+// chain, so that's the best that can be done.
+STATIC void gc_compact_count_ref(void *ptr, void **from) {
+    for (size_t i = 0; i < MP_STATE_MEM(gc_compact_n_objs); i++) {
+        mp_gc_compact_obj_t *obj = &MP_STATE_MEM(gc_compact_objs)[i];
+        if ((byte*)ptr >= obj->start && (byte*)ptr < obj->start + obj->n_bytes) {
+            obj->n_refs += 1;
+            obj->ref = from;
+        }
+    }
+}
+
+#define GC_COMPACT_COUNT_REF(ptr, from) \
+    do { \
+        if (MP_STATE_MEM(gc_compact_n_objs) > 0) { \
+            gc_compact_count_ref(ptr, from); \
+        } \
+    } while (0)
+
+#else
+
+#define GC_COMPACT_COUNT_REF(ptr, from)
+
+#endif // MICROPY_GC_COMPACT
+
+#if MICROPY_GC_SIZE_CLASSES
+
+// A run of free blocks on one of the segregated free lists.  The header lives
+// in the first block of the run itself.  Blocks can be allocated behind the
+// back of the lists (by the ATB scan in gc_alloc, or by gc_realloc expanding
+// in place), so an entry is only trusted after checking it against the ATB,
+// and a list is dropped as soon as a stale entry is found at its head.
+typedef struct _gc_free_run_t {
+    struct _gc_free_run_t *next;
+    size_t n_blocks;
+} gc_free_run_t;
+
+STATIC size_t gc_size_class(size_t n_blocks) {
+    size_t c = 0;
+    while (c < MICROPY_GC_SIZE_CLASSES - 1 && ((size_t)1 << c) < n_blocks) {
+        c += 1;
+    }
+    return c;
+}
+
+STATIC void gc_free_run_push(mp_state_mem_area_t *area, size_t block, size_t n_blocks) {
+    size_t c = gc_size_class(n_blocks);
+    gc_free_run_t *run = (gc_free_run_t*)PTR_FROM_BLOCK(area, block);
+    run->next = area->gc_free_runs[c];
+    run->n_blocks = n_blocks;
+    area->gc_free_runs[c] = run;
+}
+
+// Used by the sweep to rebuild the lists in address order.
+STATIC void gc_free_run_append(mp_state_mem_area_t *area, gc_free_run_t **tails, size_t block, size_t n_blocks) {
+    size_t c = gc_size_class(n_blocks);
+    gc_free_run_t *run = (gc_free_run_t*)PTR_FROM_BLOCK(area, block);
+    run->next = NULL;
+    run->n_blocks = n_blocks;
+    if (tails[c] == NULL) {
+        area->gc_free_runs[c] = run;
+    } else {
+        tails[c]->next = run;
+    }
+    tails[c] = run;
+}
+
+// Take n_blocks from the free lists of an area, returning the first block of
+// the chain, or (size_t)-1 if no run on the lists could satisfy the request.
+STATIC size_t gc_free_run_take(mp_state_mem_area_t *area, size_t n_blocks) {
+    size_t max_block = AREA_MAX_BLOCK(area);
+    for (size_t c = gc_size_class(n_blocks); c < MICROPY_GC_SIZE_CLASSES; c++) {
+        gc_free_run_t *run = area->gc_free_runs[c];
+        if (run == NULL) {
+            continue;
+        }
+        size_t block;
+        size_t run_len;
+        size_t n_check;
+        if (!VERIFY_PTR(area, (void*)run)) {
+            goto stale;
+        }
+        block = BLOCK_FROM_PTR(area, run);
+        run_len = run->n_blocks;
+        if (run_len == 0 || run_len > max_block - block) {
+            goto stale;
+        }
+        n_check = run_len < n_blocks ? run_len : n_blocks;
+        for (size_t bl = block; bl < block + n_check; bl++) {
+            if (ATB_GET_KIND(area, bl) != AT_FREE) {
+                goto stale;
+            }
+        }
+        if (run_len < n_blocks) {
+            // valid, but too small; only possible in the first class searched
+            continue;
+        }
+        area->gc_free_runs[c] = run->next;
+        if (run_len > n_blocks && ATB_GET_KIND(area, block + n_blocks) == AT_FREE) {
+            gc_free_run_push(area, block + n_blocks, run_len - n_blocks);
+        }
+        return block;
+    stale:
+        area->gc_free_runs[c] = NULL;
+    }
+    return (size_t)-1;
+}
+
+#endif // MICROPY_GC_SIZE_CLASSES
+
 STATIC void gc_drain_stack(void) {
+    #if MICROPY_GC_STACK_SPILL
+    while (MP_STATE_MEM(gc_sp) > MP_STATE_MEM(gc_stack) || gc_stack_unspill()) {
+    #else
     while (MP_STATE_MEM(gc_sp) > MP_STATE_MEM(gc_stack)) {
+    #endif
         // pop the next block off the stack
-        size_t block = *--MP_STATE_MEM(gc_sp);
+        void *ptr_head = *--MP_STATE_MEM(gc_sp);
+        #if MICROPY_GC_SPLIT_HEAP
+        mp_state_mem_area_t *area = gc_get_ptr_area(ptr_head);
+        #else
+        mp_state_mem_area_t *area = &MP_STATE_MEM(area);
+        #endif
+        size_t block = BLOCK_FROM_PTR(area, ptr_head);
 
         // work out number of consecutive blocks in the chain starting with this one
         size_t n_blocks = 0;
         do {
             n_blocks += 1;
-        } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
+        } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
 
         // check this block's children
-        void **ptrs = (void**)PTR_FROM_BLOCK(block);
+        void **ptrs = (void**)ptr_head;
         for (size_t i = n_blocks * BYTES_PER_BLOCK / sizeof(void*); i > 0; i--, ptrs++) {
             void *ptr = *ptrs;
+            GC_COMPACT_COUNT_REF(ptr, ptrs);
             VERIFY_MARK_AND_PUSH(ptr);
         }
     }
@@ -235,28 +643,42 @@ STATIC void gc_deal_with_stack_overflow(void) {
         MP_STATE_MEM(gc_sp) = MP_STATE_MEM(gc_stack);
 
         // scan entire memory looking for blocks which have been marked but not their children
-        for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-            // trace (again) if mark bit set
-            if (ATB_GET_KIND(block) == AT_MARK) {
-                *MP_STATE_MEM(gc_sp)++ = block;
-                gc_drain_stack();
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            for (size_t block = 0; block < AREA_MAX_BLOCK(area); block++) {
+                // trace (again) if mark bit set
+                if (ATB_GET_KIND(area, block) == AT_MARK) {
+                    *MP_STATE_MEM(gc_sp)++ = (void*)PTR_FROM_BLOCK(area, block);
+                    gc_drain_stack();
+                }
             }
         }
     }
 }
 
-STATIC void gc_sweep(void) {
-    #if MICROPY_PY_GC_COLLECT_RETVAL
-    MP_STATE_MEM(gc_collected) = 0;
-    #endif
-    // free unmarked heads and their tails
+// Free unmarked heads and their tails in an area.  With MICROPY_GC_LAZY_SWEEP
+// this continues from where the previous call stopped and sweeps up to (but
+// not including) end_block; otherwise it sweeps the whole area.
+STATIC void gc_sweep(mp_state_mem_area_t *area, size_t end_block) {
+    #if MICROPY_GC_LAZY_SWEEP
+    size_t block = area->gc_sweep_block;
+    int free_tail = area->gc_sweep_free_tail;
+    #else
+    size_t block = 0;
     int free_tail = 0;
-    for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-        switch (ATB_GET_KIND(block)) {
+    #endif
+    #if MICROPY_GC_SIZE_CLASSES
+    // rebuild the free lists from the runs of free blocks left after the sweep
+    gc_free_run_t *tails[MICROPY_GC_SIZE_CLASSES] = {NULL};
+    memset(area->gc_free_runs, 0, sizeof(area->gc_free_runs));
+    size_t run_start = 0;
+    size_t run_len = 0;
+    #endif
+    for (; block < end_block; block++) {
+        switch (ATB_GET_KIND(area, block)) {
             case AT_HEAD:
 #if MICROPY_ENABLE_FINALISER
-                if (FTB_GET(block)) {
-                    mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(block);
+                if (FTB_GET(area, block)) {
+                    mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(area, block);
                     if (obj->type != NULL) {
                         // if the object has a type then see if it has a __del__ method
                         mp_obj_t dest[2];
@@ -273,11 +695,11 @@ STATIC void gc_sweep(void) {
                         }
                     }
                     // clear finaliser flag
-                    FTB_CLEAR(block);
+                    FTB_CLEAR(area, block);
                 }
 #endif
                 free_tail = 1;
-                DEBUG_printf("gc_sweep(%x)\n", PTR_FROM_BLOCK(block));
+                DEBUG_printf("gc_sweep(%x)\n", PTR_FROM_BLOCK(area, block));
                 #if MICROPY_PY_GC_COLLECT_RETVAL
                 MP_STATE_MEM(gc_collected)++;
                 #endif
@@ -285,26 +707,117 @@ STATIC void gc_sweep(void) {
 
             case AT_TAIL:
                 if (free_tail) {
-                    ATB_ANY_TO_FREE(block);
+                    ATB_UNMARKED_TO_FREE(area, block);
                 }
                 break;
 
             case AT_MARK:
-                ATB_MARK_TO_HEAD(block);
+                ATB_MARK_TO_HEAD(area, block);
                 free_tail = 0;
                 break;
         }
+        #if MICROPY_GC_SIZE_CLASSES
+        if (ATB_GET_KIND(area, block) == AT_FREE) {
+            if (run_len++ == 0) {
+                run_start = block;
+            }
+        } else if (run_len > 0) {
+            gc_free_run_append(area, tails, run_start, run_len);
+            run_len = 0;
+        }
+        #endif
+    }
+    #if MICROPY_GC_SIZE_CLASSES
+    if (run_len > 0) {
+        gc_free_run_append(area, tails, run_start, run_len);
+    }
+    #endif
+    #if MICROPY_GC_LAZY_SWEEP
+    area->gc_sweep_block = end_block;
+    area->gc_sweep_free_tail = free_tail;
+    #endif
+}
+
+#if MICROPY_GC_LAZY_SWEEP
+// Sweep any pending blocks of an area below end_block.  Must be called with
+// the GC mutex held; the GC is locked while finalisers run, as in a full
+// collection.
+STATIC void gc_sweep_lazy(mp_state_mem_area_t *area, size_t end_block) {
+    size_t max_block = AREA_MAX_BLOCK(area);
+    if (end_block > max_block) {
+        end_block = max_block;
+    }
+    if (area->gc_sweep_block < end_block) {
+        MP_STATE_MEM(gc_lock_depth)++;
+        gc_sweep(area, end_block);
+        MP_STATE_MEM(gc_lock_depth)--;
+    }
+}
+
+void gc_sweep_all(void) {
+    GC_ENTER();
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        gc_sweep_lazy(area, AREA_MAX_BLOCK(area));
     }
+    GC_EXIT();
 }
+#endif
+
+#if MICROPY_GC_THREAD_ALLOC_BUF
+// Give the remaining blocks of a thread's allocation buffer back to the heap.
+// Must be called with the GC mutex and the buffer's lock held.
+STATIC void gc_alloc_buf_retire(mp_gc_alloc_buf_t *buf) {
+    if (buf->n_blocks == 0) {
+        return;
+    }
+    mp_state_mem_area_t *area = buf->area;
+    for (size_t bl = buf->block; bl < buf->block + buf->n_blocks; bl++) {
+        ATB_ANY_TO_FREE(area, bl);
+    }
+    if (buf->block / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+        area->gc_last_free_atb_index = buf->block / BLOCKS_PER_ATB;
+    }
+    #if MICROPY_GC_SIZE_CLASSES
+    gc_free_run_push(area, buf->block, buf->n_blocks);
+    #endif
+    buf->n_blocks = 0;
+}
+#endif
 
 void gc_collect_start(void) {
     GC_ENTER();
+    #if MICROPY_GC_PAUSE_STATS
+    MP_STATE_MEM(gc_pause_start_us) = mp_hal_ticks_us();
+    #endif
     MP_STATE_MEM(gc_lock_depth)++;
+    #if MICROPY_GC_THREAD_ALLOC_BUF
+    // Empty all allocation buffers, so no thread changes the ATB without the
+    // GC mutex until the collection is over.
+    for (mp_gc_alloc_buf_t *buf = MP_STATE_MEM(gc_alloc_bufs); buf != NULL; buf = buf->next) {
+        GC_ALLOC_BUF_LOCK(buf);
+        gc_alloc_buf_retire(buf);
+        GC_ALLOC_BUF_UNLOCK(buf);
+    }
+    #endif
+    #if MICROPY_GC_LAZY_SWEEP
+    // finish the sweep of the previous collection, so marked blocks are heads again
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        gc_sweep(area, AREA_MAX_BLOCK(area));
+    }
+    #endif
     #if MICROPY_GC_ALLOC_THRESHOLD
     MP_STATE_MEM(gc_alloc_amount) = 0;
     #endif
     MP_STATE_MEM(gc_stack_overflow) = 0;
     MP_STATE_MEM(gc_sp) = MP_STATE_MEM(gc_stack);
+    #if MICROPY_GC_STACK_SPILL
+    MP_STATE_MEM(gc_stack_seg) = NULL;
+    MP_STATE_MEM(gc_stack_seg_spare) = NULL;
+    #if MICROPY_GC_SPLIT_HEAP
+    MP_STATE_MEM(gc_stack_seg_area) = &MP_STATE_MEM(area);
+    #endif
+    MP_STATE_MEM(gc_stack_seg_block) = 0;
+    #endif
     // Trace root pointers.  This relies on the root pointers being organised
     // correctly in the mp_state_ctx structure.  We scan nlr_top, dict_locals,
     // dict_globals, then the root pointer section of mp_state_vm.
@@ -315,6 +828,7 @@ void gc_collect_start(void) {
 void gc_collect_root(void **ptrs, size_t len) {
     for (size_t i = 0; i < len; i++) {
         void *ptr = ptrs[i];
+        GC_COMPACT_COUNT_REF(ptr, &ptrs[i]);
         VERIFY_MARK_AND_PUSH(ptr);
         gc_drain_stack();
     }
@@ -322,76 +836,489 @@ void gc_collect_root(void **ptrs, size_t len) {
 
 void gc_collect_end(void) {
     gc_deal_with_stack_overflow();
-    gc_sweep();
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
+    #if MICROPY_PY_GC_COLLECT_RETVAL
+    MP_STATE_MEM(gc_collected) = 0;
+    #endif
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        #if MICROPY_GC_LAZY_SWEEP
+        // leave the sweep to gc_alloc, which does it as it searches for free blocks
+        area->gc_sweep_block = 0;
+        area->gc_sweep_free_tail = 0;
+        #else
+        gc_sweep(area, AREA_MAX_BLOCK(area));
+        #endif
+        area->gc_last_free_atb_index = 0;
+        #if MICROPY_GC_THREAD_ALLOC_BUF
+        area->gc_alloc_buf_atb_index = 0;
+        #endif
+    }
     MP_STATE_MEM(gc_lock_depth)--;
+    #if MICROPY_GC_PAUSE_STATS
+    mp_uint_t pause = (mp_hal_ticks_us() - MP_STATE_MEM(gc_pause_start_us)) & (MICROPY_PY_UTIME_TICKS_PERIOD - 1);
+    MP_STATE_MEM(gc_pause_last_us) = pause;
+    MP_STATE_MEM(gc_pause_total_us) += pause;
+    MP_STATE_MEM(gc_num_collections) += 1;
+    if (pause > MP_STATE_MEM(gc_pause_max_us)) {
+        MP_STATE_MEM(gc_pause_max_us) = pause;
+    }
+    #endif
     GC_EXIT();
 }
 
 void gc_info(gc_info_t *info) {
     GC_ENTER();
-    info->total = MP_STATE_MEM(gc_pool_end) - MP_STATE_MEM(gc_pool_start);
+    info->total = 0;
     info->used = 0;
     info->free = 0;
     info->max_free = 0;
     info->num_1block = 0;
     info->num_2block = 0;
     info->max_block = 0;
-    bool finish = false;
-    for (size_t block = 0, len = 0, len_free = 0; !finish;) {
-        size_t kind = ATB_GET_KIND(block);
-        switch (kind) {
-            case AT_FREE:
-                info->free += 1;
-                len_free += 1;
-                len = 0;
-                break;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        #if MICROPY_GC_LAZY_SWEEP
+        gc_sweep_lazy(area, AREA_MAX_BLOCK(area));
+        #endif
+        info->total += area->gc_pool_end - area->gc_pool_start;
+        bool finish = AREA_MAX_BLOCK(area) == 0;
+        for (size_t block = 0, len = 0, len_free = 0; !finish;) {
+            size_t kind = ATB_GET_KIND(area, block);
+            switch (kind) {
+                case AT_FREE:
+                    info->free += 1;
+                    len_free += 1;
+                    len = 0;
+                    break;
+
+                case AT_HEAD:
+                    info->used += 1;
+                    len = 1;
+                    break;
+
+                case AT_TAIL:
+                    info->used += 1;
+                    len += 1;
+                    break;
+
+                case AT_MARK:
+                    // shouldn't happen
+                    break;
+            }
 
-            case AT_HEAD:
-                info->used += 1;
-                len = 1;
-                break;
+            block++;
+            finish = (block == AREA_MAX_BLOCK(area));
+            // Get next block type if possible
+            if (!finish) {
+                kind = ATB_GET_KIND(area, block);
+            }
 
-            case AT_TAIL:
-                info->used += 1;
-                len += 1;
-                break;
+            if (finish || kind == AT_FREE || kind == AT_HEAD) {
+                if (len == 1) {
+                    info->num_1block += 1;
+                } else if (len == 2) {
+                    info->num_2block += 1;
+                }
+                if (len > info->max_block) {
+                    info->max_block = len;
+                }
+                if (finish || kind == AT_HEAD) {
+                    if (len_free > info->max_free) {
+                        info->max_free = len_free;
+                    }
+                    len_free = 0;
+                }
+            }
+        }
+    }
 
-            case AT_MARK:
-                // shouldn't happen
-                break;
+    info->used *= BYTES_PER_BLOCK;
+    info->free *= BYTES_PER_BLOCK;
+
+    #if MICROPY_GC_PAUSE_STATS
+    info->num_collections = MP_STATE_MEM(gc_num_collections);
+    info->total_pause_us = MP_STATE_MEM(gc_pause_total_us);
+    info->last_pause_us = MP_STATE_MEM(gc_pause_last_us);
+    info->max_pause_us = MP_STATE_MEM(gc_pause_max_us);
+    #endif
+    #if MICROPY_GC_COMPACT
+    info->num_compactions = MP_STATE_MEM(gc_compact_count);
+    info->compact_moved = MP_STATE_MEM(gc_compact_moved);
+    info->compact_max_free_before = MP_STATE_MEM(gc_compact_max_free_before);
+    info->compact_max_free_after = MP_STATE_MEM(gc_compact_max_free_after);
+    #endif
+    GC_EXIT();
+}
+
+#if MICROPY_GC_THREAD_ALLOC_BUF
+
+void gc_thread_alloc_buf_init(void) {
+    mp_gc_alloc_buf_t *buf = &MP_STATE_THREAD(gc_alloc_buf);
+    buf->n_blocks = 0;
+    buf->registered = false;
+}
+
+void gc_thread_alloc_buf_deinit(void) {
+    mp_gc_alloc_buf_t *buf = &MP_STATE_THREAD(gc_alloc_buf);
+    if (!buf->registered) {
+        return;
+    }
+    GC_ENTER();
+    GC_ALLOC_BUF_LOCK(buf);
+    gc_alloc_buf_retire(buf);
+    GC_ALLOC_BUF_UNLOCK(buf);
+    for (mp_gc_alloc_buf_t **b = &MP_STATE_MEM(gc_alloc_bufs); *b != NULL; b = &(*b)->next) {
+        if (*b == buf) {
+            *b = buf->next;
+            break;
         }
+    }
+    buf->registered = false;
+    GC_EXIT();
+}
+
+// Make the given blocks, which must be a head and its tails, the allocation
+// buffer of the current thread.  Must be called with the GC mutex held.
+STATIC void gc_alloc_buf_install(mp_state_mem_area_t *area, size_t block, size_t n_blocks) {
+    mp_gc_alloc_buf_t *buf = &MP_STATE_THREAD(gc_alloc_buf);
+    if (!buf->registered) {
+        buf->locked = 0;
+        buf->n_blocks = 0;
+        buf->next = MP_STATE_MEM(gc_alloc_bufs);
+        MP_STATE_MEM(gc_alloc_bufs) = buf;
+        buf->registered = true;
+    }
+    GC_ALLOC_BUF_LOCK(buf);
+    gc_alloc_buf_retire(buf);
+    buf->area = area;
+    buf->block = block;
+    buf->n_blocks = n_blocks;
+    GC_ALLOC_BUF_UNLOCK(buf);
+}
+
+// Allocate from the current thread's buffer, without taking the GC mutex.
+// Returns NULL if the buffer is too small.
+STATIC void *gc_alloc_buf_take(size_t n_bytes, size_t n_blocks) {
+    mp_gc_alloc_buf_t *buf = &MP_STATE_THREAD(gc_alloc_buf);
+    if (!buf->registered || MP_STATE_MEM(gc_lock_depth) > 0) {
+        return NULL;
+    }
+    GC_ALLOC_BUF_LOCK(buf);
+    if (n_blocks > buf->n_blocks) {
+        GC_ALLOC_BUF_UNLOCK(buf);
+        return NULL;
+    }
+    mp_state_mem_area_t *area = buf->area;
+    size_t block = buf->block;
+    if (n_blocks < buf->n_blocks) {
+        // the rest of the buffer starts with a new head
+        ATB_TAIL_TO_HEAD(area, block + n_blocks);
+    }
+    buf->block += n_blocks;
+    buf->n_blocks -= n_blocks;
+
+    // we must create this pointer before unlocking the buffer so a collection can find it
+    void *ret_ptr = (void*)PTR_FROM_BLOCK(area, block);
+    // (stop the compiler from working it out only after the unlock)
+    __asm__ volatile ("" : : "r" (ret_ptr) : "memory");
+    GC_ALLOC_BUF_UNLOCK(buf);
+    DEBUG_printf("gc_alloc(%p)\n", ret_ptr);
+
+    // the buffer is not cleared when it is handed out (see gc_alloc)
+    #if MICROPY_GC_CONSERVATIVE_CLEAR
+    memset((byte*)ret_ptr, 0, n_blocks * BYTES_PER_BLOCK);
+    #else
+    memset((byte*)ret_ptr + n_bytes, 0, n_blocks * BYTES_PER_BLOCK - n_bytes);
+    #endif
+
+    return ret_ptr;
+}
 
-        block++;
-        finish = (block == MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
-        // Get next block type if possible
-        if (!finish) {
-            kind = ATB_GET_KIND(block);
+#endif // MICROPY_GC_THREAD_ALLOC_BUF
+
+#if MICROPY_GC_COMPACT
+
+// Returns the number of blocks in the chain with the given head.
+STATIC size_t gc_compact_chain_blocks(mp_state_mem_area_t *area, size_t block) {
+    size_t n_blocks = 1;
+    while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL) {
+        n_blocks += 1;
+    }
+    return n_blocks;
+}
+
+// If ptr is an object whose array is normally only referenced from the object
+// itself, return the address of that reference and set *n_bytes to the size
+// of the array, provided the array is a chain of blocks of exactly that size.
+STATIC void **gc_compact_owned_array(void *ptr, size_t *n_bytes) {
+    const mp_obj_type_t *type = ((mp_obj_base_t*)ptr)->type;
+    size_t owner_bytes;
+    void **ref;
+    if (type == &mp_type_list) {
+        mp_obj_list_t *list = ptr;
+        owner_bytes = sizeof(mp_obj_list_t);
+        *n_bytes = list->alloc * sizeof(mp_obj_t);
+        ref = (void**)&list->items;
+    } else {
+        mp_map_t *map;
+        if (type == &mp_type_dict
+            #if MICROPY_PY_COLLECTIONS_ORDEREDDICT
+            || type == &mp_type_ordereddict
+            #endif
+            ) {
+            owner_bytes = sizeof(mp_obj_dict_t);
+            map = &((mp_obj_dict_t*)ptr)->map;
+        } else if (gc_nbytes(type) >= sizeof(mp_obj_type_t)
+            && type->base.type == &mp_type_type && mp_obj_is_instance_type(type)) {
+            // classes defined in Python are always on the heap
+            owner_bytes = sizeof(mp_obj_instance_t) + mp_obj_instance_num_subobj(type) * sizeof(mp_obj_t);
+            map = &((mp_obj_instance_t*)ptr)->members;
+        } else {
+            return NULL;
+        }
+        if (map->is_fixed) {
+            return NULL;
         }
+        *n_bytes = mp_map_table_bytes(map);
+        ref = (void**)&map->table;
+    }
 
-        if (finish || kind == AT_FREE || kind == AT_HEAD) {
-            if (len == 1) {
-                info->num_1block += 1;
-            } else if (len == 2) {
-                info->num_2block += 1;
+    // the first word of the block may only look like a type, for example in
+    // the items of [MyClass], so check that the block is the size of the
+    // object it claims to be, and that the array really is what the object
+    // says it is
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (gc_compact_chain_blocks(area, BLOCK_FROM_PTR(area, ptr)) != (owner_bytes + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK) {
+        return NULL;
+    }
+    area = gc_get_ptr_area(*ref);
+    if (area == NULL || *n_bytes == 0) {
+        return NULL;
+    }
+    size_t block = BLOCK_FROM_PTR(area, *ref);
+    if (ATB_GET_KIND(area, block) != AT_HEAD && ATB_GET_KIND(area, block) != AT_MARK) {
+        return NULL;
+    }
+    #if MICROPY_ENABLE_FINALISER
+    // arrays never have a finaliser, and moving the block would lose it
+    if (FTB_GET(area, block)) {
+        return NULL;
+    }
+    #endif
+    if (gc_compact_chain_blocks(area, block) != (*n_bytes + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK) {
+        return NULL;
+    }
+    return ref;
+}
+
+// Choose the run of n_blocks blocks that can be freed by moving the fewest
+// arrays, and fill in gc_compact_objs with the arrays in it.  Returns the
+// number of arrays, or (size_t)-1 if there is no such run.  This is kept out
+// of gc_compact so its locals are gone before references are counted.
+STATIC MP_NOINLINE size_t gc_compact_plan(size_t n_blocks, size_t max_free, mp_state_mem_area_t **area_out, size_t *block_out) {
+    // Mark the head of every array that could be moved, ie that would fit in
+    // the largest free run.  Nothing else is marked between collections, so
+    // the marks tell the movable chains from the others.
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        for (size_t bl = 0; bl < AREA_MAX_BLOCK(area); bl++) {
+            size_t n_bytes;
+            void **ref;
+            if (ATB_GET_KIND(area, bl) != AT_FREE && ATB_GET_KIND(area, bl) != AT_TAIL
+                && (ref = gc_compact_owned_array((void*)PTR_FROM_BLOCK(area, bl), &n_bytes)) != NULL
+                && n_bytes <= max_free * BYTES_PER_BLOCK) {
+                mp_state_mem_area_t *array_area = gc_get_ptr_area(*ref);
+                ATB_HEAD_TO_MARK(array_area, BLOCK_FROM_PTR(array_area, *ref));
+            }
+        }
+    }
+
+    // Slide a window of n_blocks over each area.  It may only cover free
+    // blocks and movable chains, and its cost is the number of blocks to move.
+    mp_state_mem_area_t *best_area = NULL;
+    size_t best_block = 0;
+    size_t best_cost = (size_t)-1;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        size_t run_start = 0;
+        size_t cost = 0;
+        size_t n_heads = 0;
+        bool movable = false;
+        for (size_t bl = 0; bl < AREA_MAX_BLOCK(area); bl++) {
+            size_t kind = ATB_GET_KIND(area, bl);
+            if (kind == AT_HEAD || (kind == AT_TAIL && !movable)) {
+                // this block has to stay, so start again after it
+                movable = false;
+                run_start = bl + 1;
+                cost = 0;
+                n_heads = 0;
+                continue;
+            }
+            if (kind == AT_MARK) {
+                movable = true;
+                n_heads += 1;
             }
-            if (len > info->max_block) {
-                info->max_block = len;
+            if (kind != AT_FREE) {
+                cost += 1;
             }
-            if (finish || kind == AT_HEAD) {
-                if (len_free > info->max_free) {
-                    info->max_free = len_free;
+            if (bl + 1 - run_start > n_blocks) {
+                kind = ATB_GET_KIND(area, bl - n_blocks);
+                if (kind != AT_FREE) {
+                    cost -= 1;
                 }
-                len_free = 0;
+                if (kind == AT_MARK) {
+                    n_heads -= 1;
+                }
+            }
+            // leave room in the count for an array that starts before the window
+            if (bl + 1 - run_start >= n_blocks && cost < best_cost && n_heads < MICROPY_GC_COMPACT) {
+                best_area = area;
+                best_block = bl + 1 - n_blocks;
+                best_cost = cost;
             }
         }
     }
 
-    info->used *= BYTES_PER_BLOCK;
-    info->free *= BYTES_PER_BLOCK;
-    GC_EXIT();
+    // collect the arrays in the chosen window
+    size_t n_objs = 0;
+    if (best_area != NULL) {
+        size_t bl = best_block;
+        while (ATB_GET_KIND(best_area, bl) == AT_TAIL) {
+            bl -= 1;
+        }
+        for (; bl < best_block + n_blocks; bl++) {
+            if (ATB_GET_KIND(best_area, bl) == AT_MARK) {
+                mp_gc_compact_obj_t *obj = &MP_STATE_MEM(gc_compact_objs)[n_objs++];
+                obj->start = (byte*)PTR_FROM_BLOCK(best_area, bl);
+                obj->owner = NULL;
+                obj->n_refs = 0;
+            }
+        }
+    }
+
+    // find the owners of these arrays, and remove all the marks
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        for (size_t bl = 0; bl < AREA_MAX_BLOCK(area); bl++) {
+            size_t kind = ATB_GET_KIND(area, bl);
+            if (kind == AT_MARK) {
+                ATB_MARK_TO_HEAD(area, bl);
+            } else if (kind != AT_HEAD) {
+                continue;
+            }
+            size_t n_bytes;
+            void **ref = gc_compact_owned_array((void*)PTR_FROM_BLOCK(area, bl), &n_bytes);
+            for (size_t i = 0; ref != NULL && i < n_objs; i++) {
+                mp_gc_compact_obj_t *obj = &MP_STATE_MEM(gc_compact_objs)[i];
+                if ((byte*)*ref == obj->start) {
+                    obj->owner = ref;
+                    obj->n_bytes = (n_bytes + BYTES_PER_BLOCK - 1) & ~(BYTES_PER_BLOCK - 1);
+                }
+            }
+        }
+    }
+
+    if (best_area == NULL) {
+        return (size_t)-1;
+    }
+    for (size_t i = 0; i < n_objs; i++) {
+        if (MP_STATE_MEM(gc_compact_objs)[i].owner == NULL) {
+            return (size_t)-1;
+        }
+    }
+    *area_out = best_area;
+    *block_out = best_block;
+    return n_objs;
+}
+
+// Try to make a run of n_blocks free blocks, when none could be found even
+// after a collection, by moving arrays that are in the way to elsewhere in
+// the heap.  The GC is conservative, so an array is only moved if a further
+// collection finds exactly one reference to it (or into it): the one from its
+// owner, which is then updated.  Returns true if the run was made.
+STATIC bool gc_compact(size_t n_blocks) {
+    #if MICROPY_GC_LAZY_SWEEP
+    gc_sweep_all();
+    #endif
+
+    gc_info_t info;
+    gc_info(&info);
+    size_t max_free_before = info.max_free;
+
+    mp_state_mem_area_t *area;
+    size_t start_block;
+    size_t n_objs = gc_compact_plan(n_blocks, max_free_before, &area, &start_block);
+    if (n_objs == (size_t)-1) {
+        return false;
+    }
+
+    // count the references to the arrays
+    MP_STATE_MEM(gc_compact_n_objs) = n_objs;
+    gc_collect();
+    MP_STATE_MEM(gc_compact_n_objs) = 0;
+    #if MICROPY_GC_LAZY_SWEEP
+    gc_sweep_all();
+    #endif
+    for (size_t i = 0; i < n_objs; i++) {
+        mp_gc_compact_obj_t *obj = &MP_STATE_MEM(gc_compact_objs)[i];
+        if (obj->n_refs != 1 || obj->ref != obj->owner || (byte*)*obj->owner != obj->start) {
+            DEBUG_printf("gc_compact(%p): pinned by %u refs\n", obj->start, (uint)obj->n_refs);
+            return false;
+        }
+    }
+
+    // Make the free blocks of the window look allocated so that the arrays
+    // are not moved into it.  There is at most one free run per array, plus
+    // one at the end.
+    size_t end_block = start_block + n_blocks;
+    size_t fake[MICROPY_GC_COMPACT + 1];
+    size_t n_fake = 0;
+    bool in_fake = false;
+    for (size_t bl = start_block; bl < end_block; bl++) {
+        if (ATB_GET_KIND(area, bl) != AT_FREE) {
+            in_fake = false;
+        } else if (in_fake) {
+            ATB_FREE_TO_TAIL(area, bl);
+        } else {
+            ATB_FREE_TO_HEAD(area, bl);
+            fake[n_fake++] = bl;
+            in_fake = true;
+        }
+    }
+
+    // move the arrays, without letting gc_alloc collect or compact again
+    MP_STATE_MEM(gc_auto_collect_enabled) = 0;
+    size_t n_moved = 0;
+    size_t moved_bytes = 0;
+    for (; n_moved < n_objs; n_moved++) {
+        mp_gc_compact_obj_t *obj = &MP_STATE_MEM(gc_compact_objs)[n_moved];
+        void *ptr = gc_alloc(obj->n_bytes, false);
+        if (ptr == NULL) {
+            break;
+        }
+        DEBUG_printf("gc_compact(%p -> %p)\n", obj->start, ptr);
+        memcpy(ptr, obj->start, obj->n_bytes);
+        *obj->owner = ptr;
+        moved_bytes += obj->n_bytes;
+    }
+    MP_STATE_MEM(gc_auto_collect_enabled) = 1;
+
+    // only now free the window, so none of it was used for the copies
+    for (size_t i = 0; i < n_moved; i++) {
+        gc_free(MP_STATE_MEM(gc_compact_objs)[i].start);
+    }
+    for (size_t i = 0; i < n_fake; i++) {
+        gc_free((void*)PTR_FROM_BLOCK(area, fake[i]));
+    }
+
+    if (n_moved > 0) {
+        gc_info(&info);
+        MP_STATE_MEM(gc_compact_count) += 1;
+        MP_STATE_MEM(gc_compact_moved) += moved_bytes;
+        MP_STATE_MEM(gc_compact_max_free_before) = max_free_before;
+        MP_STATE_MEM(gc_compact_max_free_after) = info.max_free;
+    }
+
+    return n_moved == n_objs;
 }
 
+#endif // MICROPY_GC_COMPACT
+
 void *gc_alloc(size_t n_bytes, bool has_finaliser) {
     size_t n_blocks = ((n_bytes + BYTES_PER_BLOCK - 1) & (~(BYTES_PER_BLOCK - 1))) / BYTES_PER_BLOCK;
     DEBUG_printf("gc_alloc(" UINT_FMT " bytes -> " UINT_FMT " blocks)\n", n_bytes, n_blocks);
@@ -401,6 +1328,20 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
         return NULL;
     }
 
+    // number of blocks to search for
+    size_t n_find = n_blocks;
+
+    #if MICROPY_GC_THREAD_ALLOC_BUF
+    if (n_blocks <= GC_ALLOC_BUF_MAX_BLOCKS && !has_finaliser) {
+        void *ptr = gc_alloc_buf_take(n_bytes, n_blocks);
+        if (ptr != NULL) {
+            return ptr;
+        }
+        // get a new buffer, with this object at its start
+        n_find = MICROPY_GC_THREAD_ALLOC_BUF;
+    }
+    #endif
+
     GC_ENTER();
 
     // check if GC is locked
@@ -409,11 +1350,15 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
         return NULL;
     }
 
+    mp_state_mem_area_t *area;
     size_t i;
     size_t end_block;
     size_t start_block;
-    size_t n_free = 0;
+    size_t n_free;
     int collected = !MP_STATE_MEM(gc_auto_collect_enabled);
+    #if MICROPY_GC_COMPACT
+    bool compacted = false;
+    #endif
 
     #if MICROPY_GC_ALLOC_THRESHOLD
     if (!collected && MP_STATE_MEM(gc_alloc_amount) >= MP_STATE_MEM(gc_alloc_threshold)) {
@@ -425,18 +1370,62 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
 
     for (;;) {
 
-        // look for a run of n_blocks available blocks
-        for (i = MP_STATE_MEM(gc_last_free_atb_index); i < MP_STATE_MEM(gc_alloc_table_byte_len); i++) {
-            byte a = MP_STATE_MEM(gc_alloc_table_start)[i];
-            if (ATB_0_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
-            if (ATB_1_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
-            if (ATB_2_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
-            if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
+        for (area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            #if MICROPY_GC_SIZE_CLASSES
+            // try the segregated free lists first
+            start_block = gc_free_run_take(area, n_find);
+            if (start_block != (size_t)-1) {
+                end_block = start_block + n_find - 1;
+                goto found_run;
+            }
+            #endif
+
+            // look for a run of n_find available blocks
+            n_free = 0;
+            i = area->gc_last_free_atb_index;
+            #if MICROPY_GC_THREAD_ALLOC_BUF
+            if (n_find > n_blocks) {
+                // buffers are taken in address order until the next collection
+                i = MAX(i, area->gc_alloc_buf_atb_index);
+            }
+            #endif
+            for (; i < area->gc_alloc_table_byte_len; i++) {
+                #if MICROPY_GC_LAZY_SWEEP
+                if ((i + 1) * BLOCKS_PER_ATB > area->gc_sweep_block) {
+                    gc_sweep_lazy(area, (i + GC_LAZY_SWEEP_ATBS) * BLOCKS_PER_ATB);
+                }
+                #endif
+                byte a = area->gc_alloc_table_start[i];
+                if (ATB_0_IS_FREE(a)) { if (++n_free >= n_find) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
+                if (ATB_1_IS_FREE(a)) { if (++n_free >= n_find) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
+                if (ATB_2_IS_FREE(a)) { if (++n_free >= n_find) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
+                if (ATB_3_IS_FREE(a)) { if (++n_free >= n_find) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
+            }
+        }
+
+        #if MICROPY_GC_THREAD_ALLOC_BUF
+        if (n_find > n_blocks) {
+            // no room for a new buffer, so just allocate the object and don't
+            // look for buffers again until the next collection
+            for (area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+                area->gc_alloc_buf_atb_index = area->gc_alloc_table_byte_len;
+            }
+            n_find = n_blocks;
+            continue;
         }
+        #endif
 
         GC_EXIT();
         // nothing found!
         if (collected) {
+            #if MICROPY_GC_COMPACT
+            if (!compacted && MP_STATE_MEM(gc_auto_collect_enabled) && gc_compact(n_blocks)) {
+                // there is now a run of free blocks that is large enough
+                compacted = true;
+                GC_ENTER();
+                continue;
+            }
+            #endif
             return NULL;
         }
         DEBUG_printf("gc_alloc(" UINT_FMT "): no free mem, triggering GC\n", n_bytes);
@@ -457,25 +1446,44 @@ found:
     // before this one.  Also, whenever we free or shink a block we must check
     // if this index needs adjusting (see gc_realloc and gc_free).
     if (n_free == 1) {
-        MP_STATE_MEM(gc_last_free_atb_index) = (i + 1) / BLOCKS_PER_ATB;
+        area->gc_last_free_atb_index = (i + 1) / BLOCKS_PER_ATB;
     }
 
+    #if MICROPY_GC_SIZE_CLASSES
+found_run:
+    #endif
     // mark first block as used head
-    ATB_FREE_TO_HEAD(start_block);
+    ATB_FREE_TO_HEAD(area, start_block);
 
     // mark rest of blocks as used tail
-    // TODO for a run of many blocks can make this more efficient
     for (size_t bl = start_block + 1; bl <= end_block; bl++) {
-        ATB_FREE_TO_TAIL(bl);
+        if ((bl & (BLOCKS_PER_ATB - 1)) == 0 && bl + BLOCKS_PER_ATB - 1 <= end_block) {
+            // a whole ATB at once; all its blocks were free so it's not shared
+            area->gc_alloc_table_start[bl / BLOCKS_PER_ATB] = AT_TAIL * 0x55;
+            bl += BLOCKS_PER_ATB - 1;
+        } else {
+            ATB_FREE_TO_TAIL(area, bl);
+        }
     }
 
+    #if MICROPY_GC_THREAD_ALLOC_BUF
+    if (n_find > n_blocks) {
+        // the blocks after the object become this thread's buffer; they are
+        // cleared as they are allocated from it
+        ATB_TAIL_TO_HEAD(area, start_block + n_blocks);
+        gc_alloc_buf_install(area, start_block + n_blocks, n_find - n_blocks);
+        area->gc_alloc_buf_atb_index = (end_block + 1) / BLOCKS_PER_ATB;
+        end_block = start_block + n_blocks - 1;
+    }
+    #endif
+
     // get pointer to first block
     // we must create this pointer before unlocking the GC so a collection can find it
-    void *ret_ptr = (void*)(MP_STATE_MEM(gc_pool_start) + start_block * BYTES_PER_BLOCK);
+    void *ret_ptr = (void*)(area->gc_pool_start + start_block * BYTES_PER_BLOCK);
     DEBUG_printf("gc_alloc(%p)\n", ret_ptr);
 
     #if MICROPY_GC_ALLOC_THRESHOLD
-    MP_STATE_MEM(gc_alloc_amount) += n_blocks;
+    MP_STATE_MEM(gc_alloc_amount) += n_find;
     #endif
 
     GC_EXIT();
@@ -498,7 +1506,7 @@ found:
         ((mp_obj_base_t*)ret_ptr)->type = NULL;
         // set mp_obj flag only if it has a finaliser
         GC_ENTER();
-        FTB_SET(start_block);
+        FTB_SET(area, start_block);
         GC_EXIT();
     }
     #else
@@ -538,24 +1546,38 @@ void gc_free(void *ptr) {
         GC_EXIT();
     } else {
         // get the GC block number corresponding to this pointer
-        assert(VERIFY_PTR(ptr));
-        size_t block = BLOCK_FROM_PTR(ptr);
-        assert(ATB_GET_KIND(block) == AT_HEAD);
+        mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+        assert(area != NULL);
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        #if MICROPY_GC_LAZY_SWEEP
+        // a live block that has not been swept yet is still marked
+        assert(ATB_GET_KIND(area, block) == AT_HEAD || ATB_GET_KIND(area, block) == AT_MARK);
+        #else
+        assert(ATB_GET_KIND(area, block) == AT_HEAD);
+        #endif
 
         #if MICROPY_ENABLE_FINALISER
-        FTB_CLEAR(block);
+        FTB_CLEAR(area, block);
         #endif
 
         // set the last_free pointer to this block if it's earlier in the heap
-        if (block / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-            MP_STATE_MEM(gc_last_free_atb_index) = block / BLOCKS_PER_ATB;
+        if (block / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+            area->gc_last_free_atb_index = block / BLOCKS_PER_ATB;
         }
 
+        #if MICROPY_GC_SIZE_CLASSES
+        size_t start_block = block;
+        #endif
+
         // free head and all of its tail blocks
         do {
-            ATB_ANY_TO_FREE(block);
+            ATB_ANY_TO_FREE(area, block);
             block += 1;
-        } while (ATB_GET_KIND(block) == AT_TAIL);
+        } while (ATB_GET_KIND(area, block) == AT_TAIL);
+
+        #if MICROPY_GC_SIZE_CLASSES
+        gc_free_run_push(area, start_block, block - start_block);
+        #endif
 
         GC_EXIT();
 
@@ -567,14 +1589,20 @@ void gc_free(void *ptr) {
 
 size_t gc_nbytes(const void *ptr) {
     GC_ENTER();
-    if (VERIFY_PTR(ptr)) {
-        size_t block = BLOCK_FROM_PTR(ptr);
-        if (ATB_GET_KIND(block) == AT_HEAD) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area != NULL) {
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        #if MICROPY_GC_LAZY_SWEEP
+        // a live block that has not been swept yet is still marked
+        if (ATB_GET_KIND(area, block) == AT_HEAD || ATB_GET_KIND(area, block) == AT_MARK) {
+        #else
+        if (ATB_GET_KIND(area, block) == AT_HEAD) {
+        #endif
             // work out number of consecutive blocks in the chain starting with this on
             size_t n_blocks = 0;
             do {
                 n_blocks += 1;
-            } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
+            } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
             GC_EXIT();
             return n_blocks * BYTES_PER_BLOCK;
         }
@@ -629,17 +1657,26 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     void *ptr = ptr_in;
 
     // sanity check the ptr
-    if (!VERIFY_PTR(ptr)) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area == NULL) {
         return NULL;
     }
 
     // get first block
-    size_t block = BLOCK_FROM_PTR(ptr);
+    size_t block = BLOCK_FROM_PTR(area, ptr);
 
     GC_ENTER();
 
+    #if MICROPY_GC_LAZY_SWEEP
+    // sweep this block and the ones it may grow into, so that all blocks
+    // touched below are in their final state
+    if (MP_STATE_MEM(gc_lock_depth) == 0) {
+        gc_sweep_lazy(area, block + (n_bytes + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK);
+    }
+    #endif
+
     // sanity check the ptr is pointing to the head of a block
-    if (ATB_GET_KIND(block) != AT_HEAD) {
+    if (ATB_GET_KIND(area, block) != AT_HEAD) {
         GC_EXIT();
         return NULL;
     }
@@ -660,9 +1697,9 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     // efficiently shrink it (see below for shrinking code).
     size_t n_free   = 0;
     size_t n_blocks = 1; // counting HEAD block
-    size_t max_block = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
+    size_t max_block = AREA_MAX_BLOCK(area);
     for (size_t bl = block + n_blocks; bl < max_block; bl++) {
-        byte block_type = ATB_GET_KIND(bl);
+        byte block_type = ATB_GET_KIND(area, bl);
         if (block_type == AT_TAIL) {
             n_blocks++;
             continue;
@@ -688,14 +1725,18 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     if (new_blocks < n_blocks) {
         // free unneeded tail blocks
         for (size_t bl = block + new_blocks, count = n_blocks - new_blocks; count > 0; bl++, count--) {
-            ATB_ANY_TO_FREE(bl);
+            ATB_ANY_TO_FREE(area, bl);
         }
 
         // set the last_free pointer to end of this block if it's earlier in the heap
-        if ((block + new_blocks) / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-            MP_STATE_MEM(gc_last_free_atb_index) = (block + new_blocks) / BLOCKS_PER_ATB;
+        if ((block + new_blocks) / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+            area->gc_last_free_atb_index = (block + new_blocks) / BLOCKS_PER_ATB;
         }
 
+        #if MICROPY_GC_SIZE_CLASSES
+        gc_free_run_push(area, block + new_blocks, n_blocks - new_blocks);
+        #endif
+
         GC_EXIT();
 
         #if EXTENSIVE_HEAP_PROFILING
@@ -709,8 +1750,8 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     if (new_blocks <= n_blocks + n_free) {
         // mark few more blocks as used tail
         for (size_t bl = block + n_blocks; bl < block + new_blocks; bl++) {
-            assert(ATB_GET_KIND(bl) == AT_FREE);
-            ATB_FREE_TO_TAIL(bl);
+            assert(ATB_GET_KIND(area, bl) == AT_FREE);
+            ATB_FREE_TO_TAIL(area, bl);
         }
 
         GC_EXIT();
@@ -731,7 +1772,7 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     }
 
     #if MICROPY_ENABLE_FINALISER
-    bool ftb_state = FTB_GET(block);
+    bool ftb_state = FTB_GET(area, block);
     #else
     bool ftb_state = false;
     #endif
@@ -765,115 +1806,126 @@ void gc_dump_info(void) {
         (uint)info.total, (uint)info.used, (uint)info.free);
     mp_printf(&mp_plat_print, " No. of 1-blocks: %u, 2-blocks: %u, max blk sz: %u, max free sz: %u\n",
            (uint)info.num_1block, (uint)info.num_2block, (uint)info.max_block, (uint)info.max_free);
+    #if MICROPY_GC_PAUSE_STATS
+    mp_printf(&mp_plat_print, " Pause: last: %u us, max: %u us, total: %u us in %u collections\n",
+        (uint)info.last_pause_us, (uint)info.max_pause_us, (uint)info.total_pause_us, (uint)info.num_collections);
+    #endif
+    #if MICROPY_GC_COMPACT
+    mp_printf(&mp_plat_print, " Compact: %u times, %u bytes moved, max free sz: %u -> %u\n",
+        (uint)info.num_compactions, (uint)info.compact_moved,
+        (uint)info.compact_max_free_before, (uint)info.compact_max_free_after);
+    #endif
 }
 
 void gc_dump_alloc_table(void) {
     GC_ENTER();
     static const size_t DUMP_BYTES_PER_LINE = 64;
-    #if !EXTENSIVE_HEAP_PROFILING
-    // When comparing heap output we don't want to print the starting
-    // pointer of the heap because it changes from run to run.
-    mp_printf(&mp_plat_print, "GC memory layout; from %p:", MP_STATE_MEM(gc_pool_start));
-    #endif
-    for (size_t bl = 0; bl < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; bl++) {
-        if (bl % DUMP_BYTES_PER_LINE == 0) {
-            // a new line of blocks
-            {
-                // check if this line contains only free blocks
-                size_t bl2 = bl;
-                while (bl2 < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB && ATB_GET_KIND(bl2) == AT_FREE) {
-                    bl2++;
-                }
-                if (bl2 - bl >= 2 * DUMP_BYTES_PER_LINE) {
-                    // there are at least 2 lines containing only free blocks, so abbreviate their printing
-                    mp_printf(&mp_plat_print, "\n       (%u lines all free)", (uint)(bl2 - bl) / DUMP_BYTES_PER_LINE);
-                    bl = bl2 & (~(DUMP_BYTES_PER_LINE - 1));
-                    if (bl >= MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB) {
-                        // got to end of heap
-                        break;
-                    }
-                }
-            }
-            // print header for new line of blocks
-            // (the cast to uint32_t is for 16-bit ports)
-            //mp_printf(&mp_plat_print, "\n%05x: ", (uint)(PTR_FROM_BLOCK(bl) & (uint32_t)0xfffff));
-            mp_printf(&mp_plat_print, "\n%05x: ", (uint)((bl * BYTES_PER_BLOCK) & (uint32_t)0xfffff));
-        }
-        int c = ' ';
-        switch (ATB_GET_KIND(bl)) {
-            case AT_FREE: c = '.'; break;
-            /* this prints out if the object is reachable from BSS or STACK (for unix only)
-            case AT_HEAD: {
-                c = 'h';
-                void **ptrs = (void**)(void*)&mp_state_ctx;
-                mp_uint_t len = offsetof(mp_state_ctx_t, vm.stack_top) / sizeof(mp_uint_t);
-                for (mp_uint_t i = 0; i < len; i++) {
-                    mp_uint_t ptr = (mp_uint_t)ptrs[i];
-                    if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
-                        c = 'B';
-                        break;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        #if !EXTENSIVE_HEAP_PROFILING
+        // When comparing heap output we don't want to print the starting
+        // pointer of the heap because it changes from run to run.
+        mp_printf(&mp_plat_print, "GC memory layout; from %p:", area->gc_pool_start);
+        #endif
+        for (size_t bl = 0; bl < AREA_MAX_BLOCK(area); bl++) {
+            if (bl % DUMP_BYTES_PER_LINE == 0) {
+                // a new line of blocks
+                {
+                    // check if this line contains only free blocks
+                    size_t bl2 = bl;
+                    while (bl2 < AREA_MAX_BLOCK(area) && ATB_GET_KIND(area, bl2) == AT_FREE) {
+                        bl2++;
                     }
-                }
-                if (c == 'h') {
-                    ptrs = (void**)&c;
-                    len = ((mp_uint_t)MP_STATE_THREAD(stack_top) - (mp_uint_t)&c) / sizeof(mp_uint_t);
-                    for (mp_uint_t i = 0; i < len; i++) {
-                        mp_uint_t ptr = (mp_uint_t)ptrs[i];
-                        if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
-                            c = 'S';
+                    if (bl2 - bl >= 2 * DUMP_BYTES_PER_LINE) {
+                        // there are at least 2 lines containing only free blocks, so abbreviate their printing
+                        mp_printf(&mp_plat_print, "\n       (%u lines all free)", (uint)(bl2 - bl) / DUMP_BYTES_PER_LINE);
+                        bl = bl2 & (~(DUMP_BYTES_PER_LINE - 1));
+                        if (bl >= AREA_MAX_BLOCK(area)) {
+                            // got to end of heap
                             break;
                         }
                     }
                 }
-                break;
+                // print header for new line of blocks
+                // (the cast to uint32_t is for 16-bit ports)
+                //mp_printf(&mp_plat_print, "\n%05x: ", (uint)(PTR_FROM_BLOCK(bl) & (uint32_t)0xfffff));
+                mp_printf(&mp_plat_print, "\n%05x: ", (uint)((bl * BYTES_PER_BLOCK) & (uint32_t)0xfffff));
             }
-            */
-            /* this prints the uPy object type of the head block */
-            case AT_HEAD: {
-                void **ptr = (void**)(MP_STATE_MEM(gc_pool_start) + bl * BYTES_PER_BLOCK);
-                if (*ptr == &mp_type_tuple) { c = 'T'; }
-                else if (*ptr == &mp_type_list) { c = 'L'; }
-                else if (*ptr == &mp_type_dict) { c = 'D'; }
-                else if (*ptr == &mp_type_str || *ptr == &mp_type_bytes) { c = 'S'; }
-                #if MICROPY_PY_BUILTINS_BYTEARRAY
-                else if (*ptr == &mp_type_bytearray) { c = 'A'; }
-                #endif
-                #if MICROPY_PY_ARRAY
-                else if (*ptr == &mp_type_array) { c = 'A'; }
-                #endif
-                #if MICROPY_PY_BUILTINS_FLOAT
-                else if (*ptr == &mp_type_float) { c = 'F'; }
-                #endif
-                else if (*ptr == &mp_type_fun_bc) { c = 'B'; }
-                else if (*ptr == &mp_type_module) { c = 'M'; }
-                else {
+            int c = ' ';
+            switch (ATB_GET_KIND(area, bl)) {
+                case AT_FREE: c = '.'; break;
+                /* this prints out if the object is reachable from BSS or STACK (for unix only)
+                case AT_HEAD: {
                     c = 'h';
-                    #if 0
-                    // This code prints "Q" for qstr-pool data, and "q" for qstr-str
-                    // data.  It can be useful to see how qstrs are being allocated,
-                    // but is disabled by default because it is very slow.
-                    for (qstr_pool_t *pool = MP_STATE_VM(last_pool); c == 'h' && pool != NULL; pool = pool->prev) {
-                        if ((qstr_pool_t*)ptr == pool) {
-                            c = 'Q';
+                    void **ptrs = (void**)(void*)&mp_state_ctx;
+                    mp_uint_t len = offsetof(mp_state_ctx_t, vm.stack_top) / sizeof(mp_uint_t);
+                    for (mp_uint_t i = 0; i < len; i++) {
+                        mp_uint_t ptr = (mp_uint_t)ptrs[i];
+                        if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
+                            c = 'B';
                             break;
                         }
-                        for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
-                            if ((const byte*)ptr == *q) {
-                                c = 'q';
+                    }
+                    if (c == 'h') {
+                        ptrs = (void**)&c;
+                        len = ((mp_uint_t)MP_STATE_THREAD(stack_top) - (mp_uint_t)&c) / sizeof(mp_uint_t);
+                        for (mp_uint_t i = 0; i < len; i++) {
+                            mp_uint_t ptr = (mp_uint_t)ptrs[i];
+                            if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
+                                c = 'S';
                                 break;
                             }
                         }
                     }
+                    break;
+                }
+                */
+                /* this prints the uPy object type of the head block */
+                case AT_HEAD: {
+                    void **ptr = (void**)(area->gc_pool_start + bl * BYTES_PER_BLOCK);
+                    if (*ptr == &mp_type_tuple) { c = 'T'; }
+                    else if (*ptr == &mp_type_list) { c = 'L'; }
+                    else if (*ptr == &mp_type_dict) { c = 'D'; }
+                    else if (*ptr == &mp_type_str || *ptr == &mp_type_bytes) { c = 'S'; }
+                    #if MICROPY_PY_BUILTINS_BYTEARRAY
+                    else if (*ptr == &mp_type_bytearray) { c = 'A'; }
                     #endif
+                    #if MICROPY_PY_ARRAY
+                    else if (*ptr == &mp_type_array) { c = 'A'; }
+                    #endif
+                    #if MICROPY_PY_BUILTINS_FLOAT
+                    else if (*ptr == &mp_type_float) { c = 'F'; }
+                    #endif
+                    else if (*ptr == &mp_type_fun_bc) { c = 'B'; }
+                    else if (*ptr == &mp_type_module) { c = 'M'; }
+                    else {
+                        c = 'h';
+                        #if 0
+                        // This code prints "Q" for qstr-pool data, and "q" for qstr-str
+                        // data.  It can be useful to see how qstrs are being allocated,
+                        // but is disabled by default because it is very slow.
+                        for (qstr_pool_t *pool = MP_STATE_VM(last_pool); c == 'h' && pool != NULL; pool = pool->prev) {
+                            if ((qstr_pool_t*)ptr == pool) {
+                                c = 'Q';
+                                break;
+                            }
+                            for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
+                                if ((const byte*)ptr == *q) {
+                                    c = 'q';
+                                    break;
+                                }
+                            }
+                        }
+                        #endif
+                    }
+                    break;
                 }
-                break;
+                case AT_TAIL: c = '='; break;
+                case AT_MARK: c = 'm'; break;
             }
-            case AT_TAIL: c = '='; break;
-            case AT_MARK: c = 'm'; break;
+            mp_printf(&mp_plat_print, "%c", c);
         }
-        mp_printf(&mp_plat_print, "%c", c);
+        mp_print_str(&mp_plat_print, "\n");
     }
-    mp_print_str(&mp_plat_print, "\n");
     GC_EXIT();
 }
 
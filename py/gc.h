@@ -33,6 +33,12 @@
 
 void gc_init(void *start, void *end);
 
+#if MICROPY_GC_SPLIT_HEAP
+// Add a further region of memory to the heap.  The area bookkeeping is stored
+// at the start of the region, so it must be a little larger than what it adds.
+void gc_add(void *start, void *end);
+#endif
+
 // These lock/unlock functions can be nested.
 // They can be used to prevent the GC from allocating/freeing.
 void gc_lock(void);
@@ -45,6 +51,18 @@ void gc_collect_start(void);
 void gc_collect_root(void **ptrs, size_t len);
 void gc_collect_end(void);
 
+#if MICROPY_GC_LAZY_SWEEP
+// Finish any sweep left pending by a previous collection.
+void gc_sweep_all(void);
+#endif
+
+#if MICROPY_GC_THREAD_ALLOC_BUF
+// Set up the allocation buffer of a new thread, and release it when the
+// thread finishes.
+void gc_thread_alloc_buf_init(void);
+void gc_thread_alloc_buf_deinit(void);
+#endif
+
 void *gc_alloc(size_t n_bytes, bool has_finaliser);
 void gc_free(void *ptr); // does not call finaliser
 size_t gc_nbytes(const void *ptr);
@@ -58,6 +76,19 @@ typedef struct _gc_info_t {
     size_t num_1block;
     size_t num_2block;
     size_t max_block;
+    #if MICROPY_GC_PAUSE_STATS
+    size_t num_collections;
+    size_t total_pause_us;
+    size_t last_pause_us;
+    size_t max_pause_us;
+    #endif
+    #if MICROPY_GC_COMPACT
+    size_t num_compactions;
+    size_t compact_moved;
+    // largest free run, in blocks, before and after the last compaction
+    size_t compact_max_free_before;
+    size_t compact_max_free_after;
+    #endif
 } gc_info_t;
 
 void gc_info(gc_info_t *info);
@@ -52,12 +52,34 @@ codepoint2name[ord('|')] = 'pipe'
 codepoint2name[ord('~')] = 'tilde'
 
 # this must match the equivalent function in qstr.c
-def compute_hash(qstr, bytes_hash):
+def compute_full_hash(qstr):
     hash = 5381
     for b in qstr:
         hash = (hash * 33) ^ b
+    return hash
+
+# this must match the equivalent function in qstr.c
+def compute_hash(qstr, bytes_hash):
     # Make sure that valid hash is never zero, zero means "hash not computed"
-    return (hash & ((1 << (8 * bytes_hash)) - 1)) or 1
+    return (compute_full_hash(qstr) & ((1 << (8 * bytes_hash)) - 1)) or 1
+
+# the hash index over a pool of qstrs, as used by qstr.c: an open-addressed
+# table with linear probing, where each slot is 0 if empty or else 1 plus the
+# position of the qstr in the pool; the table is at most half full
+def make_hash_index(qstrs):
+    assert len(qstrs) < 0xffff
+    size = 2
+    while size < 2 * len(qstrs):
+        size *= 2
+    index = [0] * size
+    for i, qstr in enumerate(qstrs):
+        if qstr is None:
+            continue
+        slot = compute_full_hash(bytes_cons(qstr, 'utf8')) & (size - 1)
+        while index[slot] != 0:
+            slot = (slot + 1) & (size - 1)
+        index[slot] = i + 1
+    return index
 
 def qstr_escape(qst):
     def esc_char(m):
@@ -158,6 +180,14 @@ def print_qstr_data(qcfgs, qstrs):
         qbytes = make_bytes(cfg_bytes_len, cfg_bytes_hash, qstr)
         print('QDEF(MP_QSTR_%s, %s)' % (ident, qbytes))
 
+    # print out the hash index for the qstrs, for use if it's enabled
+    index = make_hash_index([None] + [q[2] for q in sorted(qstrs.values(), key=lambda x: x[0])])
+    print('')
+    print('#ifdef QINDEX')
+    for i in range(0, len(index), 16):
+        print('QINDEX(%s)' % ', '.join(str(slot) for slot in index[i:i + 16]))
+    print('#endif')
+
 def do_work(infiles):
     qcfgs, qstrs = parse_input_headers(infiles)
     print_qstr_data(qcfgs, qstrs)
@@ -71,6 +71,156 @@ STATIC void *realloc_ext(void *ptr, size_t n_bytes, bool allow_move) {
 }
 #endif // MICROPY_ENABLE_GC
 
+#if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+#include "py/bc.h"
+#include "py/mpprint.h"
+
+// One entry per bytecode instruction that allocated.  Entry 0 collects the
+// allocations made outside bytecode, or that didn't fit in the table.
+typedef struct _m_alloc_trace_entry_t {
+    const mp_obj_fun_bc_t *fun;
+    const byte *ip;
+    size_t n_alloc;
+    size_t n_bytes;
+    size_t n_free;
+} m_alloc_trace_entry_t;
+
+#define ALLOC_TRACE_N (MICROPY_PY_MICROPYTHON_ALLOC_TRACE)
+#define ALLOC_TRACE_MAX_PROBE (8)
+
+// the table is shared by all threads so without a GIL it's guarded by the GC mutex
+#if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
+#define ALLOC_TRACE_ENTER() mp_thread_mutex_lock(&MP_STATE_MEM(gc_mutex), 1)
+#define ALLOC_TRACE_EXIT() mp_thread_mutex_unlock(&MP_STATE_MEM(gc_mutex))
+#else
+#define ALLOC_TRACE_ENTER()
+#define ALLOC_TRACE_EXIT()
+#endif
+
+STATIC m_alloc_trace_entry_t *m_alloc_trace_entry(void) {
+    m_alloc_trace_entry_t *table = MP_STATE_VM(alloc_trace_table);
+    const mp_code_state_t *code_state = MP_STATE_THREAD(current_code_state);
+    if (code_state == NULL) {
+        return &table[0];
+    }
+    const byte *ip = code_state->ip;
+    size_t h = (uintptr_t)ip;
+    for (size_t i = 0; i < ALLOC_TRACE_MAX_PROBE; ++i) {
+        m_alloc_trace_entry_t *e = &table[1 + (h + i) % (ALLOC_TRACE_N - 1)];
+        if (e->ip == ip) {
+            return e;
+        }
+        if (e->ip == NULL) {
+            e->fun = code_state->fun_bc;
+            e->ip = ip;
+            return e;
+        }
+    }
+    return &table[0];
+}
+
+STATIC void m_alloc_trace_alloc(size_t num_bytes) {
+    ALLOC_TRACE_ENTER();
+    if (MP_STATE_VM(alloc_trace_active)) {
+        m_alloc_trace_entry_t *e = m_alloc_trace_entry();
+        e->n_alloc += 1;
+        e->n_bytes += num_bytes;
+    }
+    ALLOC_TRACE_EXIT();
+}
+
+STATIC void m_alloc_trace_free(void) {
+    ALLOC_TRACE_ENTER();
+    if (MP_STATE_VM(alloc_trace_active)) {
+        m_alloc_trace_entry_t *e = m_alloc_trace_entry();
+        e->n_free += 1;
+    }
+    ALLOC_TRACE_EXIT();
+}
+
+#define ALLOC_TRACE_ALLOC(n) do { if (MP_STATE_VM(alloc_trace_active)) { m_alloc_trace_alloc(n); } } while (0)
+#define ALLOC_TRACE_FREE() do { if (MP_STATE_VM(alloc_trace_active)) { m_alloc_trace_free(); } } while (0)
+
+void m_alloc_trace_start(void) {
+    if (MP_STATE_VM(alloc_trace_table) == NULL) {
+        // the table is a root pointer so the functions it refers to stay alive
+        MP_STATE_VM(alloc_trace_table) = m_new0(m_alloc_trace_entry_t, ALLOC_TRACE_N);
+    }
+    MP_STATE_VM(alloc_trace_active) = true;
+}
+
+void m_alloc_trace_stop(void) {
+    MP_STATE_VM(alloc_trace_active) = false;
+}
+
+// Print the counts per source line, largest number of bytes first, then clear
+// them.  The entries are merged and sorted in place so no memory is needed.
+void m_alloc_trace_dump(const mp_print_t *print) {
+    m_alloc_trace_entry_t *table = MP_STATE_VM(alloc_trace_table);
+    if (table == NULL) {
+        return;
+    }
+    ALLOC_TRACE_ENTER();
+    bool active = MP_STATE_VM(alloc_trace_active);
+    MP_STATE_VM(alloc_trace_active) = false;
+
+    // merge the entries for instructions on the same line
+    for (size_t i = 1; i < ALLOC_TRACE_N; ++i) {
+        if (table[i].fun == NULL) {
+            continue;
+        }
+        qstr block, file;
+        size_t line = mp_bytecode_get_source_line(table[i].fun->bytecode, table[i].ip, &block, &file);
+        for (size_t j = i + 1; j < ALLOC_TRACE_N; ++j) {
+            if (table[j].fun == NULL) {
+                continue;
+            }
+            qstr block2, file2;
+            size_t line2 = mp_bytecode_get_source_line(table[j].fun->bytecode, table[j].ip, &block2, &file2);
+            if (line2 == line && block2 == block && file2 == file) {
+                table[i].n_alloc += table[j].n_alloc;
+                table[i].n_bytes += table[j].n_bytes;
+                table[i].n_free += table[j].n_free;
+                memset(&table[j], 0, sizeof(*table));
+            }
+        }
+    }
+
+    // sort by number of bytes, entry 0 included
+    for (size_t i = 1; i < ALLOC_TRACE_N; ++i) {
+        m_alloc_trace_entry_t e = table[i];
+        size_t j = i;
+        for (; j > 0 && table[j - 1].n_bytes < e.n_bytes; --j) {
+            table[j] = table[j - 1];
+        }
+        table[j] = e;
+    }
+
+    mp_printf(print, "   bytes  allocs   frees  location\n");
+    for (size_t i = 0; i < ALLOC_TRACE_N; ++i) {
+        m_alloc_trace_entry_t *e = &table[i];
+        if (e->n_alloc == 0 && e->n_free == 0) {
+            continue;
+        }
+        mp_printf(print, "%8u %7u %7u  ", (uint)e->n_bytes, (uint)e->n_alloc, (uint)e->n_free);
+        if (e->fun == NULL) {
+            mp_printf(print, "<other>\n");
+        } else {
+            qstr block, file;
+            size_t line = mp_bytecode_get_source_line(e->fun->bytecode, e->ip, &block, &file);
+            mp_printf(print, "%q:%u %q\n", file, (uint)line, block);
+        }
+    }
+
+    memset(table, 0, ALLOC_TRACE_N * sizeof(*table));
+    MP_STATE_VM(alloc_trace_active) = active;
+    ALLOC_TRACE_EXIT();
+}
+#else
+#define ALLOC_TRACE_ALLOC(n)
+#define ALLOC_TRACE_FREE()
+#endif // MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+
 void *m_malloc(size_t num_bytes) {
     void *ptr = malloc(num_bytes);
     if (ptr == NULL && num_bytes != 0) {
@@ -81,6 +231,7 @@ void *m_malloc(size_t num_bytes) {
     MP_STATE_MEM(current_bytes_allocated) += num_bytes;
     UPDATE_PEAK();
 #endif
+    ALLOC_TRACE_ALLOC(num_bytes);
     DEBUG_printf("malloc %d : %p\n", num_bytes, ptr);
     return ptr;
 }
@@ -92,6 +243,7 @@ void *m_malloc_maybe(size_t num_bytes) {
     MP_STATE_MEM(current_bytes_allocated) += num_bytes;
     UPDATE_PEAK();
 #endif
+    ALLOC_TRACE_ALLOC(num_bytes);
     DEBUG_printf("malloc %d : %p\n", num_bytes, ptr);
     return ptr;
 }
@@ -107,6 +259,7 @@ void *m_malloc_with_finaliser(size_t num_bytes) {
     MP_STATE_MEM(current_bytes_allocated) += num_bytes;
     UPDATE_PEAK();
 #endif
+    ALLOC_TRACE_ALLOC(num_bytes);
     DEBUG_printf("malloc %d : %p\n", num_bytes, ptr);
     return ptr;
 }
@@ -144,6 +297,10 @@ void *m_realloc(void *ptr, size_t new_num_bytes) {
     MP_STATE_MEM(current_bytes_allocated) += diff;
     UPDATE_PEAK();
 #endif
+    // a block grown in place isn't counted since its old size isn't known
+    if (new_ptr != ptr && new_ptr != NULL) {
+        ALLOC_TRACE_ALLOC(new_num_bytes);
+    }
     DEBUG_printf("realloc %p, %d, %d : %p\n", ptr, old_num_bytes, new_num_bytes, new_ptr);
     return new_ptr;
 }
@@ -168,6 +325,10 @@ void *m_realloc_maybe(void *ptr, size_t new_num_bytes, bool allow_move) {
         UPDATE_PEAK();
     }
 #endif
+    // a block grown in place isn't counted since its old size isn't known
+    if (new_ptr != ptr && new_ptr != NULL) {
+        ALLOC_TRACE_ALLOC(new_num_bytes);
+    }
     DEBUG_printf("realloc %p, %d, %d : %p\n", ptr, old_num_bytes, new_num_bytes, new_ptr);
     return new_ptr;
 }
@@ -178,6 +339,7 @@ void m_free(void *ptr, size_t num_bytes) {
 void m_free(void *ptr) {
 #endif
     free(ptr);
+    ALLOC_TRACE_FREE();
 #if MICROPY_MEM_STATS
     MP_STATE_MEM(current_bytes_allocated) -= num_bytes;
 #endif
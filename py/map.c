@@ -32,6 +32,13 @@
 #include "py/mpconfig.h"
 #include "py/misc.h"
 #include "py/runtime.h"
+#include "py/objtype.h"
+
+#if MICROPY_OPT_MAP_LOOKUP_CACHE
+// The slot in the map lookup cache for a given map and qstr key.
+#define MAP_LOOKUP_CACHE_INDEX(map, index) \
+    ((((uintptr_t)(map) >> 3) ^ ((uintptr_t)(index) >> 2)) & (MICROPY_OPT_MAP_LOOKUP_CACHE - 1))
+#endif
 
 // Fixed empty map. Useful when need to call kw-receiving functions
 // without any keywords from C, etc.
@@ -69,18 +76,105 @@ STATIC size_t get_hash_alloc_greater_or_equal_to(size_t x) {
 /******************************************************************************/
 /* map                                                                        */
 
+#if MICROPY_MAP_COMPACT
+
+// Maps that are not ordered arrays (dicts, instance members, globals) use a
+// compact layout like CPython's dicts.  map->table is a dense array of alloc
+// entries, filled in insertion order, where a removed entry keeps its place
+// with a key of MP_OBJ_SENTINEL until the next rehash; unused entries at the
+// end have a key of MP_OBJ_NULL.  Small maps are searched linearly.  Larger
+// maps also have a hash index in the same allocation, after the entries: a
+// word with the number of entries filled so far and one with the number of
+// slots in the index, then an open-addressed array of 1, 2 or 4 byte slots
+// which are 0 if empty, else 1 plus the position of an entry.  A slot
+// referring to a removed entry acts as a deleted slot.  Last there is a byte
+// for each slot with a tag made from the hash of its key, so that a probe
+// can reject most other keys without loading them and comparing.
+#define MAP_SMALL_ALLOC (8)
+
+#define MAP_FILLED(map) (((size_t*)&(map)->table[(map)->alloc])[0])
+#define MAP_INDEX_LEN(map) (((size_t*)&(map)->table[(map)->alloc])[1])
+#define MAP_INDEX(map) ((byte*)&(map)->table[(map)->alloc] + 2 * sizeof(size_t))
+#define MAP_HASH_TAG(hash) ((byte)((hash) ^ ((hash) >> 8)))
+
+STATIC size_t map_index_len(size_t alloc) {
+    // at most 2/3 full
+    return get_hash_alloc_greater_or_equal_to(alloc + alloc / 2);
+}
+
+STATIC size_t map_index_slot_size(size_t alloc) {
+    return alloc < 0xff ? 1 : alloc < 0xffff ? 2 : 4;
+}
+
+STATIC size_t map_table_bytes(size_t alloc) {
+    size_t n = alloc * sizeof(mp_map_elem_t);
+    if (alloc > MAP_SMALL_ALLOC) {
+        n += 2 * sizeof(size_t) + map_index_len(alloc) * (map_index_slot_size(alloc) + 1);
+    }
+    return n;
+}
+
+static inline size_t map_index_get(const byte *index, size_t slot_size, size_t pos) {
+    if (slot_size == 1) {
+        return index[pos];
+    } else if (slot_size == 2) {
+        return ((const uint16_t*)index)[pos];
+    } else {
+        return ((const uint32_t*)index)[pos];
+    }
+}
+
+static inline void map_index_set(byte *index, size_t slot_size, size_t pos, size_t n) {
+    if (slot_size == 1) {
+        index[pos] = n;
+    } else if (slot_size == 2) {
+        ((uint16_t*)index)[pos] = n;
+    } else {
+        ((uint32_t*)index)[pos] = n;
+    }
+}
+
+#else
+
+#define map_table_bytes(alloc) ((alloc) * sizeof(mp_map_elem_t))
+
+#endif // MICROPY_MAP_COMPACT
+
+static inline mp_uint_t map_hash(mp_obj_t key) {
+    // fast path for common case of qstr
+    if (MP_OBJ_IS_QSTR(key)) {
+        return qstr_hash(MP_OBJ_QSTR_VALUE(key));
+    } else {
+        return MP_OBJ_SMALL_INT_VALUE(mp_unary_op(MP_UNARY_OP_HASH, key));
+    }
+}
+
+// Return the number of bytes allocated for the table of the given map.
+size_t mp_map_table_bytes(const mp_map_t *map) {
+    if (map->is_ordered) {
+        return map->alloc * sizeof(mp_map_elem_t);
+    }
+    return map_table_bytes(map->alloc);
+}
+
 void mp_map_init(mp_map_t *map, size_t n) {
     if (n == 0) {
         map->alloc = 0;
         map->table = NULL;
     } else {
         map->alloc = n;
-        map->table = m_new0(mp_map_elem_t, map->alloc);
+        map->table = (mp_map_elem_t*)m_new0(byte, map_table_bytes(n));
+        #if MICROPY_MAP_COMPACT
+        if (n > MAP_SMALL_ALLOC) {
+            MAP_INDEX_LEN(map) = map_index_len(n);
+        }
+        #endif
     }
     map->used = 0;
     map->all_keys_are_qstrs = 1;
     map->is_fixed = 0;
     map->is_ordered = 0;
+    map->is_class_dict = 0;
 }
 
 void mp_map_init_fixed_table(mp_map_t *map, size_t n, const mp_obj_t *table) {
@@ -89,20 +183,42 @@ void mp_map_init_fixed_table(mp_map_t *map, size_t n, const mp_obj_t *table) {
     map->all_keys_are_qstrs = 1;
     map->is_fixed = 1;
     map->is_ordered = 1;
+    map->is_class_dict = 0;
     map->table = (mp_map_elem_t*)table;
 }
 
+void mp_map_init_copy(mp_map_t *map, const mp_map_t *src) {
+    size_t n_bytes = mp_map_table_bytes(src);
+    map->alloc = src->alloc;
+    map->used = src->used;
+    map->all_keys_are_qstrs = src->all_keys_are_qstrs;
+    map->is_fixed = 0;
+    map->is_ordered = src->is_ordered;
+    map->is_class_dict = 0;
+    if (n_bytes == 0) {
+        map->table = NULL;
+    } else {
+        map->table = (mp_map_elem_t*)m_new(byte, n_bytes);
+        memcpy(map->table, src->table, n_bytes);
+    }
+}
+
 // Differentiate from mp_map_clear() - semantics is different
 void mp_map_deinit(mp_map_t *map) {
     if (!map->is_fixed) {
-        m_del(mp_map_elem_t, map->table, map->alloc);
+        m_del(byte, map->table, mp_map_table_bytes(map));
     }
     map->used = map->alloc = 0;
 }
 
 void mp_map_clear(mp_map_t *map) {
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_CACHE || MICROPY_PY_SLOTS
+    if (map->is_class_dict) {
+        mp_obj_class_changed();
+    }
+    #endif
     if (!map->is_fixed) {
-        m_del(mp_map_elem_t, map->table, map->alloc);
+        m_del(byte, map->table, mp_map_table_bytes(map));
     }
     map->alloc = 0;
     map->used = 0;
@@ -111,6 +227,57 @@ void mp_map_clear(mp_map_t *map) {
     map->table = NULL;
 }
 
+#if MICROPY_MAP_COMPACT
+
+// Add the entry at the given position of the table to the hash index.
+STATIC void map_index_add(mp_map_t *map, size_t pos) {
+    size_t index_len = MAP_INDEX_LEN(map);
+    size_t slot_size = map_index_slot_size(map->alloc);
+    byte *index = MAP_INDEX(map);
+    mp_uint_t hash = map_hash(map->table[pos].key);
+    size_t i = hash % index_len;
+    while (map_index_get(index, slot_size, i) != 0) {
+        i = (i + 1) % index_len;
+    }
+    map_index_set(index, slot_size, i, pos + 1);
+    index[index_len * slot_size + i] = MAP_HASH_TAG(hash);
+}
+
+STATIC void mp_map_rehash(mp_map_t *map) {
+    size_t old_alloc = map->alloc;
+    // leave room to grow, counting only the entries that are still in use
+    size_t new_alloc = get_hash_alloc_greater_or_equal_to(map->used + map->used / 4 + 1);
+    mp_map_elem_t *old_table = map->table;
+    mp_map_elem_t *new_table = (mp_map_elem_t*)m_new0(byte, map_table_bytes(new_alloc));
+    // If we reach this point, table resizing succeeded, now we can edit the old map.
+    map->alloc = new_alloc;
+    map->all_keys_are_qstrs = 1;
+    map->table = new_table;
+    if (new_alloc > MAP_SMALL_ALLOC) {
+        MAP_INDEX_LEN(map) = map_index_len(new_alloc);
+    }
+    // copy the entries in use down into the new table, keeping their order
+    size_t n = 0;
+    for (size_t i = 0; i < old_alloc && old_table[i].key != MP_OBJ_NULL; i++) {
+        if (old_table[i].key != MP_OBJ_SENTINEL) {
+            new_table[n] = old_table[i];
+            if (!MP_OBJ_IS_QSTR(new_table[n].key)) {
+                map->all_keys_are_qstrs = 0;
+            }
+            if (new_alloc > MAP_SMALL_ALLOC) {
+                map_index_add(map, n);
+            }
+            n++;
+        }
+    }
+    if (new_alloc > MAP_SMALL_ALLOC) {
+        MAP_FILLED(map) = n;
+    }
+    m_del(byte, old_table, map_table_bytes(old_alloc));
+}
+
+#else
+
 STATIC void mp_map_rehash(mp_map_t *map) {
     size_t old_alloc = map->alloc;
     size_t new_alloc = get_hash_alloc_greater_or_equal_to(map->alloc + 1);
@@ -121,14 +288,20 @@ STATIC void mp_map_rehash(mp_map_t *map) {
     map->used = 0;
     map->all_keys_are_qstrs = 1;
     map->table = new_table;
+    // the entries are only moved, so the class lookups needn't be invalidated for each
+    size_t is_class_dict = map->is_class_dict;
+    map->is_class_dict = 0;
     for (size_t i = 0; i < old_alloc; i++) {
         if (old_table[i].key != MP_OBJ_NULL && old_table[i].key != MP_OBJ_SENTINEL) {
             mp_map_lookup(map, old_table[i].key, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = old_table[i].value;
         }
     }
+    map->is_class_dict = is_class_dict;
     m_del(mp_map_elem_t, old_table, old_alloc);
 }
 
+#endif // MICROPY_MAP_COMPACT
+
 // MP_MAP_LOOKUP behaviour:
 //  - returns NULL if not found, else the slot it was found in with key,value non-null
 // MP_MAP_LOOKUP_ADD_IF_NOT_FOUND behaviour:
@@ -139,6 +312,13 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
     // If the map is a fixed array then we must only be called for a lookup
     assert(!map->is_fixed || lookup_kind == MP_MAP_LOOKUP);
 
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_CACHE || MICROPY_PY_SLOTS
+    if (MP_UNLIKELY(map->is_class_dict) && lookup_kind != MP_MAP_LOOKUP) {
+        // an attribute of a class may be added, replaced or removed
+        mp_obj_class_changed();
+    }
+    #endif
+
     // Work out if we can compare just pointers
     bool compare_only_ptrs = map->all_keys_are_qstrs;
     if (compare_only_ptrs) {
@@ -160,8 +340,25 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
 
     // if the map is an ordered array then we must do a brute force linear search
     if (map->is_ordered) {
+        #if MICROPY_OPT_MAP_LOOKUP_CACHE
+        // first try the position at which this key was last found in this map;
+        // keys are unique so if the key is still there then that's the slot
+        uint8_t *cache = NULL;
+        if (compare_only_ptrs && lookup_kind == MP_MAP_LOOKUP) {
+            cache = &MP_STATE_VM(map_lookup_cache)[MAP_LOOKUP_CACHE_INDEX(map, index)];
+            if (*cache < map->used && map->table[*cache].key == index) {
+                return &map->table[*cache];
+            }
+        }
+        #endif
         for (mp_map_elem_t *elem = &map->table[0], *top = &map->table[map->used]; elem < top; elem++) {
             if (elem->key == index || (!compare_only_ptrs && mp_obj_equal(elem->key, index))) {
+                #if MICROPY_OPT_MAP_LOOKUP_CACHE
+                if (cache != NULL) {
+                    // positions beyond 255 don't fit and will just miss next time
+                    *cache = elem - map->table;
+                }
+                #endif
                 if (MP_UNLIKELY(lookup_kind == MP_MAP_LOOKUP_REMOVE_IF_FOUND)) {
                     // remove the found element by moving the rest of the array down
                     mp_obj_t value = elem->value;
@@ -202,14 +399,105 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
         }
     }
 
-    // get hash of index, with fast path for common case of qstr
-    mp_uint_t hash;
-    if (MP_OBJ_IS_QSTR(index)) {
-        hash = qstr_hash(MP_OBJ_QSTR_VALUE(index));
+    #if MICROPY_MAP_COMPACT
+    mp_map_elem_t *elem;
+    if (map->alloc <= MAP_SMALL_ALLOC) {
+        // small map, so search the entries linearly up to the first unused one
+        if (!MP_OBJ_IS_QSTR(index) && !MP_OBJ_IS_SMALL_INT(index)) {
+            // the key isn't hashed but must still be hashable, as for larger maps
+            map_hash(index);
+        }
+        mp_map_elem_t *top = &map->table[map->alloc];
+        for (elem = &map->table[0]; elem < top && elem->key != MP_OBJ_NULL; elem++) {
+            if (elem->key == index || (!compare_only_ptrs && elem->key != MP_OBJ_SENTINEL && mp_obj_equal(elem->key, index))) {
+                if (lookup_kind == MP_MAP_LOOKUP_REMOVE_IF_FOUND) {
+                    // remove the entry; if it's the last one then its place can be reused
+                    map->used--;
+                    if (elem + 1 == top || elem[1].key == MP_OBJ_NULL) {
+                        elem->key = MP_OBJ_NULL;
+                    } else {
+                        elem->key = MP_OBJ_SENTINEL;
+                    }
+                    // keep elem->value so that caller can access it if needed
+                }
+                return elem;
+            }
+        }
+        if (lookup_kind != MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
+            return NULL;
+        }
+        if (elem == top) {
+            // no unused entries left, so rehash and then add the new entry
+            mp_map_rehash(map);
+            return mp_map_lookup(map, index, lookup_kind);
+        }
     } else {
-        hash = MP_OBJ_SMALL_INT_VALUE(mp_unary_op(MP_UNARY_OP_HASH, index));
+        // search the hash index, remembering the first slot of a removed entry
+        size_t index_len = MAP_INDEX_LEN(map);
+        size_t slot_size = map_index_slot_size(map->alloc);
+        byte *hash_index = MAP_INDEX(map);
+        byte *hash_tags = hash_index + index_len * slot_size;
+        mp_uint_t hash = map_hash(index);
+        byte tag = MAP_HASH_TAG(hash);
+        size_t pos = hash % index_len;
+        size_t avail_pos = index_len;
+        for (;;) {
+            size_t n = map_index_get(hash_index, slot_size, pos);
+            if (n == 0) {
+                // found empty slot, so index is not in the map
+                break;
+            }
+            if (hash_tags[pos] != tag) {
+                // a different key, or a removed entry whose slot is not
+                // worth reusing, so skip it without loading the entry
+                pos = (pos + 1) % index_len;
+                continue;
+            }
+            elem = &map->table[n - 1];
+            if (elem->key == MP_OBJ_SENTINEL) {
+                if (avail_pos == index_len) {
+                    avail_pos = pos;
+                }
+            } else if (elem->key == index || (!compare_only_ptrs && mp_obj_equal(elem->key, index))) {
+                // found index
+                // Note: CPython does not replace the index; try x={True:'true'};x[1]='one';x
+                if (lookup_kind == MP_MAP_LOOKUP_REMOVE_IF_FOUND) {
+                    map->used--;
+                    elem->key = MP_OBJ_SENTINEL;
+                    // keep elem->value so that caller can access it if needed
+                }
+                return elem;
+            }
+            pos = (pos + 1) % index_len;
+        }
+        if (lookup_kind != MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
+            return NULL;
+        }
+        if (MAP_FILLED(map) == map->alloc) {
+            // no unused entries left, so rehash and then add the new entry
+            mp_map_rehash(map);
+            return mp_map_lookup(map, index, lookup_kind);
+        }
+        if (avail_pos == index_len) {
+            avail_pos = pos;
+        }
+        elem = &map->table[MAP_FILLED(map)++];
+        map_index_set(hash_index, slot_size, avail_pos, MAP_FILLED(map));
+        hash_tags[avail_pos] = tag;
     }
 
+    // add the new entry at the end of those filled so far
+    map->used++;
+    elem->key = index;
+    elem->value = MP_OBJ_NULL;
+    if (!MP_OBJ_IS_QSTR(index)) {
+        map->all_keys_are_qstrs = 0;
+    }
+    return elem;
+
+    #else
+
+    mp_uint_t hash = map_hash(index);
     size_t pos = hash % map->alloc;
     size_t start_pos = pos;
     mp_map_elem_t *avail_slot = NULL;
@@ -279,8 +567,11 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
             }
         }
     }
+
+    #endif // MICROPY_MAP_COMPACT
 }
 
+
 /******************************************************************************/
 /* set                                                                        */
 
@@ -100,6 +100,13 @@ size_t m_get_current_bytes_allocated(void);
 size_t m_get_peak_bytes_allocated(void);
 #endif
 
+#if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+struct _mp_print_t;
+void m_alloc_trace_start(void);
+void m_alloc_trace_stop(void);
+void m_alloc_trace_dump(const struct _mp_print_t *print);
+#endif
+
 /** array helpers ***********************************************/
 
 // get the number of elements in a fixed-size array
@@ -25,12 +25,14 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "py/builtin.h"
 #include "py/stackctrl.h"
 #include "py/runtime.h"
 #include "py/gc.h"
 #include "py/mphal.h"
+#include "py/bc.h"
 
 // Various builtins specific to MicroPython runtime,
 // living in micropython module
@@ -40,10 +42,15 @@ STATIC mp_obj_t mp_micropython_opt_level(size_t n_args, const mp_obj_t *args) {
         return MP_OBJ_NEW_SMALL_INT(MP_STATE_VM(mp_optimise_value));
     } else {
         MP_STATE_VM(mp_optimise_value) = mp_obj_get_int(args[0]);
+        #if MICROPY_EMIT_NATIVE_TIERING
+        if (n_args == 2) {
+            MP_STATE_VM(native_tier_threshold) = mp_obj_get_int(args[1]);
+        }
+        #endif
         return mp_const_none;
     }
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_opt_level_obj, 0, 1, mp_micropython_opt_level);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_opt_level_obj, 0, 2, mp_micropython_opt_level);
 
 #if MICROPY_PY_MICROPYTHON_MEM_INFO
 
@@ -112,6 +119,50 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_0(mp_micropython_stack_use_obj, mp_micropython_st
 
 #endif // MICROPY_PY_MICROPYTHON_MEM_INFO
 
+#if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+STATIC mp_obj_t mp_micropython_alloc_trace(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        // no arg means print the counts and reset them
+        m_alloc_trace_dump(&mp_plat_print);
+    } else if (mp_obj_is_true(args[0])) {
+        m_alloc_trace_start();
+    } else {
+        m_alloc_trace_stop();
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_alloc_trace_obj, 0, 1, mp_micropython_alloc_trace);
+#endif
+
+#if MICROPY_VM_STATS
+// Return a tuple of two dicts, one mapping each opcode executed to its count
+// and the other mapping each pair of opcodes executed one after the other to
+// its count.  Given a true argument, also start counting afresh.
+STATIC mp_obj_t mp_micropython_vm_stats(size_t n_args, const mp_obj_t *args) {
+    mp_obj_t ops = mp_obj_new_dict(0);
+    mp_obj_t pairs = mp_obj_new_dict(0);
+    for (size_t i = 0; i < 256; ++i) {
+        if (mp_vm_stats.op_count[i] != 0) {
+            mp_obj_dict_store(ops, MP_OBJ_NEW_SMALL_INT(i),
+                mp_obj_new_int_from_uint(mp_vm_stats.op_count[i]));
+        }
+        for (size_t j = 0; j < 256; ++j) {
+            if (mp_vm_stats.pair_count[i][j] != 0) {
+                mp_obj_t key[2] = {MP_OBJ_NEW_SMALL_INT(i), MP_OBJ_NEW_SMALL_INT(j)};
+                mp_obj_dict_store(pairs, mp_obj_new_tuple(2, key),
+                    mp_obj_new_int_from_uint(mp_vm_stats.pair_count[i][j]));
+            }
+        }
+    }
+    if (n_args > 0 && mp_obj_is_true(args[0])) {
+        memset(&mp_vm_stats, 0, sizeof(mp_vm_stats));
+    }
+    mp_obj_t tuple[2] = {ops, pairs};
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_vm_stats_obj, 0, 1, mp_micropython_vm_stats);
+#endif
+
 #if MICROPY_ENABLE_GC
 STATIC mp_obj_t mp_micropython_heap_lock(void) {
     gc_lock();
@@ -124,6 +175,16 @@ STATIC mp_obj_t mp_micropython_heap_unlock(void) {
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mp_micropython_heap_unlock_obj, mp_micropython_heap_unlock);
+
+#if MICROPY_GC_COMPACT
+// Return the number of times the heap has been compacted.
+STATIC mp_obj_t mp_micropython_heap_compact_count(void) {
+    gc_info_t info;
+    gc_info(&info);
+    return MP_OBJ_NEW_SMALL_INT(info.num_compactions);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mp_micropython_heap_compact_count_obj, mp_micropython_heap_compact_count);
+#endif
 #endif
 
 #if MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF && (MICROPY_EMERGENCY_EXCEPTION_BUF_SIZE == 0)
@@ -164,12 +225,21 @@ STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_stack_use), MP_ROM_PTR(&mp_micropython_stack_use_obj) },
     #endif
 #endif
+    #if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+    { MP_ROM_QSTR(MP_QSTR_alloc_trace), MP_ROM_PTR(&mp_micropython_alloc_trace_obj) },
+    #endif
+    #if MICROPY_VM_STATS
+    { MP_ROM_QSTR(MP_QSTR_vm_stats), MP_ROM_PTR(&mp_micropython_vm_stats_obj) },
+    #endif
 #if MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF && (MICROPY_EMERGENCY_EXCEPTION_BUF_SIZE == 0)
     { MP_ROM_QSTR(MP_QSTR_alloc_emergency_exception_buf), MP_ROM_PTR(&mp_alloc_emergency_exception_buf_obj) },
 #endif
     #if MICROPY_ENABLE_GC
     { MP_ROM_QSTR(MP_QSTR_heap_lock), MP_ROM_PTR(&mp_micropython_heap_lock_obj) },
     { MP_ROM_QSTR(MP_QSTR_heap_unlock), MP_ROM_PTR(&mp_micropython_heap_unlock_obj) },
+    #if MICROPY_GC_COMPACT
+    { MP_ROM_QSTR(MP_QSTR_heap_compact_count), MP_ROM_PTR(&mp_micropython_heap_compact_count_obj) },
+    #endif
     #endif
     #if MICROPY_KBD_EXCEPTION
     { MP_ROM_QSTR(MP_QSTR_kbd_intr), MP_ROM_PTR(&mp_micropython_kbd_intr_obj) },
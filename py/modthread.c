@@ -29,6 +29,7 @@
 
 #include "py/runtime.h"
 #include "py/stackctrl.h"
+#include "py/gc.h"
 
 #if MICROPY_PY_THREAD
 
@@ -162,6 +163,14 @@ STATIC void *thread_entry(void *args_in) {
     mp_state_thread_t ts;
     mp_thread_set_state(&ts);
 
+    #if MICROPY_GC_THREAD_ALLOC_BUF
+    gc_thread_alloc_buf_init();
+    #endif
+
+    #if MICROPY_TRACK_CODE_STATE
+    ts.current_code_state = NULL;
+    #endif
+
     mp_stack_set_top(&ts + 1); // need to include ts in root-pointer scan
     mp_stack_set_limit(args->stack_size);
 
@@ -201,6 +210,10 @@ STATIC void *thread_entry(void *args_in) {
 
     DEBUG_printf("[thread] finish ts=%p\n", &ts);
 
+    #if MICROPY_GC_THREAD_ALLOC_BUF
+    gc_thread_alloc_buf_deinit();
+    #endif
+
     // signal that we are finished
     mp_thread_finish();
 
@@ -106,6 +106,13 @@
 #define MICROPY_ALLOC_GC_STACK_SIZE (64)
 #endif
 
+// Whether the GC stack can grow into free heap blocks while marking.  Without
+// this, when the GC stack overflows the whole heap is rescanned for marked
+// blocks, which is very slow for deep structures like long linked lists.
+#ifndef MICROPY_GC_STACK_SPILL
+#define MICROPY_GC_STACK_SPILL (0)
+#endif
+
 // Be conservative and always clear to zero newly (re)allocated memory in the GC.
 // This helps eliminate stray pointers that hold on to memory that's no longer
 // used.  It decreases performance due to unnecessary memory clearing.
@@ -116,6 +123,51 @@
 #define MICROPY_GC_CONSERVATIVE_CLEAR (MICROPY_ENABLE_GC)
 #endif
 
+// Number of segregated free lists used by gc_alloc, one per size class of
+// free runs (1, 2, 3-4, 5-8, ... blocks, with the last class holding all
+// larger runs).  The lists are rebuilt during the sweep phase so that small
+// allocations don't need to scan the allocation table.  Set to 0 to disable.
+#ifndef MICROPY_GC_SIZE_CLASSES
+#define MICROPY_GC_SIZE_CLASSES (0)
+#endif
+
+// Don't sweep the heap at the end of an automatic collection, instead sweep
+// it incrementally from gc_alloc as it looks for free blocks.  This shortens
+// the pause of each collection.  An explicit gc.collect() still sweeps (and
+// runs finalisers) before returning.
+#ifndef MICROPY_GC_LAZY_SWEEP
+#define MICROPY_GC_LAZY_SWEEP (0)
+#endif
+
+// Allow the GC to manage several disjoint regions of memory, with further
+// regions added after gc_init by calling gc_add.
+#ifndef MICROPY_GC_SPLIT_HEAP
+#define MICROPY_GC_SPLIT_HEAP (0)
+#endif
+
+// Give each thread a buffer of this many heap blocks to allocate small
+// objects from without taking the GC mutex (0 to disable).  Only useful with
+// threads and no GIL.
+#ifndef MICROPY_GC_THREAD_ALLOC_BUF
+#define MICROPY_GC_THREAD_ALLOC_BUF (0)
+#endif
+
+// When an allocation fails even after a collection, try to make room for it
+// by moving the arrays of lists, dicts and instances out of the way, moving
+// at most this many arrays at a time (0 to disable).  An array is only moved
+// if a collection finds no reference to it other than from its owner, so this
+// is safe with the conservative GC, but needs the GIL if threads are enabled.
+#ifndef MICROPY_GC_COMPACT
+#define MICROPY_GC_COMPACT (0)
+#endif
+
+// Measure the duration of each garbage collection using mp_hal_ticks_us and
+// report the number of collections, their total time, and the last and the
+// longest pause in gc_info/mem_info.
+#ifndef MICROPY_GC_PAUSE_STATS
+#define MICROPY_GC_PAUSE_STATS (0)
+#endif
+
 // Support automatic GC when reaching allocation threshold,
 // configurable by gc.threshold().
 #ifndef MICROPY_GC_ALLOC_THRESHOLD
@@ -210,6 +262,13 @@
 #define MICROPY_QSTR_BYTES_IN_HASH (2)
 #endif
 
+// Whether each qstr pool has a hash index, so that interning a string doesn't
+// need to scan all existing qstrs.  The index for the ROM pool is generated
+// by makeqstrdata.py, those for dynamic pools are allocated with the pool.
+#ifndef MICROPY_QSTR_HASH_INDEX
+#define MICROPY_QSTR_HASH_INDEX (0)
+#endif
+
 // Avoid using C stack when making Python function calls. C stack still
 // may be used if there's no free heap.
 #ifndef MICROPY_STACKLESS
@@ -300,6 +359,29 @@
 // Convenience definition for whether any native emitter is enabled
 #define MICROPY_EMIT_NATIVE (MICROPY_EMIT_X64 || MICROPY_EMIT_X86 || MICROPY_EMIT_THUMB || MICROPY_EMIT_ARM || MICROPY_EMIT_XTENSA)
 
+// Whether viper functions support a "float" type, whose values are kept
+// unboxed in machine words and operated on with the FPU.  Only the native
+// emitters with float support provide it: x64 with double precision floats,
+// and thumb with single precision floats and MICROPY_EMIT_INLINE_THUMB_FLOAT.
+#ifndef MICROPY_EMIT_NATIVE_FLOAT
+#define MICROPY_EMIT_NATIVE_FLOAT (0)
+#endif
+
+// Whether bytecode functions that get hot (called often, or looping a lot)
+// are translated to native code at runtime by the native emitter, entering
+// the native code in the middle of a loop if needed.  Requires a native
+// emitter, and is only tested with the x64 and x86 ones.
+#ifndef MICROPY_EMIT_NATIVE_TIERING
+#define MICROPY_EMIT_NATIVE_TIERING (0)
+#endif
+
+// Initial value of the number of calls plus backward jumps after which a
+// bytecode function is translated to native code; 0 disables the tiering
+// until it is set with micropython.opt_level().
+#ifndef MICROPY_EMIT_NATIVE_TIERING_THRESHOLD
+#define MICROPY_EMIT_NATIVE_TIERING_THRESHOLD (0)
+#endif
+
 // Convenience definition for whether any inline assembler emitter is enabled
 #define MICROPY_EMIT_INLINE_ASM (MICROPY_EMIT_INLINE_THUMB || MICROPY_EMIT_INLINE_XTENSA)
 
@@ -389,13 +471,71 @@
 #define MICROPY_OPT_COMPUTED_GOTO (0)
 #endif
 
+// Whether the compiler fuses common sequences of opcodes into superinstructions,
+// eg a comparison followed by a conditional jump.  The VM always understands
+// them, so this only affects the bytecode generated (and .mpy files).
+#ifndef MICROPY_OPT_SUPERINSTRUCTIONS
+#define MICROPY_OPT_SUPERINSTRUCTIONS (0)
+#endif
+
+// Whether the VM does arithmetic, bitwise and comparison ops on two small ints
+// inline instead of calling mp_binary_op.  Increases VM code size a little.
+#ifndef MICROPY_OPT_SMALL_INT_FAST_PATH
+#define MICROPY_OPT_SMALL_INT_FAST_PATH (0)
+#endif
+
 // Whether to cache result of map lookups in LOAD_NAME, LOAD_GLOBAL, LOAD_ATTR,
 // STORE_ATTR bytecodes.  Uses 1 byte extra RAM for each of these opcodes and
-// uses a bit of extra code ROM, but greatly improves lookup speed.
+// uses a bit of extra code ROM, but greatly improves lookup speed.  The
+// LOAD_METHOD bytecode also gets a byte, for MICROPY_OPT_INLINE_CACHE.
 #ifndef MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (0)
 #endif
 
+// Number of inline caches for LOAD_METHOD on instances of user classes (0 to
+// disable, at most 255).  Each LOAD_METHOD is given a cache the first time it
+// runs, numbered in its cache byte, which remembers the method found for the
+// last few classes seen there so that a call skips the whole attribute lookup.
+// When they run out, caches are shared between bytecodes.  All caches are
+// invalidated when a class is created or the dict of any class is changed.
+// Requires MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE, and the GIL if
+// MICROPY_PY_THREAD is enabled.
+#ifndef MICROPY_OPT_INLINE_CACHE
+#define MICROPY_OPT_INLINE_CACHE (0)
+#endif
+
+// Number of classes remembered by each inline cache
+#ifndef MICROPY_OPT_INLINE_CACHE_WAYS
+#define MICROPY_OPT_INLINE_CACHE_WAYS (4)
+#endif
+
+// Number of entries in a global cache of attribute lookups in user classes,
+// keyed by class and attribute name (0 to disable).  It saves searching the
+// dicts of a class and all its bases on each method call.  The cache is
+// flushed when a class is created or the dict of any class is changed, also
+// through a dict kept from locals() in the class body.  Requires the GIL if
+// MICROPY_PY_THREAD is enabled.
+#ifndef MICROPY_OPT_CLASS_LOOKUP_CACHE
+#define MICROPY_OPT_CLASS_LOOKUP_CACHE (0)
+#endif
+
+// Size of a cache of the positions at which qstr keys were found in ordered
+// maps, such as the ROM dicts of builtin modules and types, so that repeated
+// lookups of the same name don't need a linear search.  Each entry is a byte
+// and is checked before use, so the cache never needs flushing.  Must be 0
+// (disabled) or a power of 2.
+#ifndef MICROPY_OPT_MAP_LOOKUP_CACHE
+#define MICROPY_OPT_MAP_LOOKUP_CACHE (0)
+#endif
+
+// Whether hash maps (dicts, instance members, globals) use a compact layout,
+// with the entries in a dense array in insertion order and a separate hash
+// index.  Lookups are faster and dicts iterate in insertion order, as in
+// CPython 3.6+, but maps of more than 8 entries use 10-25% more RAM.
+#ifndef MICROPY_MAP_COMPACT
+#define MICROPY_MAP_COMPACT (0)
+#endif
+
 // Whether to use fast versions of bitwise operations (and, or, xor) when the
 // arguments are both positive.  Increases Thumb2 code size by about 250 bytes.
 #ifndef MICROPY_OPT_MPZ_BITWISE
@@ -677,6 +817,13 @@ typedef double mp_float_t;
 #define MICROPY_PY_DESCRIPTORS (0)
 #endif
 
+// Whether to support __slots__ in classes, so that instances hold the listed
+// attributes in a fixed array instead of in a map of members.  Instances of a
+// class with __slots__, all of whose bases have them too, have no members.
+#ifndef MICROPY_PY_SLOTS
+#define MICROPY_PY_SLOTS (0)
+#endif
+
 // Whether to support class __delattr__ and __setattr__ methods
 // This costs some code size and makes all del attrs and store attrs slow
 #ifndef MICROPY_PY_DELATTR_SETATTR
@@ -865,6 +1012,28 @@ typedef double mp_float_t;
 #define MICROPY_PY_MICROPYTHON_MEM_INFO (0)
 #endif
 
+// Whether to provide micropython.alloc_trace, which counts the heap memory
+// allocated by each line of bytecode in a table of this many entries (0 to
+// disable).  It relies on MICROPY_TRACK_CODE_STATE, which costs a little on
+// each function call even when the trace is off.
+#ifndef MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+#define MICROPY_PY_MICROPYTHON_ALLOC_TRACE (0)
+#endif
+
+// Whether each thread keeps a pointer to the state of the innermost bytecode
+// function it is executing, linked to the states of its callers.  This is
+// what profilers use to find out where the program is.
+#ifndef MICROPY_TRACK_CODE_STATE
+#define MICROPY_TRACK_CODE_STATE (MICROPY_PY_MICROPYTHON_ALLOC_TRACE != 0)
+#endif
+
+// Whether the VM counts the number of times each opcode is executed, and each
+// pair of opcodes executed one after the other, for micropython.vm_stats().
+// It slows the VM down a lot so it's only meant for builds used to tune it.
+#ifndef MICROPY_VM_STATS
+#define MICROPY_VM_STATS (0)
+#endif
+
 // Whether to provide "array" module. Note that large chunk of the
 // underlying code is shared with "bytearray" builtin type, so to
 // get real savings, it should be disabled too.
@@ -46,6 +46,7 @@ typedef struct mp_dynamic_compiler_t {
     uint8_t small_int_bits; // must be <= host small_int_bits
     bool opt_cache_map_lookup_in_bytecode;
     bool py_builtins_str_unicode;
+    uint8_t native_arch; // one of MP_NATIVE_ARCH_xxx, must match the host's emitter
 } mp_dynamic_compiler_t;
 extern mp_dynamic_compiler_t mp_dynamic_compiler;
 #endif
@@ -60,12 +61,30 @@ typedef struct _mp_sched_item_t {
     mp_obj_t arg;
 } mp_sched_item_t;
 
-// This structure hold information about the memory allocation system.
-typedef struct _mp_state_mem_t {
-    #if MICROPY_MEM_STATS
-    size_t total_bytes_allocated;
-    size_t current_bytes_allocated;
-    size_t peak_bytes_allocated;
+// An entry of the class attribute lookup cache.  A NULL value records that
+// the attribute isn't in the class or its bases.
+typedef struct _mp_class_lookup_cache_entry_t {
+    const mp_obj_type_t *type;
+    qstr attr;
+    const mp_obj_type_t *found_type;
+    mp_obj_t value;
+} mp_class_lookup_cache_entry_t;
+
+// An inline cache of LOAD_METHOD, valid while its epoch matches class_epoch.
+typedef struct _mp_inline_cache_t {
+    qstr attr;
+    size_t epoch;
+    size_t next_way;
+    const mp_obj_type_t *type[MICROPY_OPT_INLINE_CACHE_WAYS];
+    mp_obj_t meth[MICROPY_OPT_INLINE_CACHE_WAYS];
+} mp_inline_cache_t;
+
+// This structure holds the state of one contiguous region of memory managed
+// by the GC.  With MICROPY_GC_SPLIT_HEAP further regions can be added with
+// gc_add, and the areas form a linked list starting at mp_state_mem_t.area.
+typedef struct _mp_state_mem_area_t {
+    #if MICROPY_GC_SPLIT_HEAP
+    struct _mp_state_mem_area_t *next;
     #endif
 
     byte *gc_alloc_table_start;
@@ -76,9 +95,84 @@ typedef struct _mp_state_mem_t {
     byte *gc_pool_start;
     byte *gc_pool_end;
 
+    size_t gc_last_free_atb_index;
+
+    #if MICROPY_GC_THREAD_ALLOC_BUF
+    // where to start searching for the next thread allocation buffer
+    size_t gc_alloc_buf_atb_index;
+    #endif
+
+    #if MICROPY_GC_LAZY_SWEEP
+    // blocks from gc_sweep_block onwards have not been swept yet
+    size_t gc_sweep_block;
+    int gc_sweep_free_tail;
+    #endif
+
+    #if MICROPY_GC_SIZE_CLASSES
+    // heads of the segregated free lists, see gc_free_run_t in gc.c
+    struct _gc_free_run_t *gc_free_runs[MICROPY_GC_SIZE_CLASSES];
+    #endif
+} mp_state_mem_area_t;
+
+#if MICROPY_GC_THREAD_ALLOC_BUF
+// A run of heap blocks that one thread allocates small objects from without
+// taking the GC mutex.  The first free block of the buffer is a head and the
+// rest are its tails, so the buffer looks like a single object to the GC.
+typedef struct _mp_gc_alloc_buf_t {
+    struct _mp_gc_alloc_buf_t *next;
+    mp_state_mem_area_t *area;
+    size_t block;
+    size_t n_blocks;
+    bool registered;
+    // spin lock held by the owning thread while it allocates, and by the
+    // collector when it empties the buffer
+    uint8_t locked;
+} mp_gc_alloc_buf_t;
+#endif
+
+#if MICROPY_GC_COMPACT
+// An array that a compaction of the heap intends to move, see gc_compact.
+typedef struct _mp_gc_compact_obj_t {
+    byte *start;
+    // size of the chain of blocks holding the array
+    size_t n_bytes;
+    // the reference to the array that is updated when it is moved
+    void **owner;
+    // number of references found by the last collection, and the last of them
+    size_t n_refs;
+    void **ref;
+} mp_gc_compact_obj_t;
+#endif
+
+// This structure hold information about the memory allocation system.
+typedef struct _mp_state_mem_t {
+    #if MICROPY_MEM_STATS
+    size_t total_bytes_allocated;
+    size_t current_bytes_allocated;
+    size_t peak_bytes_allocated;
+    #endif
+
+    // the first area of the heap, set up by gc_init
+    mp_state_mem_area_t area;
+
+    #if MICROPY_GC_SPLIT_HEAP
+    // lowest and highest addresses covered by the pools of all areas
+    byte *gc_lowest_ptr;
+    byte *gc_highest_ptr;
+    #endif
+
     int gc_stack_overflow;
-    size_t gc_stack[MICROPY_ALLOC_GC_STACK_SIZE];
-    size_t *gc_sp;
+    void *gc_stack[MICROPY_ALLOC_GC_STACK_SIZE];
+    void **gc_sp;
+    #if MICROPY_GC_STACK_SPILL
+    // segments of the GC stack spilled into free heap blocks, see gc.c
+    struct _gc_stack_seg_t *gc_stack_seg;
+    struct _gc_stack_seg_t *gc_stack_seg_spare;
+    #if MICROPY_GC_SPLIT_HEAP
+    mp_state_mem_area_t *gc_stack_seg_area;
+    #endif
+    size_t gc_stack_seg_block;
+    #endif
     uint16_t gc_lock_depth;
 
     // This variable controls auto garbage collection.  If set to 0 then the
@@ -91,16 +185,38 @@ typedef struct _mp_state_mem_t {
     size_t gc_alloc_threshold;
     #endif
 
-    size_t gc_last_free_atb_index;
-
     #if MICROPY_PY_GC_COLLECT_RETVAL
     size_t gc_collected;
     #endif
 
+    #if MICROPY_GC_PAUSE_STATS
+    mp_uint_t gc_pause_start_us;
+    mp_uint_t gc_pause_last_us;
+    mp_uint_t gc_pause_max_us;
+    mp_uint_t gc_pause_total_us;
+    size_t gc_num_collections;
+    #endif
+
+    #if MICROPY_GC_COMPACT
+    // The arrays being moved live here rather than on the C stack so that the
+    // collection which counts their references doesn't see them.
+    mp_gc_compact_obj_t gc_compact_objs[MICROPY_GC_COMPACT];
+    size_t gc_compact_n_objs;
+    size_t gc_compact_count;
+    size_t gc_compact_moved;
+    size_t gc_compact_max_free_before;
+    size_t gc_compact_max_free_after;
+    #endif
+
     #if MICROPY_PY_THREAD
     // This is a global mutex used to make the GC thread-safe.
     mp_thread_mutex_t gc_mutex;
     #endif
+
+    #if MICROPY_GC_THREAD_ALLOC_BUF
+    // linked list of the allocation buffers of all threads
+    mp_gc_alloc_buf_t *gc_alloc_bufs;
+    #endif
 } mp_state_mem_t;
 
 // This structure hold runtime and VM information.  It includes a section
@@ -162,6 +278,11 @@ typedef struct _mp_state_vm_t {
     mp_obj_dict_t *mp_module_builtins_override_dict;
     #endif
 
+    #if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+    // table of the allocations counted by micropython.alloc_trace
+    struct _m_alloc_trace_entry_t *alloc_trace_table;
+    #endif
+
     // include any root pointers defined by a port
     MICROPY_PORT_ROOT_POINTERS
 
@@ -198,6 +319,42 @@ typedef struct _mp_state_vm_t {
 
     mp_uint_t mp_optimise_value;
 
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+    // not a root pointer: entries are flushed whenever a class is created or
+    // a class dict changes, so only refer to live classes and members
+    mp_class_lookup_cache_entry_t class_lookup_cache[MICROPY_OPT_CLASS_LOOKUP_CACHE];
+    #endif
+
+    #if MICROPY_OPT_MAP_LOOKUP_CACHE
+    // positions of keys in ordered maps, indexed by a hash of the map and key
+    uint8_t map_lookup_cache[MICROPY_OPT_MAP_LOOKUP_CACHE];
+    #endif
+
+    #if MICROPY_OPT_INLINE_CACHE
+    // not root pointers either: an entry is only used while its epoch is
+    // current, so only refers to live classes and methods
+    mp_inline_cache_t inline_cache[MICROPY_OPT_INLINE_CACHE];
+    size_t inline_cache_next;
+    #endif
+
+    #if MICROPY_OPT_INLINE_CACHE || MICROPY_PY_SLOTS
+    // incremented whenever a class is created or a class dict changes
+    size_t class_epoch;
+    #endif
+
+    #if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+    bool alloc_trace_active;
+    #endif
+
+    #if MICROPY_EMIT_NATIVE_TIERING
+    // number of calls plus backward jumps after which a function is translated
+    mp_uint_t native_tier_threshold;
+    #if MICROPY_PY_THREAD_GIL && MICROPY_PY_THREAD_GIL_VM_DIVISOR
+    // counts down the backward jumps in native code to releasing the GIL
+    mp_uint_t native_tier_gil_divisor;
+    #endif
+    #endif
+
     // size of the emergency exception buf, if it's dynamically allocated
     #if MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF && MICROPY_EMERGENCY_EXCEPTION_BUF_SIZE == 0
     mp_int_t mp_emergency_exception_buf_size;
@@ -224,6 +381,20 @@ typedef struct _mp_state_thread_t {
     #if MICROPY_STACK_CHECK
     size_t stack_limit;
     #endif
+
+    #if MICROPY_GC_THREAD_ALLOC_BUF
+    mp_gc_alloc_buf_t gc_alloc_buf;
+    #endif
+
+    #if MICROPY_TRACK_CODE_STATE
+    // state of the innermost bytecode function being executed, if any
+    struct _mp_code_state_t *current_code_state;
+    #endif
+
+    #if MICROPY_EMIT_NATIVE_TIERING
+    // where the native code being entered records its position in the bytecode
+    const byte *volatile *native_tier_ip;
+    #endif
 } mp_state_thread_t;
 
 // This structure combines the above 3 structures.
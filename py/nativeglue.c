@@ -32,6 +32,7 @@
 #include "py/smallint.h"
 #include "py/emitglue.h"
 #include "py/bc.h"
+#include "py/nativetier.h"
 
 #if MICROPY_DEBUG_VERBOSE // print debugging info
 #define DEBUG_printf DEBUG_printf
@@ -49,6 +50,13 @@ mp_uint_t mp_convert_obj_to_native(mp_obj_t obj, mp_uint_t type) {
         case MP_NATIVE_TYPE_BOOL:
         case MP_NATIVE_TYPE_INT:
         case MP_NATIVE_TYPE_UINT: return mp_obj_get_int_truncated(obj);
+        #if MICROPY_EMIT_NATIVE_FLOAT
+        case MP_NATIVE_TYPE_FLOAT: {
+            union { mp_float_t f; mp_uint_t u; } val = { .u = 0 };
+            val.f = mp_obj_get_float(obj);
+            return val.u;
+        }
+        #endif
         default: { // cast obj to a pointer
             mp_buffer_info_t bufinfo;
             if (mp_get_buffer(obj, &bufinfo, MP_BUFFER_RW)) {
@@ -73,6 +81,12 @@ mp_obj_t mp_convert_native_to_obj(mp_uint_t val, mp_uint_t type) {
         case MP_NATIVE_TYPE_BOOL: return mp_obj_new_bool(val);
         case MP_NATIVE_TYPE_INT: return mp_obj_new_int(val);
         case MP_NATIVE_TYPE_UINT: return mp_obj_new_int_from_uint(val);
+        #if MICROPY_EMIT_NATIVE_FLOAT
+        case MP_NATIVE_TYPE_FLOAT: {
+            union { mp_uint_t u; mp_float_t f; } v = { .u = val };
+            return mp_obj_new_float(v.f);
+        }
+        #endif
         default: // a pointer
             // we return just the value of the pointer as an integer
             return mp_obj_new_int_from_uint(val);
@@ -92,7 +106,7 @@ mp_obj_t mp_native_call_function_n_kw(mp_obj_t fun_in, size_t n_args_kw, const m
 // wrapper that makes raise obj and raises it
 // END_FINALLY opcode requires that we don't raise if o==None
 void mp_native_raise(mp_obj_t o) {
-    if (o != mp_const_none) {
+    if (o != MP_OBJ_NULL && o != mp_const_none) {
         nlr_raise(mp_make_raise_obj(o));
     }
 }
@@ -124,6 +138,47 @@ STATIC mp_obj_t mp_native_iternext(mp_obj_iter_buf_t *iter) {
 }
 
 // these must correspond to the respective enum in runtime0.h
+// wrapper that does a step of a yield-from: sends a value (or throws one given
+// in *ret_value) to the iterator, and returns true if it yielded a value, or
+// false if it finished; either way the value is put in *ret_value
+STATIC bool mp_native_yield_from(mp_obj_t gen, mp_obj_t send_value, mp_obj_t *ret_value) {
+    mp_vm_return_kind_t ret_kind;
+    nlr_buf_t nlr_buf;
+    mp_obj_t throw_value = *ret_value;
+    if (nlr_push(&nlr_buf) == 0) {
+        if (throw_value != MP_OBJ_NULL) {
+            send_value = MP_OBJ_NULL;
+        }
+        ret_kind = mp_resume(gen, send_value, throw_value, ret_value);
+        nlr_pop();
+    } else {
+        ret_kind = MP_VM_RETURN_EXCEPTION;
+        *ret_value = nlr_buf.ret_val;
+    }
+
+    if (ret_kind == MP_VM_RETURN_YIELD) {
+        return true;
+    } else if (ret_kind == MP_VM_RETURN_NORMAL) {
+        if (*ret_value == MP_OBJ_STOP_ITERATION) {
+            *ret_value = mp_const_none;
+        }
+    } else {
+        assert(ret_kind == MP_VM_RETURN_EXCEPTION);
+        if (!mp_obj_exception_match(*ret_value, MP_OBJ_FROM_PTR(&mp_type_StopIteration))) {
+            nlr_raise(*ret_value);
+        }
+        *ret_value = mp_obj_exception_get_value(*ret_value);
+    }
+
+    if (throw_value != MP_OBJ_NULL && mp_obj_exception_match(throw_value, MP_OBJ_FROM_PTR(&mp_type_GeneratorExit))) {
+        nlr_raise(mp_make_raise_obj(throw_value));
+    }
+
+    return false;
+}
+
+// The layout of this table is the same in all builds, with NULL entries for
+// disabled features, because precompiled native code indexes into it.
 void *const mp_fun_table[MP_F_NUMBER_OF] = {
     mp_convert_obj_to_native,
     mp_convert_native_to_obj,
@@ -148,6 +203,9 @@ void *const mp_fun_table[MP_F_NUMBER_OF] = {
 #if MICROPY_PY_BUILTINS_SET
     mp_obj_new_set,
     mp_obj_set_store,
+#else
+    NULL,
+    NULL,
 #endif
     mp_make_function_from_raw_code,
     mp_native_call_function_n_kw,
@@ -163,6 +221,8 @@ void *const mp_fun_table[MP_F_NUMBER_OF] = {
     mp_import_all,
 #if MICROPY_PY_BUILTINS_SLICE
     mp_obj_new_slice,
+#else
+    NULL,
 #endif
     mp_unpack_sequence,
     mp_unpack_ex,
@@ -173,8 +233,43 @@ void *const mp_fun_table[MP_F_NUMBER_OF] = {
     mp_setup_code_state,
     mp_small_int_floor_divide,
     mp_small_int_modulo,
+    mp_native_yield_from,
+#if MICROPY_EMIT_NATIVE_TIERING
+    mp_native_tier_ip,
+    mp_native_tier_loop_hook,
+#else
+    NULL,
+    NULL,
+#endif
 };
 
+// Returns the word to store in native code for the given relocation
+mp_uint_t mp_native_reloc_value(mp_native_reloc_kind_t kind, mp_uint_t value) {
+    switch (kind) {
+        case MP_NATIVE_RELOC_FUN_TABLE:
+            return (mp_uint_t)mp_fun_table;
+        case MP_NATIVE_RELOC_FUN:
+            return (mp_uint_t)mp_fun_table[value];
+        case MP_NATIVE_RELOC_CONST:
+            switch (value) {
+                case MP_NATIVE_CONST_NONE: return (mp_uint_t)mp_const_none;
+                case MP_NATIVE_CONST_FALSE: return (mp_uint_t)mp_const_false;
+                case MP_NATIVE_CONST_TRUE: return (mp_uint_t)mp_const_true;
+                case MP_NATIVE_CONST_ELLIPSIS: return (mp_uint_t)MP_OBJ_FROM_PTR(&mp_const_ellipsis_obj);
+                case MP_NATIVE_CONST_STOP_ITERATION: return (mp_uint_t)MP_OBJ_STOP_ITERATION;
+                case MP_NATIVE_CONST_SENTINEL: return (mp_uint_t)MP_OBJ_SENTINEL;
+                default:
+                    assert(value == MP_NATIVE_CONST_TYPE_RUNTIME_ERROR);
+                    return (mp_uint_t)&mp_type_RuntimeError;
+            }
+        case MP_NATIVE_RELOC_QSTR_OBJ:
+            return (mp_uint_t)MP_OBJ_NEW_QSTR(value);
+        default:
+            // qstrs, and objects and raw code which are stored as is
+            return value;
+    }
+}
+
 /*
 void mp_f_vector(mp_fun_kind_t fun_kind) {
     (mp_f_table[fun_kind])();
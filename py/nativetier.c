@@ -0,0 +1,944 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "py/runtime.h"
+#include "py/gc.h"
+#include "py/bc0.h"
+#include "py/emit.h"
+#include "py/nativetier.h"
+
+// Translation of hot bytecode functions to native code.
+//
+// The bytecode of a function is decoded and fed to the native emitter, with
+// the same calls that the compiler makes when compiling a @micropython.native
+// function, so the native code follows the same conventions as that of a
+// native function.  Only straight-line code, loops and calls are supported:
+// functions with exception handlers, closures or yield are left as bytecode.
+//
+// Running bytecode can switch to the native code at the target of a backward
+// jump: for each of these the native code has an extra entry point which
+// copies the locals and the stack of the bytecode frame into the native frame
+// and jumps to the corresponding place in the code.
+//
+// As in the VM, the native code checks for pending exceptions at the target of
+// each backward jump, and it records its position in the bytecode at each new
+// line so that the traceback of an exception is the same as from the bytecode.
+
+#if MICROPY_EMIT_NATIVE_TIERING
+
+#if MICROPY_DEBUG_VERBOSE // print debugging info
+#define DEBUG_PRINT (1)
+#define DEBUG_printf DEBUG_printf
+#else // don't print debugging info
+#define DEBUG_printf(...) (void)0
+#endif
+
+// define a macro to access external native emitter
+#if MICROPY_EMIT_X64
+#define NATIVE_EMITTER(f) emit_native_x64_##f
+#elif MICROPY_EMIT_X86
+#define NATIVE_EMITTER(f) emit_native_x86_##f
+#elif MICROPY_EMIT_THUMB
+#define NATIVE_EMITTER(f) emit_native_thumb_##f
+#elif MICROPY_EMIT_ARM
+#define NATIVE_EMITTER(f) emit_native_arm_##f
+#elif MICROPY_EMIT_XTENSA
+#define NATIVE_EMITTER(f) emit_native_xtensa_##f
+#else
+#error "unknown native emitter"
+#endif
+
+// the locals that are bound at each opcode are tracked in a 64-bit mask
+#define TIER_MAX_LOCALS (64)
+
+// the native emitter only has room for a limited stack depth
+#define TIER_MAX_STACK (100)
+
+// a decoded opcode
+typedef struct _tier_insn_t {
+    const byte *next;       // following opcode
+    const byte *target;     // target of the jump, or NULL if it doesn't jump
+    byte op;                // opcode, with the *_MULTI ones not including their argument
+    bool ends_block;        // the following opcode is not reached from this one
+    int16_t n_push;         // change in stack depth when going to the next opcode
+    int16_t n_push_jump;    // change in stack depth when jumping to the target
+    mp_uint_t arg;
+    mp_uint_t arg2;
+} tier_insn_t;
+
+// what is known about the opcode at each offset in the bytecode
+typedef struct _tier_info_t {
+    uint64_t bound;         // mask of the locals that are bound here
+    int16_t depth;          // depth of the stack here, -1 if not reached
+    uint16_t label;         // label + 1 of this opcode if jumped to, else 0
+    uint16_t for_label;     // label + 1 for the exit of a for loop to here, else 0
+    bool osr;               // target of a backward jump, so an entry point
+    bool jump_target;
+    bool for_target;
+    bool fallthrough;       // reached from the previous opcode
+} tier_info_t;
+
+typedef struct _tier_t {
+    const byte *bytecode;
+    const byte *code;       // start of the opcodes
+    const mp_uint_t *const_table;
+    size_t n_state;
+    size_t n_args;
+    size_t num_locals;
+    tier_info_t *info;      // indexed by offset from code
+    size_t info_alloc;
+    size_t *work;           // offsets still to analyse
+    size_t work_len;
+    size_t work_alloc;
+    size_t n_labels;
+    size_t n_osr;
+} tier_t;
+
+STATIC qstr tier_decode_qstr(const byte **ip) {
+    #if MICROPY_PERSISTENT_CODE
+    qstr qst = (*ip)[0] | (*ip)[1] << 8;
+    *ip += 2;
+    return qst;
+    #else
+    return mp_decode_uint(ip);
+    #endif
+}
+
+STATIC mp_uint_t tier_decode_ptr(const byte **ip, const mp_uint_t *const_table) {
+    #if MICROPY_PERSISTENT_CODE
+    return const_table[mp_decode_uint(ip)];
+    #else
+    (void)const_table;
+    *ip = (const byte*)MP_ALIGN(*ip, sizeof(mp_uint_t));
+    mp_uint_t ptr = *(const mp_uint_t*)*ip;
+    *ip += sizeof(mp_uint_t);
+    return ptr;
+    #endif
+}
+
+STATIC const byte *tier_decode_slabel(const byte **ip) {
+    size_t slab = ((*ip)[0] | ((*ip)[1] << 8)) - 0x8000;
+    *ip += 2;
+    return *ip + slab;
+}
+
+STATIC qstr tier_decode_qstr_cached(const byte **ip) {
+    qstr qst = tier_decode_qstr(ip);
+    #if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+    *ip += 1;
+    #endif
+    return qst;
+}
+
+// Decode the opcode at ip, returning false if it can't be translated.
+STATIC bool tier_decode(const byte *ip, const mp_uint_t *const_table, tier_insn_t *insn) {
+    mp_int_t n_push = 0;
+    insn->target = NULL;
+    insn->ends_block = false;
+    insn->n_push_jump = 0;
+    insn->arg = 0;
+    insn->arg2 = 0;
+    byte op = *ip++;
+    if (op >= MP_BC_BINARY_OP_MULTI) {
+        insn->arg = op - MP_BC_BINARY_OP_MULTI;
+        op = MP_BC_BINARY_OP_MULTI;
+        n_push = -1;
+    } else if (op >= MP_BC_UNARY_OP_MULTI) {
+        insn->arg = op - MP_BC_UNARY_OP_MULTI;
+        op = MP_BC_UNARY_OP_MULTI;
+    } else if (op >= MP_BC_STORE_FAST_MULTI) {
+        insn->arg = op - MP_BC_STORE_FAST_MULTI;
+        op = MP_BC_STORE_FAST_MULTI;
+        n_push = -1;
+    } else if (op >= MP_BC_LOAD_FAST_MULTI) {
+        insn->arg = op - MP_BC_LOAD_FAST_MULTI;
+        op = MP_BC_LOAD_FAST_MULTI;
+        n_push = 1;
+    } else if (op >= MP_BC_LOAD_CONST_SMALL_INT_MULTI) {
+        insn->arg = (mp_int_t)op - MP_BC_LOAD_CONST_SMALL_INT_MULTI - 16;
+        op = MP_BC_LOAD_CONST_SMALL_INT_MULTI;
+        n_push = 1;
+    } else {
+        switch (op) {
+            case MP_BC_LOAD_CONST_FALSE:
+            case MP_BC_LOAD_CONST_NONE:
+            case MP_BC_LOAD_CONST_TRUE:
+            case MP_BC_LOAD_NULL:
+            case MP_BC_LOAD_BUILD_CLASS:
+            case MP_BC_DUP_TOP:
+                n_push = 1;
+                break;
+            case MP_BC_LOAD_CONST_SMALL_INT: {
+                mp_int_t num = 0;
+                if ((ip[0] & 0x40) != 0) {
+                    // number is negative
+                    num--;
+                }
+                do {
+                    num = (num << 7) | (*ip & 0x7f);
+                } while ((*ip++ & 0x80) != 0);
+                insn->arg = num;
+                n_push = 1;
+                break;
+            }
+            case MP_BC_LOAD_CONST_STRING:
+            case MP_BC_IMPORT_FROM:
+                insn->arg = tier_decode_qstr(&ip);
+                n_push = 1;
+                break;
+            case MP_BC_LOAD_CONST_OBJ:
+            case MP_BC_MAKE_FUNCTION:
+                insn->arg = tier_decode_ptr(&ip, const_table);
+                n_push = 1;
+                break;
+            case MP_BC_MAKE_FUNCTION_DEFARGS:
+                insn->arg = tier_decode_ptr(&ip, const_table);
+                n_push = -1;
+                break;
+            case MP_BC_LOAD_FAST_N:
+                insn->arg = mp_decode_uint(&ip);
+                n_push = 1;
+                break;
+            case MP_BC_STORE_FAST_N:
+                insn->arg = mp_decode_uint(&ip);
+                n_push = -1;
+                break;
+            case MP_BC_LOAD_NAME:
+            case MP_BC_LOAD_GLOBAL:
+            case MP_BC_LOAD_METHOD:
+                insn->arg = tier_decode_qstr_cached(&ip);
+                n_push = 1;
+                break;
+            case MP_BC_LOAD_ATTR:
+                insn->arg = tier_decode_qstr_cached(&ip);
+                break;
+            case MP_BC_STORE_ATTR:
+                insn->arg = tier_decode_qstr_cached(&ip);
+                n_push = -2;
+                break;
+            case MP_BC_STORE_NAME:
+            case MP_BC_STORE_GLOBAL:
+            case MP_BC_IMPORT_NAME:
+                insn->arg = tier_decode_qstr(&ip);
+                n_push = -1;
+                break;
+            case MP_BC_DELETE_NAME:
+            case MP_BC_DELETE_GLOBAL:
+                insn->arg = tier_decode_qstr(&ip);
+                break;
+            case MP_BC_LOAD_SUBSCR:
+            case MP_BC_POP_TOP:
+            case MP_BC_IMPORT_STAR:
+                n_push = -1;
+                break;
+            case MP_BC_STORE_SUBSCR:
+                n_push = -3;
+                break;
+            case MP_BC_DUP_TOP_TWO:
+                n_push = 2;
+                break;
+            case MP_BC_ROT_TWO:
+            case MP_BC_ROT_THREE:
+            case MP_BC_GET_ITER:
+                break;
+            case MP_BC_JUMP:
+                insn->target = tier_decode_slabel(&ip);
+                insn->ends_block = true;
+                break;
+            case MP_BC_POP_JUMP_IF_TRUE:
+            case MP_BC_POP_JUMP_IF_FALSE:
+                insn->target = tier_decode_slabel(&ip);
+                n_push = -1;
+                insn->n_push_jump = -1;
+                break;
+            case MP_BC_JUMP_IF_TRUE_OR_POP:
+            case MP_BC_JUMP_IF_FALSE_OR_POP:
+                insn->target = tier_decode_slabel(&ip);
+                n_push = -1;
+                break;
+            case MP_BC_GET_ITER_STACK:
+                n_push = MP_OBJ_ITER_BUF_NSLOTS - 1;
+                break;
+            case MP_BC_FOR_ITER: {
+                size_t ulab = ip[0] | (ip[1] << 8);
+                ip += 2;
+                insn->target = ip + ulab;
+                n_push = 1;
+                insn->n_push_jump = -(int)MP_OBJ_ITER_BUF_NSLOTS;
+                break;
+            }
+            case MP_BC_BUILD_TUPLE:
+            case MP_BC_BUILD_LIST:
+            #if MICROPY_PY_BUILTINS_SET
+            case MP_BC_BUILD_SET:
+            #endif
+            #if MICROPY_PY_BUILTINS_SLICE
+            case MP_BC_BUILD_SLICE:
+            #endif
+                insn->arg = mp_decode_uint(&ip);
+                n_push = 1 - (mp_int_t)insn->arg;
+                break;
+            case MP_BC_BUILD_MAP:
+                insn->arg = mp_decode_uint(&ip);
+                n_push = 1;
+                break;
+            case MP_BC_STORE_MAP:
+                n_push = -2;
+                break;
+            case MP_BC_STORE_COMP:
+                insn->arg = mp_decode_uint(&ip);
+                n_push = (!MICROPY_PY_BUILTINS_SET || (insn->arg & 3) == 1) ? -2 : -1;
+                break;
+            case MP_BC_UNPACK_SEQUENCE:
+                insn->arg = mp_decode_uint(&ip);
+                n_push = insn->arg - 1;
+                break;
+            case MP_BC_UNPACK_EX:
+                insn->arg = mp_decode_uint(&ip);
+                n_push = (insn->arg & 0xff) + (insn->arg >> 8);
+                break;
+            case MP_BC_RETURN_VALUE:
+                insn->ends_block = true;
+                n_push = -1;
+                break;
+            case MP_BC_RAISE_VARARGS:
+                // only a plain "raise exc" is supported by the native emitter
+                if (*ip++ != 1) {
+                    return false;
+                }
+                insn->ends_block = true;
+                n_push = -1;
+                break;
+            case MP_BC_CALL_FUNCTION:
+            case MP_BC_CALL_FUNCTION_VAR_KW:
+            case MP_BC_CALL_METHOD:
+            case MP_BC_CALL_METHOD_VAR_KW:
+                insn->arg = mp_decode_uint(&ip);
+                n_push = -(mp_int_t)((insn->arg & 0xff) + 2 * ((insn->arg >> 8) & 0xff));
+                if (op == MP_BC_CALL_FUNCTION_VAR_KW || op == MP_BC_CALL_METHOD_VAR_KW) {
+                    n_push -= 2;
+                }
+                if (op == MP_BC_CALL_METHOD || op == MP_BC_CALL_METHOD_VAR_KW) {
+                    n_push -= 1;
+                }
+                break;
+            case MP_BC_LOAD_FAST_LOAD_FAST:
+                insn->arg = *ip++;
+                n_push = 2;
+                break;
+            case MP_BC_BINARY_OP_SMALL_INT:
+                insn->arg = ip[0];
+                insn->arg2 = (int8_t)ip[1];
+                ip += 2;
+                break;
+            case MP_BC_BINARY_OP_POP_JUMP_IF_TRUE:
+            case MP_BC_BINARY_OP_POP_JUMP_IF_FALSE:
+                insn->arg = *ip++;
+                insn->target = tier_decode_slabel(&ip);
+                n_push = -2;
+                insn->n_push_jump = -2;
+                break;
+            default:
+                // cells, exception handlers, generators and closures
+                return false;
+        }
+    }
+    insn->next = ip;
+    insn->op = op;
+    insn->n_push = n_push;
+    return true;
+}
+
+STATIC void tier_grow_info(tier_t *t, size_t offset) {
+    if (offset >= t->info_alloc) {
+        size_t new_alloc = offset + 32;
+        t->info = m_renew(tier_info_t, t->info, t->info_alloc, new_alloc);
+        memset(t->info + t->info_alloc, 0, (new_alloc - t->info_alloc) * sizeof(tier_info_t));
+        for (size_t i = t->info_alloc; i < new_alloc; i++) {
+            t->info[i].depth = -1;
+        }
+        t->info_alloc = new_alloc;
+    }
+}
+
+// Merge the state flowing into the opcode at the given offset, queueing the
+// opcode to be analysed if that changed what is known about it.
+STATIC bool tier_merge(tier_t *t, size_t offset, uint64_t bound, mp_int_t depth) {
+    if (depth < 0 || depth > TIER_MAX_STACK || offset > 0xffff) {
+        return false;
+    }
+    tier_grow_info(t, offset);
+    tier_info_t *info = &t->info[offset];
+    if (info->depth < 0) {
+        info->depth = depth;
+        info->bound = bound;
+    } else if (info->depth != depth) {
+        return false;
+    } else if ((info->bound & bound) != info->bound) {
+        info->bound &= bound;
+    } else {
+        return true;
+    }
+    if (t->work_len >= t->work_alloc) {
+        t->work = m_renew(size_t, t->work, t->work_alloc, t->work_alloc * 2);
+        t->work_alloc *= 2;
+    }
+    t->work[t->work_len++] = offset;
+    return true;
+}
+
+STATIC bool tier_use_local(tier_t *t, uint64_t bound, mp_uint_t local_num) {
+    if (local_num >= TIER_MAX_LOCALS || !(bound & ((uint64_t)1 << local_num))) {
+        // the native code doesn't check for unbound locals
+        return false;
+    }
+    if (local_num >= t->num_locals) {
+        t->num_locals = local_num + 1;
+    }
+    return true;
+}
+
+// Work out the stack depth and the bound locals at each opcode.
+STATIC bool tier_analyse(tier_t *t) {
+    uint64_t bound = 0;
+    for (size_t i = 0; i < t->n_args; i++) {
+        bound |= (uint64_t)1 << i;
+    }
+    if (!tier_merge(t, 0, bound, 0)) {
+        return false;
+    }
+    while (t->work_len > 0) {
+        size_t offset = t->work[--t->work_len];
+        tier_info_t *info = &t->info[offset];
+        mp_int_t depth = info->depth;
+        bound = info->bound;
+        tier_insn_t insn;
+        if (!tier_decode(t->code + offset, t->const_table, &insn)) {
+            return false;
+        }
+        switch (insn.op) {
+            case MP_BC_LOAD_FAST_N:
+            case MP_BC_LOAD_FAST_MULTI:
+                if (!tier_use_local(t, bound, insn.arg)) {
+                    return false;
+                }
+                break;
+            case MP_BC_LOAD_FAST_LOAD_FAST:
+                if (!tier_use_local(t, bound, insn.arg >> 4) || !tier_use_local(t, bound, insn.arg & 0xf)) {
+                    return false;
+                }
+                break;
+            case MP_BC_STORE_FAST_N:
+            case MP_BC_STORE_FAST_MULTI:
+                if (insn.arg >= TIER_MAX_LOCALS) {
+                    return false;
+                }
+                bound |= (uint64_t)1 << insn.arg;
+                if (insn.arg >= t->num_locals) {
+                    t->num_locals = insn.arg + 1;
+                }
+                break;
+        }
+        size_t next = insn.next - t->code;
+        if (!insn.ends_block) {
+            if (!tier_merge(t, next, bound, depth + insn.n_push)) {
+                return false;
+            }
+            t->info[next].fallthrough = true;
+        }
+        if (insn.target != NULL) {
+            size_t target = insn.target - t->code;
+            if (insn.target < t->code || !tier_merge(t, target, bound, depth + insn.n_push_jump)) {
+                return false;
+            }
+            if (insn.op == MP_BC_FOR_ITER) {
+                t->info[target].for_target = true;
+            } else {
+                t->info[target].jump_target = true;
+            }
+            if (target < next) {
+                // the VM switches to native code at backward jumps
+                t->info[target].osr = true;
+            }
+        }
+    }
+
+    // allocate the labels, and count the entry points
+    for (size_t i = 0; i < t->info_alloc; i++) {
+        tier_info_t *info = &t->info[i];
+        if (info->for_target) {
+            info->for_label = ++t->n_labels;
+        }
+        if (info->jump_target || (info->for_target && info->fallthrough)) {
+            info->label = ++t->n_labels;
+        }
+        if (info->osr) {
+            ++t->n_osr;
+        }
+    }
+    return true;
+}
+
+// Run one pass of the native emitter over the bytecode.
+STATIC void tier_emit_pass(tier_t *t, emit_t *emit, pass_kind_t pass, scope_t *scope, mp_native_tier_osr_t *osr) {
+    const emit_method_table_t *m = &NATIVE_EMITTER(method_table);
+    scope_t child_scope;
+
+    m->start_pass(emit, pass, scope);
+    // the analysis checked that the locals are bound before they are used
+    for (size_t i = 0; i < t->num_locals; i++) {
+        m->set_native_type(emit, MP_EMIT_NATIVE_TYPE_ARG, i, MP_QSTR_object);
+    }
+    // the extra local after those of the bytecode holds where to record the
+    // position in the bytecode
+    size_t ip_local = t->num_locals;
+    NATIVE_EMITTER(tier_entry)(emit, ip_local);
+
+    mp_int_t depth = 0;
+    size_t line = 0;
+    bool set_ip = true;
+    for (size_t offset = 0; offset < t->info_alloc; offset++) {
+        tier_info_t *info = &t->info[offset];
+        if (info->depth < 0) {
+            continue;
+        }
+
+        // the exit of a for loop is reached with the iterator still on the stack
+        if (info->for_label) {
+            if (info->fallthrough) {
+                m->jump(emit, info->label - 1);
+            }
+            m->adjust_stack_size(emit, info->depth + MP_OBJ_ITER_BUF_NSLOTS - depth);
+            m->label_assign(emit, info->for_label - 1);
+            m->for_iter_end(emit);
+            depth = info->depth;
+        }
+        if (info->label) {
+            m->adjust_stack_size(emit, info->depth - depth);
+            m->label_assign(emit, info->label - 1);
+        }
+
+        // the position is recorded for the traceback of an exception, at each
+        // new line and wherever the code is jumped to
+        qstr block_name, source_file;
+        size_t new_line = mp_bytecode_get_source_line(t->bytecode, t->code + offset, &block_name, &source_file);
+        if (set_ip || new_line != line || info->label || info->for_label) {
+            NATIVE_EMITTER(tier_set_ip)(emit, ip_local, t->code + offset);
+            line = new_line;
+        }
+        if (info->osr) {
+            // check for pending exceptions on each pass through a loop, as the VM does
+            NATIVE_EMITTER(tier_loop_hook)(emit);
+        }
+
+        tier_insn_t insn;
+        tier_decode(t->code + offset, t->const_table, &insn);
+        // the VM takes a StopIteration raised at a FOR_ITER to be the end of
+        // the loop, so the position is recorded again after each one
+        set_ip = insn.op == MP_BC_FOR_ITER;
+        mp_uint_t label = 0;
+        if (insn.target != NULL) {
+            tier_info_t *target = &t->info[insn.target - t->code];
+            label = (insn.op == MP_BC_FOR_ITER ? target->for_label : target->label) - 1;
+        }
+
+        switch (insn.op) {
+            case MP_BC_LOAD_CONST_FALSE: m->load_const_tok(emit, MP_TOKEN_KW_FALSE); break;
+            case MP_BC_LOAD_CONST_NONE: m->load_const_tok(emit, MP_TOKEN_KW_NONE); break;
+            case MP_BC_LOAD_CONST_TRUE: m->load_const_tok(emit, MP_TOKEN_KW_TRUE); break;
+            case MP_BC_LOAD_CONST_SMALL_INT:
+            case MP_BC_LOAD_CONST_SMALL_INT_MULTI: m->load_const_small_int(emit, insn.arg); break;
+            case MP_BC_LOAD_CONST_STRING: m->load_const_str(emit, insn.arg); break;
+            case MP_BC_LOAD_CONST_OBJ: m->load_const_obj(emit, (mp_obj_t)insn.arg); break;
+            case MP_BC_LOAD_NULL: m->load_null(emit); break;
+            case MP_BC_LOAD_FAST_N:
+            case MP_BC_LOAD_FAST_MULTI: m->load_id.fast(emit, MP_QSTR_, insn.arg); break;
+            case MP_BC_LOAD_NAME: m->load_id.name(emit, insn.arg); break;
+            case MP_BC_LOAD_GLOBAL: m->load_id.global(emit, insn.arg); break;
+            case MP_BC_LOAD_ATTR: m->load_attr(emit, insn.arg); break;
+            case MP_BC_LOAD_METHOD: m->load_method(emit, insn.arg, false); break;
+            case MP_BC_LOAD_BUILD_CLASS: m->load_build_class(emit); break;
+            case MP_BC_LOAD_SUBSCR: m->load_subscr(emit); break;
+            case MP_BC_STORE_FAST_N:
+            case MP_BC_STORE_FAST_MULTI: m->store_id.fast(emit, MP_QSTR_, insn.arg); break;
+            case MP_BC_STORE_NAME: m->store_id.name(emit, insn.arg); break;
+            case MP_BC_STORE_GLOBAL: m->store_id.global(emit, insn.arg); break;
+            case MP_BC_STORE_ATTR: m->store_attr(emit, insn.arg); break;
+            case MP_BC_STORE_SUBSCR: m->store_subscr(emit); break;
+            case MP_BC_DELETE_NAME: m->delete_id.name(emit, insn.arg); break;
+            case MP_BC_DELETE_GLOBAL: m->delete_id.global(emit, insn.arg); break;
+            case MP_BC_DUP_TOP: m->dup_top(emit); break;
+            case MP_BC_DUP_TOP_TWO: m->dup_top_two(emit); break;
+            case MP_BC_POP_TOP: m->pop_top(emit); break;
+            case MP_BC_ROT_TWO: m->rot_two(emit); break;
+            case MP_BC_ROT_THREE: m->rot_three(emit); break;
+            case MP_BC_JUMP: m->jump(emit, label); break;
+            case MP_BC_POP_JUMP_IF_TRUE: m->pop_jump_if(emit, true, label); break;
+            case MP_BC_POP_JUMP_IF_FALSE: m->pop_jump_if(emit, false, label); break;
+            case MP_BC_JUMP_IF_TRUE_OR_POP: m->jump_if_or_pop(emit, true, label); break;
+            case MP_BC_JUMP_IF_FALSE_OR_POP: m->jump_if_or_pop(emit, false, label); break;
+            case MP_BC_GET_ITER: m->get_iter(emit, false); break;
+            case MP_BC_GET_ITER_STACK: m->get_iter(emit, true); break;
+            case MP_BC_FOR_ITER: m->for_iter(emit, label); break;
+            case MP_BC_UNARY_OP_MULTI: m->unary_op(emit, insn.arg); break;
+            case MP_BC_BINARY_OP_MULTI: m->binary_op(emit, insn.arg); break;
+            case MP_BC_BUILD_TUPLE: m->build_tuple(emit, insn.arg); break;
+            case MP_BC_BUILD_LIST: m->build_list(emit, insn.arg); break;
+            case MP_BC_BUILD_MAP: m->build_map(emit, insn.arg); break;
+            case MP_BC_STORE_MAP: m->store_map(emit); break;
+            #if MICROPY_PY_BUILTINS_SET
+            case MP_BC_BUILD_SET: m->build_set(emit, insn.arg); break;
+            #endif
+            #if MICROPY_PY_BUILTINS_SLICE
+            case MP_BC_BUILD_SLICE: m->build_slice(emit, insn.arg); break;
+            #endif
+            case MP_BC_STORE_COMP: {
+                // the emitter takes the position of the collection after the
+                // item (or key and value) are popped
+                scope_kind_t kind = SCOPE_LIST_COMP;
+                mp_uint_t n = 0;
+                if (!MICROPY_PY_BUILTINS_SET || (insn.arg & 3) == 1) {
+                    kind = SCOPE_DICT_COMP;
+                    n = 1;
+                } else if ((insn.arg & 3) == 2) {
+                    kind = SCOPE_SET_COMP;
+                }
+                m->store_comp(emit, kind, (insn.arg >> 2) - n);
+                break;
+            }
+            case MP_BC_UNPACK_SEQUENCE: m->unpack_sequence(emit, insn.arg); break;
+            case MP_BC_UNPACK_EX: m->unpack_ex(emit, insn.arg & 0xff, insn.arg >> 8); break;
+            case MP_BC_RETURN_VALUE: m->return_value(emit); break;
+            case MP_BC_RAISE_VARARGS: m->raise_varargs(emit, 1); break;
+            case MP_BC_MAKE_FUNCTION:
+            case MP_BC_MAKE_FUNCTION_DEFARGS:
+                // the emitter only needs the raw code of the child scope
+                child_scope.raw_code = (mp_raw_code_t*)insn.arg;
+                m->make_function(emit, &child_scope, insn.op == MP_BC_MAKE_FUNCTION_DEFARGS, 0);
+                break;
+            case MP_BC_CALL_FUNCTION: m->call_function(emit, insn.arg & 0xff, (insn.arg >> 8) & 0xff, 0); break;
+            case MP_BC_CALL_FUNCTION_VAR_KW:
+                m->call_function(emit, insn.arg & 0xff, (insn.arg >> 8) & 0xff, MP_EMIT_STAR_FLAG_SINGLE | MP_EMIT_STAR_FLAG_DOUBLE);
+                break;
+            case MP_BC_CALL_METHOD: m->call_method(emit, insn.arg & 0xff, (insn.arg >> 8) & 0xff, 0); break;
+            case MP_BC_CALL_METHOD_VAR_KW:
+                m->call_method(emit, insn.arg & 0xff, (insn.arg >> 8) & 0xff, MP_EMIT_STAR_FLAG_SINGLE | MP_EMIT_STAR_FLAG_DOUBLE);
+                break;
+            case MP_BC_IMPORT_NAME: m->import_name(emit, insn.arg); break;
+            case MP_BC_IMPORT_FROM: m->import_from(emit, insn.arg); break;
+            case MP_BC_IMPORT_STAR: m->import_star(emit); break;
+            case MP_BC_LOAD_FAST_LOAD_FAST:
+                m->load_id.fast(emit, MP_QSTR_, insn.arg >> 4);
+                m->load_id.fast(emit, MP_QSTR_, insn.arg & 0xf);
+                break;
+            case MP_BC_BINARY_OP_SMALL_INT:
+                m->load_const_small_int(emit, (mp_int_t)insn.arg2);
+                m->binary_op(emit, insn.arg);
+                break;
+            case MP_BC_BINARY_OP_POP_JUMP_IF_TRUE:
+            case MP_BC_BINARY_OP_POP_JUMP_IF_FALSE:
+                m->binary_op(emit, insn.arg);
+                m->pop_jump_if(emit, insn.op == MP_BC_BINARY_OP_POP_JUMP_IF_TRUE, label);
+                break;
+        }
+        depth = info->depth + insn.n_push;
+    }
+    m->adjust_stack_size(emit, -depth);
+
+    // the entry points from the bytecode go after the code of the function
+    for (size_t offset = 0; offset < t->info_alloc; offset++) {
+        tier_info_t *info = &t->info[offset];
+        if (info->osr) {
+            mp_uint_t code_offset = NATIVE_EMITTER(osr_entry)(emit, info->label - 1, t->n_state, info->depth, ip_local);
+            osr->bc_offset = t->code + offset - t->bytecode;
+            osr->n_stack = info->depth;
+            osr->code_offset = code_offset;
+            ++osr;
+        }
+    }
+
+    m->end_pass(emit);
+}
+
+STATIC mp_native_tier_t *tier_new(size_t n_osr) {
+    mp_native_tier_t *tier = m_new_obj_var(mp_native_tier_t, mp_native_tier_osr_t, n_osr);
+    tier->fun_data = NULL;
+    tier->const_table = NULL;
+    tier->n_osr = 0;
+    return tier;
+}
+
+// Translate the bytecode, returning a new entry for it: with NULL fun_data
+// if the bytecode can't be translated.
+STATIC mp_native_tier_t *tier_translate(tier_t *t) {
+    const byte *ip = t->bytecode;
+    t->n_state = mp_decode_uint(&ip);
+    ip = mp_decode_uint_skip(ip); // skip n_exc_stack
+    scope_t scope;
+    memset(&scope, 0, sizeof(scope));
+    scope.kind = SCOPE_FUNCTION;
+    scope.scope_flags = *ip++;
+    scope.num_pos_args = *ip++;
+    scope.num_kwonly_args = *ip++;
+    scope.num_def_pos_args = *ip++;
+    if (scope.scope_flags & MP_SCOPE_FLAG_GENERATOR) {
+        return tier_new(0);
+    }
+
+    // skip the code info, and there must not be any cells
+    ip += mp_decode_uint_value(ip);
+    if (*ip++ != 255) {
+        return tier_new(0);
+    }
+    t->code = ip;
+    qstr block_name, source_file;
+    mp_bytecode_get_source_line(t->bytecode, t->code, &block_name, &source_file);
+    scope.simple_name = block_name;
+    scope.source_file = source_file;
+
+    t->n_args = scope.num_pos_args + scope.num_kwonly_args;
+    if (scope.scope_flags & MP_SCOPE_FLAG_VARARGS) {
+        t->n_args += 1;
+    }
+    if (scope.scope_flags & MP_SCOPE_FLAG_VARKEYWORDS) {
+        t->n_args += 1;
+    }
+    t->num_locals = t->n_args;
+    if (t->n_args > TIER_MAX_LOCALS || !tier_analyse(t)) {
+        DEBUG_printf("native tier: can't translate %s\n", qstr_str(scope.simple_name));
+        return tier_new(0);
+    }
+    scope.num_locals = t->num_locals + 1;
+    mp_native_tier_t *tier = tier_new(t->n_osr);
+
+    // the native code gets the names of the arguments from the scope
+    size_t n_names = scope.num_pos_args + scope.num_kwonly_args;
+    id_info_t id_info[n_names + 1];
+    for (size_t i = 0; i < n_names; i++) {
+        id_info[i].kind = ID_INFO_KIND_LOCAL;
+        id_info[i].flags = ID_FLAG_IS_PARAM;
+        id_info[i].local_num = i;
+        id_info[i].qst = MP_OBJ_QSTR_VALUE(t->const_table[i]);
+    }
+    scope.id_info = id_info;
+    scope.id_info_len = n_names;
+    scope.raw_code = mp_emit_glue_new_raw_code();
+
+    // the translated code has no exception handlers or yields, so the emitter
+    // never needs any labels of its own beyond those from the bytecode
+    mp_obj_t error = MP_OBJ_NULL;
+    uint label_slot = t->n_labels;
+    emit_t *emit = NATIVE_EMITTER(new)(&error, &label_slot, t->n_labels);
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        NATIVE_EMITTER(method_table).set_native_type(emit, MP_EMIT_NATIVE_TYPE_ENABLE, false, 0);
+        tier_emit_pass(t, emit, MP_PASS_STACK_SIZE, &scope, tier->osr);
+        if (error == MP_OBJ_NULL) {
+            tier_emit_pass(t, emit, MP_PASS_CODE_SIZE, &scope, tier->osr);
+        }
+        if (error == MP_OBJ_NULL) {
+            tier_emit_pass(t, emit, MP_PASS_EMIT, &scope, tier->osr);
+        }
+        nlr_pop();
+    } else {
+        error = MP_OBJ_FROM_PTR(nlr.ret_val);
+    }
+    NATIVE_EMITTER(free)(emit);
+
+    if (error != MP_OBJ_NULL || scope.raw_code->kind != MP_CODE_NATIVE_PY) {
+        DEBUG_printf("native tier: error translating %s\n", qstr_str(scope.simple_name));
+        return tier;
+    }
+    DEBUG_printf("native tier: translated %s\n", qstr_str(scope.simple_name));
+    tier->fun_data = scope.raw_code->data.u_native.fun_data;
+    tier->const_table = scope.raw_code->data.u_native.const_table;
+    tier->n_osr = t->n_osr;
+    return tier;
+}
+
+// Translate the given bytecode to native code.
+STATIC mp_native_tier_t *tier_get(const byte *bytecode, const mp_uint_t *const_table) {
+    tier_t t;
+    memset(&t, 0, sizeof(t));
+    t.bytecode = bytecode;
+    t.const_table = const_table;
+    t.work_alloc = 16;
+    t.work = m_new(size_t, t.work_alloc);
+    mp_native_tier_t *tier = tier_translate(&t);
+    m_del(size_t, t.work, t.work_alloc);
+    m_del(tier_info_t, t.info, t.info_alloc);
+    return tier;
+}
+
+// Set fun_native of the given function, to a native function object sharing
+// its defaults and globals, or to itself if it can't be translated, and keep
+// the entry points for backward jumps in native_tier.  It is left as NULL
+// while the heap is locked, to try again later.
+STATIC void tier_make_fun(mp_obj_fun_bc_t *self) {
+    #if MICROPY_ENABLE_GC
+    if (gc_is_locked()) {
+        return;
+    }
+    #endif
+    mp_native_tier_t *tier = tier_get(self->bytecode, self->const_table);
+    if (tier->fun_data == NULL) {
+        self->fun_native = self;
+        return;
+    }
+    const byte *ip = mp_decode_uint_skip(mp_decode_uint_skip(self->bytecode));
+    size_t scope_flags = ip[0];
+    size_t n_def_pos_args = ip[3];
+    mp_obj_t def_args = MP_OBJ_NULL;
+    mp_obj_t def_kw_args = MP_OBJ_NULL;
+    if (n_def_pos_args > 0) {
+        def_args = mp_obj_new_tuple(n_def_pos_args, self->extra_args);
+    }
+    if (scope_flags & MP_SCOPE_FLAG_DEFKWARGS) {
+        def_kw_args = self->extra_args[n_def_pos_args];
+    }
+    mp_obj_fun_bc_t *fun = MP_OBJ_TO_PTR(mp_obj_new_fun_native(def_args, def_kw_args, tier->fun_data, tier->const_table));
+    fun->globals = self->globals;
+    fun->fun_native = fun;
+    self->fun_native = fun;
+    if (tier->n_osr != 0) {
+        self->native_tier = tier;
+    }
+}
+
+mp_obj_t mp_native_tier_call(mp_obj_fun_bc_t *self, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    if (self->fun_native == NULL) {
+        tier_make_fun(self);
+    }
+    mp_obj_fun_bc_t *fun = self->fun_native;
+    if (fun == NULL || fun == self) {
+        return MP_OBJ_NULL;
+    }
+
+    // leave a wrong number of positional args to the bytecode, because the
+    // error message has the name of the function
+    const byte *ip = mp_decode_uint_skip(mp_decode_uint_skip(self->bytecode));
+    size_t scope_flags = ip[0];
+    size_t n_pos_args = ip[1];
+    size_t n_def_pos_args = ip[3];
+    if (n_args > n_pos_args) {
+        if ((scope_flags & MP_SCOPE_FLAG_VARARGS) == 0) {
+            return MP_OBJ_NULL;
+        }
+    } else if (n_kw == 0 && (scope_flags & MP_SCOPE_FLAG_DEFKWARGS) == 0
+        && n_args < n_pos_args - n_def_pos_args) {
+        return MP_OBJ_NULL;
+    }
+
+    // native code uses the current globals, so they must be switched as for
+    // bytecode, and it records its position in the bytecode in cur_ip so that
+    // an exception gets the same traceback as from the bytecode
+    mp_call_fun_t call = MICROPY_MAKE_POINTER_CALLABLE((void*)fun->bytecode);
+    mp_obj_dict_t *old_globals = mp_globals_get();
+    const byte *volatile cur_ip = NULL;
+    MP_STATE_THREAD(native_tier_ip) = &cur_ip;
+    mp_globals_set(self->globals);
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t ret = call(MP_OBJ_FROM_PTR(fun), n_args, n_kw, args);
+        nlr_pop();
+        mp_globals_set(old_globals);
+        return ret;
+    } else {
+        mp_globals_set(old_globals);
+        // no position is recorded if the arguments are wrong, and then the
+        // bytecode doesn't add to the traceback either
+        if (cur_ip != NULL && nlr.ret_val != &mp_const_GeneratorExit_obj && nlr.ret_val != &mp_const_MemoryError_obj) {
+            qstr block_name;
+            qstr source_file;
+            size_t source_line = mp_bytecode_get_source_line(self->bytecode, cur_ip, &block_name, &source_file);
+            mp_obj_exception_add_traceback(MP_OBJ_FROM_PTR(nlr.ret_val), source_file, source_line, block_name);
+        }
+        nlr_jump(nlr.ret_val);
+    }
+}
+
+bool mp_native_tier_osr(mp_code_state_t *code_state) {
+    mp_obj_fun_bc_t *self = code_state->fun_bc;
+    if (self->fun_native == NULL) {
+        tier_make_fun(self);
+    }
+    mp_native_tier_t *tier = self->native_tier;
+    if (tier == NULL) {
+        return false;
+    }
+    size_t bc_offset = code_state->ip - self->bytecode;
+    size_t n_stack = code_state->sp - code_state->state + 1;
+    for (size_t i = 0; i < tier->n_osr; i++) {
+        const mp_native_tier_osr_t *osr = &tier->osr[i];
+        if (osr->bc_offset == bc_offset && osr->n_stack == n_stack) {
+            // the native code records its position in the ip of the frame, for
+            // the VM to add to the traceback of an exception
+            typedef mp_obj_t (*osr_fun_t)(mp_obj_t *state, const byte **ip);
+            osr_fun_t f = MICROPY_MAKE_POINTER_CALLABLE((void*)((const byte*)tier->fun_data + osr->code_offset));
+            code_state->sp = &code_state->state[0];
+            *code_state->sp = f(code_state->state, &code_state->ip);
+            return true;
+        }
+    }
+    // don't look for an entry point in this function again
+    self->native_tier = NULL;
+    return false;
+}
+
+const byte *volatile *mp_native_tier_ip(void) {
+    return MP_STATE_THREAD(native_tier_ip);
+}
+
+// A variant of the pending exception check of the VM
+void mp_native_tier_loop_hook(void) {
+    MICROPY_VM_HOOK_LOOP
+
+    mp_handle_pending();
+
+    #if MICROPY_PY_THREAD_GIL
+    #if MICROPY_PY_THREAD_GIL_VM_DIVISOR
+    if (--MP_STATE_VM(native_tier_gil_divisor) == 0) {
+        MP_STATE_VM(native_tier_gil_divisor) = MICROPY_PY_THREAD_GIL_VM_DIVISOR;
+    #else
+    {
+    #endif
+        #if MICROPY_ENABLE_SCHEDULER
+        // can only switch threads if the scheduler is unlocked
+        if (MP_STATE_VM(sched_state) == MP_SCHED_IDLE)
+        #endif
+        {
+            MP_THREAD_GIL_EXIT();
+            MP_THREAD_GIL_ENTER();
+        }
+    }
+    #endif
+}
+
+#endif // MICROPY_EMIT_NATIVE_TIERING
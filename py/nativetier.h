@@ -0,0 +1,71 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef MICROPY_INCLUDED_PY_NATIVETIER_H
+#define MICROPY_INCLUDED_PY_NATIVETIER_H
+
+#include "py/bc.h"
+#include "py/objfun.h"
+
+#if MICROPY_EMIT_NATIVE_TIERING
+
+// An entry point into the native code in the middle of a function, at the
+// target of a backward jump in the bytecode.
+typedef struct _mp_native_tier_osr_t {
+    uint16_t bc_offset;     // offset of the jump target in the bytecode
+    uint16_t n_stack;       // number of values on the stack at the jump target
+    uint32_t code_offset;   // offset of the entry point in the native code
+} mp_native_tier_osr_t;
+
+// The native code translated from the bytecode of a function.
+typedef struct _mp_native_tier_t {
+    const void *fun_data;   // NULL if the bytecode can't be translated
+    const mp_uint_t *const_table;
+    size_t n_osr;
+    mp_native_tier_osr_t osr[];
+} mp_native_tier_t;
+
+// Whether a call to, or backward jump in, the given function should go to its
+// native code version.  Counts towards making the function hot.
+#define MP_NATIVE_TIER_IS_HOT(fun) ((fun)->fun_native != (fun) && MP_STATE_VM(native_tier_threshold) != 0 \
+    && ((fun)->fun_native != NULL || ++(fun)->hot_count >= MP_STATE_VM(native_tier_threshold)))
+
+// Call the native code version of the given function, translating it first
+// if needed.  Returns MP_OBJ_NULL if it can't, and the bytecode must be run.
+mp_obj_t mp_native_tier_call(mp_obj_fun_bc_t *self, size_t n_args, size_t n_kw, const mp_obj_t *args);
+
+// Continue running the given bytecode frame as native code, from its ip which
+// must be the target of a backward jump.  Returns false if it can't, else the
+// return value of the function is left in *code_state->sp.
+bool mp_native_tier_osr(mp_code_state_t *code_state);
+
+// Called by the native code: at its start, to get where to record its position
+// in the bytecode, and at the target of each backward jump.
+const byte *volatile *mp_native_tier_ip(void);
+void mp_native_tier_loop_hook(void);
+
+#endif // MICROPY_EMIT_NATIVE_TIERING
+
+#endif // MICROPY_INCLUDED_PY_NATIVETIER_H
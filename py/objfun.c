@@ -33,6 +33,7 @@
 #include "py/runtime.h"
 #include "py/bc.h"
 #include "py/stackctrl.h"
+#include "py/nativetier.h"
 
 #if MICROPY_DEBUG_VERBOSE // print debugging info
 #define DEBUG_PRINT (1)
@@ -225,6 +226,16 @@ mp_code_state_t *mp_obj_fun_bc_prepare_codestate(mp_obj_t self_in, size_t n_args
 
     return code_state;
 }
+
+void mp_obj_fun_bc_free_codestate(mp_code_state_t *code_state) {
+    // frames are freed as soon as they return, so that the next call can
+    // reuse the memory rather than leaving it all for the GC to collect
+    const byte *bytecode = code_state->fun_bc->bytecode;
+    size_t n_state = mp_decode_uint_value(bytecode);
+    size_t n_exc_stack = mp_decode_uint_value(mp_decode_uint_skip(bytecode));
+    size_t state_size = n_state * sizeof(mp_obj_t) + n_exc_stack * sizeof(mp_exc_stack_t);
+    m_del_var(mp_code_state_t, byte, state_size, code_state);
+}
 #endif
 
 STATIC mp_obj_t fun_bc_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args) {
@@ -238,6 +249,16 @@ STATIC mp_obj_t fun_bc_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const
     mp_obj_fun_bc_t *self = MP_OBJ_TO_PTR(self_in);
     DEBUG_printf("Func n_def_args: %d\n", self->n_def_args);
 
+    #if MICROPY_EMIT_NATIVE_TIERING
+    // once the function is hot call its native code version instead, if it has one
+    if (MP_NATIVE_TIER_IS_HOT(self)) {
+        mp_obj_t ret = mp_native_tier_call(self, n_args, n_kw, args);
+        if (ret != MP_OBJ_NULL) {
+            return ret;
+        }
+    }
+    #endif
+
     // bytecode prelude: state size and exception stack size
     size_t n_state = mp_decode_uint_value(self->bytecode);
     size_t n_exc_stack = mp_decode_uint_value(mp_decode_uint_skip(self->bytecode));
@@ -264,7 +285,18 @@ STATIC mp_obj_t fun_bc_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const
     // execute the byte code with the correct globals context
     code_state->old_globals = mp_globals_get();
     mp_globals_set(self->globals);
+    #if MICROPY_TRACK_CODE_STATE
+    mp_code_state_t *prev_code_state = MP_STATE_THREAD(current_code_state);
+    #if !MICROPY_STACKLESS
+    // with stackless the VM uses prev to return, so the chain stops here
+    code_state->prev = prev_code_state;
+    #endif
+    MP_STATE_THREAD(current_code_state) = code_state;
+    #endif
     mp_vm_return_kind_t vm_return_kind = mp_execute_bytecode(code_state, MP_OBJ_NULL);
+    #if MICROPY_TRACK_CODE_STATE
+    MP_STATE_THREAD(current_code_state) = prev_code_state;
+    #endif
     mp_globals_set(code_state->old_globals);
 
 #if VM_DETECT_STACK_OVERFLOW
@@ -358,6 +390,11 @@ mp_obj_t mp_obj_new_fun_bc(mp_obj_t def_args_in, mp_obj_t def_kw_args, const byt
     o->globals = mp_globals_get();
     o->bytecode = code;
     o->const_table = const_table;
+    #if MICROPY_EMIT_NATIVE_TIERING
+    o->hot_count = 0;
+    o->fun_native = NULL;
+    o->native_tier = NULL;
+    #endif
     if (def_args != NULL) {
         memcpy(o->extra_args, def_args->items, n_def_args * sizeof(mp_obj_t));
     }
@@ -33,6 +33,15 @@ typedef struct _mp_obj_fun_bc_t {
     mp_obj_dict_t *globals;         // the context within which this function was defined
     const byte *bytecode;           // bytecode for the function
     const mp_uint_t *const_table;   // constant table
+    #if MICROPY_EMIT_NATIVE_TIERING
+    mp_uint_t hot_count;            // calls and backward jumps so far
+    // native code version of this function, once it is hot: NULL if not
+    // tried yet, or this function itself if it can't be translated
+    struct _mp_obj_fun_bc_t *fun_native;
+    // entry points into the native code from backward jumps: NULL if there
+    // are none, or if switching to the native code at a jump has failed
+    struct _mp_native_tier_t *native_tier;
+    #endif
     // the following extra_args array is allocated space to take (in order):
     //  - values of positional default args (if any)
     //  - a single slot for default kw args dict (if it has them)
@@ -75,9 +75,54 @@ const mp_obj_type_t mp_type_gen_wrap = {
     .unary_op = mp_generic_unary_op,
 };
 
-mp_obj_t mp_obj_new_gen_wrap(mp_obj_t fun) {
+#if MICROPY_EMIT_NATIVE
+
+// The code of a native generator starts with two words: the offset of its
+// prelude, and the id of the point to start running from.  The machine code
+// follows them, and takes the code_state and a value to throw as arguments.
+typedef uintptr_t (*mp_fun_native_gen_t)(mp_code_state_t *code_state, mp_obj_t throw_value);
+
+STATIC mp_obj_t native_gen_wrap_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_obj_gen_wrap_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_obj_fun_bc_t *self_fun = (mp_obj_fun_bc_t*)self->fun;
+
+    // the native code has no exception stack, only the state
+    size_t prelude_offset = ((uintptr_t*)self_fun->bytecode)[0];
+    size_t n_state = mp_decode_uint_value(self_fun->bytecode + prelude_offset);
+
+    mp_obj_gen_instance_t *o = m_new_obj_var(mp_obj_gen_instance_t, byte, n_state * sizeof(mp_obj_t));
+    o->base.type = &mp_type_gen_instance;
+
+    o->globals = self_fun->globals;
+    o->code_state.fun_bc = self_fun;
+    o->code_state.ip = (const byte*)prelude_offset;
+    mp_setup_code_state(&o->code_state, n_args, n_kw, args);
+
+    // a NULL exc_sp marks the generator as native, and ip holds the resume point
+    o->code_state.exc_sp = NULL;
+    o->code_state.ip = (const byte*)((uintptr_t*)self_fun->bytecode)[1];
+    return MP_OBJ_FROM_PTR(o);
+}
+
+STATIC const mp_obj_type_t mp_type_native_gen_wrap = {
+    { &mp_type_type },
+    .name = MP_QSTR_generator,
+    .call = native_gen_wrap_call,
+    .unary_op = mp_generic_unary_op,
+};
+
+#endif
+
+mp_obj_t mp_obj_new_gen_wrap(mp_obj_t fun, bool is_native) {
     mp_obj_gen_wrap_t *o = m_new_obj(mp_obj_gen_wrap_t);
     o->base.type = &mp_type_gen_wrap;
+    #if MICROPY_EMIT_NATIVE
+    if (is_native) {
+        o->base.type = &mp_type_native_gen_wrap;
+    }
+    #else
+    (void)is_native;
+    #endif
     o->fun = MP_OBJ_TO_PTR(fun);
     return MP_OBJ_FROM_PTR(o);
 }
@@ -108,7 +153,34 @@ mp_vm_return_kind_t mp_obj_gen_resume(mp_obj_t self_in, mp_obj_t send_value, mp_
     }
     mp_obj_dict_t *old_globals = mp_globals_get();
     mp_globals_set(self->globals);
-    mp_vm_return_kind_t ret_kind = mp_execute_bytecode(&self->code_state, throw_value);
+    #if MICROPY_TRACK_CODE_STATE
+    mp_code_state_t *prev_code_state = MP_STATE_THREAD(current_code_state);
+    #if MICROPY_EMIT_NATIVE
+    // the ip of a native generator isn't a bytecode position, so it's left to
+    // the code resuming it to be the current one
+    if (self->code_state.exc_sp != NULL)
+    #endif
+    {
+        #if !MICROPY_STACKLESS
+        self->code_state.prev = prev_code_state;
+        #endif
+        MP_STATE_THREAD(current_code_state) = &self->code_state;
+    }
+    #endif
+    mp_vm_return_kind_t ret_kind;
+    #if MICROPY_EMIT_NATIVE
+    if (self->code_state.exc_sp == NULL) {
+        // native generator, so call its machine code directly
+        mp_fun_native_gen_t fun = MICROPY_MAKE_POINTER_CALLABLE((void*)(self->code_state.fun_bc->bytecode + 2 * sizeof(uintptr_t)));
+        ret_kind = fun(&self->code_state, throw_value);
+    } else
+    #endif
+    {
+        ret_kind = mp_execute_bytecode(&self->code_state, throw_value);
+    }
+    #if MICROPY_TRACK_CODE_STATE
+    MP_STATE_THREAD(current_code_state) = prev_code_state;
+    #endif
     mp_globals_set(old_globals);
 
     switch (ret_kind) {
@@ -131,7 +203,13 @@ mp_vm_return_kind_t mp_obj_gen_resume(mp_obj_t self_in, mp_obj_t send_value, mp_
             break;
 
         case MP_VM_RETURN_EXCEPTION: {
-            size_t n_state = mp_decode_uint_value(self->code_state.fun_bc->bytecode);
+            const byte *bc = self->code_state.fun_bc->bytecode;
+            #if MICROPY_EMIT_NATIVE
+            if (self->code_state.exc_sp == NULL) {
+                bc += ((uintptr_t*)bc)[0];
+            }
+            #endif
+            size_t n_state = mp_decode_uint_value(bc);
             self->code_state.ip = 0;
             *ret_val = self->code_state.state[n_state - 1];
             break;
@@ -105,13 +105,25 @@ struct class_lookup_data {
     size_t meth_offset;
     mp_obj_t *dest;
     bool is_type;
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+    // filled in by the search for the class lookup cache
+    const mp_obj_type_t *found_type;
+    mp_obj_t found_value;
+    bool seen_native;
+    #endif
 };
 
-STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_type_t *type) {
+STATIC void mp_obj_class_lookup_search(struct class_lookup_data  *lookup, const mp_obj_type_t *type) {
     assert(lookup->dest[0] == MP_OBJ_NULL);
     assert(lookup->dest[1] == MP_OBJ_NULL);
     for (;;) {
         DEBUG_printf("mp_obj_class_lookup: Looking up %s in %s\n", qstr_str(lookup->attr), qstr_str(type->name));
+        #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+        // native types can find attributes dynamically, through load_attr
+        if (mp_obj_is_native_type(type)) {
+            lookup->seen_native = true;
+        }
+        #endif
         // Optimize special method lookup for native types
         // This avoids extra method_name => slot lookup. On the other hand,
         // this should not be applied to class types, as will result in extra
@@ -131,6 +143,10 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_
             mp_map_t *locals_map = &type->locals_dict->map;
             mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(lookup->attr), MP_MAP_LOOKUP);
             if (elem != NULL) {
+                #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+                lookup->found_type = type;
+                lookup->found_value = elem->value;
+                #endif
                 if (lookup->is_type) {
                     // If we look up a class method, we need to return original type for which we
                     // do a lookup, not a (base) type in which we found the class method.
@@ -183,7 +199,7 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_
                     // Not a "real" type
                     continue;
                 }
-                mp_obj_class_lookup(lookup, bt);
+                mp_obj_class_lookup_search(lookup, bt);
                 if (lookup->dest[0] != MP_OBJ_NULL) {
                     return;
                 }
@@ -202,6 +218,139 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_
     }
 }
 
+#if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_CACHE || MICROPY_PY_SLOTS
+// Called when a class is created, or an attribute of a class is changed, to
+// invalidate the lookups which have been cached.
+void mp_obj_class_changed(void) {
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+    memset(MP_STATE_VM(class_lookup_cache), 0, sizeof(MP_STATE_VM(class_lookup_cache)));
+    #endif
+    #if MICROPY_OPT_INLINE_CACHE || MICROPY_PY_SLOTS
+    MP_STATE_VM(class_epoch) += 1;
+    #endif
+}
+#endif
+
+#if MICROPY_OPT_CLASS_LOOKUP_CACHE
+
+#if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
+#error MICROPY_OPT_CLASS_LOOKUP_CACHE requires the GIL if MICROPY_PY_THREAD is enabled
+#endif
+
+STATIC void mp_obj_class_lookup(struct class_lookup_data *lookup, const mp_obj_type_t *type) {
+    if (!mp_obj_is_instance_type(type)) {
+        mp_obj_class_lookup_search(lookup, type);
+        return;
+    }
+
+    mp_class_lookup_cache_entry_t *entry = &MP_STATE_VM(class_lookup_cache)
+        [(((uintptr_t)type >> 3) ^ lookup->attr) % MICROPY_OPT_CLASS_LOOKUP_CACHE];
+    if (entry->type == type && entry->attr == lookup->attr) {
+        // The cache is cleared whenever the dict of a class changes, so the
+        // member is still in the dict it was found in, which keeps it alive.
+        // Only lookups that didn't go through a native type are cached, so
+        // the member always applies to the object itself, as in the search.
+        if (entry->value != MP_OBJ_NULL) {
+            if (lookup->is_type) {
+                mp_convert_member_lookup(MP_OBJ_NULL, (const mp_obj_type_t*)lookup->obj, entry->value, lookup->dest);
+            } else {
+                mp_convert_member_lookup(MP_OBJ_FROM_PTR(lookup->obj), entry->found_type, entry->value, lookup->dest);
+            }
+        }
+        return;
+    }
+
+    lookup->found_type = NULL;
+    lookup->found_value = MP_OBJ_NULL;
+    lookup->seen_native = false;
+    mp_obj_class_lookup_search(lookup, type);
+    if (!lookup->seen_native) {
+        entry->type = type;
+        entry->attr = lookup->attr;
+        entry->found_type = lookup->found_type;
+        entry->value = lookup->found_value;
+    }
+}
+
+#else
+
+#define mp_obj_class_lookup mp_obj_class_lookup_search
+
+#endif // MICROPY_OPT_CLASS_LOOKUP_CACHE
+
+#if MICROPY_PY_SLOTS
+
+// A class member, made for each name in __slots__, which gives access to
+// that slot of the instances
+typedef struct _mp_obj_member_t {
+    mp_obj_base_t base;
+    qstr name;
+    size_t index;
+} mp_obj_member_t;
+
+STATIC const mp_obj_type_t mp_type_member = {
+    { &mp_type_type },
+    .name = MP_QSTR_member_descriptor,
+};
+
+// Returns the slot of the instance that the given class member refers to, or
+// NULL if the member is not a slot of the instance's class.
+STATIC mp_obj_t *instance_get_slot(mp_obj_instance_t *self, mp_obj_t member) {
+    if (member == MP_OBJ_NULL || !MP_OBJ_IS_TYPE(member, &mp_type_member)) {
+        return NULL;
+    }
+    const mp_obj_member_t *m = MP_OBJ_TO_PTR(member);
+    const mp_obj_slots_t *slots = MP_OBJ_CLASS_SLOTS(self->base.type);
+    // the member may have been copied to another class
+    if (slots == NULL || m->index >= slots->n_subobj || slots->names[m->index] != m->name) {
+        return NULL;
+    }
+    return &self->subobj[m->index];
+}
+
+size_t mp_obj_class_find_slot(const mp_obj_type_t *type, qstr attr) {
+    mp_obj_slots_t *slots = MP_OBJ_CLASS_SLOTS(type);
+    size_t epoch = MP_STATE_VM(class_epoch);
+    if (slots->epoch != epoch) {
+        // a class attribute may now hide a slot, so check that each name
+        // still finds the member for its slot, and only then record the
+        // result together with the epoch it was checked at
+        bool direct = true;
+        for (size_t i = 0; i < slots->n_subobj; ++i) {
+            if (slots->names[i] == MP_QSTR_NULL) {
+                continue;
+            }
+            mp_obj_t member[2] = {MP_OBJ_NULL};
+            struct class_lookup_data lookup = {
+                .obj = NULL,
+                .attr = slots->names[i],
+                .meth_offset = 0,
+                .dest = member,
+                .is_type = false,
+            };
+            mp_obj_class_lookup(&lookup, type);
+            const mp_obj_member_t *m = MP_OBJ_TO_PTR(member[0]);
+            if (member[0] == MP_OBJ_NULL || !MP_OBJ_IS_TYPE(member[0], &mp_type_member)
+                || m->name != slots->names[i] || m->index != i) {
+                direct = false;
+                break;
+            }
+        }
+        slots->direct = direct;
+        slots->epoch = epoch;
+    }
+    if (slots->direct) {
+        for (size_t i = 0; i < slots->n_subobj; ++i) {
+            if (slots->names[i] == attr) {
+                return i;
+            }
+        }
+    }
+    return (size_t)-1;
+}
+
+#endif // MICROPY_PY_SLOTS
+
 STATIC void instance_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
     mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
     qstr meth = (kind == PRINT_STR) ? MP_QSTR___str__ : MP_QSTR___repr__;
@@ -244,6 +393,16 @@ STATIC void instance_print(const mp_print_t *print, mp_obj_t self_in, mp_print_k
     mp_printf(print, "<%s object at %p>", mp_obj_get_type_str(self_in), self);
 }
 
+size_t mp_obj_instance_num_subobj(const mp_obj_type_t *type) {
+    #if MICROPY_PY_SLOTS
+    if (MP_OBJ_CLASS_SLOTS(type) != NULL) {
+        return MP_OBJ_CLASS_SLOTS(type)->n_subobj;
+    }
+    #endif
+    const mp_obj_type_t *native_base;
+    return instance_count_native_bases(type, &native_base);
+}
+
 mp_obj_t mp_obj_instance_make_new(const mp_obj_type_t *self, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     assert(mp_obj_is_instance_type(self));
 
@@ -251,7 +410,14 @@ mp_obj_t mp_obj_instance_make_new(const mp_obj_type_t *self, size_t n_args, size
     size_t num_native_bases = instance_count_native_bases(self, &native_base);
     assert(num_native_bases < 2);
 
-    mp_obj_instance_t *o = MP_OBJ_TO_PTR(mp_obj_new_instance(self, num_native_bases));
+    size_t num_subobj = num_native_bases;
+    #if MICROPY_PY_SLOTS
+    if (MP_OBJ_CLASS_SLOTS(self) != NULL) {
+        num_subobj = MP_OBJ_CLASS_SLOTS(self)->n_subobj;
+    }
+    #endif
+
+    mp_obj_instance_t *o = MP_OBJ_TO_PTR(mp_obj_new_instance(self, num_subobj));
 
     // This executes only "__new__" part of instance creation.
     // TODO: This won't work well for classes with native bases.
@@ -310,6 +476,10 @@ mp_obj_t mp_obj_instance_make_new(const mp_obj_type_t *self, size_t n_args, size
         mp_obj_t init_ret;
         if (n_args == 0 && n_kw == 0) {
             init_ret = mp_call_method_n_kw(0, 0, init_fn);
+        } else if (init_fn[1] != MP_OBJ_NULL) {
+            // a few args are passed on the stack; a temporary copy on the heap
+            // would leave a hole after each new instance
+            init_ret = mp_call_method_self_n_kw(init_fn[0], init_fn[1], n_args, n_kw, args);
         } else {
             mp_obj_t *args2 = m_new(mp_obj_t, 2 + n_args + 2 * n_kw);
             args2[0] = init_fn[0];
@@ -359,7 +529,7 @@ STATIC mp_obj_t instance_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
         size_t num_native_bases = instance_count_native_bases(mp_obj_get_type(self_in), &native_base);
 
         size_t sz = sizeof(*self) + sizeof(*self->subobj) * num_native_bases
-            + sizeof(*self->members.table) * self->members.alloc;
+            + mp_map_table_bytes(&self->members);
         return MP_OBJ_NEW_SMALL_INT(sz);
     }
     #endif
@@ -562,6 +732,17 @@ STATIC void mp_obj_instance_load_attr(mp_obj_t self_in, qstr attr, mp_obj_t *des
     };
     mp_obj_class_lookup(&lookup, self->base.type);
     mp_obj_t member = dest[0];
+    #if MICROPY_PY_SLOTS
+    mp_obj_t *slot = instance_get_slot(self, member);
+    if (slot != NULL) {
+        // slot values are always treated as values, like object members
+        dest[0] = member = *slot;
+        if (member != MP_OBJ_NULL) {
+            return;
+        }
+        // the slot is unassigned, so try __getattr__
+    }
+    #endif
     if (member != MP_OBJ_NULL) {
         #if MICROPY_PY_BUILTINS_PROPERTY
         if (MP_OBJ_IS_TYPE(member, &mp_type_property)) {
@@ -624,8 +805,8 @@ STATIC void mp_obj_instance_load_attr(mp_obj_t self_in, qstr attr, mp_obj_t *des
 STATIC bool mp_obj_instance_store_attr(mp_obj_t self_in, qstr attr, mp_obj_t value) {
     mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
 
-    #if MICROPY_PY_BUILTINS_PROPERTY || MICROPY_PY_DESCRIPTORS
-    // With property and/or descriptors enabled we need to do a lookup
+    #if MICROPY_PY_BUILTINS_PROPERTY || MICROPY_PY_DESCRIPTORS || MICROPY_PY_SLOTS
+    // With property, descriptors and/or slots enabled we need to do a lookup
     // first in the class dict for the attribute to see if the store should
     // be delegated.
     // Note: this makes all stores slow... how to fix?
@@ -640,6 +821,18 @@ STATIC bool mp_obj_instance_store_attr(mp_obj_t self_in, qstr attr, mp_obj_t val
     mp_obj_class_lookup(&lookup, self->base.type);
 
     if (member[0] != MP_OBJ_NULL) {
+        #if MICROPY_PY_SLOTS
+        mp_obj_t *slot = instance_get_slot(self, member[0]);
+        if (slot != NULL) {
+            if (value == MP_OBJ_NULL && *slot == MP_OBJ_NULL) {
+                // can't delete an unassigned slot
+                return false;
+            }
+            *slot = value;
+            return true;
+        }
+        #endif
+
         #if MICROPY_PY_BUILTINS_PROPERTY
         if (MP_OBJ_IS_TYPE(member[0], &mp_type_property)) {
             // attribute exists and is a property; delegate the store/delete
@@ -731,6 +924,14 @@ STATIC bool mp_obj_instance_store_attr(mp_obj_t self_in, qstr attr, mp_obj_t val
         }
         #endif
 
+        #if MICROPY_PY_SLOTS
+        const mp_obj_slots_t *slots = MP_OBJ_CLASS_SLOTS(self->base.type);
+        if (slots != NULL && !slots->has_dict) {
+            // instances of this class only have the attributes in __slots__
+            return false;
+        }
+        #endif
+
         mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = value;
         return true;
     }
@@ -746,6 +947,42 @@ void mp_obj_instance_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
     }
 }
 
+#if MICROPY_OPT_INLINE_CACHE
+// Called by the VM when a LOAD_METHOD on an instance missed its inline cache,
+// with the method that was loaded, to remember it if it is a function bound
+// straight from the class.  In that case the instance has no member of that
+// name, so a later hit only needs to check that this is still true.
+void mp_obj_instance_inline_cache_store(byte *cache_byte, mp_obj_t self_in, qstr attr, mp_obj_t meth) {
+    mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
+    const mp_obj_type_t *type = self->base.type;
+    if (!(MP_OBJ_IS_FUN(meth) || (MP_OBJ_IS_OBJ(meth)
+        && ((mp_obj_base_t*)MP_OBJ_TO_PTR(meth))->type->name == MP_QSTR_closure))) {
+        return;
+    }
+    // a native base may find attributes dynamically, through load_attr
+    const mp_obj_type_t *native_base;
+    if (instance_count_native_bases(type, &native_base) != 0) {
+        return;
+    }
+
+    size_t n = *cache_byte;
+    if (n == 0) {
+        // give this bytecode a cache, sharing them once they run out
+        n = MP_STATE_VM(inline_cache_next)++ % MICROPY_OPT_INLINE_CACHE + 1;
+        *cache_byte = n;
+    }
+    mp_inline_cache_t *ic = &MP_STATE_VM(inline_cache)[n - 1];
+    if (ic->epoch != MP_STATE_VM(class_epoch) || ic->attr != attr) {
+        memset(ic, 0, sizeof(*ic));
+        ic->attr = attr;
+        ic->epoch = MP_STATE_VM(class_epoch);
+    }
+    ic->type[ic->next_way] = type;
+    ic->meth[ic->next_way] = meth;
+    ic->next_way = (ic->next_way + 1) % MICROPY_OPT_INLINE_CACHE_WAYS;
+}
+#endif
+
 STATIC mp_obj_t instance_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value) {
     mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
     mp_obj_t member[2] = {MP_OBJ_NULL};
@@ -976,6 +1213,88 @@ const mp_obj_type_t mp_type_type = {
     .attr = type_attr,
 };
 
+#if MICROPY_PY_SLOTS
+// Works out the layout of the instances of a new class from its __slots__ and
+// the layouts of its bases, and adds a member to the class for each new slot.
+// Returns NULL if the instances have no slots.
+STATIC mp_obj_slots_t *type_make_slots(mp_obj_type_t *o, size_t n_bases, const mp_obj_t *bases, size_t num_native_bases) {
+    // the instances have members unless they are left out by __slots__ in the
+    // class and all its bases, and at most one base can have slots
+    const mp_obj_slots_t *base_slots = NULL;
+    bool has_dict = false;
+    for (size_t i = 0; i < n_bases; i++) {
+        const mp_obj_type_t *t = MP_OBJ_TO_PTR(bases[i]);
+        if (!mp_obj_is_instance_type(t)) {
+            continue;
+        }
+        const mp_obj_slots_t *slots = MP_OBJ_CLASS_SLOTS(t);
+        if (slots == NULL || slots->has_dict) {
+            has_dict = true;
+        }
+        if (slots != NULL && slots->n_subobj > 0 && slots->names[slots->n_subobj - 1] != MP_QSTR_NULL) {
+            // the slots must stay at the same place in subobj, after the same
+            // native base if there is one
+            if (base_slots != NULL || num_native_bases != (size_t)(slots->names[0] == MP_QSTR_NULL)) {
+                mp_raise_TypeError("multiple bases have instance lay-out conflict");
+            }
+            base_slots = slots;
+        }
+    }
+
+    mp_map_t *locals_map = &o->locals_dict->map;
+    mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(MP_QSTR___slots__), MP_MAP_LOOKUP);
+    size_t n_names = 0;
+    mp_obj_t *names = NULL;
+    if (elem == NULL) {
+        if (base_slots == NULL) {
+            return NULL;
+        }
+        has_dict = true;
+    } else if (MP_OBJ_IS_STR(elem->value)) {
+        n_names = 1;
+        names = &elem->value;
+    } else {
+        mp_obj_t names_tuple = mp_type_tuple.make_new(&mp_type_tuple, 1, 0, &elem->value);
+        mp_obj_tuple_get(names_tuple, &n_names, &names);
+    }
+
+    size_t n_base = base_slots != NULL ? base_slots->n_subobj : num_native_bases;
+    mp_obj_slots_t *slots = m_new_obj_var(mp_obj_slots_t, qstr, n_base + n_names);
+    slots->epoch = MP_STATE_VM(class_epoch) - 1;
+    slots->n_subobj = n_base;
+    slots->direct = false;
+    for (size_t i = 0; i < n_base; i++) {
+        slots->names[i] = base_slots != NULL ? base_slots->names[i] : MP_QSTR_NULL;
+    }
+
+    for (size_t i = 0; i < n_names; i++) {
+        qstr attr = mp_obj_str_get_qstr(names[i]);
+        if (attr == MP_QSTR___dict__) {
+            has_dict = true;
+            continue;
+        }
+        elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+        if (elem->value != MP_OBJ_NULL) {
+            if (MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_TERSE) {
+                mp_raise_ValueError("__slots__ conflicts with class variable");
+            } else {
+                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError,
+                    "'%q' in __slots__ conflicts with class variable", attr));
+            }
+        }
+        mp_obj_member_t *m = m_new_obj(mp_obj_member_t);
+        m->base.type = &mp_type_member;
+        m->name = attr;
+        m->index = slots->n_subobj;
+        elem->value = MP_OBJ_FROM_PTR(m);
+        slots->names[slots->n_subobj++] = attr;
+    }
+    slots->has_dict = has_dict;
+
+    return slots;
+}
+#endif
+
 mp_obj_t mp_obj_new_type(qstr name, mp_obj_t bases_tuple, mp_obj_t locals_dict) {
     assert(MP_OBJ_IS_TYPE(bases_tuple, &mp_type_tuple)); // MicroPython restriction, for now
     assert(MP_OBJ_IS_TYPE(locals_dict, &mp_type_dict)); // MicroPython restriction, for now
@@ -1000,7 +1319,15 @@ mp_obj_t mp_obj_new_type(qstr name, mp_obj_t bases_tuple, mp_obj_t locals_dict)
         }
     }
 
+    #if MICROPY_PY_SLOTS
+    mp_obj_type_t *o = &m_new0(mp_obj_class_t, 1)->type;
+    #else
     mp_obj_type_t *o = m_new0(mp_obj_type_t, 1);
+    #endif
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_CACHE || MICROPY_PY_SLOTS
+    // the new class may reuse the memory of a freed one
+    mp_obj_class_changed();
+    #endif
     o->base.type = &mp_type_type;
     o->name = name;
     o->print = instance_print;
@@ -1029,6 +1356,8 @@ mp_obj_t mp_obj_new_type(qstr name, mp_obj_t bases_tuple, mp_obj_t locals_dict)
     }
 
     o->locals_dict = MP_OBJ_TO_PTR(locals_dict);
+    // the dict may also be changed directly, eg if it was kept from locals()
+    o->locals_dict->map.is_class_dict = 1;
 
     const mp_obj_type_t *native_base;
     size_t num_native_bases = instance_count_native_bases(o, &native_base);
@@ -1036,6 +1365,10 @@ mp_obj_t mp_obj_new_type(qstr name, mp_obj_t bases_tuple, mp_obj_t locals_dict)
         mp_raise_TypeError("multiple bases have instance lay-out conflict");
     }
 
+    #if MICROPY_PY_SLOTS
+    ((mp_obj_class_t*)o)->slots = type_make_slots(o, len, items, num_native_bases);
+    #endif
+
     mp_map_t *locals_map = &o->locals_dict->map;
     mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(MP_QSTR___new__), MP_MAP_LOOKUP);
     if (elem != NULL) {
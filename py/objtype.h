@@ -37,9 +37,46 @@ typedef struct _mp_obj_instance_t {
     // TODO maybe cache __getattr__ and __setattr__ for efficient lookup of them
 } mp_obj_instance_t;
 
+#if MICROPY_PY_SLOTS
+// The layout of the instances of a class which has __slots__, or a base class
+// that does.  The value of each slot is kept in subobj, after any native base
+// object, and is MP_OBJ_NULL until the slot is assigned.
+typedef struct _mp_obj_slots_t {
+    size_t epoch;       // value of class_epoch when direct was last worked out
+    size_t n_subobj;    // number of entries in subobj of each instance
+    bool direct;        // whether each name in names loads straight from its slot
+    bool has_dict;      // whether instances also have members
+    qstr names[];       // name of each slot, or MP_QSTR_NULL for a native base
+} mp_obj_slots_t;
+
+// A class created by mp_obj_new_type
+typedef struct _mp_obj_class_t {
+    mp_obj_type_t type;
+    mp_obj_slots_t *slots;  // NULL if instances have no slots
+} mp_obj_class_t;
+
+#define MP_OBJ_CLASS_SLOTS(type) (((const mp_obj_class_t*)(type))->slots)
+
+// Returns the position in subobj of the slot which holds the given attribute
+// of instances of the given class, or -1 if the attribute must be looked up.
+size_t mp_obj_class_find_slot(const mp_obj_type_t *type, qstr attr);
+#endif
+
+#if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_CACHE || MICROPY_PY_SLOTS
+// invalidates the cached lookups of class attributes
+void mp_obj_class_changed(void);
+#endif
+
 // this needs to be exposed for MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE to work
 void mp_obj_instance_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest);
 
+#if MICROPY_OPT_INLINE_CACHE
+void mp_obj_instance_inline_cache_store(byte *cache_byte, mp_obj_t self_in, qstr attr, mp_obj_t meth);
+#endif
+
+// returns the number of entries in subobj of each instance of the given class
+size_t mp_obj_instance_num_subobj(const mp_obj_type_t *type);
+
 // these need to be exposed so mp_obj_is_callable can work correctly
 bool mp_obj_instance_is_callable(mp_obj_t self_in);
 mp_obj_t mp_obj_instance_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args);
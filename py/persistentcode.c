@@ -39,10 +39,11 @@
 #include "py/smallint.h"
 
 // The current version of .mpy files
-#define MPY_VERSION (3)
+#define MPY_VERSION (6)
 
 // The feature flags byte encodes the compile-time config options that
-// affect the generate bytecode.
+// affect the generate bytecode, in the low 2 bits.  The upper bits hold
+// the arch that any native code in the file is for.
 #define MPY_FEATURE_FLAGS ( \
     ((MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE) << 0) \
     | ((MICROPY_PY_BUILTINS_STR_UNICODE) << 1) \
@@ -52,6 +53,16 @@
     ((MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE_DYNAMIC) << 0) \
     | ((MICROPY_PY_BUILTINS_STR_UNICODE_DYNAMIC) << 1) \
     )
+#define MPY_FEATURE_FLAGS_MASK (0x03)
+#define MPY_FEATURE_ARCH_SHIFT (2)
+
+// The length of each raw code is stored shifted left by this, with the kind
+// of code (relative to MP_CODE_BYTECODE) in the low bits.
+#define MPY_KIND_LEN_SHIFT (2)
+
+// Native code depends on the layout of these structures, which varies with
+// the config of the runtime, so it is stored with the code and checked.
+#define MPY_NATIVE_ABI ((sizeof(mp_code_state_t) / sizeof(mp_uint_t)) | (sizeof(nlr_buf_t) / sizeof(mp_uint_t)) << 4)
 
 #if MICROPY_PERSISTENT_CODE_LOAD || (MICROPY_PERSISTENT_CODE_SAVE && !MICROPY_DYNAMIC_COMPILER)
 // The bytecode will depend on the number of bits in a small-int, and
@@ -164,9 +175,92 @@ STATIC void load_bytecode_qstrs(mp_reader_t *reader, byte *ip, byte *ip_top) {
     }
 }
 
-STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader) {
+STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader, uint native_arch);
+
+#if MICROPY_EMIT_NATIVE
+STATIC mp_raw_code_t *load_raw_code_native(mp_reader_t *reader, mp_raw_code_kind_t kind, size_t fun_len, uint native_arch) {
+    if (read_uint(reader) != MPY_NATIVE_ABI) {
+        mp_raise_ValueError("incompatible .mpy arch");
+    }
+
+    // load the machine code into executable memory
+    byte *fun_data;
+    size_t fun_alloc;
+    MP_PLAT_ALLOC_EXEC(fun_len, (void**)&fun_data, &fun_alloc);
+    (void)fun_alloc;
+    read_bytes(reader, fun_data, fun_len);
+    size_t const_table_offset = read_uint(reader);
+    if (const_table_offset > fun_len) {
+        mp_raise_ValueError("incompatible .mpy file");
+    }
+    size_t scope_flags = read_uint(reader);
+    size_t n_pos_args = read_uint(reader);
+    mp_uint_t type_sig = read_uint(reader);
+
+    // link the words in the code that depend on the runtime
+    size_t n_reloc = read_uint(reader);
+    for (size_t i = 0; i < n_reloc; ++i) {
+        size_t offset = read_uint(reader);
+        mp_native_reloc_kind_t reloc_kind = read_byte(reader);
+        mp_uint_t value;
+        switch (reloc_kind) {
+            case MP_NATIVE_RELOC_FUN_TABLE:
+                value = 0;
+                break;
+            case MP_NATIVE_RELOC_QSTR:
+            case MP_NATIVE_RELOC_QSTR16:
+            case MP_NATIVE_RELOC_QSTR_OBJ:
+                value = load_qstr(reader);
+                break;
+            case MP_NATIVE_RELOC_OBJ:
+                value = (mp_uint_t)load_obj(reader);
+                break;
+            case MP_NATIVE_RELOC_RAW_CODE:
+                value = (mp_uint_t)(uintptr_t)load_raw_code(reader, native_arch);
+                break;
+            default:
+                value = read_uint(reader);
+                break;
+        }
+        value = mp_native_reloc_value(reloc_kind, value);
+        size_t value_len = reloc_kind == MP_NATIVE_RELOC_QSTR16 ? 2 : sizeof(value);
+        if (offset > fun_len || fun_len - offset < value_len) {
+            mp_raise_ValueError("incompatible .mpy file");
+        }
+        if (reloc_kind == MP_NATIVE_RELOC_QSTR16) {
+            fun_data[offset] = value;
+            fun_data[offset + 1] = value >> 8;
+        } else {
+            memcpy(fun_data + offset, &value, sizeof(value));
+        }
+    }
+
+    // create raw_code and return it
+    mp_raw_code_t *rc = mp_emit_glue_new_raw_code();
+    mp_emit_glue_assign_native(rc, kind, fun_data, fun_len, (mp_uint_t*)(fun_data + const_table_offset),
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        NULL, 0,
+        #endif
+        n_pos_args, scope_flags, type_sig);
+    return rc;
+}
+#endif
+
+STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader, uint native_arch) {
+    size_t kind_len = read_uint(reader);
+    mp_raw_code_kind_t kind = MP_CODE_BYTECODE + (kind_len & ((1 << MPY_KIND_LEN_SHIFT) - 1));
+    if (kind != MP_CODE_BYTECODE) {
+        // native code can only be run on the arch it was made for
+        #if MICROPY_EMIT_NATIVE
+        if (native_arch == MPY_NATIVE_ARCH) {
+            return load_raw_code_native(reader, kind, kind_len >> MPY_KIND_LEN_SHIFT, native_arch);
+        }
+        #endif
+        mp_raise_ValueError("incompatible .mpy arch");
+    }
+
     // load bytecode
-    size_t bc_len = read_uint(reader);
+    size_t bc_len = kind_len >> MPY_KIND_LEN_SHIFT;
     byte *bytecode = m_new(byte, bc_len);
     read_bytes(reader, bytecode, bc_len);
 
@@ -195,7 +289,7 @@ STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader) {
         *ct++ = (mp_uint_t)load_obj(reader);
     }
     for (size_t i = 0; i < n_raw_code; ++i) {
-        *ct++ = (mp_uint_t)(uintptr_t)load_raw_code(reader);
+        *ct++ = (mp_uint_t)(uintptr_t)load_raw_code(reader, native_arch);
     }
 
     // create raw_code and return it
@@ -213,11 +307,11 @@ mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader) {
     read_bytes(reader, header, sizeof(header));
     if (header[0] != 'M'
         || header[1] != MPY_VERSION
-        || header[2] != MPY_FEATURE_FLAGS
+        || (header[2] & MPY_FEATURE_FLAGS_MASK) != MPY_FEATURE_FLAGS
         || header[3] > mp_small_int_bits()) {
         mp_raise_ValueError("incompatible .mpy file");
     }
-    mp_raw_code_t *rc = load_raw_code(reader);
+    mp_raw_code_t *rc = load_raw_code(reader, header[2] >> MPY_FEATURE_ARCH_SHIFT);
     reader->close(reader->data);
     return rc;
 }
@@ -316,13 +410,61 @@ STATIC void save_bytecode_qstrs(mp_print_t *print, const byte *ip, const byte *i
     }
 }
 
+STATIC void save_raw_code(mp_print_t *print, mp_raw_code_t *rc);
+
+#if MICROPY_EMIT_NATIVE
+STATIC void save_raw_code_native(mp_print_t *print, mp_raw_code_t *rc) {
+    // save the machine code and what's needed to make a function from it
+    mp_print_uint(print, (rc->data.u_native.fun_len << MPY_KIND_LEN_SHIFT) | (rc->kind - MP_CODE_BYTECODE));
+    mp_print_uint(print, MPY_NATIVE_ABI);
+    mp_print_bytes(print, rc->data.u_native.fun_data, rc->data.u_native.fun_len);
+    mp_print_uint(print, (const byte*)rc->data.u_native.const_table - (const byte*)rc->data.u_native.fun_data);
+    mp_print_uint(print, rc->scope_flags);
+    mp_print_uint(print, rc->n_pos_args);
+    mp_print_uint(print, rc->data.u_native.type_sig);
+
+    // save the words that must be linked when the code is loaded
+    mp_print_uint(print, rc->data.u_native.n_reloc);
+    for (size_t i = 0; i < rc->data.u_native.n_reloc; ++i) {
+        const mp_native_reloc_t *r = &rc->data.u_native.relocs[i];
+        byte reloc_kind = r->kind;
+        mp_print_uint(print, r->offset);
+        mp_print_bytes(print, &reloc_kind, 1);
+        switch (reloc_kind) {
+            case MP_NATIVE_RELOC_FUN_TABLE:
+                break;
+            case MP_NATIVE_RELOC_QSTR:
+            case MP_NATIVE_RELOC_QSTR16:
+            case MP_NATIVE_RELOC_QSTR_OBJ:
+                save_qstr(print, r->value);
+                break;
+            case MP_NATIVE_RELOC_OBJ:
+                save_obj(print, (mp_obj_t)r->value);
+                break;
+            case MP_NATIVE_RELOC_RAW_CODE:
+                save_raw_code(print, (mp_raw_code_t*)(uintptr_t)r->value);
+                break;
+            default:
+                mp_print_uint(print, r->value);
+                break;
+        }
+    }
+}
+#endif
+
 STATIC void save_raw_code(mp_print_t *print, mp_raw_code_t *rc) {
+    #if MICROPY_EMIT_NATIVE
+    if (rc->kind == MP_CODE_NATIVE_PY || rc->kind == MP_CODE_NATIVE_VIPER) {
+        save_raw_code_native(print, rc);
+        return;
+    }
+    #endif
     if (rc->kind != MP_CODE_BYTECODE) {
-        mp_raise_ValueError("can only save bytecode");
+        mp_raise_ValueError("can only save bytecode and native code");
     }
 
     // save bytecode
-    mp_print_uint(print, rc->data.u_byte.bc_len);
+    mp_print_uint(print, rc->data.u_byte.bc_len << MPY_KIND_LEN_SHIFT);
     mp_print_bytes(print, rc->data.u_byte.bytecode, rc->data.u_byte.bc_len);
 
     // extract prelude
@@ -356,9 +498,14 @@ void mp_raw_code_save(mp_raw_code_t *rc, mp_print_t *print) {
     // header contains:
     //  byte  'M'
     //  byte  version
-    //  byte  feature flags
+    //  byte  feature flags, and arch of any native code
     //  byte  number of bits in a small int
-    byte header[4] = {'M', MPY_VERSION, MPY_FEATURE_FLAGS_DYNAMIC,
+    byte header[4] = {'M', MPY_VERSION,
+        #if MICROPY_DYNAMIC_COMPILER
+        MPY_FEATURE_FLAGS_DYNAMIC | (mp_dynamic_compiler.native_arch << MPY_FEATURE_ARCH_SHIFT),
+        #else
+        MPY_FEATURE_FLAGS_DYNAMIC | (MPY_NATIVE_ARCH << MPY_FEATURE_ARCH_SHIFT),
+        #endif
         #if MICROPY_DYNAMIC_COMPILER
         mp_dynamic_compiler.small_int_bits,
         #else
@@ -30,6 +30,31 @@
 #include "py/reader.h"
 #include "py/emitglue.h"
 
+// The kind of machine code that native code in a .mpy file is for
+enum {
+    MP_NATIVE_ARCH_NONE = 0,
+    MP_NATIVE_ARCH_X86,
+    MP_NATIVE_ARCH_X64,
+    MP_NATIVE_ARCH_ARMV6,
+    MP_NATIVE_ARCH_ARMV7M,
+    MP_NATIVE_ARCH_XTENSA,
+};
+
+// The kind of native code that this build can run
+#if MICROPY_EMIT_X64
+#define MPY_NATIVE_ARCH (MP_NATIVE_ARCH_X64)
+#elif MICROPY_EMIT_X86
+#define MPY_NATIVE_ARCH (MP_NATIVE_ARCH_X86)
+#elif MICROPY_EMIT_THUMB
+#define MPY_NATIVE_ARCH (MP_NATIVE_ARCH_ARMV7M)
+#elif MICROPY_EMIT_ARM
+#define MPY_NATIVE_ARCH (MP_NATIVE_ARCH_ARMV6)
+#elif MICROPY_EMIT_XTENSA
+#define MPY_NATIVE_ARCH (MP_NATIVE_ARCH_XTENSA)
+#else
+#define MPY_NATIVE_ARCH (MP_NATIVE_ARCH_NONE)
+#endif
+
 mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader);
 mp_raw_code_t *mp_raw_code_load_mem(const byte *buf, size_t len);
 mp_raw_code_t *mp_raw_code_load_file(const char *filename);
@@ -144,6 +144,7 @@ PY_O_BASENAME = \
 	runtime_utils.o \
 	scheduler.o \
 	nativeglue.o \
+	nativetier.o \
 	stackctrl.o \
 	argcheck.o \
 	warning.o \
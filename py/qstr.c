@@ -32,8 +32,8 @@
 #include "py/qstr.h"
 #include "py/gc.h"
 
-// NOTE: we are using linear arrays to store and search for qstr's (unique strings, interned strings)
-// ultimately we will replace this with a static hash table of some kind
+// NOTE: we are using linear arrays to store qstr's (unique strings, interned strings)
+// and, if MICROPY_QSTR_HASH_INDEX is enabled, a hash index for each array to search them
 // also probably need to include the length in the string data, to allow null bytes in the string
 
 #if MICROPY_DEBUG_VERBOSE // print debugging info
@@ -81,13 +81,18 @@
 #endif
 
 // this must match the equivalent function in makeqstrdata.py
-mp_uint_t qstr_compute_hash(const byte *data, size_t len) {
+STATIC mp_uint_t qstr_compute_full_hash(const byte *data, size_t len) {
     // djb2 algorithm; see http://www.cse.yorku.ca/~oz/hash.html
     mp_uint_t hash = 5381;
     for (const byte *top = data + len; data < top; data++) {
         hash = ((hash << 5) + hash) ^ (*data); // hash * 33 ^ data
     }
-    hash &= Q_HASH_MASK;
+    return hash;
+}
+
+// this must match the equivalent function in makeqstrdata.py
+mp_uint_t qstr_compute_hash(const byte *data, size_t len) {
+    mp_uint_t hash = qstr_compute_full_hash(data, len) & Q_HASH_MASK;
     // Make sure that valid hash is never zero, zero means "hash not computed"
     if (hash == 0) {
         hash++;
@@ -95,11 +100,28 @@ mp_uint_t qstr_compute_hash(const byte *data, size_t len) {
     return hash;
 }
 
+#if MICROPY_QSTR_HASH_INDEX
+// the hash index for the const pool just below, generated by makeqstrdata.py
+STATIC const uint16_t mp_qstr_const_index[] = {
+#ifndef NO_QSTR
+#define QDEF(id, str)
+#define QINDEX(...) __VA_ARGS__,
+#include "genhdr/qstrdefs.generated.h"
+#undef QINDEX
+#undef QDEF
+#endif
+};
+#endif
+
 const qstr_pool_t mp_qstr_const_pool = {
     NULL,               // no previous pool
     0,                  // no previous pool
     10,                 // set so that the first dynamically allocated pool is twice this size; must be <= the len (just below)
     MP_QSTRnumber_of,   // corresponds to number of strings in array just below
+    #if MICROPY_QSTR_HASH_INDEX
+    mp_qstr_const_index,
+    MP_ARRAY_SIZE(mp_qstr_const_index) - 1,
+    #endif
     {
 #ifndef NO_QSTR
 #define QDEF(id, str) str,
@@ -143,32 +165,81 @@ STATIC qstr qstr_add(const byte *q_ptr) {
 
     // make sure we have room in the pool for a new qstr
     if (MP_STATE_VM(last_pool)->len >= MP_STATE_VM(last_pool)->alloc) {
-        qstr_pool_t *pool = m_new_obj_var_maybe(qstr_pool_t, const char*, MP_STATE_VM(last_pool)->alloc * 2);
+        size_t new_alloc = MP_STATE_VM(last_pool)->alloc * 2;
+        #if MICROPY_QSTR_HASH_INDEX
+        // index slots are 16 bits, which limits the size of a pool
+        if (new_alloc > 0x8000) {
+            new_alloc = 0x8000;
+        }
+        // the index is a power of 2 in size and at most half full, and is
+        // stored just after the qstrs array
+        size_t index_len = 2;
+        while (index_len < 2 * new_alloc) {
+            index_len *= 2;
+        }
+        size_t n_bytes = sizeof(qstr_pool_t) + new_alloc * sizeof(const byte*) + index_len * sizeof(uint16_t);
+        qstr_pool_t *pool = (qstr_pool_t*)m_new_maybe(byte, n_bytes);
+        #else
+        size_t n_bytes = sizeof(qstr_pool_t) + new_alloc * sizeof(const byte*);
+        qstr_pool_t *pool = m_new_obj_var_maybe(qstr_pool_t, const char*, new_alloc);
+        #endif
         if (pool == NULL) {
             QSTR_EXIT();
-            m_malloc_fail(MP_STATE_VM(last_pool)->alloc * 2);
+            m_malloc_fail(n_bytes);
         }
         pool->prev = MP_STATE_VM(last_pool);
         pool->total_prev_len = MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len;
-        pool->alloc = MP_STATE_VM(last_pool)->alloc * 2;
+        pool->alloc = new_alloc;
         pool->len = 0;
+        #if MICROPY_QSTR_HASH_INDEX
+        pool->index = (uint16_t*)&pool->qstrs[new_alloc];
+        pool->index_mask = index_len - 1;
+        memset((uint16_t*)pool->index, 0, index_len * sizeof(uint16_t));
+        #endif
         MP_STATE_VM(last_pool) = pool;
         DEBUG_printf("QSTR: allocate new pool of size %d\n", MP_STATE_VM(last_pool)->alloc);
     }
 
     // add the new qstr
-    MP_STATE_VM(last_pool)->qstrs[MP_STATE_VM(last_pool)->len++] = q_ptr;
+    qstr_pool_t *pool = MP_STATE_VM(last_pool);
+    pool->qstrs[pool->len++] = q_ptr;
+
+    #if MICROPY_QSTR_HASH_INDEX
+    // add it to the index, in the first empty slot from its hash onwards
+    uint16_t *index = (uint16_t*)pool->index;
+    size_t i = qstr_compute_full_hash(Q_GET_DATA(q_ptr), Q_GET_LENGTH(q_ptr)) & pool->index_mask;
+    while (index[i] != 0) {
+        i = (i + 1) & pool->index_mask;
+    }
+    index[i] = pool->len;
+    #endif
 
     // return id for the newly-added qstr
-    return MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+    return pool->total_prev_len + pool->len - 1;
 }
 
 qstr qstr_find_strn(const char *str, size_t str_len) {
     // work out hash of str
-    mp_uint_t str_hash = qstr_compute_hash((const byte*)str, str_len);
+    mp_uint_t full_hash = qstr_compute_full_hash((const byte*)str, str_len);
+    mp_uint_t str_hash = full_hash & Q_HASH_MASK;
+    if (str_hash == 0) {
+        str_hash++;
+    }
 
     // search pools for the data
     for (qstr_pool_t *pool = MP_STATE_VM(last_pool); pool != NULL; pool = pool->prev) {
+        #if MICROPY_QSTR_HASH_INDEX
+        if (pool->index != NULL) {
+            // probe the index from the slot for the hash up to an empty slot
+            for (size_t i = full_hash & pool->index_mask; pool->index[i] != 0; i = (i + 1) & pool->index_mask) {
+                const byte *q = pool->qstrs[pool->index[i] - 1];
+                if (Q_GET_HASH(q) == str_hash && Q_GET_LENGTH(q) == str_len && memcmp(Q_GET_DATA(q), str, str_len) == 0) {
+                    return pool->total_prev_len + pool->index[i] - 1;
+                }
+            }
+            continue;
+        }
+        #endif
         for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
             if (Q_GET_HASH(*q) == str_hash && Q_GET_LENGTH(*q) == str_len && memcmp(Q_GET_DATA(*q), str, str_len) == 0) {
                 return pool->total_prev_len + (q - pool->qstrs);
@@ -302,6 +373,9 @@ void qstr_pool_info(size_t *n_pool, size_t *n_qstr, size_t *n_str_data_bytes, si
         *n_total_bytes += gc_nbytes(pool); // this counts actual bytes used in heap
         #else
         *n_total_bytes += sizeof(qstr_pool_t) + sizeof(qstr) * pool->alloc;
+        #if MICROPY_QSTR_HASH_INDEX
+        *n_total_bytes += sizeof(uint16_t) * (pool->index_mask + 1);
+        #endif
         #endif
     }
     *n_total_bytes += *n_str_data_bytes;
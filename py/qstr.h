@@ -52,6 +52,12 @@ typedef struct _qstr_pool_t {
     size_t total_prev_len;
     size_t alloc;
     size_t len;
+    #if MICROPY_QSTR_HASH_INDEX
+    // open-addressed hash table over the qstrs in this pool: each slot is 0
+    // if empty, or else the position in qstrs plus 1 (NULL if no index)
+    const uint16_t *index;
+    size_t index_mask;  // number of slots minus 1, a power of 2 minus 1
+    #endif
     const byte *qstrs[];
 } qstr_pool_t;
 
@@ -86,6 +86,33 @@ void mp_init(void) {
     // optimization disabled by default
     MP_STATE_VM(mp_optimise_value) = 0;
 
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+    memset(MP_STATE_VM(class_lookup_cache), 0, sizeof(MP_STATE_VM(class_lookup_cache)));
+    #endif
+
+    #if MICROPY_OPT_INLINE_CACHE
+    // caches with epoch 0 are invalid
+    memset(MP_STATE_VM(inline_cache), 0, sizeof(MP_STATE_VM(inline_cache)));
+    MP_STATE_VM(inline_cache_next) = 0;
+    MP_STATE_VM(class_epoch) = 1;
+    #endif
+
+    #if MICROPY_TRACK_CODE_STATE
+    MP_STATE_THREAD(current_code_state) = NULL;
+    #endif
+
+    #if MICROPY_EMIT_NATIVE_TIERING
+    MP_STATE_VM(native_tier_threshold) = MICROPY_EMIT_NATIVE_TIERING_THRESHOLD;
+    #if MICROPY_PY_THREAD_GIL && MICROPY_PY_THREAD_GIL_VM_DIVISOR
+    MP_STATE_VM(native_tier_gil_divisor) = MICROPY_PY_THREAD_GIL_VM_DIVISOR;
+    #endif
+    #endif
+
+    #if MICROPY_PY_MICROPYTHON_ALLOC_TRACE
+    MP_STATE_VM(alloc_trace_table) = NULL;
+    MP_STATE_VM(alloc_trace_active) = false;
+    #endif
+
     // init global module dict
     mp_obj_dict_init(&MP_STATE_VM(mp_loaded_modules_dict), 3);
 
@@ -243,6 +243,9 @@ const byte *mp_bytecode_print_str(const byte *ip) {
         case MP_BC_LOAD_METHOD:
             DECODE_QSTR;
             printf("LOAD_METHOD %s", qstr_str(qst));
+            if (MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE) {
+                printf(" (cache=%u)", *ip++);
+            }
             break;
 
         case MP_BC_LOAD_SUPER_METHOD:
@@ -532,6 +535,27 @@ const byte *mp_bytecode_print_str(const byte *ip) {
             printf("IMPORT_STAR");
             break;
 
+        case MP_BC_LOAD_FAST_LOAD_FAST:
+            unum = *ip++;
+            printf("LOAD_FAST_LOAD_FAST " UINT_FMT " " UINT_FMT, unum >> 4, unum & 0xf);
+            break;
+
+        case MP_BC_BINARY_OP_SMALL_INT:
+            unum = *ip++;
+            printf("BINARY_OP_SMALL_INT " UINT_FMT " %s " INT_FMT,
+                unum, qstr_str(mp_binary_op_method_name[unum]), (mp_int_t)(int8_t)*ip++);
+            break;
+
+        case MP_BC_BINARY_OP_POP_JUMP_IF_TRUE:
+        case MP_BC_BINARY_OP_POP_JUMP_IF_FALSE: {
+            mp_uint_t op = *ip++;
+            const char *cond = ip[-2] == MP_BC_BINARY_OP_POP_JUMP_IF_TRUE ? "TRUE" : "FALSE";
+            DECODE_SLABEL;
+            printf("BINARY_OP_POP_JUMP_IF_%s " UINT_FMT " %s " UINT_FMT,
+                cond, op, qstr_str(mp_binary_op_method_name[op]), (mp_uint_t)(ip + unum - mp_showbc_code_start));
+            break;
+        }
+
         default:
             if (ip[-1] < MP_BC_LOAD_CONST_SMALL_INT_MULTI + 64) {
                 printf("LOAD_CONST_SMALL_INT " INT_FMT, (mp_int_t)ip[-1] - MP_BC_LOAD_CONST_SMALL_INT_MULTI - 16);
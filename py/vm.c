@@ -32,8 +32,17 @@
 #include "py/emitglue.h"
 #include "py/objtype.h"
 #include "py/runtime.h"
+#include "py/smallint.h"
 #include "py/bc0.h"
 #include "py/bc.h"
+#include "py/nativetier.h"
+
+#if MICROPY_OPT_INLINE_CACHE && !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+#error MICROPY_OPT_INLINE_CACHE requires MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+#endif
+#if MICROPY_OPT_INLINE_CACHE && MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
+#error MICROPY_OPT_INLINE_CACHE requires the GIL if MICROPY_PY_THREAD is enabled
+#endif
 
 #if 0
 #define TRACE(ip) printf("sp=%d ", (int)(sp - &code_state->state[0] + 1)); mp_bytecode_print2(ip, 1, code_state->fun_bc->const_table);
@@ -41,6 +50,85 @@
 #define TRACE(ip)
 #endif
 
+#if MICROPY_VM_STATS
+mp_vm_stats_t mp_vm_stats;
+
+void mp_vm_stats_dump(const mp_print_t *print) {
+    for (size_t i = 0; i < 256; ++i) {
+        if (mp_vm_stats.op_count[i] != 0) {
+            mp_printf(print, "op %u %u\n", (uint)i, (uint)mp_vm_stats.op_count[i]);
+        }
+    }
+    for (size_t i = 0; i < 256; ++i) {
+        for (size_t j = 0; j < 256; ++j) {
+            if (mp_vm_stats.pair_count[i][j] != 0) {
+                mp_printf(print, "pair %u %u %u\n", (uint)i, (uint)j, (uint)mp_vm_stats.pair_count[i][j]);
+            }
+        }
+    }
+}
+
+// The counters aren't atomic, so with threads the counts are approximate
+#define VM_STATS_COUNT(opcode) do { \
+        byte vm_stats_op = (opcode); \
+        ++mp_vm_stats.op_count[vm_stats_op]; \
+        ++mp_vm_stats.pair_count[vm_stats_prev_op][vm_stats_op]; \
+        vm_stats_prev_op = vm_stats_op; \
+    } while (0)
+#else
+#define VM_STATS_COUNT(opcode)
+#endif
+
+// Binary op as done by the bytecode.  With MICROPY_OPT_SMALL_INT_FAST_PATH the
+// common arithmetic, bitwise and comparison ops on two small ints are done
+// inline, and only the other cases (and overflow) go through mp_binary_op.
+static inline mp_obj_t vm_binary_op(mp_binary_op_t op, mp_obj_t lhs, mp_obj_t rhs) {
+    #if MICROPY_OPT_SMALL_INT_FAST_PATH
+    if (MP_OBJ_IS_SMALL_INT(lhs) && MP_OBJ_IS_SMALL_INT(rhs)) {
+        mp_int_t lhs_val = MP_OBJ_SMALL_INT_VALUE(lhs);
+        mp_int_t rhs_val = MP_OBJ_SMALL_INT_VALUE(rhs);
+        switch (op) {
+            case MP_BINARY_OP_LESS: return mp_obj_new_bool(lhs_val < rhs_val);
+            case MP_BINARY_OP_MORE: return mp_obj_new_bool(lhs_val > rhs_val);
+            case MP_BINARY_OP_EQUAL: return mp_obj_new_bool(lhs_val == rhs_val);
+            case MP_BINARY_OP_LESS_EQUAL: return mp_obj_new_bool(lhs_val <= rhs_val);
+            case MP_BINARY_OP_MORE_EQUAL: return mp_obj_new_bool(lhs_val >= rhs_val);
+            case MP_BINARY_OP_NOT_EQUAL: return mp_obj_new_bool(lhs_val != rhs_val);
+            case MP_BINARY_OP_OR:
+            case MP_BINARY_OP_INPLACE_OR: return MP_OBJ_NEW_SMALL_INT(lhs_val | rhs_val);
+            case MP_BINARY_OP_XOR:
+            case MP_BINARY_OP_INPLACE_XOR: return MP_OBJ_NEW_SMALL_INT(lhs_val ^ rhs_val);
+            case MP_BINARY_OP_AND:
+            case MP_BINARY_OP_INPLACE_AND: return MP_OBJ_NEW_SMALL_INT(lhs_val & rhs_val);
+            case MP_BINARY_OP_ADD:
+            case MP_BINARY_OP_INPLACE_ADD:
+                // can't overflow a machine word, but may not fit in a small int
+                lhs_val += rhs_val;
+                if (MP_SMALL_INT_FITS(lhs_val)) {
+                    return MP_OBJ_NEW_SMALL_INT(lhs_val);
+                }
+                break;
+            case MP_BINARY_OP_SUBTRACT:
+            case MP_BINARY_OP_INPLACE_SUBTRACT:
+                lhs_val -= rhs_val;
+                if (MP_SMALL_INT_FITS(lhs_val)) {
+                    return MP_OBJ_NEW_SMALL_INT(lhs_val);
+                }
+                break;
+            case MP_BINARY_OP_MULTIPLY:
+            case MP_BINARY_OP_INPLACE_MULTIPLY:
+                if (!mp_small_int_mul_overflow(lhs_val, rhs_val)) {
+                    return MP_OBJ_NEW_SMALL_INT(lhs_val * rhs_val);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    #endif
+    return mp_binary_op(op, lhs, rhs);
+}
+
 // Value stack grows up (this makes it incompatible with native C stack, but
 // makes sure that arguments to functions are in natural order arg1..argN
 // (Python semantics mandates left-to-right evaluation order, including for
@@ -118,6 +206,35 @@ typedef enum {
     exc_sp--; /* pop back to previous exception handler */ \
     CLEAR_SYS_EXC_INFO() /* just clear sys.exc_info(), not compliant, but it shouldn't be used in 1st place */
 
+#if MICROPY_EMIT_NATIVE_TIERING
+// A backward jump makes the function hotter, and once it is hot the rest of
+// the function is run as native code, starting at the target of the jump.
+#define TIER_UP_AT_JUMP() do { \
+    mp_obj_fun_bc_t *tier_fun = code_state->fun_bc; \
+    if ((mp_int_t)slab < 0 && MP_NATIVE_TIER_IS_HOT(tier_fun)) { \
+        code_state->ip = ip; \
+        code_state->sp = sp; \
+        if (mp_native_tier_osr(code_state)) { \
+            sp = code_state->sp; \
+            goto unwind_return; \
+        } \
+    } \
+} while (0)
+#else
+#define TIER_UP_AT_JUMP()
+#endif
+
+#if MICROPY_STACKLESS
+// Calls to bytecode functions are run within this loop, except for calls to
+// hot functions which go via mp_call_function_n_kw to use their native code.
+#if MICROPY_EMIT_NATIVE_TIERING
+#define STACKLESS_CALLABLE(f) (mp_obj_get_type(f) == &mp_type_fun_bc \
+    && !MP_NATIVE_TIER_IS_HOT((mp_obj_fun_bc_t*)MP_OBJ_TO_PTR(f)))
+#else
+#define STACKLESS_CALLABLE(f) (mp_obj_get_type(f) == &mp_type_fun_bc)
+#endif
+#endif
+
 // fastn has items in reverse order (fastn[0] is local[0], fastn[-1] is local[1], etc)
 // sp points to bottom of stack which grows up
 // returns:
@@ -137,6 +254,7 @@ mp_vm_return_kind_t mp_execute_bytecode(mp_code_state_t *code_state, volatile mp
     #include "py/vmentrytable.h"
     #define DISPATCH() do { \
         TRACE(ip); \
+        VM_STATS_COUNT(*ip); \
         MARK_EXC_IP_GLOBAL(); \
         goto *entry_table[*ip++]; \
     } while (0)
@@ -168,6 +286,11 @@ run_code_state: ;
         exc_stack = (mp_exc_stack_t*)(code_state->state + n_state);
     }
 
+    #if MICROPY_STACKLESS && MICROPY_TRACK_CODE_STATE
+    // calls and returns within this loop switch to another code state
+    MP_STATE_THREAD(current_code_state) = code_state;
+    #endif
+
     // variables that are visible to the exception handler (declared volatile)
     volatile bool currently_in_except_block = MP_TAGPTR_TAG0(code_state->exc_sp); // 0 or 1, to detect nested exceptions
     mp_exc_stack_t *volatile exc_sp = MP_TAGPTR_PTR(code_state->exc_sp); // stack grows up, exc_sp points to top of stack
@@ -187,6 +310,9 @@ outer_dispatch_loop:
             const byte *ip = code_state->ip;
             mp_obj_t *sp = code_state->sp;
             mp_obj_t obj_shared;
+            #if MICROPY_VM_STATS
+            byte vm_stats_prev_op = 0;
+            #endif
             MICROPY_VM_HOOK_INIT
 
             // If we have exception to inject, now that we finish setting up
@@ -208,6 +334,7 @@ dispatch_loop:
                 DISPATCH();
 #else
                 TRACE(ip);
+                VM_STATS_COUNT(*ip);
                 MARK_EXC_IP_GLOBAL();
                 switch (*ip++) {
 #endif
@@ -352,6 +479,23 @@ dispatch_loop:
                         if (x < self->members.alloc && self->members.table[x].key == key) {
                             elem = &self->members.table[x];
                         } else {
+                            #if MICROPY_PY_SLOTS
+                            // a slot is loaded straight from the instance, by
+                            // its position cached in the same way
+                            const mp_obj_slots_t *slots = MP_OBJ_CLASS_SLOTS(self->base.type);
+                            if (slots != NULL) {
+                                if (!(x < slots->n_subobj && slots->names[x] == qst
+                                    && slots->epoch == MP_STATE_VM(class_epoch) && slots->direct)) {
+                                    x = mp_obj_class_find_slot(self->base.type, qst);
+                                    *(byte*)ip = x;
+                                }
+                                if (x < slots->n_subobj && self->subobj[x] != MP_OBJ_NULL) {
+                                    SET_TOP(self->subobj[x]);
+                                    ip++;
+                                    DISPATCH();
+                                }
+                            }
+                            #endif
                             elem = mp_map_lookup(&self->members, key, MP_MAP_LOOKUP);
                             if (elem != NULL) {
                                 *(byte*)ip = elem - &self->members.table[0];
@@ -370,13 +514,52 @@ dispatch_loop:
                 }
                 #endif
 
+                #if !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                ENTRY(MP_BC_LOAD_METHOD): {
+                    MARK_EXC_IP_SELECTIVE();
+                    DECODE_QSTR;
+                    mp_load_method(*sp, qst, sp);
+                    sp += 1;
+                    DISPATCH();
+                }
+                #else
                 ENTRY(MP_BC_LOAD_METHOD): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
+                    #if MICROPY_OPT_INLINE_CACHE
+                    mp_obj_t top = TOP();
+                    mp_uint_t x = *ip;
+                    const mp_obj_type_t *type = mp_obj_get_type(top);
+                    if (type->attr == mp_obj_instance_attr) {
+                        const mp_inline_cache_t *ic = &MP_STATE_VM(inline_cache)[x == 0 ? 0 : x - 1];
+                        size_t i = MICROPY_OPT_INLINE_CACHE_WAYS;
+                        if (x != 0 && ic->epoch == MP_STATE_VM(class_epoch) && ic->attr == qst) {
+                            for (i = 0; i < MICROPY_OPT_INLINE_CACHE_WAYS && ic->type[i] != type; ++i) {
+                            }
+                        }
+                        // the method is only valid if not shadowed by a member
+                        mp_obj_instance_t *self = MP_OBJ_TO_PTR(top);
+                        if (i < MICROPY_OPT_INLINE_CACHE_WAYS && (self->members.used == 0
+                            || mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(qst), MP_MAP_LOOKUP) == NULL)) {
+                            sp[0] = ic->meth[i];
+                            sp[1] = top;
+                        } else {
+                            mp_load_method(top, qst, sp);
+                            if (sp[1] == top) {
+                                mp_obj_instance_inline_cache_store((byte*)ip, top, qst, sp[0]);
+                            }
+                        }
+                        sp += 1;
+                        ip++;
+                        DISPATCH();
+                    }
+                    #endif
                     mp_load_method(*sp, qst, sp);
                     sp += 1;
+                    ip++;
                     DISPATCH();
                 }
+                #endif
 
                 ENTRY(MP_BC_LOAD_SUPER_METHOD): {
                     MARK_EXC_IP_SELECTIVE();
@@ -450,6 +633,24 @@ dispatch_loop:
                         if (x < self->members.alloc && self->members.table[x].key == key) {
                             elem = &self->members.table[x];
                         } else {
+                            #if MICROPY_PY_SLOTS
+                            // a slot is stored straight to the instance, as
+                            // mp_store_attr would do before trying __setattr__
+                            const mp_obj_slots_t *slots = MP_OBJ_CLASS_SLOTS(self->base.type);
+                            if (slots != NULL) {
+                                if (!(x < slots->n_subobj && slots->names[x] == qst
+                                    && slots->epoch == MP_STATE_VM(class_epoch) && slots->direct)) {
+                                    x = mp_obj_class_find_slot(self->base.type, qst);
+                                    *(byte*)ip = x;
+                                }
+                                if (x < slots->n_subobj) {
+                                    self->subobj[x] = sp[-1];
+                                    sp -= 2;
+                                    ip++;
+                                    DISPATCH();
+                                }
+                            }
+                            #endif
                             elem = mp_map_lookup(&self->members, key, MP_MAP_LOOKUP);
                             if (elem != NULL) {
                                 *(byte*)ip = elem - &self->members.table[0];
@@ -544,6 +745,7 @@ dispatch_loop:
                 ENTRY(MP_BC_JUMP): {
                     DECODE_SLABEL;
                     ip += slab;
+                    TIER_UP_AT_JUMP();
                     DISPATCH_WITH_PEND_EXC_CHECK();
                 }
 
@@ -551,6 +753,7 @@ dispatch_loop:
                     DECODE_SLABEL;
                     if (mp_obj_is_true(POP())) {
                         ip += slab;
+                        TIER_UP_AT_JUMP();
                     }
                     DISPATCH_WITH_PEND_EXC_CHECK();
                 }
@@ -559,6 +762,7 @@ dispatch_loop:
                     DECODE_SLABEL;
                     if (!mp_obj_is_true(POP())) {
                         ip += slab;
+                        TIER_UP_AT_JUMP();
                     }
                     DISPATCH_WITH_PEND_EXC_CHECK();
                 }
@@ -921,7 +1125,7 @@ unwind_jump:;
                     // (unum >> 8) & 0xff == n_keyword
                     sp -= (unum & 0xff) + ((unum >> 7) & 0x1fe);
                     #if MICROPY_STACKLESS
-                    if (mp_obj_get_type(*sp) == &mp_type_fun_bc) {
+                    if (STACKLESS_CALLABLE(*sp)) {
                         code_state->ip = ip;
                         code_state->sp = sp;
                         code_state->exc_sp = MP_TAGPTR_MAKE(exc_sp, currently_in_except_block);
@@ -953,7 +1157,7 @@ unwind_jump:;
                     // fun arg0 arg1 ... kw0 val0 kw1 val1 ... seq dict <- TOS
                     sp -= (unum & 0xff) + ((unum >> 7) & 0x1fe) + 2;
                     #if MICROPY_STACKLESS
-                    if (mp_obj_get_type(*sp) == &mp_type_fun_bc) {
+                    if (STACKLESS_CALLABLE(*sp)) {
                         code_state->ip = ip;
                         code_state->sp = sp;
                         code_state->exc_sp = MP_TAGPTR_MAKE(exc_sp, currently_in_except_block);
@@ -988,7 +1192,7 @@ unwind_jump:;
                     // (unum >> 8) & 0xff == n_keyword
                     sp -= (unum & 0xff) + ((unum >> 7) & 0x1fe) + 1;
                     #if MICROPY_STACKLESS
-                    if (mp_obj_get_type(*sp) == &mp_type_fun_bc) {
+                    if (STACKLESS_CALLABLE(*sp)) {
                         code_state->ip = ip;
                         code_state->sp = sp;
                         code_state->exc_sp = MP_TAGPTR_MAKE(exc_sp, currently_in_except_block);
@@ -1024,7 +1228,7 @@ unwind_jump:;
                     // fun self arg0 arg1 ... kw0 val0 kw1 val1 ... seq dict <- TOS
                     sp -= (unum & 0xff) + ((unum >> 7) & 0x1fe) + 3;
                     #if MICROPY_STACKLESS
-                    if (mp_obj_get_type(*sp) == &mp_type_fun_bc) {
+                    if (STACKLESS_CALLABLE(*sp)) {
                         code_state->ip = ip;
                         code_state->sp = sp;
                         code_state->exc_sp = MP_TAGPTR_MAKE(exc_sp, currently_in_except_block);
@@ -1096,7 +1300,14 @@ unwind_return:
                     if (code_state->prev != NULL) {
                         mp_obj_t res = *sp;
                         mp_globals_set(code_state->old_globals);
-                        code_state = code_state->prev;
+                        mp_code_state_t *new_code_state = code_state->prev;
+                        #if MICROPY_TRACK_CODE_STATE
+                        // switch away before the frame is freed, which the
+                        // allocation trace and the profiler may look at
+                        MP_STATE_THREAD(current_code_state) = new_code_state;
+                        #endif
+                        mp_obj_fun_bc_free_codestate(code_state);
+                        code_state = new_code_state;
                         *code_state->sp = res;
                         goto run_code_state;
                     }
@@ -1214,6 +1425,45 @@ yield:
                     mp_import_all(POP());
                     DISPATCH();
 
+                // Superinstructions, emitted by the compiler in place of
+                // common sequences of the opcodes above
+
+                ENTRY(MP_BC_LOAD_FAST_LOAD_FAST): {
+                    mp_uint_t locals = *ip++;
+                    obj_shared = fastn[-(mp_int_t)(locals >> 4)];
+                    if (obj_shared == MP_OBJ_NULL) {
+                        goto local_name_error;
+                    }
+                    PUSH(obj_shared);
+                    obj_shared = fastn[-(mp_int_t)(locals & 0xf)];
+                    goto load_check;
+                }
+
+                ENTRY(MP_BC_BINARY_OP_SMALL_INT): {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_binary_op_t op = ip[0];
+                    mp_obj_t rhs = MP_OBJ_NEW_SMALL_INT((int8_t)ip[1]);
+                    ip += 2;
+                    SET_TOP(vm_binary_op(op, TOP(), rhs));
+                    DISPATCH();
+                }
+
+                ENTRY(MP_BC_BINARY_OP_POP_JUMP_IF_TRUE):
+                ENTRY(MP_BC_BINARY_OP_POP_JUMP_IF_FALSE): {
+                    MARK_EXC_IP_SELECTIVE();
+                    bool jump_if = ip[-1] == MP_BC_BINARY_OP_POP_JUMP_IF_TRUE;
+                    mp_binary_op_t op = *ip++;
+                    DECODE_SLABEL;
+                    mp_obj_t rhs = POP();
+                    mp_obj_t lhs = POP();
+                    mp_obj_t res = vm_binary_op(op, lhs, rhs);
+                    if ((res == mp_const_true || (res != mp_const_false && mp_obj_is_true(res))) == jump_if) {
+                        ip += slab;
+                        TIER_UP_AT_JUMP();
+                    }
+                    DISPATCH_WITH_PEND_EXC_CHECK();
+                }
+
 #if MICROPY_OPT_COMPUTED_GOTO
                 ENTRY(MP_BC_LOAD_CONST_SMALL_INT_MULTI):
                     PUSH(MP_OBJ_NEW_SMALL_INT((mp_int_t)ip[-1] - MP_BC_LOAD_CONST_SMALL_INT_MULTI - 16));
@@ -1236,7 +1486,7 @@ yield:
                     MARK_EXC_IP_SELECTIVE();
                     mp_obj_t rhs = POP();
                     mp_obj_t lhs = TOP();
-                    SET_TOP(mp_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs));
+                    SET_TOP(vm_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs));
                     DISPATCH();
                 }
 
@@ -1259,7 +1509,7 @@ yield:
                     } else if (ip[-1] < MP_BC_BINARY_OP_MULTI + 36) {
                         mp_obj_t rhs = POP();
                         mp_obj_t lhs = TOP();
-                        SET_TOP(mp_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs));
+                        SET_TOP(vm_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs));
                         DISPATCH();
                     } else
 #endif
@@ -1363,50 +1613,9 @@ unwind_loop:
             // But consider how to handle nested exceptions.
             // TODO need a better way of not adding traceback to constant objects (right now, just GeneratorExit_obj and MemoryError_obj)
             if (nlr.ret_val != &mp_const_GeneratorExit_obj && nlr.ret_val != &mp_const_MemoryError_obj) {
-                const byte *ip = code_state->fun_bc->bytecode;
-                ip = mp_decode_uint_skip(ip); // skip n_state
-                ip = mp_decode_uint_skip(ip); // skip n_exc_stack
-                ip++; // skip scope_params
-                ip++; // skip n_pos_args
-                ip++; // skip n_kwonly_args
-                ip++; // skip n_def_pos_args
-                size_t bc = code_state->ip - ip;
-                size_t code_info_size = mp_decode_uint_value(ip);
-                ip = mp_decode_uint_skip(ip); // skip code_info_size
-                bc -= code_info_size;
-                #if MICROPY_PERSISTENT_CODE
-                qstr block_name = ip[0] | (ip[1] << 8);
-                qstr source_file = ip[2] | (ip[3] << 8);
-                ip += 4;
-                #else
-                qstr block_name = mp_decode_uint_value(ip);
-                ip = mp_decode_uint_skip(ip);
-                qstr source_file = mp_decode_uint_value(ip);
-                ip = mp_decode_uint_skip(ip);
-                #endif
-                size_t source_line = 1;
-                size_t c;
-                while ((c = *ip)) {
-                    size_t b, l;
-                    if ((c & 0x80) == 0) {
-                        // 0b0LLBBBBB encoding
-                        b = c & 0x1f;
-                        l = c >> 5;
-                        ip += 1;
-                    } else {
-                        // 0b1LLLBBBB 0bLLLLLLLL encoding (l's LSB in second byte)
-                        b = c & 0xf;
-                        l = ((c << 4) & 0x700) | ip[1];
-                        ip += 2;
-                    }
-                    if (bc >= b) {
-                        bc -= b;
-                        source_line += l;
-                    } else {
-                        // found source line corresponding to bytecode offset
-                        break;
-                    }
-                }
+                qstr block_name;
+                qstr source_file;
+                size_t source_line = mp_bytecode_get_source_line(code_state->fun_bc->bytecode, code_state->ip, &block_name, &source_file);
                 mp_obj_exception_add_traceback(MP_OBJ_FROM_PTR(nlr.ret_val), source_file, source_line, block_name);
             }
 
@@ -1438,7 +1647,12 @@ unwind_loop:
             #if MICROPY_STACKLESS
             } else if (code_state->prev != NULL) {
                 mp_globals_set(code_state->old_globals);
-                code_state = code_state->prev;
+                mp_code_state_t *new_code_state = code_state->prev;
+                #if MICROPY_TRACK_CODE_STATE
+                MP_STATE_THREAD(current_code_state) = new_code_state;
+                #endif
+                mp_obj_fun_bc_free_codestate(code_state);
+                code_state = new_code_state;
                 size_t n_state = mp_decode_uint_value(code_state->fun_bc->bytecode);
                 fastn = &code_state->state[n_state - 1];
                 exc_stack = (mp_exc_stack_t*)(code_state->state + n_state);
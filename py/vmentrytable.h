@@ -106,6 +106,10 @@ static const void *const entry_table[256] = {
     [MP_BC_IMPORT_NAME] = &&entry_MP_BC_IMPORT_NAME,
     [MP_BC_IMPORT_FROM] = &&entry_MP_BC_IMPORT_FROM,
     [MP_BC_IMPORT_STAR] = &&entry_MP_BC_IMPORT_STAR,
+    [MP_BC_LOAD_FAST_LOAD_FAST] = &&entry_MP_BC_LOAD_FAST_LOAD_FAST,
+    [MP_BC_BINARY_OP_SMALL_INT] = &&entry_MP_BC_BINARY_OP_SMALL_INT,
+    [MP_BC_BINARY_OP_POP_JUMP_IF_TRUE] = &&entry_MP_BC_BINARY_OP_POP_JUMP_IF_TRUE,
+    [MP_BC_BINARY_OP_POP_JUMP_IF_FALSE] = &&entry_MP_BC_BINARY_OP_POP_JUMP_IF_FALSE,
     [MP_BC_LOAD_CONST_SMALL_INT_MULTI ... MP_BC_LOAD_CONST_SMALL_INT_MULTI + 63] = &&entry_MP_BC_LOAD_CONST_SMALL_INT_MULTI,
     [MP_BC_LOAD_FAST_MULTI ... MP_BC_LOAD_FAST_MULTI + 15] = &&entry_MP_BC_LOAD_FAST_MULTI,
     [MP_BC_STORE_FAST_MULTI ... MP_BC_STORE_FAST_MULTI + 15] = &&entry_MP_BC_STORE_FAST_MULTI,
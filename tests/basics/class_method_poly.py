@@ -0,0 +1,54 @@
+# test method calls from one place in the code on objects of different
+# classes, and changes to the objects and classes between the calls
+
+class A:
+    def f(self):
+        return 'A'
+
+class B(A):
+    def f(self):
+        return 'B'
+
+class C(A):
+    pass
+
+class D:
+    def f(self):
+        return 'D'
+
+class E:
+    f = lambda self: 'E'
+
+class L(list):
+    def f(self):
+        return 'L' + str(len(self))
+
+def call(objs):
+    return [o.f() for o in objs]
+
+objs = [A(), B(), C(), D(), E(), L([1, 2])]
+print(call(objs))
+print(call(objs))
+
+# an instance member shadows the method of the class
+c = C()
+print(call([c, c]))
+c.f = lambda: 'member'
+print(call([c, c]))
+del c.f
+print(call([c, c]))
+
+# replace the method in a class
+A.f = lambda self: 'A2'
+print(call(objs))
+
+# add an override to a subclass which previously inherited the method
+C.f = lambda self: 'C'
+print(call(objs))
+
+# a method found through __getattr__ rather than the class
+class G:
+    def __getattr__(self, name):
+        return lambda: 'G.' + name
+
+print(call([G(), A(), G()]))
@@ -0,0 +1,94 @@
+# test classes with __slots__
+
+# skip if __slots__ is not supported, so instances take any attribute
+class Test:
+    __slots__ = ()
+try:
+    Test().noexist = 1
+    print('SKIP')
+    raise SystemExit
+except AttributeError:
+    pass
+
+class A:
+    __slots__ = ('x', 'y')
+    def __init__(self, x):
+        self.x = x
+    def get(self):
+        return self.x, self.y
+
+a = A(1)
+print(a.x)
+a.y = 2
+print(a.get())
+
+# an unassigned slot
+print(hasattr(A(1), 'y'))
+try:
+    A(1).y
+except AttributeError:
+    print('AttributeError')
+
+# delete a slot
+del a.x
+print(hasattr(a, 'x'))
+try:
+    del a.x
+except AttributeError:
+    print('AttributeError')
+a.x = 3
+print(a.x)
+
+# only the listed attributes can be stored
+try:
+    a.z = 1
+except AttributeError:
+    print('AttributeError')
+
+# a single name
+class B:
+    __slots__ = 'x'
+b = B()
+b.x = 4
+print(b.x)
+
+# extending the slots of a base class
+class C(A):
+    __slots__ = ['z']
+    def __init__(self):
+        A.__init__(self, 5)
+        self.y = 6
+        self.z = 7
+c = C()
+print(c.x, c.y, c.z, c.get())
+try:
+    c.w = 1
+except AttributeError:
+    print('AttributeError')
+
+# a subclass without __slots__ has members too
+class D(A):
+    pass
+d = D(8)
+d.w = 9
+print(d.x, d.w)
+
+# a class attribute in a subclass hides a slot
+class E(A):
+    x = 10
+e = E(11)
+print(e.x)
+
+# a class attribute which conflicts with a slot
+try:
+    class F:
+        __slots__ = ('x',)
+        x = 1
+except ValueError:
+    print('ValueError')
+
+# many instances, each with their own values
+l = [A(i) for i in range(10)]
+for o in l:
+    o.y = o.x * 2
+print([o.get() for o in l])
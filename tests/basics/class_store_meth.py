@@ -0,0 +1,59 @@
+# test that methods looked up through base classes see later changes to
+# the classes
+
+class A:
+    def f(self):
+        return 'A.f'
+
+class B(A):
+    pass
+
+class C(B):
+    def g(self):
+        return 'C.g'
+
+c = C()
+print(c.f(), c.g())
+
+# replace a method in the base class
+A.f = lambda self: 'A.f2'
+print(c.f())
+
+# override it in an intermediate class
+B.f = lambda self: 'B.f'
+print(c.f())
+
+# remove the override again
+del B.f
+print(c.f())
+
+# an attribute that didn't exist before
+try:
+    c.h()
+except AttributeError:
+    print('AttributeError')
+A.h = lambda self: 'A.h'
+print(c.h())
+
+# class-level lookups
+print(C.g(c), C.f(c))
+del A.h
+print(hasattr(c, 'h'), hasattr(C, 'h'))
+
+# classmethod found through a base, then called on different classes
+class D:
+    @classmethod
+    def name(cls):
+        return cls.__name__
+
+class E(D):
+    pass
+
+print(D().name(), E().name(), E.name())
+
+# classes created in a loop get fresh lookups
+for i in range(3):
+    class F:
+        def f(self, i=i):
+            return i
+    print(F().f())
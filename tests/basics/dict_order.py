@@ -0,0 +1,52 @@
+# dicts keep their items in insertion order, through deletions and growth
+
+d = {}
+for i in range(20):
+    d[i * 7 % 20] = i
+if list(d.values()) != list(range(20)):
+    print('SKIP')
+    raise SystemExit
+print(list(d.keys()))
+
+# deleting items and adding new ones
+for i in range(0, 20, 3):
+    del d[i]
+d[100] = 100
+d[3] = 3
+print(list(d.items()))
+
+# re-inserting an existing key keeps its place
+d[1] = 'one'
+print(list(d.keys())[:5])
+
+# small dicts, and keys of different types
+d = {'b': 1, 'a': 2}
+d[3] = 3
+d[(1, 2)] = 4
+del d['b']
+d['b'] = 5
+print(d)
+
+# instance attributes
+class A:
+    pass
+a = A()
+a.z = 1
+a.y = 2
+a.x = 3
+print(list(a.__dict__))
+
+# copying and updating
+d = {k: k for k in 'hello world'}
+d2 = d.copy()
+d2.update({'q': 1, 'h': 2})
+print(d2)
+print(len(d), len(d2))
+
+# many insertions and deletions, where deleted entries must be reclaimed
+d = {}
+for i in range(1000):
+    d[i] = i
+    if i >= 10:
+        del d[i - 10]
+print(list(d))
@@ -0,0 +1,109 @@
+# test sequences of operations which the compiler may fuse together
+
+def locals_pair(a, b):
+    return a - b, b - a
+
+print(locals_pair(3, 10))
+print(locals_pair(1.5, 2))
+
+# second local of a pair unbound
+def unbound_pair(a):
+    if a:
+        b = 1
+    return a + b
+
+print(unbound_pair(True))
+try:
+    unbound_pair(False)
+except NameError:
+    print('NameError')
+
+# op with a small int constant, on ints and other types
+def small_const(x):
+    return x + 1, x - 2, x * 3, x & 7, x | 8, x ^ 15, x < 4, x >= -16
+
+for x in (0, 5, -5, 1 << 29, 1 << 61, 1 << 100, -(1 << 100)):
+    print(small_const(x))
+print(small_const(True))
+
+def small_const_other(x):
+    return x * 2, x + 1
+
+print(small_const_other(2.5))
+try:
+    small_const_other('ab')
+except TypeError:
+    print('TypeError')
+
+def inplace(x):
+    x += 1
+    x -= 47
+    x <<= 1
+    return x
+
+print(inplace(3), inplace(-100), inplace(1 << 62))
+
+# small int results that overflow into big ints
+def overflow(a, b):
+    return a + b, a - b, a * b
+
+print(overflow(1 << 30, 1 << 30))
+print(overflow(1 << 62, 1 << 62))
+print(overflow(-(1 << 62), 1 << 62))
+print(overflow(1 << 31, -(1 << 31)))
+
+# comparison followed by a conditional jump
+def count(n):
+    i = 0
+    while i < n:
+        i += 1
+    return i
+
+print(count(10), count(-1))
+
+def compare(a, b):
+    r = []
+    if a < b:
+        r.append('<')
+    if a <= b:
+        r.append('<=')
+    if a == b:
+        r.append('==')
+    if not a != b:
+        r.append('not !=')
+    if a > b:
+        r.append('>')
+    if a >= b:
+        r.append('>=')
+    if a in (1, 2):
+        r.append('in')
+    if a & 1:
+        r.append('odd')
+    return r
+
+print(compare(1, 2))
+print(compare(2, 2))
+print(compare(3, 2))
+print(compare(1 << 100, 1))
+print(compare(True, 1))
+
+# comparison whose result isn't a bool
+class A:
+    def __init__(self, v):
+        self.v = v
+    def __lt__(self, other):
+        return self.v
+
+print([1 if A(v) < A(0) else 0 for v in (0, 1, [], [0], None)])
+
+# mixing chained comparisons and boolean operators
+def chained(a, b, c):
+    if a < b < c:
+        return 1
+    elif a < b or b < c:
+        return 2
+    elif a < b and b < c:
+        return 3
+    return 4
+
+print(chained(1, 2, 3), chained(1, 3, 2), chained(3, 2, 1))
@@ -0,0 +1,26 @@
+# Biquad filter over floats, as viper code with unboxed floats
+import bench
+
+@micropython.viper
+def biquad(n: int, b: float, a1: float, a2: float) -> float:
+    b0 = b
+    b1 = 2.0 * b
+    b2 = b
+    x1 = 0.0
+    x2 = 0.0
+    y1 = 0.0
+    y2 = 0.0
+    x = 1.0
+    for i in range(n):
+        y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2
+        x2 = x1
+        x1 = x
+        y2 = y1
+        y1 = y
+        x = 0.0
+    return y1
+
+def test(num):
+    biquad(num, 0.2, -0.5, 0.25)
+
+bench.run(test)
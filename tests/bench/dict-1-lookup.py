@@ -0,0 +1,12 @@
+# Looking up keys in a dict of 100 entries
+import bench
+
+def test(num):
+    d = {}
+    for i in range(100):
+        d["k%d" % i] = i
+    k0, k1, k2, k3, k4 = "k0", "k10", "k49", "k99", "k77"
+    for i in iter(range(num // 20)):
+        d[k0]; d[k1]; d[k2]; d[k3]; d[k4]
+
+bench.run(test)
@@ -0,0 +1,12 @@
+# Iterating over the items of a dict of 50 entries
+import bench
+
+def test(num):
+    d = {}
+    for i in range(50):
+        d['k%d' % i] = i
+    for i in iter(range(num // 500)):
+        for k, v in d.items():
+            pass
+
+bench.run(test)
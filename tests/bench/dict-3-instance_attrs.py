@@ -0,0 +1,16 @@
+# Creating many objects with a few attributes each, which live in small dicts
+import bench
+
+class Point:
+    def __init__(self, x, y, z):
+        self.x = x
+        self.y = y
+        self.z = z
+        self.w = 0
+
+def test(num):
+    for i in iter(range(num // 200)):
+        p = Point(i, i, i)
+        p.w = p.x + p.y + p.z
+
+bench.run(test)
@@ -0,0 +1,11 @@
+# Adding and removing keys, with the dict staying at about 20 entries
+import bench
+
+def test(num):
+    d = {}
+    for i in iter(range(num // 100)):
+        d[i] = i
+        if i >= 20:
+            del d[i - 20]
+
+bench.run(test)
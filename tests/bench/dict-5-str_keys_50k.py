@@ -0,0 +1,20 @@
+# cmdline: -X heapsize=16M
+# Building and querying a dict of 50k HTTP header strings, which are not
+# interned, as when they come from the network.  Needs a heap of about 10MB,
+# more than the default of the unix port.
+import bench
+
+HEADERS = ('Content-Type', 'Content-Length', 'Accept-Encoding', 'User-Agent',
+    'X-Request-Id', 'Cache-Control', 'Set-Cookie', 'If-None-Match')
+
+def test(num):
+    n = 50000
+    d = {}
+    for i in range(n):
+        d['%s-%d' % (HEADERS[i % 8], i)] = i
+    keys = ['%s-%d' % (HEADERS[i % 8], i) for i in range(0, n, n // 1000)]
+    for i in iter(range(num // 4000)):
+        for k in keys:
+            d[k]
+
+bench.run(test)
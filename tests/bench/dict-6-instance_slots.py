@@ -0,0 +1,18 @@
+# Creating many objects with a few attributes each, which live in slots
+import bench
+
+class Point:
+    __slots__ = ('x', 'y', 'z', 'w')
+
+    def __init__(self, x, y, z):
+        self.x = x
+        self.y = y
+        self.z = z
+        self.w = 0
+
+def test(num):
+    for i in iter(range(num // 200)):
+        p = Point(i, i, i)
+        p.w = p.x + p.y + p.z
+
+bench.run(test)
@@ -0,0 +1,13 @@
+# Allocation throughput for 1 to 8 block objects on an unfragmented heap.
+# Compare against gcalloc-2-fragmented.py, and run with a larger heap (eg
+# -X heapsize=8M on the unix port) to see how the cost scales with heap size.
+import bench
+import gc
+
+def test(num):
+    gc.collect()
+    for i in iter(range(num // 2000)):
+        for k in (1, 3, 5, 7, 9, 13, 17, 25, 29):
+            t = (0,) * k
+
+bench.run(test)
@@ -0,0 +1,21 @@
+# Allocation throughput for 1 to 8 block objects on a heap fragmented into
+# many single-block holes.  With a linear scan of the allocation table each
+# multi-block allocation walks past all the holes; with segregated free lists
+# (MICROPY_GC_SIZE_CLASSES) it doesn't.
+import bench
+import gc
+
+def test(num):
+    gc.collect()
+    n = gc.mem_free() // 80
+    keep = [None] * n
+    for i in iter(range(n)):
+        keep[i] = (i,)
+    for i in iter(range(0, n, 2)):
+        keep[i] = None
+    gc.collect()
+    for i in iter(range(num // 2000)):
+        for k in (1, 3, 5, 7, 9, 13, 17, 25, 29):
+            t = (0,) * k
+
+bench.run(test)
@@ -0,0 +1,23 @@
+# Longest pause seen by a single allocation while short-lived objects are
+# churned through a heap that is half full of live objects.  Prints the
+# pause in seconds.  With MICROPY_GC_LAZY_SWEEP the sweep is spread over the
+# allocations that follow a collection, so the pause is mostly the mark
+# phase.  Run with eg -X heapsize=8M on the unix port for a large heap.
+import time
+import gc
+
+def test(num):
+    gc.collect()
+    live = [None] * (gc.mem_free() // 96)
+    for i in iter(range(len(live))):
+        live[i] = (i, i)
+    pause = 0
+    for i in iter(range(num // 50)):
+        t = time.ticks_us()
+        x = [i]
+        t = time.ticks_diff(time.ticks_us(), t)
+        if t > pause:
+            pause = t
+    print(pause / 1000000)
+
+test(20000000)
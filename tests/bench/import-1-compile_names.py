@@ -0,0 +1,16 @@
+# Compiling a module, as done on import: every identifier the lexer sees is
+# interned, which needs a lookup among all the qstrs that exist so far
+import bench
+
+# the qstrs of a large application, eg from frozen modules
+qstrs = ['q%d' % i for i in range(4000)]
+for q in qstrs:
+    compile(q, '', 'eval')
+
+src = '\n'.join('def f%d(a%d, b%d):\n    return a%d.x%d + b%d.y%d' % ((i,) * 7) for i in range(50))
+
+def test(num):
+    for i in iter(range(num // 100000)):
+        compile(src, 'mod', 'exec')
+
+bench.run(test)
@@ -0,0 +1,12 @@
+import bench
+
+class A:
+    def meth(self):
+        return 1
+
+def test(num):
+    o = A()
+    for i in iter(range(num)):
+        o.meth()
+
+bench.run(test)
@@ -0,0 +1,20 @@
+import bench
+
+class A:
+    def meth(self):
+        return 1
+
+class B(A):
+    def other_b(self):
+        pass
+
+class C(B):
+    def other_c(self):
+        pass
+
+def test(num):
+    o = C()
+    for i in iter(range(num)):
+        o.meth()
+
+bench.run(test)
@@ -0,0 +1,32 @@
+import bench
+
+class A:
+    def meth(self):
+        return 1
+
+class B(A):
+    def other_b(self):
+        pass
+
+class C(B):
+    def other_c(self):
+        pass
+
+class D(C):
+    def other_d(self):
+        pass
+
+class E(D):
+    def other_e(self):
+        pass
+
+class F(E):
+    def other_f(self):
+        pass
+
+def test(num):
+    o = F()
+    for i in iter(range(num)):
+        o.meth()
+
+bench.run(test)
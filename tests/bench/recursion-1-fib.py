@@ -0,0 +1,13 @@
+# Recursive function calls: each call to fib is a Python-to-Python call
+import bench
+
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+
+def test(num):
+    for i in iter(range(num // 200000)):
+        fib(20)
+
+bench.run(test)
@@ -0,0 +1,19 @@
+# Recursive walk of a binary tree of tuples, with a call per node
+import bench
+
+def make(depth):
+    if depth == 0:
+        return None
+    return (make(depth - 1), depth, make(depth - 1))
+
+def walk(node):
+    if node is None:
+        return 0
+    return walk(node[0]) + node[1] + walk(node[2])
+
+def test(num):
+    tree = make(12)
+    for i in iter(range(num // 100000)):
+        walk(tree)
+
+bench.run(test)
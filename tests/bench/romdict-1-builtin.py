@@ -0,0 +1,8 @@
+# Loading a builtin by name, which is found in the ROM dict of builtins
+import bench
+
+def test(num):
+    for i in iter(range(num // 10)):
+        len; abs; isinstance; print; divmod
+
+bench.run(test)
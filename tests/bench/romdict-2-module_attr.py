@@ -0,0 +1,9 @@
+# Loading attributes of a builtin module, which has a ROM dict of globals
+import bench
+import sys
+
+def test(num):
+    for i in iter(range(num // 10)):
+        sys.stdout; sys.version; sys.maxsize; sys.byteorder; sys.platform
+
+bench.run(test)
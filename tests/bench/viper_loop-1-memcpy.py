@@ -0,0 +1,15 @@
+# Copy a buffer byte by byte, as a viper loop
+import bench
+
+@micropython.viper
+def memcpy(dest:ptr8, src:ptr8, n:int):
+    for i in range(n):
+        dest[i] = src[i]
+
+def test(num):
+    src = bytearray(1000)
+    dest = bytearray(1000)
+    for i in iter(range(num // 1000)):
+        memcpy(dest, src, 1000)
+
+bench.run(test)
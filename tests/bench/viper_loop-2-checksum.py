@@ -0,0 +1,18 @@
+# Fletcher-16 checksum of a buffer, as a viper loop
+import bench
+
+@micropython.viper
+def checksum(src:ptr8, n:int) -> int:
+    s1 = 0
+    s2 = 0
+    for i in range(n):
+        s1 = (s1 + src[i]) % 255
+        s2 = (s2 + s1) % 255
+    return s2 << 8 | s1
+
+def test(num):
+    src = bytearray(1000)
+    for i in iter(range(num // 1000)):
+        checksum(src, 1000)
+
+bench.run(test)
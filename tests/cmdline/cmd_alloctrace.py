@@ -0,0 +1,16 @@
+# cmdline: -X alloctrace
+# test printing of the heap allocations made by each source line
+def f(n):
+    l = []
+    for i in range(n):
+        l.append(bytearray(100))
+    return l
+f(10)
+print('done')
+
+# allocations made by a native generator count towards the line resuming it
+@micropython.native
+def g(n):
+    for i in range(n):
+        yield bytearray(1000)
+print(len(list(g(3))))
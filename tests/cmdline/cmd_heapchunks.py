@@ -0,0 +1,38 @@
+# cmdline: -X heapsize=256k -X heapchunks=4
+# test a heap that is made of several separate areas
+import gc
+
+# the heap is the sum of all the areas
+free = gc.mem_free()
+print(free + gc.mem_alloc() > 200000)
+
+# an object can't span areas, so this is too big
+try:
+    bytearray(100000)
+except MemoryError:
+    print('MemoryError')
+
+# fill most of the heap, with objects in different areas referring to each other
+def fill(n):
+    l = None
+    for i in range(n):
+        l = (l, bytearray(64), str(i))
+    return l
+
+def check(l):
+    n = 0
+    while l is not None:
+        l, b, s = l
+        if len(b) != 64 or s != str(799 - n):
+            print('bad', n)
+        n += 1
+    return n
+
+def run():
+    l = fill(800)
+    gc.collect()
+    print(check(l))
+
+# the memory is reclaimed each time
+for _ in range(3):
+    run()
@@ -0,0 +1,47 @@
+# a method replaced through the class dict, kept from locals() in the class
+# body, is seen by instances which already looked it up
+
+class A:
+    d = locals()
+    def f(self):
+        return 1
+
+a = A()
+print(a.f())
+A.d['f'] = lambda self: 2
+print(a.f())
+
+# an attribute added through the dict after it was looked up and not found
+try:
+    a.g
+except AttributeError:
+    print('AttributeError')
+A.d['g'] = 3
+print(a.g)
+del A.d['g']
+try:
+    a.g
+except AttributeError:
+    print('AttributeError')
+
+# an attribute added to the dict of a subclass hides that of its base
+class B(A):
+    d = locals()
+
+b = B()
+print(getattr(b, 'f')(), b.f())
+B.d['f'] = lambda self: 4
+print(getattr(b, 'f')(), b.f())
+B.d.clear()
+print(getattr(b, 'f')(), b.f())
+
+# a method call that has been cached in a loop sees the change
+def call(o):
+    r = 0
+    for i in range(4):
+        r += o.f()
+    return r
+
+print(call(b))
+B.d['f'] = lambda self: 5
+print(call(b))
@@ -0,0 +1,25 @@
+# a slot hidden by a class attribute stored through the class dict, kept from
+# locals() in the class body, is no longer loaded straight from the slot
+
+# skip if __slots__ is not supported, so instances take any attribute
+class Test:
+    __slots__ = ()
+try:
+    Test().noexist = 1
+    print('SKIP')
+    raise SystemExit
+except AttributeError:
+    pass
+
+class A:
+    __slots__ = ('x',)
+    d = locals()
+
+def get(a):
+    return a.x
+
+a = A()
+a.x = 1
+print(get(a), get(a))
+A.d['x'] = 5
+print(get(a), a.x)
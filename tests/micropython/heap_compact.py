@@ -0,0 +1,60 @@
+# check that filling up a fragmented heap compacts it, and that objects are
+# intact after the arrays of their lists, dicts and instances got moved
+
+import gc
+import micropython
+
+try:
+    micropython.heap_compact_count
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+class A:
+    pass
+
+def fragment(n):
+    objs = [A() for i in range(n)]
+    for i, a in enumerate(objs):
+        a.l = [i] * 3
+        a.d = {'a': i}
+    # grow the arrays, which moves them, leaving holes between them
+    for i, a in enumerate(objs):
+        a.x = i
+        a.l.extend(range(i, i + 6))
+        a.d['b'] = -i
+        a.d[i] = 'c'
+        junk = bytes(100)
+    return objs
+
+def check(objs):
+    ok = True
+    for i, a in enumerate(objs):
+        ok = (ok and a.x == i and a.l == [i] * 3 + list(range(i, i + 6))
+            and a.d == {'a': i, 'b': -i, i: 'c'})
+    return ok
+
+def fill():
+    pins = []
+    try:
+        while True:
+            pins.append(bytearray(1000))
+    except MemoryError:
+        pass
+    return pins
+
+def run():
+    objs = fragment(300)
+    gc.collect()
+    n = micropython.heap_compact_count()
+    pins = fill()
+    print(micropython.heap_compact_count() > n)
+    pins = None
+    gc.collect()
+    print(check(objs))
+    # the heap can be filled again
+    pins = fill()
+    pins = None
+    print(check(objs))
+
+run()
@@ -0,0 +1,53 @@
+# test loading native code from a .mpy file, and rejecting it if the file
+# is for another arch
+
+import sys
+try:
+    import uos
+    uos.unlink
+except (ImportError, AttributeError):
+    print('SKIP')
+    raise SystemExit
+
+# "def f(x): return x + 1" compiled for x64 with
+# mpy-cross -mcache-lookup-bc -march=x64 -X emit=native
+mpy = (
+    b'M\x06\x0b\x1f\x85\x01\x81&UH\x89\xe5H\x83\xec8SATAUAVA'
+    b'WH\x89}\xc8\xbf\x93\x00\x00\x00H\x89}\xd0H\x8d}\xc8\x90\x90\x90\x90H\xb8'
+    b'\xdd?\r\xfa-V\x00\x00\xff\xd0\xbe\x00\x00\x00\x00\xba\x00\x00\x00\x00\x90\x90H\xbf'
+    b'\xa0#\xa4Yv\x7f\x00\x00\x90\x90\x90\x90\x90\x90H\xb8\xd5\x1f\x0c\xfa-V\x00\x00'
+    b'\xff\xd0H\x89\xc6\x90H\xbf\xfe\x00\x00\x00\x00\x00\x00\x00\x90\x90\x90\x90\x90\x90H\xb8'
+    b"\xec'\x0c\xfa-V\x00\x00\xff\xd0\x90\x90\x90\x90H\xb8\xd0\xdb\r\xfa-V\x00\x00"
+    b'A_A^A]A\\[\xc9\xc3\x80\x01\x00\x00\x00\x00\x00\x054\x00\xfd\x00\xff'
+    b'\x81 \x00\x00\x00\x08(\x01)@\x07\x83a\x81&UH\x89\xe5H\x83\xecHS'
+    b'ATAUAVAWH\x89}\xb8\xbf]\x00\x00\x00H\x89}\xc0H\x8d}'
+    b'\xb8\x90\x90\x90\x90H\xb8\xdd?\r\xfa-V\x00\x00\xff\xd0H\x8b]\xf8\xba\x03\x00'
+    b'\x00\x00H\x89\xde\xbf\x1a\x00\x00\x00\x90\x90\x90H\xb8\xd3;\x0c\xfa-V\x00\x00\xff'
+    b'\xd0A_A^A]A\\[\xc9\xc3\x80\x03\x00\x00\x01\x00\x00\x05\xfe\x00\xfd\x00'
+    b'\xff\x00\x00\x00\x00\x00\x00\xfe\x03\x00\x00\x00\x00\x00\x00p\x00\x01\x00\x05(\x01)H'
+    b'\x01\x0ee\x04\x01fg\x04\x06mod.pyp\x05\x01xP\x01\x16`\x03'
+    b'\x01fp\x01\x08\x81\x00\x02\x00\x81\x1b\x04\x08<module>\x81\x1d\x04'
+    b'\x06mod.py'
+)
+
+def load(data):
+    with open('mpytest_native.mpy', 'wb') as f:
+        f.write(data)
+    try:
+        import mpytest_native
+        return mpytest_native.f(1)
+    except ValueError as er:
+        return er.args[0]
+    finally:
+        uos.unlink('mpytest_native.mpy')
+        sys.modules.pop('mpytest_native', None)
+
+# this is only x64 code for the layout of the default unix build
+if load(mpy) != 2:
+    print('SKIP')
+    raise SystemExit
+
+print(load(mpy))
+
+# the same code marked as being for x86
+print(load(mpy[:2] + bytes([mpy[2] & 3 | 1 << 2]) + mpy[3:]))
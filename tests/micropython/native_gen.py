@@ -0,0 +1,59 @@
+# test for native generators
+
+# simple generator with yield and return
+@micropython.native
+def gen1(x):
+    yield x
+    yield x + 1
+    return x + 2
+g = gen1(3)
+print(next(g), next(g))
+try:
+    next(g)
+except StopIteration as e:
+    print('StopIteration', e.args)
+
+# generator with locals and a loop, and send
+@micropython.native
+def gen2(n):
+    total = 0
+    for i in range(n):
+        x = yield total
+        total += x
+    print('total', total)
+g = gen2(3)
+print(next(g), g.send(1), g.send(2))
+try:
+    g.send(3)
+except StopIteration:
+    print('StopIteration')
+
+# yield from another generator, and throwing in
+@micropython.native
+def gen3():
+    try:
+        r = yield from gen1(5)
+        print('returned', r)
+        yield 100
+    except ValueError as e:
+        print('caught', repr(e))
+        yield 200
+g = gen3()
+print(list(g))
+g = gen3()
+print(next(g), g.throw(ValueError(1)))
+
+# close and finally
+@micropython.native
+def gen4():
+    try:
+        yield 1
+        yield 2
+    finally:
+        print('finally')
+g = gen4()
+print(next(g))
+g.close()
+
+# generator expression
+print(list(x * x for x in range(5)))
@@ -0,0 +1,85 @@
+# test running hot bytecode functions as native code
+
+import micropython
+
+try:
+    micropython.opt_level(micropython.opt_level(), 1)
+except TypeError:
+    print('SKIP')
+    raise SystemExit
+
+# a loop that is entered part way through as native code
+def loop(n):
+    s = 0
+    i = 0
+    while i < n:
+        s += i
+        i += 1
+    return s
+print(loop(10), loop(1000))
+
+def for_loop(lst):
+    t = 0
+    for x in lst:
+        if x & 1:
+            continue
+        t += x
+    return t
+print(for_loop([1, 2, 3, 4]), for_loop(range(100)))
+
+# arguments and defaults
+def args(a, b=2, *c, d=4, **e):
+    return a, b, c, d, sorted(e)
+for i in range(3):
+    print(args(1), args(1, 3, 5, d=6, f=7))
+
+# globals of the module the function was defined in
+G = 5
+def glob():
+    return G * 2
+print(glob(), glob())
+G = 6
+print(glob())
+
+# exceptions raised and caught
+def exc(n):
+    try:
+        return 1 // n
+    except ZeroDivisionError:
+        return 'div'
+    finally:
+        pass
+print(exc(1), exc(0), exc(0))
+try:
+    exc(None)
+except TypeError:
+    print('TypeError')
+
+# comprehensions and closures made inside the function
+def comp(n):
+    return [x * x for x in range(n)], {x: x + n for x in range(2)}
+print(comp(3), comp(4))
+
+# functions that stay as bytecode
+def gen():
+    yield 1
+def cell():
+    x = 1
+    return lambda: x
+print(list(gen()), list(gen()), cell()(), cell()())
+
+# recursion
+def fib(n):
+    return n if n < 2 else fib(n - 1) + fib(n - 2)
+print(fib(15))
+
+# a StopIteration in the body of a for loop doesn't end the loop
+def next_in_loop(n, it):
+    for x in range(n): next(it)
+    return 'done'
+try:
+    next_in_loop(100, iter(range(50)))
+except StopIteration:
+    print('StopIteration')
+
+micropython.opt_level(micropython.opt_level(), 0)
@@ -0,0 +1,30 @@
+# test that hot bytecode functions run as native code keep their tracebacks
+
+import micropython
+import sys
+
+try:
+    import uio
+    micropython.opt_level(micropython.opt_level(), 3)
+except (ImportError, TypeError):
+    print('SKIP')
+    raise SystemExit
+
+def raise_in(lst):
+    t = 0
+    for x in lst:
+        t += x
+        t += 1 // x
+    return t
+
+# the first call enters the native code part way through the loop, and the
+# others run all of it as native code
+for i in range(3):
+    buf = uio.StringIO()
+    try:
+        raise_in([1, 2, 0])
+    except ZeroDivisionError as e:
+        sys.print_exception(e, buf)
+    print([l.split(', ')[1] for l in buf.getvalue().split('\n') if l.startswith('  File')])
+
+micropython.opt_level(micropython.opt_level(), 0)
@@ -0,0 +1,88 @@
+# test for native try/except/finally and with
+
+# return from try and except, with a finally
+@micropython.native
+def f(x):
+    try:
+        return 10 // x
+    except ZeroDivisionError:
+        return 'div'
+    finally:
+        print('finally')
+print(f(2), f(0))
+
+# break and continue through finally
+@micropython.native
+def f():
+    for i in range(4):
+        try:
+            if i == 1:
+                continue
+            if i == 3:
+                break
+            print('body', i)
+        finally:
+            print('finally', i)
+    return i
+print(f())
+
+# nested handlers, bare raise and exception as a name
+@micropython.native
+def f():
+    try:
+        try:
+            raise ValueError(1)
+        except TypeError:
+            print('not here')
+    except ValueError as e:
+        print('caught', repr(e))
+    try:
+        try:
+            raise KeyError(2)
+        except KeyError:
+            print('reraise')
+            raise
+    except KeyError as e:
+        print('caught', repr(e))
+f()
+
+# locals keep their values after an exception
+@micropython.native
+def f(x):
+    a = x + 1
+    try:
+        a = a * 2
+        b = 1 // 0
+    except ZeroDivisionError:
+        a += 1
+    return a
+print(f(3))
+
+# with statement, where __exit__ swallows or doesn't swallow the exception
+class CM:
+    def __init__(self, swallow):
+        self.swallow = swallow
+    def __enter__(self):
+        print('enter')
+        return self
+    def __exit__(self, a, b, c):
+        print('exit', a)
+        return self.swallow
+
+@micropython.native
+def f(swallow):
+    with CM(swallow) as c:
+        raise ValueError
+    return 'after'
+print(f(True))
+try:
+    f(False)
+except ValueError:
+    print('ValueError')
+
+# return from inside a with
+@micropython.native
+def f():
+    with CM(False):
+        return 1
+print(f())
@@ -0,0 +1,53 @@
+# test the viper float type, which holds floats unboxed
+
+try:
+    exec("@micropython.viper\ndef f(x:float) -> float: return x")
+except:
+    print("SKIP")
+    raise SystemExit
+
+# arguments and return values are boxed and unboxed
+@micropython.viper
+def add(x:float, y:float) -> float:
+    return x + y
+print(add(1.5, 2.25))
+print(add(1, 2))
+
+# arithmetic, including with int operands and constants
+@micropython.viper
+def arith(x:float, y:float, i:int):
+    print(x - y, x * y, x / y)
+    print(-x, +x, x * 2, 3 - x, x + i, i * y)
+    z = x
+    z += 0.5
+    z *= y
+    print(z)
+arith(1.5, 2.0, 3)
+arith(-0.25, 4.0, -1)
+
+# comparisons, which are false for nan except for !=
+@micropython.viper
+def comp(x:float, y:float):
+    print(x < y, x > y, x == y, x <= y, x >= y, x != y)
+comp(1.5, 2.0)
+comp(2.0, 2.0)
+comp(2.0, 1.0)
+comp(float('nan'), 1.0)
+
+# conversions between int and float
+@micropython.viper
+def conv(x:float, i:int):
+    print(int(x), int(-x), float(i), float(3), float(i) / 2, float(2.5))
+conv(7.9, 5)
+conv(-0.5, -3)
+
+# float locals in a loop, and floats passed to Python code
+@micropython.viper
+def loop(n:int) -> float:
+    s = 0.0
+    for i in range(n):
+        if float(i) > 1.5:
+            s += 0.5 * i
+    print(s)
+    return s
+print(loop(10))
@@ -0,0 +1,37 @@
+# test viper functions with more locals than can be kept in registers
+
+@micropython.viper
+def f(src:ptr8, n:int) -> int:
+    a = 1
+    b = 2
+    c = 3
+    d = 4
+    e = 5
+    for i in range(n):
+        a += src[i]
+        b += a
+        c ^= b
+    for i in range(n):
+        d += src[n - 1 - i]
+        e = e * 3 + d
+    return a + b + c + d + e
+
+@micropython.viper
+def g(dest:ptr8, src:ptr8, n:int) -> int:
+    x = 0
+    y = 0
+    i = 0
+    while i < n:
+        j = 0
+        while j < 4:
+            x += src[i]
+            j += 1
+        dest[i] = x
+        y = x
+        i += 1
+    return y
+
+b = bytearray(b'1234')
+print(f(b, 4))
+d = bytearray(4)
+print(g(d, b, 4), d)
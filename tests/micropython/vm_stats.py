@@ -0,0 +1,26 @@
+# test micropython.vm_stats, which counts the opcodes executed by the VM
+
+import micropython
+
+try:
+    micropython.vm_stats
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+def f(n):
+    i = 0
+    while i < n:
+        i += 1
+
+# start counting afresh
+micropython.vm_stats(True)
+f(100)
+ops, pairs = micropython.vm_stats()
+
+# each opcode of the loop ran 100 times
+print(max(ops.values()) >= 100)
+
+# each opcode is counted once as the second of a pair
+print(all(type(k) is tuple and len(k) == 2 for k in pairs))
+print(all(sum(n for (op1, op2), n in pairs.items() if op2 == op) == ops[op] for op in ops))
@@ -0,0 +1,35 @@
+# mark a very long linked list, which keeps growing the GC stack
+
+import gc
+import sys
+
+try:
+    import utime as time
+except ImportError:
+    import time
+
+# each node is (payload, next), so the payload of every node is still on the
+# GC stack while the rest of the list is being traced
+n = 1000000
+if hasattr(gc, 'mem_free'):
+    n = min(n, gc.mem_free() // 80)
+head = None
+for i in range(n):
+    head = ((i,), head)
+
+t = time.time()
+gc.collect()
+gc.collect()
+t = time.time() - t
+
+# check the list survived
+count = 0
+node = head
+while node is not None:
+    count += 1
+    node = node[1]
+print(count == n)
+
+# pass any argument to see the time taken by the two collections
+if len(sys.argv) > 1:
+    print(n, t)
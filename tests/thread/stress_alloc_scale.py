@@ -0,0 +1,44 @@
+# benchmark of heap allocation throughput with 1 to 8 threads allocating at once
+# run with an argument, eg "micropython stress_alloc_scale.py 1", to print timings
+
+import sys
+try:
+    import utime as time
+except ImportError:
+    import time
+import _thread
+
+timing = len(sys.argv) > 1
+
+def thread_entry(n, done):
+    # allocate lots of small, short lived objects
+    total = 0
+    for i in range(n):
+        t = (i, i + 1)
+        l = [t, t]
+        total += len(l) + t[1] - t[0]
+    with lock:
+        results.append(total)
+    done.release()
+
+def run(n_thread, n):
+    locks = []
+    if timing:
+        t0 = time.ticks_us()
+    for i in range(n_thread):
+        done = _thread.allocate_lock()
+        done.acquire()
+        locks.append(done)
+        _thread.start_new_thread(thread_entry, (n, done))
+    # wait for all threads to finish
+    for done in locks:
+        done.acquire()
+    if timing:
+        dt = time.ticks_diff(time.ticks_us(), t0)
+        print('%d threads: %d allocs/ms' % (n_thread, 2 * n_thread * n * 1000 // dt))
+
+lock = _thread.allocate_lock()
+results = []
+for n_thread in (1, 2, 4, 8):
+    run(n_thread, 20000 if timing else 1000)
+print(len(results), results[0], all(r == results[0] for r in results))
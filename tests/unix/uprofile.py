@@ -0,0 +1,47 @@
+# test the uprofile sampling profiler
+
+try:
+    import uprofile
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+
+def hot():
+    x = 0
+    for i in range(1000):
+        x += i
+    return x
+
+# sample every 100us of CPU time until the hot function is seen
+uprofile.start(100)
+for i in range(10000):
+    hot()
+    if i % 100 == 0 and any(s.endswith(')') and 'hot (' in s for s in uprofile.collect()):
+        break
+uprofile.stop()
+counts = uprofile.collect()
+print(any('<module> (' in s and ';hot (' in s for s in counts))
+print(all(type(n) is int and n > 0 for n in counts.values()))
+
+# dump writes "stack count" lines and clears the counts
+import uio
+buf = uio.StringIO()
+uprofile.dump(buf)
+lines = buf.getvalue().split('\n')
+print(lines[-1] == '' and all(l.rsplit(' ', 1)[1].isdigit() for l in lines[:-1]))
+print(len(uprofile.collect()))
+
+# while a native generator runs the sample is of the code resuming it
+@micropython.native
+def gen(n):
+    for i in range(n):
+        yield i
+
+uprofile.start(100)
+for i in range(10000):
+    for x in gen(1000):
+        pass
+    if i % 100 == 0 and uprofile.collect():
+        break
+uprofile.stop()
+print(all(s.startswith('<module> (') and ';' not in s for s in uprofile.collect()))
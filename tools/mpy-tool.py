@@ -57,7 +57,7 @@ class FreezeError(Exception):
         return 'error while freezing %s: %s' % (self.rawcode.source_file, self.msg)
 
 class Config:
-    MPY_VERSION = 3
+    MPY_VERSION = 6
     MICROPY_LONGINT_IMPL_NONE = 0
     MICROPY_LONGINT_IMPL_LONGLONG = 1
     MICROPY_LONGINT_IMPL_MPZ = 2
@@ -72,10 +72,16 @@ MP_OPCODE_OFFSET = 3
 MP_BC_MAKE_CLOSURE = 0x62
 MP_BC_MAKE_CLOSURE_DEFARGS = 0x63
 MP_BC_RAISE_VARARGS = 0x5c
+MP_BC_LOAD_FAST_LOAD_FAST = 0x48
+MP_BC_BINARY_OP_POP_JUMP_IF_TRUE = 0x4a
+MP_BC_BINARY_OP_POP_JUMP_IF_FALSE = 0x4b
+# 2 extra bytes:
+MP_BC_BINARY_OP_SMALL_INT = 0x49
 # extra byte if caching enabled:
-MP_BC_LOAD_NAME = 0x1c
-MP_BC_LOAD_GLOBAL = 0x1d
-MP_BC_LOAD_ATTR = 0x1e
+MP_BC_LOAD_NAME = 0x1b
+MP_BC_LOAD_GLOBAL = 0x1c
+MP_BC_LOAD_ATTR = 0x1d
+MP_BC_LOAD_METHOD = 0x1e
 MP_BC_STORE_ATTR = 0x26
 
 def make_opcode_format():
@@ -106,7 +112,7 @@ def make_opcode_format():
     OC4(U, O, B, O), # 0x3c-0x3f
     OC4(O, B, B, O), # 0x40-0x43
     OC4(B, B, O, B), # 0x44-0x47
-    OC4(U, U, U, U), # 0x48-0x4b
+    OC4(B, B, O, O), # 0x48-0x4b
     OC4(U, U, U, U), # 0x4c-0x4f
     OC4(V, V, U, V), # 0x50-0x53
     OC4(B, U, V, V), # 0x54-0x57
@@ -166,19 +172,24 @@ def mp_opcode_format(bytecode, ip, opcode_format=make_opcode_format()):
     ip_start = ip
     f = (opcode_format[opcode >> 2] >> (2 * (opcode & 3))) & 3
     if f == MP_OPCODE_QSTR:
+        if config.MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE and (
+            opcode == MP_BC_LOAD_NAME
+            or opcode == MP_BC_LOAD_GLOBAL
+            or opcode == MP_BC_LOAD_ATTR
+            or opcode == MP_BC_LOAD_METHOD
+            or opcode == MP_BC_STORE_ATTR
+        ):
+            ip += 1
         ip += 3
     else:
         extra_byte = (
             opcode == MP_BC_RAISE_VARARGS
             or opcode == MP_BC_MAKE_CLOSURE
             or opcode == MP_BC_MAKE_CLOSURE_DEFARGS
-            or config.MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE and (
-                opcode == MP_BC_LOAD_NAME
-                or opcode == MP_BC_LOAD_GLOBAL
-                or opcode == MP_BC_LOAD_ATTR
-                or opcode == MP_BC_STORE_ATTR
-            )
-        )
+            or opcode == MP_BC_LOAD_FAST_LOAD_FAST
+            or opcode == MP_BC_BINARY_OP_POP_JUMP_IF_TRUE
+            or opcode == MP_BC_BINARY_OP_POP_JUMP_IF_FALSE
+        ) + 2 * (opcode == MP_BC_BINARY_OP_SMALL_INT)
         ip += 1
         if f == MP_OPCODE_VAR_UINT:
             while bytecode[ip] & 0x80 != 0:
@@ -426,7 +437,10 @@ def read_bytecode_qstrs(file, bytecode, ip):
         ip += sz
 
 def read_raw_code(f):
-    bc_len = read_uint(f)
+    kind_len = read_uint(f)
+    if kind_len & 3:
+        raise Exception('native code in .mpy files is not supported')
+    bc_len = kind_len >> 2
     bytecode = bytearray(f.read(bc_len))
     ip, ip2, prelude = extract_prelude(bytecode)
     read_qstr_and_pack(f, bytecode, ip2) # simple_name
@@ -514,6 +528,15 @@ def freeze_mpy(base_qstrs, raw_codes):
             print('    MP_QSTR_%s,' % new[i][1])
     print('};')
 
+    print()
+    index = qstrutil.make_hash_index([q for _, _, q in new])
+    print('#if MICROPY_QSTR_HASH_INDEX')
+    print('STATIC const uint16_t mp_qstr_frozen_const_index[] = {')
+    for i in range(0, len(index), 16):
+        print('    %s,' % ', '.join(str(slot) for slot in index[i:i + 16]))
+    print('};')
+    print('#endif')
+
     print()
     print('extern const qstr_pool_t mp_qstr_const_pool;');
     print('const qstr_pool_t mp_qstr_frozen_const_pool = {')
@@ -521,6 +544,10 @@ def freeze_mpy(base_qstrs, raw_codes):
     print('    MP_QSTRnumber_of, // previous pool size')
     print('    %u, // allocated entries' % len(new))
     print('    %u, // used entries' % len(new))
+    print('    #if MICROPY_QSTR_HASH_INDEX')
+    print('    mp_qstr_frozen_const_index,')
+    print('    %u, // index mask' % (len(index) - 1))
+    print('    #endif')
     print('    {')
     for _, _, qstr in new:
         print('        %s,'
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+#
+# This file is part of the MicroPython project, http://micropython.org/
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2026 agent
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+# Aggregate the opcode counts of the VM over a set of scripts.
+#
+# The unix port must be built with MICROPY_VM_STATS enabled, eg:
+#
+#     make -C ports/unix CFLAGS_EXTRA=-DMICROPY_VM_STATS=1
+#
+# Then run this script, by default over tests/bench and tests/basics:
+#
+#     ./tools/vmstats.py
+#
+# Each script is run with "-X vmstats" and the counts it prints on exit are
+# added up.  The most executed opcodes, and pairs of opcodes executed one after
+# the other, are printed, which shows where superinstructions and fast paths
+# are worth adding to the VM.
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+from collections import Counter
+
+TOP = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+def opcode_names(bc0_h, group_multi):
+    # Name each opcode from the definitions in py/bc0.h.  The *_MULTI opcodes
+    # cover all the values up to the next definition, for their argument.
+    defs = []
+    with open(bc0_h) as f:
+        for line in f:
+            m = re.match(r'#define MP_BC_(\w+) +\((0x[0-9a-f]+)\)', line)
+            if m:
+                defs.append((int(m.group(2), 16), m.group(1)))
+    defs.sort()
+    names = {0: '(enter)'}
+    for i, (op, name) in enumerate(defs):
+        names[op] = name
+        if name.endswith('_MULTI'):
+            end = defs[i + 1][0] if i + 1 < len(defs) else 256
+            for arg in range(end - op):
+                names[op + arg] = name if group_multi else '%s+%d' % (name, arg)
+    return names
+
+def run_script(micropython, path, env, timeout):
+    try:
+        p = subprocess.run([micropython, '-X', 'vmstats', os.path.basename(path)],
+            cwd=os.path.dirname(path), env=env, timeout=timeout,
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    except subprocess.TimeoutExpired:
+        print('timeout:', path, file=sys.stderr)
+        return None, None
+    if p.stdout.startswith(b'Invalid option'):
+        sys.exit('%s was not built with MICROPY_VM_STATS' % micropython)
+    ops = Counter()
+    pairs = Counter()
+    for line in p.stderr.decode('utf8', 'replace').splitlines():
+        m = re.match(r'(?:op (\d+)|pair (\d+) (\d+)) (\d+)$', line)
+        if m is None:
+            continue
+        if m.group(1) is not None:
+            ops[int(m.group(1))] += int(m.group(4))
+        else:
+            pairs[int(m.group(2)), int(m.group(3))] += int(m.group(4))
+    return ops, pairs
+
+def print_counts(title, counts, top, label):
+    total = sum(counts.values())
+    print('%s (%d in total)' % (title, total))
+    for key, n in counts.most_common(top):
+        print('%12d %5.1f%%  %s' % (n, 100 * n / total, label(key)))
+    print()
+
+def main():
+    cmd_parser = argparse.ArgumentParser(description='Count the opcodes executed by the VM.')
+    cmd_parser.add_argument('--micropython', default=os.path.join(TOP, 'ports/unix/micropython'),
+        help='the micropython executable, built with MICROPY_VM_STATS')
+    cmd_parser.add_argument('-n', '--top', type=int, default=40, help='number of entries to print')
+    cmd_parser.add_argument('--raw', action='store_true',
+        help='count each argument of the *_MULTI opcodes separately')
+    cmd_parser.add_argument('--timeout', type=float, default=120, help='timeout for each script, in seconds')
+    cmd_parser.add_argument('files', nargs='*',
+        help='scripts or directories of scripts to run (default: tests/bench and tests/basics)')
+    args = cmd_parser.parse_args()
+    # the scripts are run from their own directory
+    micropython = os.path.abspath(args.micropython)
+
+    names = opcode_names(os.path.join(TOP, 'py/bc0.h'), not args.raw)
+    name = lambda op: names.get(op, '0x%02x' % op)
+
+    files = args.files or [os.path.join(TOP, 'tests/bench'), os.path.join(TOP, 'tests/basics')]
+    scripts = []
+    for f in files:
+        if os.path.isdir(f):
+            scripts.extend(os.path.join(f, s) for s in sorted(os.listdir(f)) if s.endswith('.py'))
+        else:
+            scripts.append(f)
+
+    # the benchmarks import time, which the unix port only has as utime
+    shim_dir = tempfile.mkdtemp()
+    with open(os.path.join(shim_dir, 'time.py'), 'w') as f:
+        f.write('from utime import *\n')
+    env = dict(os.environ)
+    env['MICROPYPATH'] = shim_dir + ':.'
+
+    ops = Counter()
+    pairs = Counter()
+    try:
+        for path in scripts:
+            script_ops, script_pairs = run_script(micropython, os.path.abspath(path), env, args.timeout)
+            if script_ops is None:
+                continue
+            # group the counts by name
+            for op, n in script_ops.items():
+                ops[name(op)] += n
+            for (op1, op2), n in script_pairs.items():
+                pairs[name(op1), name(op2)] += n
+    finally:
+        shutil.rmtree(shim_dir)
+
+    print('%d scripts run\n' % len(scripts))
+    print_counts('opcodes', ops, args.top, lambda key: key)
+    print_counts('pairs of opcodes', pairs, args.top, lambda key: '%s, %s' % key)
+
+if __name__ == '__main__':
+    main()